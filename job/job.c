@@ -8,6 +8,7 @@
  */
 
 #include	<sys/types.h>
+#include	<sys/stat.h>
 #include	<sys/stropts.h>
 #include	<netinet/in.h>
 
@@ -26,6 +27,8 @@
 #include	<libnvpair.h>
 #include	<inttypes.h>
 #include	<errno.h>
+#include	<time.h>
+#include	<limits.h>
 
 #define	DATA_TYPE_NVINLINE -1
 
@@ -33,6 +36,8 @@ static int put_server(nvlist_t *);
 static nvlist_t *read_nvlist();
 static nvlist_t *simple_command(char const *, ...);
 static void print_nvlist(FILE *, nvlist_t *);
+static void show_histogram(char const *, uint32_t *, uint_t);
+static void show_stats(nvlist_t *);
 
 int server_fd;
 
@@ -50,6 +55,9 @@ static int	c_quota(int, char **);
 static int	c_start(int, char **);
 static int	c_unset(int, char **);
 static int	c_stop(int, char **);
+static int	c_status(int, char **);
+static int	c_forecast(int, char **);
+static int	c_log(int, char **);
 
 static struct {
 	char const	*cmd;
@@ -75,6 +83,9 @@ static struct {
 	{ "start",	c_start },
 	{ "unset",	c_unset },
 	{ "stop",	c_stop },
+	{ "status",	c_status },
+	{ "forecast",	c_forecast },
+	{ "log",	c_log },
 };
 
 static int debug;
@@ -108,6 +119,12 @@ char const *u_start =
 "       job [-D] start <fmri>\n";
 char const *u_stop =
 "       job [-D] stop <fmri>\n";
+char const *u_status =
+"       job [-D] status [-u <user>]\n";
+char const *u_forecast =
+"       job [-D] forecast [-u <user>] [-w <minutes>] [-n <count>]\n";
+char const *u_log =
+"       job [-D] log [-s <time>] <fmri>\n";
 static void
 usage()
 {
@@ -123,6 +140,9 @@ usage()
 	(void) fprintf(stderr, "%s", u_clear);
 	(void) fprintf(stderr, "%s", u_start);
 	(void) fprintf(stderr, "%s", u_stop);
+	(void) fprintf(stderr, "%s", u_status);
+	(void) fprintf(stderr, "%s", u_forecast);
+	(void) fprintf(stderr, "%s", u_log);
 	(void) fprintf(stderr,
 	    "\nGlobal options:\n"
 	    "      -D      Enable debug mode.\n");
@@ -317,14 +337,36 @@ int	 fmri_w = 0, state_w = 0, rstate_w = 0, w;
 struct {
 	char	*fmri, *state, *rstate, *name;
 } *ents = NULL;
+int	 c;
+char	*user = NULL;
 
-	if (argc != 1) {
+	optind = 1;
+	while ((c = getopt(argc, argv, "u:")) != -1) {
+		switch (c) {
+		case 'u':
+			user = optarg;
+			break;
+
+		default:
+			(void) fprintf(stderr, "%s", u_list);
+			return (1);
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc != 0) {
 		(void) fprintf(stderr, "list: wrong number of arguments\n\n");
 		(void) fprintf(stderr, "%s", u_list);
 		return (1);
 	}
 
-	reply = simple_command("list", NULL);
+	if (user)
+		reply = simple_command("list",
+			"user", DATA_TYPE_STRING, user,
+			NULL);
+	else
+		reply = simple_command("list", NULL);
 	if (nvlist_lookup_nvlist_array(reply, "jobs", &jobs, &njobs)) {
 		(void) fprintf(stderr, "list: unexpected reply from server\n");
 		return (1);
@@ -460,8 +502,12 @@ nvlist_t *reply;
 		(void) printf("%s = %"PRIu32"\n", argv[1], value);
 	} else {
 		nvlist_alloc(&cmd, NV_UNIQUE_NAME, 0);
-		if (strcmp(argv[1], "jobs-per-user") == 0)
-			nvlist_add_int32(cmd, "jobs_per_user", atoi(argv[2]));
+		if (strcmp(argv[1], "jobs-per-user") == 0 ||
+		    strcmp(argv[1], "max-running") == 0 ||
+		    strcmp(argv[1], "max-running-per-user") == 0 ||
+		    strcmp(argv[1], "shutdown-timeout") == 0 ||
+		    strncmp(argv[1], "share:", 6) == 0)
+			nvlist_add_uint32(cmd, argv[1], atoi(argv[2]));
 		else {
 			(void) fprintf(stderr, "Invalid option.\n");
 			return (1);
@@ -475,6 +521,401 @@ nvlist_t *reply;
 	return (0);
 }
 
+int
+c_status(argc, argv)
+	int argc;
+	char **argv;
+{
+nvlist_t	*reply, *all, *user;
+uint32_t	 running, stopping, stopped, queued, limit, pending = 0, share;
+uint64_t	 usage;
+char		*name = NULL, *uname;
+int		 c;
+
+	optind = 1;
+	while ((c = getopt(argc, argv, "u:")) != -1) {
+		switch (c) {
+		case 'u':
+			name = optarg;
+			break;
+
+		default:
+			(void) fprintf(stderr, "%s", u_status);
+			return (1);
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc != 0) {
+		(void) fprintf(stderr, "status: wrong number of arguments\n\n");
+		(void) fprintf(stderr, "%s", u_status);
+		return (1);
+	}
+
+	if (name)
+		reply = simple_command("status",
+			"user", DATA_TYPE_STRING, name,
+			NULL);
+	else
+		reply = simple_command("status", NULL);
+
+	if (nvlist_lookup_nvlist(reply, "all", &all) ||
+	    nvlist_lookup_nvlist(reply, "user", &user) ||
+	    nvlist_lookup_string(user, "name", &uname)) {
+		(void) fprintf(stderr, "status: unexpected reply from server\n");
+		return (1);
+	}
+
+	if (nvlist_lookup_uint32(all, "pending-starts", &pending) == 0 &&
+	    pending > 0)
+		(void) printf("%"PRIu32" jobs waiting to be started after "
+		    "startup or to catch up missed runs\n\n", pending);
+
+	(void) printf("%-12s %8s %8s %8s %8s %8s\n", "", "RUNNING",
+	    "STOPPING", "STOPPED", "QUEUED", "LIMIT");
+
+	running = stopping = stopped = queued = limit = 0;
+	(void) nvlist_lookup_uint32(all, "running", &running);
+	(void) nvlist_lookup_uint32(all, "stopping", &stopping);
+	(void) nvlist_lookup_uint32(all, "stopped", &stopped);
+	(void) nvlist_lookup_uint32(all, "queued", &queued);
+	(void) nvlist_lookup_uint32(all, "limit", &limit);
+	(void) printf("%-12s %8"PRIu32" %8"PRIu32" %8"PRIu32" %8"PRIu32,
+	    "(all)", running, stopping, stopped, queued);
+	if (limit)
+		(void) printf(" %8"PRIu32"\n", limit);
+	else
+		(void) printf(" %8s\n", "-");
+
+	running = stopping = stopped = queued = limit = 0;
+	(void) nvlist_lookup_uint32(user, "running", &running);
+	(void) nvlist_lookup_uint32(user, "stopping", &stopping);
+	(void) nvlist_lookup_uint32(user, "stopped", &stopped);
+	(void) nvlist_lookup_uint32(user, "queued", &queued);
+	(void) nvlist_lookup_uint32(user, "limit", &limit);
+	(void) printf("%-12s %8"PRIu32" %8"PRIu32" %8"PRIu32" %8"PRIu32,
+	    uname, running, stopping, stopped, queued);
+	if (limit)
+		(void) printf(" %8"PRIu32"\n", limit);
+	else
+		(void) printf(" %8s\n", "-");
+
+	if (nvlist_lookup_uint32(user, "share", &share) == 0 &&
+	    nvlist_lookup_uint64(user, "usage", &usage) == 0)
+		(void) printf("\n%s: share %"PRIu32", recent usage %"PRIu64
+		    " seconds\n", uname, share, usage);
+	return (0);
+}
+
+#define	FORECAST_BUSIEST	10
+
+int
+c_forecast(argc, argv)
+	int argc;
+	char **argv;
+{
+nvlist_t	*reply;
+uint64_t	 start, total, *times;
+uint32_t	 window, njobs, *hist, best[FORECAST_BUSIEST];
+uint_t		 ntimes, nfmris, nhist, i, j, k, nbest = 0;
+char		**fmris, *user = NULL, tbuf[64];
+int		 c, minutes = 60, count = 20;
+time_t		 t;
+
+	optind = 1;
+	while ((c = getopt(argc, argv, "u:w:n:")) != -1) {
+		switch (c) {
+		case 'u':
+			user = optarg;
+			break;
+
+		case 'w':
+			minutes = atoi(optarg);
+			break;
+
+		case 'n':
+			count = atoi(optarg);
+			break;
+
+		default:
+			(void) fprintf(stderr, "%s", u_forecast);
+			return (1);
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc != 0 || minutes <= 0 || count < 0) {
+		(void) fprintf(stderr, "%s", u_forecast);
+		return (1);
+	}
+
+	if (user)
+		reply = simple_command("forecast",
+			"window", DATA_TYPE_UINT32, (uint32_t)minutes * 60,
+			"limit", DATA_TYPE_UINT32, (uint32_t)count,
+			"user", DATA_TYPE_STRING, user,
+			NULL);
+	else
+		reply = simple_command("forecast",
+			"window", DATA_TYPE_UINT32, (uint32_t)minutes * 60,
+			"limit", DATA_TYPE_UINT32, (uint32_t)count,
+			NULL);
+
+	if (nvlist_lookup_pairs(reply, 0,
+	    "start", DATA_TYPE_UINT64, &start,
+	    "window", DATA_TYPE_UINT32, &window,
+	    "total", DATA_TYPE_UINT64, &total,
+	    "jobs", DATA_TYPE_UINT32, &njobs,
+	    "times", DATA_TYPE_UINT64_ARRAY, &times, &ntimes,
+	    "fmris", DATA_TYPE_STRING_ARRAY, &fmris, &nfmris,
+	    "histogram", DATA_TYPE_UINT32_ARRAY, &hist, &nhist,
+	    NULL) || ntimes != nfmris) {
+		(void) fprintf(stderr,
+		    "forecast: unexpected reply from server\n");
+		return (1);
+	}
+
+	(void) printf("%"PRIu64" starts of %"PRIu32" jobs in the next "
+	    "%"PRIu32" minutes.\n", total, njobs, window / 60);
+	if (total == 0)
+		return (0);
+
+	/*
+	 * Find the busiest minutes, keeping best[] sorted by count.
+	 */
+	for (i = 0; i < nhist; ++i) {
+		if (hist[i] == 0 || (nbest == FORECAST_BUSIEST &&
+		    hist[i] <= hist[best[nbest - 1]]))
+			continue;
+
+		for (j = 0; j < nbest && hist[best[j]] >= hist[i]; ++j)
+			;
+		if (nbest < FORECAST_BUSIEST)
+			nbest++;
+		for (k = nbest - 1; k > j; --k)
+			best[k] = best[k - 1];
+		best[j] = i;
+	}
+
+	(void) printf("\n%sBusiest minutes:%s\n", bold, reset);
+	for (i = 0; i < nbest; ++i) {
+		t = (time_t)start + best[i] * 60;
+		(void) strftime(tbuf, sizeof (tbuf), "%Y-%m-%d %H:%M",
+		    localtime(&t));
+		(void) printf("  %s  %8"PRIu32"\n", tbuf, hist[best[i]]);
+	}
+
+	if (ntimes == 0)
+		return (0);
+
+	(void) printf("\n%s%-19s  FMRI%s\n", bold, "TIME", reset);
+	for (i = 0; i < ntimes; ++i) {
+		t = (time_t)times[i];
+		(void) strftime(tbuf, sizeof (tbuf), "%Y-%m-%d %H:%M:%S",
+		    localtime(&t));
+		(void) printf("%-19s  %s\n", tbuf, fmris[i]);
+	}
+
+	if (total > ntimes)
+		(void) printf("(%"PRIu64" more)\n", total - ntimes);
+	return (0);
+}
+
+/*
+ * The log index written by the jobserver when logstamp is on (see joblog.h
+ * in the jobserver): a fixed-size record for each minute in which the job
+ * wrote anything, holding the time and the log's size at that time.
+ */
+#define	LOG_IDX_SUFFIX	".idx"
+#define	LOG_IDX_RECSZ	32
+
+/*
+ * Parse "HH:MM[:SS]" (today) or "YYYY-MM-DD HH:MM[:SS]", in local time.
+ */
+static int
+log_parse_time(s, t)
+	char const	*s;
+	time_t		*t;
+{
+struct tm	tm;
+time_t		now = time(NULL);
+int		n = 0;
+
+	tm = *localtime(&now);
+	tm.tm_sec = 0;
+
+	if (sscanf(s, "%d-%d-%d %d:%d%n", &tm.tm_year, &tm.tm_mon,
+	    &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &n) == 5) {
+		tm.tm_year -= 1900;
+		tm.tm_mon -= 1;
+	} else if (sscanf(s, "%d:%d%n", &tm.tm_hour, &tm.tm_min, &n) != 2)
+		return (-1);
+
+	s += n;
+	if (*s == ':') {
+		if (sscanf(s, ":%d%n", &tm.tm_sec, &n) != 1)
+			return (-1);
+		s += n;
+	}
+
+	if (*s)
+		return (-1);
+
+	tm.tm_isdst = -1;
+	if ((*t = mktime(&tm)) == (time_t)-1)
+		return (-1);
+	return (0);
+}
+
+/*
+ * Find where to start reading 'file' for output since 'since': the offset of
+ * the last bucket in the index which started no later than 'since'.
+ */
+static off_t
+log_find(file, since)
+	char const	*file;
+	time_t		 since;
+{
+char		 idx[PATH_MAX], rec[LOG_IDX_RECSZ + 1];
+struct stat	 st;
+long		 t;
+unsigned long long off, found = 0;
+off_t		 lo, hi, mid;
+int		 fd;
+
+	(void) snprintf(idx, sizeof (idx), "%s" LOG_IDX_SUFFIX, file);
+	if ((fd = open(idx, O_RDONLY)) == -1)
+		return (-1);
+
+	if (fstat(fd, &st) == -1) {
+		(void) close(fd);
+		return (-1);
+	}
+
+	lo = 0;
+	hi = st.st_size / LOG_IDX_RECSZ;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		bzero(rec, sizeof (rec));
+		if (pread(fd, rec, LOG_IDX_RECSZ, mid * LOG_IDX_RECSZ) !=
+		    LOG_IDX_RECSZ || sscanf(rec, "%ld %llu", &t, &off) != 2) {
+			(void) close(fd);
+			errno = EINVAL;
+			return (-1);
+		}
+
+		if ((time_t)t <= since) {
+			found = off;
+			lo = mid + 1;
+		} else
+			hi = mid;
+	}
+
+	(void) close(fd);
+	return ((off_t)found);
+}
+
+int
+c_log(argc, argv)
+	int argc;
+	char **argv;
+{
+nvlist_t	*reply, *job;
+char		*file, line[1024], sbuf[32];
+FILE		*fl;
+time_t		 since = 0;
+off_t		 off = 0;
+size_t		 slen = 0, len;
+int		 c, sflag = 0, bol = 1;
+
+	optind = 1;
+	while ((c = getopt(argc, argv, "s:")) != -1) {
+		switch (c) {
+		case 's':
+			if (log_parse_time(optarg, &since) == -1) {
+				(void) fprintf(stderr, "log: invalid time "
+				    "\"%s\"\n", optarg);
+				return (1);
+			}
+			sflag = 1;
+			break;
+
+		default:
+			(void) fprintf(stderr, "%s", u_log);
+			return (1);
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc != 1) {
+		(void) fprintf(stderr, "log: wrong number of arguments\n\n");
+		(void) fprintf(stderr, "%s", u_log);
+		return (1);
+	}
+
+	reply = simple_command("stat",
+	    "fmri", DATA_TYPE_STRING, argv[0],
+	    NULL);
+
+	if (nvlist_lookup_nvlist(reply, "job", &job)) {
+		(void) fprintf(stderr, "log: invalid reply from server\n");
+		return (1);
+	}
+
+	if (nvlist_lookup_string(job, "logfile", &file)) {
+		(void) fprintf(stderr, "log: %s has not been started since "
+		    "the jobserver started\n", argv[0]);
+		return (1);
+	}
+
+	if (sflag) {
+		if ((off = log_find(file, since)) == -1) {
+			(void) fprintf(stderr, "log: %s%s: %s\n"
+			    "(the index is only kept when logstamp is on)\n",
+			    file, LOG_IDX_SUFFIX, strerror(errno));
+			return (1);
+		}
+
+		(void) strftime(sbuf, sizeof (sbuf), "%Y-%m-%dT%H:%M:%S",
+		    gmtime(&since));
+		slen = strlen(sbuf);
+	}
+
+	if ((fl = fopen(file, "r")) == NULL) {
+		(void) fprintf(stderr, "log: %s: %s\n", file, strerror(errno));
+		return (1);
+	}
+
+	if (off && fseeko(fl, off, SEEK_SET) == -1) {
+		(void) fprintf(stderr, "log: %s: %s\n", file, strerror(errno));
+		(void) fclose(fl);
+		return (1);
+	}
+
+	/*
+	 * The index only gets us to the right minute; skip the lines before
+	 * 'since' in that minute by their timestamp.  Lines are in time order,
+	 * so once one is late enough, so are the rest.
+	 */
+	while (fgets(line, sizeof (line), fl) != NULL) {
+		len = strlen(line);
+		if (sflag && (!bol || (line[0] == '[' &&
+		    strncmp(line + 1, sbuf, slen) < 0))) {
+			bol = (line[len - 1] == '\n');
+			continue;
+		}
+
+		sflag = 0;
+		(void) fputs(line, stdout);
+	}
+
+	(void) fclose(fl);
+	return (0);
+}
+
 int
 c_disable(argc, argv)
 	int argc;
@@ -526,18 +967,105 @@ c_clear(argc, argv)
 	return (0);
 }
 
+/*
+ * Print the non-empty buckets of a log2 histogram (see sched.h in the daemon).
+ */
+static void
+show_histogram(label, hist, n)
+	char const	*label;
+	uint32_t	*hist;
+	uint_t		 n;
+{
+uint_t	i;
+int	first = 1;
+
+	(void) printf("%s", label);
+	for (i = 0; i < n; ++i) {
+		if (hist[i] == 0)
+			continue;
+		if (i == 0)
+			(void) printf(" <1s:%"PRIu32, hist[i]);
+		else if (i == n - 1)
+			(void) printf(" >=%lus:%"PRIu32, 1UL << (i - 1), hist[i]);
+		else
+			(void) printf(" %lu-%lus:%"PRIu32, 1UL << (i - 1),
+			    (1UL << i) - 1, hist[i]);
+		first = 0;
+	}
+	(void) printf("%s\n", first ? " -" : "");
+}
+
+static void
+show_stats(job)
+	nvlist_t	*job;
+{
+nvlist_t	*st, **recent;
+uint32_t	 runs, exits, fails, crashes, maxdur, *hist, dur, skew;
+uint64_t	 meandur, start;
+uint_t		 nhist, nrecent, i;
+char		*result, tbuf[64];
+time_t		 t;
+
+	if (nvlist_lookup_nvlist(job, "stats", &st) ||
+	    nvlist_lookup_pairs(st, 0,
+	    "runs", DATA_TYPE_UINT32, &runs,
+	    "exits", DATA_TYPE_UINT32, &exits,
+	    "fails", DATA_TYPE_UINT32, &fails,
+	    "crashes", DATA_TYPE_UINT32, &crashes,
+	    "mean-duration", DATA_TYPE_UINT64, &meandur,
+	    "max-duration", DATA_TYPE_UINT32, &maxdur,
+	    NULL))
+		return;
+
+	(void) printf("        runs: %"PRIu32" (%"PRIu32" exited, %"PRIu32
+	    " failed, %"PRIu32" crashed)\n", runs, exits, fails, crashes);
+	(void) printf("    duration: mean %"PRIu64"s, max %"PRIu32"s\n",
+	    meandur, maxdur);
+	if (nvlist_lookup_uint32_array(st, "duration-histogram", &hist,
+	    &nhist) == 0)
+		show_histogram("             ", hist, nhist);
+	if (nvlist_lookup_uint32_array(st, "skew-histogram", &hist,
+	    &nhist) == 0)
+		show_histogram("  start skew:", hist, nhist);
+
+	if (nvlist_lookup_nvlist_array(st, "recent", &recent, &nrecent))
+		return;
+
+	for (i = 0; i < nrecent; ++i) {
+		if (nvlist_lookup_pairs(recent[i], 0,
+		    "start", DATA_TYPE_UINT64, &start,
+		    "duration", DATA_TYPE_UINT32, &dur,
+		    "result", DATA_TYPE_STRING, &result,
+		    NULL))
+			continue;
+
+		t = (time_t)start;
+		(void) strftime(tbuf, sizeof (tbuf), "%Y-%m-%d %H:%M:%S",
+		    localtime(&t));
+		(void) printf("%s %s %-5s %"PRIu32"s",
+		    i ? "            " : " recent runs", tbuf, result, dur);
+		if (nvlist_lookup_uint32(recent[i], "skew", &skew) == 0)
+			(void) printf(", started %"PRIu32"s late", skew);
+		(void) printf("\n");
+	}
+}
+
 int
 c_show(argc, argv)
 	int argc;
 	char **argv;
 {
-nvlist_t	*reply, *job, *rctls;
+nvlist_t	*reply, *job, *rctls, **deps;
 char		*fmri, *state, *rstate, *start, *stop,
 		*schedule = NULL, *nextrun = NULL, *project, *logfmt,
-		*exit, *fail, *crash;
+		*exit, *fail, *crash, *tz, *catchup, *outcome, *overlap,
+		*stopsigs, *logstamp, *logfile;
+char		*dfmri, *dcond, *dstate, **rdeps;
+uint_t		 ndeps, i;
 nvpair_t	*pair = NULL;
-uint32_t	 logkeep;
-uint64_t	 logsize;
+uint32_t	 logkeep, qpos, rdelay, rbackoff, rmax, rreset, rattempts;
+uint32_t	 catchupmax, skipped, ninst, stoptimeout;
+uint64_t	 logsize, qwait, rwait, lastrun;
 int		 first = 1;
 
 	if (argc != 2) {
@@ -563,6 +1091,7 @@ int		 first = 1;
 	    "stop", DATA_TYPE_STRING, &stop,
 	    "project", DATA_TYPE_STRING, &project,
 	    "logfmt", DATA_TYPE_STRING, &logfmt,
+	    "tz", DATA_TYPE_STRING, &tz,
 	    "exit", DATA_TYPE_STRING, &exit,
 	    "fail", DATA_TYPE_STRING, &fail,
 	    "crash", DATA_TYPE_STRING, &crash,
@@ -576,19 +1105,96 @@ int		 first = 1;
 	(void) printf("%s%s%s:\n", bold, fmri, reset);
 	(void) printf("       state: %s\n", state);
 	(void) printf("      rstate: %s\n", rstate);
+	if (nvlist_lookup_uint32(job, "queue-position", &qpos) == 0 &&
+	    nvlist_lookup_uint64(job, "queue-wait", &qwait) == 0)
+		(void) printf("              (position %"PRIu32" in queue, "
+		    "waiting %"PRIu64"s)\n", qpos, qwait);
 	(void) printf("start method: %s\n", start);
 	(void) printf(" stop method: %s\n", stop);
+	if (nvlist_lookup_string(job, "stop-signals", &stopsigs) == 0 &&
+	    nvlist_lookup_uint32(job, "stop-timeout", &stoptimeout) == 0)
+		(void) printf("    stopping: %s, kill after %"PRIu32"s\n",
+		    stopsigs, stoptimeout);
 	if (nvlist_lookup_string(job, "schedule", &schedule) == 0)
 		(void) printf("    schedule: %s\n", schedule);
 	if (nvlist_lookup_string(job, "nextrun", &nextrun) == 0)
 		(void) printf("              (in %s)\n", nextrun);
+	if (nvlist_lookup_string(job, "catchup", &catchup) == 0 &&
+	    nvlist_lookup_uint32(job, "catchup-max", &catchupmax) == 0) {
+		(void) printf("    catch-up: %s", catchup);
+		if (strcmp(catchup, "all") == 0)
+			(void) printf(" (at most %"PRIu32")", catchupmax);
+		(void) printf("\n");
+	}
+	if (nvlist_lookup_string(job, "overlap", &overlap) == 0) {
+		(void) printf("     overlap: %s", overlap);
+		if (nvlist_lookup_uint32(job, "skipped-runs", &skipped) == 0 &&
+		    skipped > 0)
+			(void) printf(" (%"PRIu32" runs skipped)", skipped);
+		if (nvlist_lookup_uint32(job, "instances", &ninst) == 0)
+			(void) printf(" (%"PRIu32" extra instances running)",
+			    ninst);
+		(void) printf("\n");
+	}
+	if (nvlist_lookup_uint64(job, "lastrun", &lastrun) == 0) {
+	time_t	t = (time_t)lastrun;
+	char	tbuf[64];
+		(void) strftime(tbuf, sizeof (tbuf), "%Y-%m-%d %H:%M:%S",
+		    localtime(&t));
+		(void) printf("    last run: %s\n", tbuf);
+	}
+	if (nvlist_lookup_nvlist_array(job, "depends", &deps, &ndeps) == 0) {
+		for (i = 0; i < ndeps; ++i) {
+			if (nvlist_lookup_pairs(deps[i], 0,
+			    "fmri", DATA_TYPE_STRING, &dfmri,
+			    "condition", DATA_TYPE_STRING, &dcond,
+			    "state", DATA_TYPE_STRING, &dstate,
+			    NULL))
+				continue;
+			(void) printf("%s %s (on %s, %s)\n",
+			    i ? "            " : "  depends on", dfmri, dcond,
+			    dstate);
+		}
+	}
+	if (nvlist_lookup_string_array(job, "dependents", &rdeps,
+	    &ndeps) == 0) {
+		for (i = 0; i < ndeps; ++i)
+			(void) printf("%s %s\n",
+			    i ? "            " : " depended on", rdeps[i]);
+	}
+	if (nvlist_lookup_string(job, "last-outcome", &outcome) == 0)
+		(void) printf(" last result: %s\n", outcome);
+	(void) printf("   time zone: %s\n", tz);
 	(void) printf("     project: %s\n", project);
 	(void) printf("  log format: %s\n", logfmt);
 	(void) printf("log rotation: size %"PRIu64", keep %"PRIu32"\n",
 	    logsize, logkeep);
+	if (nvlist_lookup_string(job, "logstamp", &logstamp) == 0)
+		(void) printf("  timestamps: %s\n", logstamp);
+	if (nvlist_lookup_string(job, "logfile", &logfile) == 0)
+		(void) printf("    last log: %s\n", logfile);
 	(void) printf("     on exit: %s\n", exit);
 	(void) printf("     on fail: %s\n", fail);
 	(void) printf("    on crash: %s\n", crash);
+	if (nvlist_lookup_uint32(job, "restart-delay", &rdelay) == 0 &&
+	    rdelay > 0 &&
+	    nvlist_lookup_pairs(job, 0,
+	    "restart-backoff", DATA_TYPE_UINT32, &rbackoff,
+	    "restart-max-delay", DATA_TYPE_UINT32, &rmax,
+	    "restart-reset", DATA_TYPE_UINT32, &rreset,
+	    "restart-attempts", DATA_TYPE_UINT32, &rattempts,
+	    NULL) == 0) {
+		(void) printf("     restart: after %"PRIu32"s, x%"PRIu32
+		    " up to %"PRIu32"s, reset after %"PRIu32"s",
+		    rdelay, rbackoff, rmax, rreset);
+		if (rattempts)
+			(void) printf(", at most %"PRIu32" times", rattempts);
+		(void) printf("\n");
+	}
+	if (nvlist_lookup_uint64(job, "restart-wait", &rwait) == 0)
+		(void) printf("              (restarting in %"PRIu64"s)\n",
+		    rwait);
+	show_stats(job);
 
 	(void) printf("      limits: ");
 	reply = simple_command("list_rctls",
@@ -680,11 +1286,20 @@ static char const ui64[][20] = {
 	"max-msg-messages",
 	"max-msg-qbytes",
 	"max-port-events",
-	"max-sem-ops",
 	"max-sem-nsems",
+	"max-sem-ops",
 	"max-stack-size",
 };
-static char const *const ui16[][20] = {
+static char const ui32[][20] = {
+	"catchup-max",
+	"restart-attempts",
+	"restart-backoff",
+	"restart-delay",
+	"restart-max-delay",
+	"restart-reset",
+	"stop-timeout",
+};
+static char const ui16[][20] = {
 	"logkeep",
 };
 nvlist_t	*reply;
@@ -697,6 +1312,13 @@ int		 ret = 0;
 		    	prop, DATA_TYPE_UINT64, strtoll(val, NULL, 0),
 			NULL,
 		    NULL);
+	} else if (bsearch(prop, ui32, sizeof(ui32) / sizeof(*ui32), 20, (int (*)(void const *, void const *)) strcmp)) {
+		reply = simple_command("set_property",
+		    "fmri", DATA_TYPE_STRING, fmri,
+		    "opts", DATA_TYPE_NVINLINE,
+		    	prop, DATA_TYPE_UINT32, strtoul(val, NULL, 0),
+			NULL,
+		    NULL);
 	} else if (bsearch(prop, ui16, sizeof(ui16) / sizeof(*ui16), 20, (int (*)(void const *, void const *)) strcmp)) {
 		reply = simple_command("set_property",
 		    "fmri", DATA_TYPE_STRING, fmri,
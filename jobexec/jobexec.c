@@ -0,0 +1,566 @@
+/*
+ * Copyright 2010 River Tarnell.  All rights reserved.
+ * Use is subject to license terms.
+ */
+
+/*
+ * jobexec: started with posix_spawn() by jobserverd's launcher (or by the
+ * daemon itself, if there's no launcher) to run a job's start or stop method.
+ * Everything which needs to happen between creating the process and running
+ * the user's command (looking up the user, joining the project, dropping
+ * privileges and reading the environment) happens here, so the daemon never
+ * has to fork itself.  Our stdout and stderr are already a pipe to the job's
+ * log collector, which runs in the launcher, or in the daemon when there's no
+ * launcher.
+ *
+ * Usage:
+ *	jobexec -u <user> [-p <project>] [-r <rctl>=<value> ...] -- <command>
+ *
+ * or, when the daemon has a launch plan for the job:
+ *	jobexec -u <user> -c <uid>,<gid>[,<gid>...] -d <home> -j <project> -e
+ *	    [-E] [-r <rctl>=<value> ...] -- <command>
+ *
+ * With a plan, the user, groups and project have already been looked up.  -e
+ * means the job's environment is on our stdin, each entry ending in a NUL,
+ * with an empty entry at the end; -E means the daemon couldn't read
+ * ~/.environment, so we read it here.  Our own environment is always empty:
+ * we're root until we become the user, and the runtime linker would honour
+ * LD_PRELOAD and the like from it, so the job's environment is only used for
+ * the job's command.
+ */
+
+#include	<sys/types.h>
+#include	<sys/stat.h>
+#include	<sys/task.h>
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<deflt.h>
+#include	<project.h>
+#include	<string.h>
+#include	<strings.h>
+#include	<pwd.h>
+#include	<grp.h>
+#include	<fcntl.h>
+#include	<unistd.h>
+#include	<errno.h>
+#include	<alloca.h>
+#include	<rctl.h>
+#include	<syslog.h>
+#include	<stdarg.h>
+#include	<time.h>
+
+typedef struct {
+	char		*jr_name;
+	rctl_qty_t	 jr_value;
+} exec_rctl_t;
+
+static time_t		 now;
+
+static void	 usage(void);
+static void	 set_rctls(exec_rctl_t *, int);
+static int	 load_environment(char ***, int, char const *);
+static int	 read_environment(char ***);
+static int	 parse_creds(char *, uid_t *, gid_t **, int *);
+static void	*xrecalloc(void *, size_t, size_t, size_t);
+int		 vasprintf(char **, char const *, va_list);
+int		 asprintf(char **, char const *, ...);
+
+static void
+usage()
+{
+	syslog(LOG_ERR, "usage: jobexec -u <user> [-p <project> | "
+	    "-c <uid>,<gid>... -d <home> -j <project> [-e] [-E]] "
+	    "[-r <rctl>=<value> ...] -- <command>");
+	exit(1);
+}
+
+static void *
+xrecalloc(ptr, o, n, size)
+	void	*ptr;
+	size_t	 o, n;
+	size_t	 size;
+{
+	if ((ptr = realloc(ptr, n * size)) == NULL)
+		return (NULL);
+
+	bzero(((char *)ptr) + (o * size), (n - o) * size);
+	return (ptr);
+}
+
+int
+vasprintf(buf, fmt, ap)
+	char		**buf;
+	char const	 *fmt;
+	va_list		  ap;
+{
+int	sz, ret;
+va_list	ap2;
+	va_copy(ap2, ap);
+	if ((sz = vsnprintf(NULL, 0, fmt, ap2)) == -1)
+		return (-1);
+
+	if ((*buf = malloc(sz + 1)) == NULL)
+		return (-1);
+
+	ret = vsnprintf(*buf, sz + 1, fmt, ap);
+	if (ret == -1) {
+		free(*buf);
+		*buf = NULL;
+		return (-1);
+	}
+
+	return (ret);
+}
+
+int
+asprintf(char **buf, char const *fmt, ...)
+{
+va_list	ap;
+int	ret;
+	va_start(ap, fmt);
+	ret = vasprintf(buf, fmt, ap);
+	va_end(ap);
+	return (ret);
+}
+
+/*
+ * Load user-defined environment from $HOME/.environment, after the first i
+ * entries of env.  This is executed as the target user.
+ */
+static int
+load_environment(env, i, file)
+	char		***env;
+	int		  i;
+	char const	 *file;
+{
+FILE	*inf;
+char	 line[4096];
+char	**np = *env;
+
+	if ((inf = fopen(file, "r")) == NULL)
+		return (-1);
+
+	while (fgets(line, sizeof (line), inf) != NULL) {
+	char	*k = line, *e;
+
+		while (*k == ' ')
+			k++;
+
+		if ((e = index(k, '\n')) != NULL)
+			*e = '\0';
+
+		if (!*k || *k == '#')
+			continue;
+
+		if ((np = xrecalloc(np, i, i + 2, sizeof (char *))) == NULL)
+			return (-1);
+		np[i++] = strdup(k);
+		np[i] = NULL;
+		*env = np;
+	}
+
+	(void) fclose(inf);
+	return (0);
+}
+
+/*
+ * Read the environment the daemon wrote to our stdin, and put /dev/null in
+ * its place for the job.  The entries point into a buffer which is never
+ * freed.  Returns the number of entries, or -1 if the environment couldn't
+ * be read or didn't end with an empty entry.
+ */
+static int
+read_environment(env)
+	char	***env;
+{
+char	 *buf = NULL, *p, **np;
+size_t	  len = 0, sz = 0;
+ssize_t	  n;
+int	  i = 0, fd;
+
+	for (;;) {
+		if (len == sz) {
+			if ((p = realloc(buf, sz + 4096 + 1)) == NULL)
+				return (-1);
+			buf = p;
+			sz += 4096;
+		}
+
+		if ((n = read(STDIN_FILENO, buf + len, sz - len)) == -1) {
+			if (errno == EINTR)
+				continue;
+			return (-1);
+		}
+
+		if (n == 0)
+			break;
+		len += n;
+	}
+	buf[len] = '\0';
+
+	if ((np = calloc(1, sizeof (char *))) == NULL)
+		return (-1);
+
+	for (p = buf; *p; p += strlen(p) + 1) {
+		if (p + strlen(p) >= buf + len) {
+			errno = EINVAL;
+			return (-1);
+		}
+
+		if ((np = xrecalloc(np, i, i + 2, sizeof (char *))) == NULL)
+			return (-1);
+		np[i++] = p;
+	}
+
+	if (p >= buf + len) {
+		errno = EINVAL;
+		return (-1);
+	}
+
+	if ((fd = open("/dev/null", O_RDONLY)) == -1 ||
+	    dup2(fd, STDIN_FILENO) == -1)
+		return (-1);
+	(void) close(fd);
+
+	*env = np;
+	return (i);
+}
+
+/*
+ * Parse the -c argument: the uid, then the groups, primary group first.
+ */
+static int
+parse_creds(s, uid, groups, ngroups)
+	char	 *s;
+	uid_t	 *uid;
+	gid_t	**groups;
+	int	 *ngroups;
+{
+char	*p, *q;
+int	 n = 0;
+
+	for (p = s; *p; ++p)
+		if (*p == ',')
+			n++;
+
+	if (n == 0 || (*groups = calloc(n, sizeof (gid_t))) == NULL)
+		return (-1);
+
+	*uid = strtol(s, &p, 10);
+	for (n = 0; *p == ','; ++n) {
+		(*groups)[n] = strtol(p + 1, &q, 10);
+		if (q == p + 1)
+			return (-1);
+		p = q;
+	}
+
+	if (*p)
+		return (-1);
+
+	*ngroups = n;
+	return (0);
+}
+
+/*
+ * Set up resource controls defined in the job.  Names are normally given in
+ * full; a bare name is taken to be a process rctl, except max-cpu-time.
+ */
+static void
+set_rctls(rctls, nrctls)
+	exec_rctl_t	*rctls;
+	int		 nrctls;
+{
+int		 i;
+rctlblk_t	*blk = alloca(rctlblk_size()), *blk2 = alloca(rctlblk_size());
+
+	for (i = 0; i < nrctls; ++i) {
+	exec_rctl_t	*r = &rctls[i];
+	char		 rname[64];
+	int		 i;
+
+		/*
+		 * Get the existing rctl data, then modify it.  This means
+		 * we don't have to know e.g. what signal should be delivered
+		 * for deny action.
+		 */
+
+		if (index(r->jr_name, '.') != NULL)
+			(void) strlcpy(rname, r->jr_name, sizeof (rname));
+		else if (strcmp(r->jr_name, "max-cpu-time") == 0)
+			(void) snprintf(rname, sizeof (rname),
+					"task.%s", r->jr_name);
+		else
+			(void) snprintf(rname, sizeof (rname),
+					"process.%s", r->jr_name);
+
+		for (i = getrctl(rname, NULL, blk, RCTL_FIRST);
+			i != -1;
+			i = getrctl(rname, blk, blk, RCTL_NEXT))
+		{
+			if (rctlblk_get_privilege(blk) == RCPRIV_BASIC)
+				break;
+		}
+
+		if (i == -1 && errno == ENOENT) {
+			rctlblk_set_privilege(blk, RCPRIV_BASIC);
+			rctlblk_set_value(blk, r->jr_value);
+
+			if (setrctl(rname, NULL, blk, RCTL_INSERT) == -1)
+				(void) printf("[ setrctl(%s, %llu) "
+						"failed: %s ]\n",
+						rname,
+						(u_longlong_t)r->jr_value,
+						strerror(errno));
+			continue;
+		}
+
+		if (i == -1) {
+			(void) printf("[ getrctl(%s) failed: %s ]\n",
+					rname, strerror(errno));
+			continue;
+		}
+
+		bcopy(blk, blk2, rctlblk_size());
+		rctlblk_set_value(blk2, r->jr_value);
+		if (setrctl(rname, blk, blk2, RCTL_REPLACE) == -1) {
+			(void) printf("[ setrctl(%s, %llu) failed: %s ]\n",
+					rname, (u_longlong_t)r->jr_value,
+					strerror(errno));
+			continue;
+		}
+	}
+}
+
+int
+main(argc, argv)
+	int	  argc;
+	char	**argv;
+{
+char		 *user = NULL, *project = NULL;
+char		 *creds = NULL, *home = NULL, *pjname = NULL;
+char		 *cmd, *envfile, *s, *path;
+char		**env, **jobenv = NULL;
+int		  c, i = 0, readenv = 0, stdinenv = 0;
+exec_rctl_t	 *rctls = NULL;
+int		  nrctls = 0;
+struct passwd	 *pwd, pwbuf;
+uid_t		  uid;
+gid_t		 *groups = NULL;
+int		  ngroups = 0;
+struct project	  proj;
+char		  nssbuf[PROJECT_BUFSZ];
+char		  tbuf[64];
+
+	/*
+	 * stdin is /dev/null (or, with -e, the job's environment), and
+	 * stdout and stderr are the log.  Anything else is one of the
+	 * daemon's descriptors, which the job mustn't have.
+	 */
+	closefrom(STDERR_FILENO + 1);
+	openlog("jobexec", LOG_PID, LOG_DAEMON);
+	now = time(NULL);
+
+	while ((c = getopt(argc, argv, "u:p:r:c:d:j:eE")) != -1) {
+		switch (c) {
+		case 'u':
+			user = optarg;
+			break;
+
+		case 'p':
+			project = optarg;
+			break;
+
+		case 'c':
+			creds = optarg;
+			break;
+
+		case 'd':
+			home = optarg;
+			break;
+
+		case 'j':
+			pjname = optarg;
+			break;
+
+		case 'e':
+			stdinenv = 1;
+			break;
+
+		case 'E':
+			readenv = 1;
+			break;
+
+		case 'r':
+			if ((s = index(optarg, '=')) == NULL)
+				usage();
+			*s++ = '\0';
+			if ((rctls = xrecalloc(rctls, nrctls, nrctls + 1,
+			    sizeof (*rctls))) == NULL) {
+				syslog(LOG_ERR, "out of memory");
+				return (1);
+			}
+			rctls[nrctls].jr_name = optarg;
+			rctls[nrctls].jr_value = strtoull(s, NULL, 10);
+			nrctls++;
+			break;
+
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc != 1 || user == NULL || (stdinenv && creds == NULL))
+		usage();
+	cmd = argv[0];
+
+	if (stdinenv && (i = read_environment(&jobenv)) == -1) {
+		syslog(LOG_ERR, "start_job: cannot read environment: %s",
+		    strerror(errno));
+		return (1);
+	}
+
+	if (creds) {
+		/*
+		 * The daemon's launch plan: everything has been looked up
+		 * already.  Only the fields we use are filled in.
+		 */
+		if (home == NULL || pjname == NULL ||
+		    parse_creds(creds, &uid, &groups, &ngroups) == -1)
+			usage();
+
+		bzero(&pwbuf, sizeof (pwbuf));
+		pwbuf.pw_name = user;
+		pwbuf.pw_uid = uid;
+		pwbuf.pw_gid = groups[0];
+		pwbuf.pw_dir = home;
+		pwd = &pwbuf;
+	} else if ((pwd = getpwnam(user)) == NULL) {
+		syslog(LOG_ERR, "start_job: user %s doesn't exist", user);
+		return (1);
+	}
+
+	/*
+	 * Until we're the user, errors go to syslog rather than the user's
+	 * log.
+	 */
+	if (creds) {
+		if (setproject(pjname, pwd->pw_name, TASK_NORMAL) != 0) {
+			syslog(LOG_ERR, "start_job: setproject: %s",
+			    strerror(errno));
+			return (1);
+		}
+	} else {
+		if (getdefaultproj(pwd->pw_name, &proj,
+					nssbuf, sizeof (nssbuf)) == NULL) {
+			syslog(LOG_ERR, "start_job: getdefaultproj: %s",
+			    strerror(errno));
+			return (1);
+		}
+
+		if (setproject(proj.pj_name, pwd->pw_name, TASK_NORMAL) != 0) {
+			syslog(LOG_ERR, "start_job: setproject: %s",
+			    strerror(errno));
+			return (1);
+		}
+	}
+
+	if (project) {
+		if (inproj(pwd->pw_name, project, nssbuf, sizeof (nssbuf))) {
+			/*
+			 * Don't error out here... it might be some kind of
+			 * transient issue.
+			 */
+			if (setproject(project, pwd->pw_name, TASK_NORMAL) != 0)
+				syslog(LOG_ERR, "start_job: setproject: %s",
+						strerror(errno));
+		} else {
+			syslog(LOG_ERR, "Warning: user \"%s\" is not "
+					"a member of project \"%s\"",
+					pwd->pw_name, project);
+		}
+	}
+
+	if (creds) {
+		if (setgroups(ngroups, groups) == -1) {
+			syslog(LOG_ERR, "start_job: setgroups: %s",
+			    strerror(errno));
+			return (1);
+		}
+	} else if (initgroups(pwd->pw_name, pwd->pw_gid) == -1) {
+		syslog(LOG_ERR, "start_job: initgroups: %s", strerror(errno));
+		return (1);
+	}
+
+	if (setgid(pwd->pw_gid) == -1) {
+		syslog(LOG_ERR, "start_job: setgid: %s", strerror(errno));
+		return (1);
+	}
+
+	if (setuid(pwd->pw_uid) == -1) {
+		syslog(LOG_ERR, "start_job: setuid: %s", strerror(errno));
+		return (1);
+	}
+
+	if (chdir(pwd->pw_dir) == -1) {
+		(void) printf("[ chdir(%s): %s ]\n",
+				pwd->pw_dir, strerror(errno));
+		(void) printf("[ Job start aborted. ]\n");
+		return (1);
+	}
+
+	set_rctls(rctls, nrctls);
+
+	if (creds) {
+		/*
+		 * The daemon gave us the job's environment on stdin.
+		 */
+		if (jobenv)
+			env = jobenv;
+		else if ((env = calloc(1, sizeof (char **))) == NULL) {
+			(void) printf("[ Out of memory. ]\n");
+			(void) printf("[ Job start aborted. ]\n");
+			return (1);
+		}
+	} else {
+		if ((env = calloc(6, sizeof (char **))) == NULL) {
+			(void) printf("[ Out of memory. ]\n");
+			(void) printf("[ Job start aborted. ]\n");
+			return (1);
+		}
+
+		if (defopen(DEFLT "/login") == -1 ||
+		    (path = defread("PATH=")) == NULL)
+			path = "/usr/bin:";
+
+		(void) asprintf(&env[i++], "PATH=%s", path);
+		(void) asprintf(&env[i++], "HOME=%s", pwd->pw_dir);
+		(void) asprintf(&env[i++], "LOGNAME=%s", pwd->pw_name);
+		(void) asprintf(&env[i++], "USER=%s", pwd->pw_name);
+		(void) asprintf(&env[i++], "SHELL=%s", pwd->pw_shell);
+		env[i] = NULL;
+		readenv = 1;
+	}
+
+	if (readenv) {
+		(void) asprintf(&envfile, "%s/.environment", pwd->pw_dir);
+		(void) load_environment(&env, i, envfile);
+	}
+
+	(void) strftime(tbuf, sizeof (tbuf), "%Y-%m-%d %H:%M:%S",
+	    localtime(&now));
+
+	(void) printf("[ %s: Executing command \"%s\" ]\n",
+			tbuf, cmd);
+	(void) fflush(stdout);
+
+	closelog();
+	(void) execle("/usr/xpg4/bin/sh", "sh", "-c", cmd, NULL, env);
+
+	(void) printf("[ Failed: %s ]\n", strerror(errno));
+	(void) fflush(stdout);
+
+	return (1);
+}
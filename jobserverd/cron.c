@@ -0,0 +1,373 @@
+/*
+ * Copyright 2010 River Tarnell.  All rights reserved.
+ * Use is subject to license terms.
+ */
+
+#include	<stdlib.h>
+#include	<string.h>
+#include	<strings.h>
+#include	<ctype.h>
+#include	<errno.h>
+#include	<time.h>
+
+#include	"cron.h"
+#include	"jerrno.h"
+
+/*
+ * How many years ahead to look before deciding an expression never fires.
+ * Eight years is enough to find the next 29 February.
+ */
+#define	CRON_MAX_YEARS	8
+
+static char const *const month_names[] = {
+	"jan", "feb", "mar", "apr", "may", "jun",
+	"jul", "aug", "sep", "oct", "nov", "dec", NULL
+};
+
+static char const *const wday_names[] = {
+	"sun", "mon", "tue", "wed", "thu", "fri", "sat", NULL
+};
+
+static int	parse_field(char const *, char const *, int, int,
+			char const *const *, int, uint64_t *);
+static int	parse_value(char const **, char const *, int,
+			char const *const *, int *);
+static int	lowbit(uint64_t);
+static int	next_bit(uint64_t, int);
+static int	days_in_month(int, int);
+static int	day_of_week(int, int, int);
+
+/*
+ * Return the index of the lowest set bit in a non-zero mask.
+ */
+static int
+lowbit(m)
+	uint64_t	m;
+{
+int	n = 0;
+	if ((m & 0xFFFFFFFFULL) == 0) { n += 32; m >>= 32; }
+	if ((m & 0xFFFFULL) == 0) { n += 16; m >>= 16; }
+	if ((m & 0xFFULL) == 0) { n += 8; m >>= 8; }
+	if ((m & 0xFULL) == 0) { n += 4; m >>= 4; }
+	if ((m & 0x3ULL) == 0) { n += 2; m >>= 2; }
+	if ((m & 0x1ULL) == 0) { n += 1; }
+	return (n);
+}
+
+/*
+ * Return the first set bit in m at or above 'from', or -1.
+ */
+static int
+next_bit(m, from)
+	uint64_t	m;
+	int		from;
+{
+	if (from >= 64)
+		return (-1);
+	m &= ~0ULL << from;
+	return (m ? lowbit(m) : -1);
+}
+
+static int
+days_in_month(year, mon)
+	int	year, mon;
+{
+static int const	days[] = {
+	31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31
+};
+	if (mon == 1 && (year % 4 == 0 && (year % 100 != 0 || year % 400 == 0)))
+		return (29);
+	return (days[mon]);
+}
+
+/*
+ * Day of the week (0 = Sunday) for a date; mon is 0-11.
+ */
+static int
+day_of_week(year, mon, mday)
+	int	year, mon, mday;
+{
+static int const	t[] = { 0, 3, 2, 5, 0, 3, 5, 1, 4, 6, 2, 4 };
+	if (mon < 2)
+		year--;
+	return ((year + year / 4 - year / 100 + year / 400 + t[mon] + mday) % 7);
+}
+
+/*
+ * Parse a number or (if names is not NULL) a name from *p, advancing *p.
+ */
+static int
+parse_value(p, end, base, names, val)
+	char const		**p, *end;
+	int			  base;
+	char const *const	 *names;
+	int			 *val;
+{
+int	i;
+
+	if (*p < end && isdigit((unsigned char)**p)) {
+		*val = 0;
+		while (*p < end && isdigit((unsigned char)**p)) {
+			*val = (*val * 10) + (**p - '0');
+			if (*val > 1000)
+				return (-1);
+			(*p)++;
+		}
+		return (0);
+	}
+
+	if (names == NULL || end - *p < 3)
+		return (-1);
+
+	for (i = 0; names[i]; ++i) {
+		if (strncasecmp(*p, names[i], 3) == 0) {
+			*val = i + base;
+			*p += 3;
+			return (0);
+		}
+	}
+
+	return (-1);
+}
+
+/*
+ * Parse one field, [start, end), into a bitmask.  Bit n of the result
+ * corresponds to value n.  Values above 'max' are only allowed if they are
+ * equal to 'alias', which is wrapped to 0 (for Sunday as 7).
+ */
+static int
+parse_field(start, end, min, max, names, alias, mask)
+	char const		*start, *end;
+	int			 min, max;
+	char const *const	*names;
+	int			 alias;
+	uint64_t		*mask;
+{
+char const	*p = start;
+int		 lo, hi, step, i, range;
+
+	*mask = 0;
+
+	for (;;) {
+		step = 1;
+		range = 1;
+
+		if (p < end && *p == '*') {
+			lo = min;
+			hi = max;
+			p++;
+		} else {
+			if (parse_value(&p, end, min, names, &lo) == -1)
+				return (-1);
+			hi = lo;
+			range = 0;
+
+			if (p < end && *p == '-') {
+				range = 1;
+				p++;
+				if (parse_value(&p, end, min, names, &hi) == -1)
+					return (-1);
+			}
+		}
+
+		if (p < end && *p == '/') {
+			p++;
+			if (parse_value(&p, end, 0, NULL, &step) == -1 ||
+			    step == 0)
+				return (-1);
+			/* "5/10" means "5-max/10". */
+			if (!range)
+				hi = max;
+		}
+
+		if (lo < min || hi < lo || (hi > max && hi != alias))
+			return (-1);
+
+		for (i = lo; i <= hi; i += step)
+			*mask |= 1ULL << (i == alias ? 0 : i);
+
+		if (p == end)
+			return (0);
+		if (*p++ != ',')
+			return (-1);
+	}
+}
+
+int
+cron_expr_compile(spec, ce)
+	char const	*spec;
+	cron_expr_t	*ce;
+{
+char const	*fields[5], *ends[5], *p = spec;
+uint64_t	 m;
+int		 i;
+
+	bzero(ce, sizeof (*ce));
+
+	for (i = 0; i < 5; ++i) {
+		while (isspace((unsigned char)*p))
+			p++;
+		if (*p == '\0')
+			goto err;
+		fields[i] = p;
+		while (*p && !isspace((unsigned char)*p))
+			p++;
+		ends[i] = p;
+	}
+
+	while (isspace((unsigned char)*p))
+		p++;
+	if (*p != '\0')
+		goto err;
+
+	if (parse_field(fields[0], ends[0], 0, 59, NULL, -1, &m) == -1)
+		goto err;
+	ce->ce_minutes = m;
+
+	if (parse_field(fields[1], ends[1], 0, 23, NULL, -1, &m) == -1)
+		goto err;
+	ce->ce_hours = (uint32_t)m;
+
+	if (parse_field(fields[2], ends[2], 1, 31, NULL, -1, &m) == -1)
+		goto err;
+	ce->ce_mdays = (uint32_t)m;
+
+	/* Months are 1-12 in the expression, but 0-11 in the mask. */
+	if (parse_field(fields[3], ends[3], 1, 12, month_names, -1, &m) == -1)
+		goto err;
+	ce->ce_months = (uint16_t)(m >> 1);
+
+	if (parse_field(fields[4], ends[4], 0, 6, wday_names, 7, &m) == -1)
+		goto err;
+	ce->ce_wdays = (uint8_t)m;
+
+	if (*fields[2] == '*')
+		ce->ce_flags |= CE_MDAY_ANY;
+	if (*fields[4] == '*')
+		ce->ce_flags |= CE_WDAY_ANY;
+
+	return (0);
+
+err:
+	errno = JEINVALID_SCHEDULE;
+	return (-1);
+}
+
+time_t
+cron_expr_next(ce, tz, after)
+	cron_expr_t const	*ce;
+	tz_t const		*tz;
+	time_t			 after;
+{
+struct tm	 tm;
+time_t		 t;
+int		 year, mon, mday, hour, min, lastyear;
+int		 dim, wd1;
+uint64_t	 days, wdays;
+
+	t = after + 60;
+	tz_localtime(tz, t, &tm);
+	year = tm.tm_year + 1900;
+	mon = tm.tm_mon;
+	mday = tm.tm_mday;
+	hour = tm.tm_hour;
+	min = tm.tm_min;
+	lastyear = year + CRON_MAX_YEARS;
+
+	/*
+	 * Each step either finds a matching value for the current field, or
+	 * moves to the start of the next value of the field above it.  When a
+	 * field moves forward, all the fields below it start again from their
+	 * lowest value.
+	 */
+	while (year <= lastyear) {
+	int	n;
+		if ((n = next_bit(ce->ce_months, mon)) == -1) {
+			year++;
+			mon = 0;
+			mday = 1;
+			hour = min = 0;
+			continue;
+		}
+
+		if (n != mon) {
+			mon = n;
+			mday = 1;
+			hour = min = 0;
+		}
+
+		/*
+		 * Day.  Build a mask of matching days in this month.  If
+		 * both day fields are restricted, a day matches if either
+		 * does (as in traditional cron).
+		 */
+		dim = days_in_month(year, mon);
+		wd1 = day_of_week(year, mon, 1);
+		/* Rotate the weekday mask so bit 1 is the 1st of the month. */
+		wdays = ((uint64_t)ce->ce_wdays >> wd1) |
+		    ((uint64_t)ce->ce_wdays << (7 - wd1));
+		wdays &= 0x7F;
+		wdays |= wdays << 7;
+		wdays |= wdays << 14;
+		wdays |= wdays << 28;
+		wdays <<= 1;
+
+		if (ce->ce_flags & CE_WDAY_ANY)
+			days = ce->ce_mdays;
+		else if (ce->ce_flags & CE_MDAY_ANY)
+			days = wdays;
+		else
+			days = ce->ce_mdays | wdays;
+		days &= (2ULL << dim) - 2;
+
+		if ((n = next_bit(days, mday)) == -1) {
+			if (++mon == 12) {
+				mon = 0;
+				year++;
+			}
+			mday = 1;
+			hour = min = 0;
+			continue;
+		}
+
+		if (n != mday) {
+			mday = n;
+			hour = min = 0;
+		}
+
+		if ((n = next_bit(ce->ce_hours, hour)) == -1) {
+			mday++;
+			hour = min = 0;
+			continue;
+		}
+
+		if (n != hour) {
+			hour = n;
+			min = 0;
+		}
+
+		if ((min = next_bit(ce->ce_minutes, min)) == -1) {
+			hour++;
+			min = 0;
+			continue;
+		}
+
+		bzero(&tm, sizeof (tm));
+		tm.tm_year = year - 1900;
+		tm.tm_mon = mon;
+		tm.tm_mday = mday;
+		tm.tm_hour = hour;
+		tm.tm_min = min;
+
+		/*
+		 * A local time that's repeated because of a DST change gives
+		 * the first occurrence, which may not be after 'after'; carry
+		 * on from the next minute, so the job runs only once.
+		 */
+		if ((t = tz_mktime(tz, &tm)) > after)
+			return (t);
+		min++;
+	}
+
+	return (-1);
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright 2010 River Tarnell.  All rights reserved.
+ * Use is subject to license terms.
+ */
+
+/*
+ * Standard five-field cron expressions ("minute hour day-of-month month
+ * day-of-week").  An expression is compiled once into a set of bitmasks, one
+ * per field, and the next time the expression fires is found by scanning for
+ * set bits rather than stepping through time a minute at a time.
+ */
+
+#ifndef	CRON_H
+#define	CRON_H
+
+#include	<sys/types.h>
+#include	<inttypes.h>
+
+#include	"tz.h"
+
+typedef struct cron_expr {
+	uint64_t	ce_minutes;	/* bits 0-59 */
+	uint32_t	ce_hours;	/* bits 0-23 */
+	uint32_t	ce_mdays;	/* bits 1-31 */
+	uint16_t	ce_months;	/* bits 0-11 */
+	uint8_t		ce_wdays;	/* bits 0-6, 0 = Sunday */
+	uint8_t		ce_flags;
+} cron_expr_t;
+
+#define	CE_MDAY_ANY	0x1	/* day-of-month field was "*" */
+#define	CE_WDAY_ANY	0x2	/* day-of-week field was "*" */
+
+/*
+ * Compile an expression.  Fields may be "*", a number, a range "a-b", any of
+ * these followed by a step "/n", or a comma-separated list.  Months and days
+ * of the week may also be given by name ("jan", "mon"), and 7 means Sunday.
+ * Returns -1 and sets errno to JEINVALID_SCHEDULE if the expression is not
+ * valid.
+ */
+int	cron_expr_compile(char const *, cron_expr_t *);
+
+/*
+ * Return the first time strictly after 'after' at which the expression
+ * fires in the given zone, or -1 if it never fires (e.g. "0 0 31 2 *").
+ * See tz_mktime() for what happens around DST changes.
+ */
+time_t	cron_expr_next(cron_expr_t const *, tz_t const *, time_t after);
+
+#endif	/* !CRON_H */
@@ -17,6 +17,7 @@
 #include	"jobserver.h"
 
 static ctid_t get_last_ctid(void);
+static contract_t *contract_open_common(ctid_t, int);
 
 static ctid_t
 get_last_ctid()
@@ -49,6 +50,25 @@ ct_stathdl_t	 ctst;
 contract_t *
 contract_open(ctid)
 	ctid_t	ctid;
+{
+	return (contract_open_common(ctid, 0));
+}
+
+contract_t *
+contract_adopt(ctid)
+	ctid_t	ctid;
+{
+	return (contract_open_common(ctid, 1));
+}
+
+/*
+ * Open a contract's files.  If 'adopt' is set, adopt the contract before
+ * opening the events file, so that we listen to it as its holder.
+ */
+static contract_t *
+contract_open_common(ctid, adopt)
+	ctid_t	ctid;
+	int	adopt;
 {
 contract_t	*ct;
 char		 fname[128];
@@ -76,6 +96,12 @@ char		 fname[128];
 		goto err;
 	}
 
+	if (adopt && ct_ctl_adopt(ct->ct_ctl) == -1) {
+		logm(LOG_ERR, "contract_open: cannot adopt %d: %s",
+		    (int)ctid, strerror(errno));
+		goto err;
+	}
+
 	(void) snprintf(fname, sizeof (fname), "%s/process/%d/events",
 			CTFS_ROOT, ctid);
 
@@ -121,6 +147,54 @@ ctid_t	id;
 	return (contract_open(id));
 }
 
+int
+contract_template()
+{
+int	fd;
+uint_t	inform;
+
+	if ((fd = open64(CTFS_ROOT "/process/template", O_RDWR)) == -1) {
+		logm(LOG_ERR, "contract_template: cannot open process "
+		    "template: %s", strerror(errno));
+		return (-1);
+	}
+
+	if (fd_set_cloexec(fd, 1) == -1) {
+		logm(LOG_ERR, "contract_template: "
+			"cannot set cloexec on process template fd: %s",
+			strerror(errno));
+		goto err;
+	}
+
+	if (ct_tmpl_get_informative(fd, &inform) == -1) {
+		logm(LOG_ERR, "contract_template: ct_tmpl_get_informative: %s",
+				strerror(errno));
+		goto err;
+	}
+
+	inform |= (CT_PR_EV_EMPTY | CT_PR_EV_EXIT | CT_PR_EV_CORE |
+			CT_PR_EV_SIGNAL | CT_PR_EV_HWERR);
+	if (ct_tmpl_set_informative(fd, inform) == -1) {
+		logm(LOG_ERR, "contract_template: ct_tmpl_set_informative: %s",
+				strerror(errno));
+		goto err;
+	}
+
+#if 1	/* Remove this when contract adoption is working  */
+	if (ct_pr_tmpl_set_param(fd, CT_PR_NOORPHAN) == -1) {
+		logm(LOG_ERR, "contract_template: cannot set CT_PR_NOORPHAN: %s",
+			strerror(errno));
+		goto err;
+	}
+#endif
+
+	return (fd);
+
+err:
+	(void) close(fd);
+	return (-1);
+}
+
 void
 contract_close(ct)
 	contract_t	*ct;
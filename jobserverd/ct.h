@@ -23,4 +23,17 @@ contract_t	*contract_open(ctid_t id);
 contract_t	*contract_open_latest(void);
 void		 contract_close(contract_t *);
 
+/*
+ * Adopt a contract which was inherited by our process contract (because a
+ * member of it abandoned it), and open it.
+ */
+contract_t	*contract_adopt(ctid_t id);
+
+/*
+ * Open a new process template set up the way job contracts need: informative
+ * events for the job's processes, and the processes killed if the contract is
+ * orphaned.  Returns the template fd, which is not activated, or -1.
+ */
+int		 contract_template(void);
+
 #endif	/* !CT_H */
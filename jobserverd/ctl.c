@@ -18,6 +18,8 @@
 #include	<auth_attr.h>
 #include	<secdb.h>
 #include	<ctype.h>
+#include	<limits.h>
+#include	<signal.h>
 
 #include	"fd.h"
 #include	"ctl.h"
@@ -26,6 +28,8 @@
 #include	"sched.h"
 #include	"queue.h"
 #include	"jerrno.h"
+#include	"schedtab.h"
+#include	"forecast.h"
 
 #define	PROTOCOL_VERSION 1
 #define	ADMIN_AUTH_NAME "solaris.jobs.admin"
@@ -45,6 +49,7 @@ typedef struct ctl_client {
 	ctl_state_t	 cc_state;
 	int		 cc_admin;
 	int		 cc_user;
+	forecast_t	*cc_forecast;	/* forecast we're waiting for */
 	LIST_ENTRY(ctl_client) cc_entries;
 } ctl_client_t;
 static LIST_HEAD(client_list, ctl_client) clients;
@@ -66,6 +71,10 @@ static void	c_start(ctl_client_t *, job_t *job, nvlist_t *);
 static void	c_stop(ctl_client_t *, job_t *job, nvlist_t *);
 static void	c_enable(ctl_client_t *, job_t *job, nvlist_t *);
 static void	c_disable(ctl_client_t *, job_t *job, nvlist_t *);
+static void	c_status(ctl_client_t *, job_t *job, nvlist_t *);
+static void	c_forecast(ctl_client_t *, job_t *job, nvlist_t *);
+static void	stat_stop_signals(nvlist_t *, job_t *);
+static void	forecast_done(forecast_result_t const *, void *);
 
 static void ctl_client_accept(int, fde_evt_type_t, void *);
 static void ctl_close(ctl_client_t *);
@@ -106,10 +115,13 @@ static struct command {
 	{ "stop",	RUNNING, c_stop, CMD_F_FMRI | CMD_J_STARTSTOP },
 	{ "enable",	RUNNING, c_enable,	CMD_F_FMRI | CMD_J_STARTSTOP },
 	{ "disable",	RUNNING, c_disable,	CMD_F_FMRI | CMD_J_STARTSTOP },
+	{ "status",	RUNNING, c_status, 0 },
+	{ "forecast",	RUNNING, c_forecast, 0 },
 };
 
 static ctl_client_t *find_client(int);
 static ctl_client_t *new_client(int);
+static job_t *ctl_find_job(ctl_client_t *, char const *);
 
 static ctl_client_t *
 find_client(fd)
@@ -371,8 +383,8 @@ job_t		*job = NULL;
 			return;
 		}
 
-		if ((job = find_job_fmri(fmri)) == NULL) {
-			if (ctl_error(client, "Job not found") == -1)
+		if ((job = ctl_find_job(client, fmri)) == NULL) {
+			if (ctl_error(client, jstrerror(errno)) == -1)
 				ctl_close(client);
 			return;
 		}
@@ -399,6 +411,34 @@ job_t		*job = NULL;
 		ctl_close(client);
 }
 
+/*
+ * Find the job a client is referring to.  A partial FMRI is first tried as
+ * a job in the client's own namespace, so that another user creating a job
+ * with the same name doesn't make the client's partial FMRIs ambiguous.
+ */
+static job_t *
+ctl_find_job(client, fmri)
+	ctl_client_t	*client;
+	char const	*fmri;
+{
+job_t	*job;
+char	*own;
+
+	if (strncmp(fmri, "job:/", 5) != 0) {
+		if (asprintf(&own, "job:/%s/%s", client->cc_name, fmri) == -1) {
+			logm(LOG_ERR, "ctl_find_job: out of memory");
+			return (NULL);
+		}
+
+		job = find_job_fmri(own);
+		free(own);
+		if (job != NULL)
+			return (job);
+	}
+
+	return (find_job_fmri(fmri));
+}
+
 void
 c_helo(client, job, args)
 	ctl_client_t	*client;
@@ -582,6 +622,9 @@ nvlist_t	*nvl;
 		case SJOB_STOPPED:
 			rstate = "stopped";
 			break;
+		case SJOB_QUEUED:
+			rstate = "queued";
+			break;
 		default:
 		case SJOB_UNKNOWN:
 			rstate = "unknown";
@@ -610,12 +653,18 @@ c_list(client, job, args)
 {
 nvlist_t *resp;
 struct list_callback data;
+char	*user;
 
-	(void) args;
+	/*
+	 * Non-admin users can only see their own jobs, so there's no need to
+	 * look at anyone else's.
+	 */
+	if (nvlist_lookup_string(args, "user", &user))
+		user = client->cc_admin ? NULL : client->cc_name;
 
 	bzero(&data, sizeof(data));
 	data.client = client;
-	if (job_enumerate(list_callback, &data) == -1) {
+	if (job_enumerate_user(user, list_callback, &data) == -1) {
 		logm(LOG_WARNING, "c_list: job_enumerate failed");
 		(void) ctl_error(client, "Internal error");
 		return;
@@ -688,6 +737,162 @@ char	*time;
 		(void) ctl_message(client, "OK");
 }
 
+static char const *
+outcome_name(o)
+	sjob_outcome_t	o;
+{
+	switch (o) {
+	case SJOB_OUTCOME_SUCCESS:
+		return ("succeeded");
+	case SJOB_OUTCOME_FAILURE:
+		return ("failed");
+	case SJOB_OUTCOME_SKIPPED:
+		return ("skipped");
+	default:
+		return ("waiting");
+	}
+}
+
+/*
+ * Add a job's dependencies, and the state of each towards the job's next run,
+ * to a stat response.
+ */
+static void
+stat_deps(njob, job)
+	nvlist_t	*njob;
+	job_t		*job;
+{
+nvlist_t	**deps;
+char const	**rdeps;
+job_t		*dep;
+int		 i, n;
+
+	if (job->job_ndeps &&
+	    (deps = calloc(job->job_ndeps, sizeof (*deps))) != NULL) {
+		for (i = 0, n = 0; i < job->job_ndeps; ++i) {
+			if ((dep = find_job(job->job_deps[i].jd_job)) == NULL ||
+			    nvlist_alloc(&deps[n], NV_UNIQUE_NAME, 0))
+				continue;
+
+			nvlist_add_string(deps[n], "fmri", dep->job_fmri);
+			nvlist_add_string(deps[n], "condition",
+			    job->job_deps[i].jd_cond == DEP_FAILURE ? "failure" :
+			    job->job_deps[i].jd_cond == DEP_ALWAYS ? "always" :
+			    "success");
+			nvlist_add_string(deps[n], "state", outcome_name(
+			    sched_dep_outcome(job, dep->job_id)));
+			n++;
+		}
+
+		nvlist_add_nvlist_array(njob, "depends", deps, n);
+		while (n--)
+			nvlist_free(deps[n]);
+		free(deps);
+	}
+
+	if (job->job_nrdeps &&
+	    (rdeps = calloc(job->job_nrdeps, sizeof (*rdeps))) != NULL) {
+		for (i = 0, n = 0; i < job->job_nrdeps; ++i)
+			if ((dep = find_job(job->job_rdeps[i])) != NULL)
+				rdeps[n++] = dep->job_fmri;
+
+		nvlist_add_string_array(njob, "dependents", (char **)rdeps, n);
+		free(rdeps);
+	}
+
+	if (sched_last_outcome(job) != SJOB_OUTCOME_NONE)
+		nvlist_add_string(njob, "last-outcome",
+		    outcome_name(sched_last_outcome(job)));
+}
+
+/*
+ * Add a job's run statistics to a stat response, as the nvlist "stats".
+ */
+static void
+stat_runs(njob, job)
+	nvlist_t	*njob;
+	job_t		*job;
+{
+sjob_stats_t const	*st;
+sjob_run_t const	*r;
+nvlist_t		*nst, *recent[SJOB_NRECENT];
+static char const	*results[] = { "exit", "fail", "crash" };
+uint_t			 n, i;
+
+	if ((st = sched_get_stats(job)) == NULL ||
+	    nvlist_alloc(&nst, NV_UNIQUE_NAME, 0))
+		return;
+
+	nvlist_add_uint32(nst, "runs", st->st_runs);
+	nvlist_add_uint32(nst, "exits", st->st_results[SJOB_RESULT_EXIT]);
+	nvlist_add_uint32(nst, "fails", st->st_results[SJOB_RESULT_FAIL]);
+	nvlist_add_uint32(nst, "crashes", st->st_results[SJOB_RESULT_CRASH]);
+	nvlist_add_uint64(nst, "mean-duration",
+	    st->st_total_duration / st->st_runs);
+	nvlist_add_uint32(nst, "max-duration", st->st_max_duration);
+	nvlist_add_uint32_array(nst, "duration-histogram",
+	    (uint32_t *)st->st_duration, SJOB_HIST_BUCKETS);
+	nvlist_add_uint32_array(nst, "skew-histogram",
+	    (uint32_t *)st->st_skew, SJOB_HIST_BUCKETS);
+
+	/*
+	 * Most recent first.
+	 */
+	n = st->st_nrecent < SJOB_NRECENT ? st->st_nrecent : SJOB_NRECENT;
+	for (i = 0; i < n; ++i) {
+		r = &st->st_recent[(st->st_nrecent - 1 - i) % SJOB_NRECENT];
+		if (nvlist_alloc(&recent[i], NV_UNIQUE_NAME, 0))
+			break;
+		nvlist_add_uint64(recent[i], "start", r->sr_start);
+		nvlist_add_uint32(recent[i], "duration", r->sr_duration);
+		if (r->sr_skew >= 0)
+			nvlist_add_uint32(recent[i], "skew", r->sr_skew);
+		if (r->sr_status != -1)
+			nvlist_add_int32(recent[i], "status", r->sr_status);
+		nvlist_add_string(recent[i], "result",
+		    results[r->sr_result]);
+	}
+	nvlist_add_nvlist_array(nst, "recent", recent, i);
+	while (i--)
+		nvlist_free(recent[i]);
+
+	nvlist_add_nvlist(njob, "stats", nst);
+	nvlist_free(nst);
+}
+
+/*
+ * Add the job's stop signals, in the form accepted by set_stop_signals().
+ */
+static void
+stat_stop_signals(njob, job)
+	nvlist_t	*njob;
+	job_t		*job;
+{
+stop_policy_t const	*sp = &job->job_stop;
+char			 buf[128], step[SIG2STR_MAX + 16], sig[SIG2STR_MAX];
+int			 i;
+
+	if (sp->sp_nsteps == 0) {
+		nvlist_add_string(njob, "stop-signals", "TERM");
+		return;
+	}
+
+	buf[0] = 0;
+	for (i = 0; i < sp->sp_nsteps; ++i) {
+		if (sig2str(sp->sp_steps[i].ss_signo, sig) == -1)
+			(void) snprintf(sig, sizeof (sig), "%d",
+			    sp->sp_steps[i].ss_signo);
+		if (i == 0)
+			(void) snprintf(step, sizeof (step), "%s", sig);
+		else
+			(void) snprintf(step, sizeof (step), ",%s:%d", sig,
+			    sp->sp_steps[i].ss_delay);
+		(void) strlcat(buf, step, sizeof (buf));
+	}
+
+	nvlist_add_string(njob, "stop-signals", buf);
+}
+
 void
 c_stat(client, job, args)
 	ctl_client_t	*client;
@@ -696,6 +901,8 @@ c_stat(client, job, args)
 {
 nvlist_t	*njob, *resp;
 char		 buf[64];
+int		 qpos, ninst;
+time_t		 qsince, restart_at;
 	(void) args;
 
 	if (nvlist_alloc(&njob, NV_UNIQUE_NAME, 0)) {
@@ -727,6 +934,9 @@ char		 buf[64];
 		case SJOB_STOPPED:
 			nvlist_add_string(njob, "rstate", "stopped");
 			break;
+		case SJOB_QUEUED:
+			nvlist_add_string(njob, "rstate", "queued");
+			break;
 		default:
 		case SJOB_UNKNOWN:
 			nvlist_add_string(njob, "rstate", "unknown");
@@ -734,6 +944,11 @@ char		 buf[64];
 		}
 	}
 
+	if ((qpos = sched_queue_position(job, &qsince)) != 0) {
+		nvlist_add_uint32(njob, "queue-position", qpos);
+		nvlist_add_uint64(njob, "queue-wait", current_time - qsince);
+	}
+
 	nvlist_add_string(njob, "fmri", job->job_fmri);
 	nvlist_add_string(njob, "start", job->job_start_method);
 	if (job->job_stop_method)
@@ -744,6 +959,29 @@ char		 buf[64];
 		nvlist_add_string(njob, "logfmt", DEFAULT_LOGFMT);
 	nvlist_add_uint64(njob, "logsize", job->job_logsize);
 	nvlist_add_uint32(njob, "logkeep", job->job_logkeep);
+	nvlist_add_string(njob, "logstamp", job->job_logstamp ? "on" : "off");
+	if (job->job_logfile)
+		nvlist_add_string(njob, "logfile", job->job_logfile);
+	nvlist_add_uint32(njob, "restart-delay", job->job_restart.rs_delay);
+	if (job->job_restart.rs_delay) {
+		nvlist_add_uint32(njob, "restart-backoff",
+		    job->job_restart.rs_backoff ? job->job_restart.rs_backoff :
+		    SCHED_RESTART_BACKOFF);
+		nvlist_add_uint32(njob, "restart-max-delay",
+		    job->job_restart.rs_max_delay ?
+		    job->job_restart.rs_max_delay : SCHED_RESTART_MAX_DELAY);
+		nvlist_add_uint32(njob, "restart-reset",
+		    job->job_restart.rs_reset ? job->job_restart.rs_reset :
+		    SCHED_MIN_RUNTIME);
+		nvlist_add_uint32(njob, "restart-attempts",
+		    job->job_restart.rs_attempts);
+	}
+	if ((restart_at = sched_restart_pending(job)) != 0)
+		nvlist_add_uint64(njob, "restart-wait",
+		    restart_at > current_time ? restart_at - current_time : 0);
+	nvlist_add_uint32(njob, "stop-timeout", job->job_stop.sp_timeout ?
+	    job->job_stop.sp_timeout : SCHED_STOP_TIMEOUT);
+	stat_stop_signals(njob, job);
 
 	buf[0] = 0;
 	if (job->job_exit_action & ST_EXIT_RESTART)
@@ -777,13 +1015,59 @@ char		 buf[64];
 	else
 		nvlist_add_string(njob, "project", "default");
 
+	if (job->job_tz)
+		nvlist_add_string(njob, "tz", job->job_tz);
+	else
+		nvlist_add_string(njob, "tz", tz_name(tz_default()));
+
+	stat_deps(njob, job);
+	stat_runs(njob, job);
+
 	if (job->job_flags & JOB_SCHEDULED) {
 		nvlist_add_string(njob, "schedule",
-		    cron_to_string(&job->job_schedule));
+		    cron_to_string(job));
+
+		switch (job->job_catchup) {
+		case CATCHUP_SKIP:
+			nvlist_add_string(njob, "catchup", "skip");
+			break;
+		case CATCHUP_ONCE:
+			nvlist_add_string(njob, "catchup", "once");
+			break;
+		case CATCHUP_ALL:
+			nvlist_add_string(njob, "catchup", "all");
+			break;
+		default:
+			nvlist_add_string(njob, "catchup", "default");
+			break;
+		}
+		nvlist_add_uint32(njob, "catchup-max", job->job_catchup_max ?
+		    job->job_catchup_max : SCHED_CATCHUP_MAX);
+		if (job->job_lastrun)
+			nvlist_add_uint64(njob, "lastrun", job->job_lastrun);
+
+		switch (job->job_overlap) {
+		case OVERLAP_QUEUE:
+			nvlist_add_string(njob, "overlap", "queue");
+			break;
+		case OVERLAP_KILL:
+			nvlist_add_string(njob, "overlap", "kill");
+			break;
+		case OVERLAP_PARALLEL:
+			nvlist_add_string(njob, "overlap", "parallel");
+			break;
+		default:
+			nvlist_add_string(njob, "overlap", "skip");
+			break;
+		}
+		nvlist_add_uint32(njob, "skipped-runs",
+		    sched_skipped_runs(job));
+		if ((ninst = sched_instances(job)) != 0)
+			nvlist_add_uint32(njob, "instances", ninst);
 
 		if (job->job_flags & JOB_ENABLED)
 			nvlist_add_string(njob, "nextrun",
-			    cron_to_string_interval(&job->job_schedule));
+			    cron_to_string_interval(job));
 	}
 
 	nvlist_alloc(&resp, NV_UNIQUE_NAME, 0);
@@ -817,10 +1101,10 @@ set_stop_method(client, job, value)
 	job_t		*job;
 	nvpair_t	*value;
 {
-char	*method = NULL;
-	if (nvpair_type(value) == DATA_TYPE_BOOLEAN)
+char	*method = "";
+	if (nvpair_type(value) != DATA_TYPE_BOOLEAN_VALUE)
 		nvpair_value_string(value, &method);
-	if (job_set_start_method(job, method) == -1)
+	if (job_set_stop_method(job, method) == -1)
 		return jstrerror(errno);
 	return NULL;
 }
@@ -884,7 +1168,7 @@ set_project(client, job, value)
 	nvpair_t	*value;
 {
 char	*project;
-	if (nvpair_type(value) == DATA_TYPE_BOOLEAN)
+	if (nvpair_type(value) == DATA_TYPE_BOOLEAN_VALUE)
 		project = NULL;
 	else
 		nvpair_value_string(value, &project);
@@ -901,7 +1185,7 @@ set_logfmt(client, job, value)
 	nvpair_t	*value;
 {
 char	*fmt;
-	if (nvpair_type(value) == DATA_TYPE_BOOLEAN) {
+	if (nvpair_type(value) == DATA_TYPE_BOOLEAN_VALUE) {
 		if (job_set_logfmt(job, NULL) == -1)
 			return jstrerror(errno);
 		return NULL;
@@ -913,6 +1197,250 @@ char	*fmt;
 	return NULL;
 }
 
+static char const *
+set_tz(client, job, value)
+	ctl_client_t	*client;
+	job_t		*job;
+	nvpair_t	*value;
+{
+char	*tz;
+	if (nvpair_type(value) == DATA_TYPE_BOOLEAN_VALUE) {
+		if (job_set_tz(job, NULL) == -1)
+			return jstrerror(errno);
+		return NULL;
+	}
+
+	nvpair_value_string(value, &tz);
+	if (job_set_tz(job, tz) == -1)
+		return jstrerror(errno);
+	return NULL;
+}
+
+static char const *
+set_overlap(client, job, value)
+	ctl_client_t	*client;
+	job_t		*job;
+	nvpair_t	*value;
+{
+char		*v;
+overlap_t	 overlap;
+	if (nvpair_type(value) == DATA_TYPE_BOOLEAN_VALUE)
+		overlap = OVERLAP_SKIP;
+	else {
+		nvpair_value_string(value, &v);
+		if (strcmp(v, "skip") == 0)
+			overlap = OVERLAP_SKIP;
+		else if (strcmp(v, "queue") == 0)
+			overlap = OVERLAP_QUEUE;
+		else if (strcmp(v, "kill") == 0)
+			overlap = OVERLAP_KILL;
+		else if (strcmp(v, "parallel") == 0)
+			overlap = OVERLAP_PARALLEL;
+		else
+			return "Invalid overlap policy";
+	}
+
+	if (job_set_overlap(job, overlap) == -1)
+		return jstrerror(errno);
+	return NULL;
+}
+
+static char const *
+set_logstamp(client, job, value)
+	ctl_client_t	*client;
+	job_t		*job;
+	nvpair_t	*value;
+{
+char	*v;
+int	 stamp;
+	if (nvpair_type(value) == DATA_TYPE_BOOLEAN_VALUE)
+		stamp = 0;
+	else {
+		nvpair_value_string(value, &v);
+		if (strcmp(v, "on") == 0)
+			stamp = 1;
+		else if (strcmp(v, "off") == 0)
+			stamp = 0;
+		else
+			return "Invalid value for logstamp (must be on or off)";
+	}
+
+	if (job_set_logstamp(job, stamp) == -1)
+		return jstrerror(errno);
+	return NULL;
+}
+
+static char const *
+set_stop_timeout(client, job, value)
+	ctl_client_t	*client;
+	job_t		*job;
+	nvpair_t	*value;
+{
+stop_policy_t	 sp = job->job_stop;
+uint32_t	 n = 0;
+
+	if (nvpair_type(value) != DATA_TYPE_BOOLEAN_VALUE)
+		nvpair_value_uint32(value, &n);
+	if (n > INT_MAX)
+		return (jstrerror(EINVAL));
+	sp.sp_timeout = (int)n;
+
+	if (job_set_stop_policy(job, &sp) == -1)
+		return jstrerror(errno);
+	return NULL;
+}
+
+/*
+ * The value is a comma-separated list of signals, each after the first
+ * followed by ":" and the number of seconds after the stop began to send it,
+ * e.g. "TERM,INT:10,KILL:60".  Signals may be given with or without "SIG".
+ */
+static char const *
+set_stop_signals(client, job, value)
+	ctl_client_t	*client;
+	job_t		*job;
+	nvpair_t	*value;
+{
+stop_policy_t	 sp = job->job_stop;
+char		*v, *s, *p, *delay, *end;
+long		 n;
+
+	sp.sp_nsteps = 0;
+	if (nvpair_type(value) != DATA_TYPE_BOOLEAN_VALUE) {
+		nvpair_value_string(value, &v);
+		if ((v = strdup(v)) == NULL)
+			return "Out of memory";
+
+		for (s = strtok_r(v, ",", &p); s != NULL;
+		    s = strtok_r(NULL, ",", &p)) {
+		stop_step_t	*st = &sp.sp_steps[sp.sp_nsteps];
+			if (sp.sp_nsteps == JOB_MAX_STOP_STEPS) {
+				free(v);
+				return "Too many stop signals";
+			}
+
+			if ((delay = strchr(s, ':')) != NULL)
+				*delay++ = '\0';
+			if (strncasecmp(s, "SIG", 3) == 0)
+				s += 3;
+			if (str2sig(s, &st->ss_signo) == -1) {
+				free(v);
+				return "Invalid signal";
+			}
+
+			n = 0;
+			if (delay != NULL) {
+				n = strtol(delay, &end, 10);
+				if (*delay == '\0' || *end != '\0' || n < 0 ||
+				    n > INT_MAX) {
+					free(v);
+					return "Invalid signal delay";
+				}
+			}
+
+			/*LINTED*/
+			st->ss_delay = n;
+			sp.sp_nsteps++;
+		}
+
+		free(v);
+	}
+
+	if (job_set_stop_policy(job, &sp) == -1) {
+		if (errno == EINVAL)
+			return "Signal delays must start at 0 and increase";
+		return jstrerror(errno);
+	}
+	return NULL;
+}
+
+/*
+ * The value is a comma-separated list of FMRIs, each optionally followed by
+ * ":success" (the default), ":failure" or ":always".
+ */
+static char const *
+set_depends(client, job, value)
+	ctl_client_t	*client;
+	job_t		*job;
+	nvpair_t	*value;
+{
+char		*v, *list, *item, *last, *cond, *end;
+job_dep_t	*deps = NULL, *nd;
+int		 ndeps = 0;
+job_t		*dep;
+char const	*err = NULL;
+
+	if (nvpair_type(value) == DATA_TYPE_BOOLEAN_VALUE) {
+		if (job_set_deps(job, NULL, 0) == -1)
+			return jstrerror(errno);
+		return NULL;
+	}
+
+	nvpair_value_string(value, &v);
+	if ((list = strdup(v)) == NULL) {
+		logm(LOG_ERR, "out of memory");
+		return "Internal error";
+	}
+
+	for (item = strtok_r(list, ",", &last); item != NULL;
+	    item = strtok_r(NULL, ",", &last)) {
+		while (isspace(*item))
+			item++;
+		for (end = item + strlen(item); end > item &&
+		    isspace(end[-1]); --end)
+			;
+		*end = '\0';
+		if (*item == '\0')
+			continue;
+
+		if ((nd = xrecalloc(deps, ndeps, ndeps + 1,
+		    sizeof (*deps))) == NULL) {
+			logm(LOG_ERR, "out of memory");
+			err = "Internal error";
+			goto done;
+		}
+		deps = nd;
+		deps[ndeps].jd_cond = DEP_SUCCESS;
+
+		/*
+		 * FMRIs contain a ':' themselves, so only treat the last one
+		 * as a separator if a condition follows it.
+		 */
+		if ((cond = strrchr(item, ':')) != NULL) {
+			if (strcmp(cond + 1, "success") == 0)
+				*cond = '\0';
+			else if (strcmp(cond + 1, "failure") == 0) {
+				deps[ndeps].jd_cond = DEP_FAILURE;
+				*cond = '\0';
+			} else if (strcmp(cond + 1, "always") == 0) {
+				deps[ndeps].jd_cond = DEP_ALWAYS;
+				*cond = '\0';
+			}
+		}
+
+		if ((dep = ctl_find_job(client, item)) == NULL) {
+			err = jstrerror(errno);
+			goto done;
+		}
+
+		if (!client->cc_admin &&
+		    !job_access(dep, client->cc_name, JOB_VIEW)) {
+			err = "Permission denied";
+			goto done;
+		}
+
+		deps[ndeps++].jd_job = dep->job_id;
+	}
+
+	if (job_set_deps(job, deps, ndeps) == -1)
+		err = jstrerror(errno);
+
+done:
+	free(deps);
+	free(list);
+	return err;
+}
+
 static char const *
 set_logkeep(client, job, value)
 	ctl_client_t	*client;
@@ -926,6 +1454,83 @@ uint16_t	logkeep;
 	return NULL;
 }
 
+static char const *
+set_restart(client, job, value)
+	ctl_client_t	*client;
+	job_t		*job;
+	nvpair_t	*value;
+{
+restart_policy_t	 rs = job->job_restart;
+char const		*name = nvpair_name(value);
+uint32_t		 n = 0;
+int			*field;
+
+	if (strcmp(name, "restart-delay") == 0)
+		field = &rs.rs_delay;
+	else if (strcmp(name, "restart-backoff") == 0)
+		field = &rs.rs_backoff;
+	else if (strcmp(name, "restart-max-delay") == 0)
+		field = &rs.rs_max_delay;
+	else if (strcmp(name, "restart-reset") == 0)
+		field = &rs.rs_reset;
+	else
+		field = &rs.rs_attempts;
+
+	if (nvpair_type(value) != DATA_TYPE_BOOLEAN_VALUE)
+		nvpair_value_uint32(value, &n);
+	if (n > INT_MAX)
+		return (jstrerror(EINVAL));
+	*field = (int)n;
+
+	if (job_set_restart_policy(job, &rs) == -1)
+		return jstrerror(errno);
+	return NULL;
+}
+
+static char const *
+set_catchup(client, job, value)
+	ctl_client_t	*client;
+	job_t		*job;
+	nvpair_t	*value;
+{
+char		*v;
+catchup_t	 policy;
+	if (nvpair_type(value) == DATA_TYPE_BOOLEAN_VALUE)
+		policy = CATCHUP_DEFAULT;
+	else {
+		nvpair_value_string(value, &v);
+		if (strcmp(v, "skip") == 0)
+			policy = CATCHUP_SKIP;
+		else if (strcmp(v, "once") == 0)
+			policy = CATCHUP_ONCE;
+		else if (strcmp(v, "all") == 0)
+			policy = CATCHUP_ALL;
+		else
+			return "Invalid catch-up policy";
+	}
+
+	if (job_set_catchup(job, policy, job->job_catchup_max) == -1)
+		return jstrerror(errno);
+	return NULL;
+}
+
+static char const *
+set_catchup_max(client, job, value)
+	ctl_client_t	*client;
+	job_t		*job;
+	nvpair_t	*value;
+{
+uint32_t	max = 0;
+	if (nvpair_type(value) != DATA_TYPE_BOOLEAN_VALUE)
+		nvpair_value_uint32(value, &max);
+	if (max > INT_MAX)
+		return (jstrerror(EINVAL));
+
+	if (job_set_catchup(job, job->job_catchup, (int)max) == -1)
+		return jstrerror(errno);
+	return NULL;
+}
+
 static char const *
 set_logsize(client, job, value)
 	ctl_client_t	*client;
@@ -1048,7 +1653,20 @@ struct props {
 	{ "name",	DATA_TYPE_STRING,	set_name,		0 },
 	{ "project",	DATA_TYPE_STRING,	set_project,		1 },
 	{ "logfmt",	DATA_TYPE_STRING,	set_logfmt,		1 },
+	{ "tz",		DATA_TYPE_STRING,	set_tz,			1 },
 	{ "logkeep",	DATA_TYPE_UINT16,	set_logkeep,		0 },
+	{ "logstamp",	DATA_TYPE_STRING,	set_logstamp,		1 },
+	{ "restart-delay",	DATA_TYPE_UINT32,	set_restart,	1 },
+	{ "restart-backoff",	DATA_TYPE_UINT32,	set_restart,	1 },
+	{ "restart-max-delay",	DATA_TYPE_UINT32,	set_restart,	1 },
+	{ "restart-reset",	DATA_TYPE_UINT32,	set_restart,	1 },
+	{ "restart-attempts",	DATA_TYPE_UINT32,	set_restart,	1 },
+	{ "catchup",	DATA_TYPE_STRING,	set_catchup,		1 },
+	{ "catchup-max",	DATA_TYPE_UINT32,	set_catchup_max,	1 },
+	{ "depends",	DATA_TYPE_STRING,	set_depends,		1 },
+	{ "overlap",	DATA_TYPE_STRING,	set_overlap,		1 },
+	{ "stop-timeout",	DATA_TYPE_UINT32,	set_stop_timeout,	1 },
+	{ "stop-signals",	DATA_TYPE_STRING,	set_stop_signals,	1 },
 	{ "logsize",	DATA_TYPE_UINT64,	set_logsize,		0 },
 	{ "exit",	DATA_TYPE_STRING,	set_exit,		0 },
 	{ "fail",	DATA_TYPE_STRING,	set_fail,		0 },
@@ -1133,6 +1751,9 @@ ctl_close(client)
 	if (unregister_fd(client->cc_fd, FDE_BOTH) == -1)
 		logm(LOG_WARNING, "ctl_close: unregister_fd failed");
 
+	if (client->cc_forecast)
+		forecast_cancel(client->cc_forecast);
+
 	free(client->cc_name);
 	close_fd(client->cc_fd);
 
@@ -1196,20 +1817,183 @@ nvlist_t *resp;
 
 	nvlist_alloc(&resp, NV_UNIQUE_NAME, 0);
 	while ((pair = nvlist_next_nvpair(opts, pair)) != NULL) {
-		if (strcmp(nvpair_name(pair), "jobs-per-user") == 0) {
-		int	njobs;
-			if ((njobs = quota_get_jobs_per_user()) == -1) {
-				(void) ctl_error(client, jstrerror(errno));
-				return;
-			} else {
-				nvlist_add_uint32(resp, "jobs-per-user", njobs);
-			}
+	char const	*name = nvpair_name(pair);
+	int		 n;
+		if (strcmp(name, "jobs-per-user") == 0)
+			n = quota_get_jobs_per_user();
+		else if (strcmp(name, "max-running") == 0)
+			n = quota_get_running();
+		else if (strcmp(name, "max-running-per-user") == 0)
+			n = quota_get_running_per_user();
+		else if (strncmp(name, "share:", 6) == 0 && name[6])
+			n = quota_get_share(name + 6);
+		else if (strcmp(name, "shutdown-timeout") == 0) {
+			if ((n = config_get_shutdown_timeout()) == 0)
+				n = SCHED_SHUTDOWN_TIMEOUT;
 		} else {
 			(void) ctl_error(client, "Invalid parameter");
+			nvlist_free(resp);
+			return;
+		}
+
+		if (n == -1) {
+			(void) ctl_error(client, jstrerror(errno));
+			nvlist_free(resp);
+			return;
 		}
+
+		nvlist_add_uint32(resp, name, n);
+	}
+	(void) ctl_send_nvlist(client, resp);
+	nvlist_free(resp);
+}
+
+/*
+ * Return the number of jobs in each run state, for the whole system and for a
+ * single user.
+ */
+static void
+c_status(client, job, args)
+	ctl_client_t	*client;
+	job_t		*job;
+	nvlist_t	*args;
+{
+nvlist_t	*resp, *all, *user;
+char		*name;
+int		 limit;
+job_user_t const *ju;
+	(void) job;
+
+	if (nvlist_lookup_string(args, "user", &name))
+		name = client->cc_name;
+	else if (!client->cc_admin && strcmp(name, client->cc_name)) {
+		(void) ctl_error(client, "Permission denied");
+		return;
+	}
+
+	nvlist_alloc(&all, NV_UNIQUE_NAME, 0);
+	nvlist_add_uint32(all, "running",
+	    sched_count(SCHEDTAB_STATE(SJOB_RUNNING), NULL));
+	nvlist_add_uint32(all, "stopping",
+	    sched_count(SCHEDTAB_STATE(SJOB_STOPPING), NULL));
+	nvlist_add_uint32(all, "stopped",
+	    sched_count(SCHEDTAB_STATE(SJOB_STOPPED), NULL));
+	nvlist_add_uint32(all, "queued",
+	    sched_count(SCHEDTAB_STATE(SJOB_QUEUED), NULL));
+	if ((limit = quota_get_running()) > 0)
+		nvlist_add_uint32(all, "limit", limit);
+	nvlist_add_uint32(all, "pending-starts", sched_pace_pending());
+
+	nvlist_alloc(&user, NV_UNIQUE_NAME, 0);
+	nvlist_add_string(user, "name", name);
+	nvlist_add_uint32(user, "running",
+	    sched_count(SCHEDTAB_STATE(SJOB_RUNNING), name));
+	nvlist_add_uint32(user, "stopping",
+	    sched_count(SCHEDTAB_STATE(SJOB_STOPPING), name));
+	nvlist_add_uint32(user, "stopped",
+	    sched_count(SCHEDTAB_STATE(SJOB_STOPPED), name));
+	nvlist_add_uint32(user, "queued",
+	    sched_count(SCHEDTAB_STATE(SJOB_QUEUED), name));
+	if ((limit = quota_get_running_per_user()) > 0)
+		nvlist_add_uint32(user, "limit", limit);
+	if ((ju = find_job_user(name)) != NULL) {
+		nvlist_add_uint32(user, "share", ju->ju_share);
+		nvlist_add_uint64(user, "usage", (uint64_t)job_user_usage(ju));
+	}
+
+	nvlist_alloc(&resp, NV_UNIQUE_NAME, 0);
+	nvlist_add_nvlist(resp, "all", all);
+	nvlist_add_nvlist(resp, "user", user);
+	(void) ctl_send_nvlist(client, resp);
+	nvlist_free(resp);
+	nvlist_free(user);
+	nvlist_free(all);
+}
+
+/*
+ * Return every time a job the client can see is due to start in a window,
+ * and how many starts fall in each minute of it.  The reply is sent from
+ * forecast_done() once the forecast has been worked out.
+ */
+static void
+c_forecast(client, job, args)
+	ctl_client_t	*client;
+	job_t		*job;
+	nvlist_t	*args;
+{
+uint64_t	 start;
+uint32_t	 window, limit;
+char		*user;
+	(void) job;
+
+	if (client->cc_forecast) {
+		(void) ctl_error(client, "Forecast already in progress");
+		return;
+	}
+
+	if (nvlist_lookup_uint64(args, "start", &start))
+		start = current_time;
+	if (nvlist_lookup_uint32(args, "window", &window))
+		window = FORECAST_DEFAULT_WINDOW;
+	if (nvlist_lookup_uint32(args, "limit", &limit))
+		limit = FORECAST_DEFAULT_LIMIT;
+	if (nvlist_lookup_string(args, "user", &user))
+		user = NULL;
+
+	if (window == 0 || window > FORECAST_MAX_WINDOW) {
+		(void) ctl_error(client, "Invalid forecast window");
+		return;
+	}
+
+	if (limit > FORECAST_MAX_LIMIT) {
+		(void) ctl_error(client, "Invalid forecast limit");
+		return;
+	}
+
+	/*
+	 * A negative time from the client arrives as a very large start; both
+	 * it and the end of the window must fit in a time_t.
+	 */
+	if (start > (uint64_t)(LONG_MAX - FORECAST_MAX_WINDOW)) {
+		(void) ctl_error(client, "Invalid forecast start");
+		return;
+	}
+
+	if ((client->cc_forecast = forecast_start((time_t)start, window, limit,
+	    user, client->cc_admin ? NULL : client->cc_name,
+	    forecast_done, client)) == NULL)
+		(void) ctl_error(client, jstrerror(errno));
+}
+
+static void
+forecast_done(res, udata)
+	forecast_result_t const	*res;
+	void			*udata;
+{
+ctl_client_t	*client = udata;
+nvlist_t	*resp;
+
+	client->cc_forecast = NULL;
+
+	if (nvlist_alloc(&resp, NV_UNIQUE_NAME, 0)) {
+		(void) ctl_error(client, "Internal error");
+		goto done;
 	}
+
+	nvlist_add_uint64(resp, "start", (uint64_t)res->fr_start);
+	nvlist_add_uint32(resp, "window", (uint32_t)res->fr_window);
+	nvlist_add_uint64(resp, "total", res->fr_total);
+	nvlist_add_uint32(resp, "jobs", res->fr_njobs);
+	nvlist_add_uint64_array(resp, "times", res->fr_times, res->fr_nfires);
+	nvlist_add_string_array(resp, "fmris", res->fr_fmris, res->fr_nfires);
+	nvlist_add_uint32_array(resp, "histogram", res->fr_histogram,
+	    res->fr_nminutes);
 	(void) ctl_send_nvlist(client, resp);
 	nvlist_free(resp);
+
+done:
+	if (client->cc_state == DEAD)
+		ctl_close(client);
 }
 
 static void
@@ -1235,19 +2019,42 @@ nvlist_t	*opts;
 
 	if (nvlist_lookup_nvlist(args, "opts", &opts)) {
 		(void) ctl_error(client, "Invalid request");
+		nvlist_free(resp);
 		return;
 	}
 
 	while ((pair = nvlist_next_nvpair(opts, pair)) != NULL) {
-		if (strcmp(nvpair_name(pair), "jobs-per-user") == 0) {
-		uint32_t	njobs;
-			if (nvlist_lookup_uint32(args, "jobs-per-user", &njobs)) {
-				nvlist_add_string(resp, "jobs-per-user", "Invalid type");
-			if (quota_set_jobs_per_user((int) njobs) == -1)
-				nvlist_add_string(resp, "jobs-per-user", jstrerror(errno));
-			}
+	char const	*name = nvpair_name(pair);
+	uint32_t	 n;
+	int		 ret;
+		if (nvpair_value_uint32(pair, &n)) {
+			nvlist_add_string(resp, name, "Invalid type");
+			continue;
+		}
+
+		if (strcmp(name, "jobs-per-user") == 0)
+			ret = quota_set_jobs_per_user((int) n);
+		else if (strcmp(name, "max-running") == 0)
+			ret = quota_set_running((int) n);
+		else if (strcmp(name, "max-running-per-user") == 0)
+			ret = quota_set_running_per_user((int) n);
+		else if (strncmp(name, "share:", 6) == 0 && name[6])
+			ret = quota_set_share(name + 6, (int) n);
+		else if (strcmp(name, "shutdown-timeout") == 0)
+			ret = config_set_shutdown_timeout((int) n);
+		else {
+			nvlist_add_string(resp, name, "Invalid parameter");
+			continue;
 		}
-	} 
+
+		if (ret == -1)
+			nvlist_add_string(resp, name, jstrerror(errno));
+	}
+
+	/*
+	 * If a run limit was raised, queued jobs may be able to start now.
+	 */
+	sched_admit();
 
 	(void) ctl_send_nvlist(client, resp);
 	nvlist_free(resp);
@@ -1261,6 +2068,15 @@ c_start(client, job, args)
 {
 	(void) args;
 
+	/*
+	 * Only scheduled jobs and jobs with dependencies can be started by
+	 * hand; other jobs are started by enabling them.
+	 */
+	if (!(job->job_flags & JOB_SCHEDULED) && job->job_ndeps == 0) {
+		(void) ctl_error(client, jstrerror(JENOT_SCHEDULED));
+		return;
+	}
+
 	if (sched_start(job) == -1)
 		(void) ctl_error(client, jstrerror(errno));
 	else
@@ -3,550 +3,364 @@
  * Use is subject to license terms.
  */
 
-#include	<sys/task.h>
+#include	<sys/types.h>
 
 #include	<stdio.h>
 #include	<stdlib.h>
-#include	<deflt.h>
-#include	<project.h>
 #include	<string.h>
-#include	<pwd.h>
 #include	<fcntl.h>
 #include	<unistd.h>
 #include	<errno.h>
 #include	<assert.h>
-#include	<alloca.h>
-#include	<grp.h>
-#include	<rctl.h>
-#include	<strings.h>
-#include	<ctype.h>
+#include	<signal.h>
+#include	<spawn.h>
 
 #include	"execute.h"
+#include	"joblog.h"
 #include	"jobserver.h"
+#include	"fd.h"
 
-static int fork_logwriter(char const *, size_t, int);
-static int load_environment(char ***, int, char const *);
-static char *logfmt(char const *fmt, job_t *);
+/* "process.", the name, "=" and the value */
+#define	RCTL_ARG_SIZE	(sizeof (((job_rctl_t *)0)->jr_name) + 40)
 
 /*
- * Set standard environment, and load user-defined environment from
- * $HOME/.environment.  This is executed as the target user.
+ * Start a program with posix_spawn(), with stdin from 'infd', stdout and
+ * stderr to 'outfd' (either of which is /dev/null if it's -1), and the
+ * environment 'envp' (or an empty one if it's NULL).  Unlike fork(), this
+ * doesn't copy the daemon's address space, so its cost doesn't grow with the
+ * number of jobs.  The program must close any other descriptors it inherits.
  */
-static int
-load_environment(env, i, file)
-	char		***env;
-	int		  i;
-	char const	 *file;
+pid_t
+spawn_program(path, argv, envp, infd, outfd)
+	char const		*path;
+	char const *const	*argv;
+	char const *const	*envp;
+	int			 infd, outfd;
 {
-FILE	*inf;
-char	 line[4096];
-char	*path;
-char	**np = *env;
-
-	if ((inf = fopen(file, "r")) == NULL)
-		return (-1);
-
-	if (defopen(DEFLT "/login") == -1 || (path = defread("PATH=")) == NULL)
-		path = "/usr/bin:";
-
-	if ((np = xrecalloc(np, i, i + 1, sizeof (char **))) == NULL)
+posix_spawn_file_actions_t	 fa;
+posix_spawnattr_t		 attr;
+sigset_t			 sigs;
+pid_t				 pid;
+int				 err;
+static char			*env[] = { NULL };
+
+	if ((err = posix_spawn_file_actions_init(&fa)) != 0) {
+		errno = err;
 		return (-1);
+	}
 
-	if (asprintf(&np[i++], "PATH=%s", path) == -1)
+	if ((err = posix_spawnattr_init(&attr)) != 0) {
+		(void) posix_spawn_file_actions_destroy(&fa);
+		errno = err;
 		return (-1);
-
-	while (fgets(line, sizeof (line), inf) != NULL) {
-	char	*k = line;
-
-		while (*k == ' ')
-			k++;
-
-		if (!*k || *k == '#')
-			continue;
-
-		if ((np = xrecalloc(np, i, i + 2, sizeof (char *))) == NULL)
-			return (-1);
-		np[i++] = strdup(k);
-		np[i] = NULL;
-		*env = np;
 	}
 
-	(void) fclose(inf);
-	return (0);
-}
-
-/*
- * Set up resource controls defined in the job.
- */
-static void
-set_rctls(job)
-	job_t	*job;
-{
-int		 i;
-rctlblk_t	*blk = alloca(rctlblk_size()), *blk2 = alloca(rctlblk_size());
-
-	for (i = 0; i < job->job_nrctls; ++i) {
-	job_rctl_t	*r = &job->job_rctls[i];
-	char		 rname[64];
-	int		 i;
-
-		/*
-		 * Get the existing rctl data, then modify it.  This means
-		 * we don't have to know e.g. what signal should be delivered
-		 * for deny action.
-		 */
-
-		if (strcmp(r->jr_name, "max-cpu-time") == 0)
-			(void) snprintf(rname, sizeof (rname),
-					"task.%s", r->jr_name);
-		else
-			(void) snprintf(rname, sizeof (rname),
-					"process.%s", r->jr_name);
-
-		for (i = getrctl(rname, NULL, blk, RCTL_FIRST);
-			i != -1;
-			i = getrctl(rname, blk, blk, RCTL_NEXT))
-		{
-			if (rctlblk_get_privilege(blk) == RCPRIV_BASIC)
-				break;
-		}
+	/*
+	 * The daemon and the launcher ignore several signals (the launcher
+	 * ignores SIGINT and SIGTERM too), and ignored signals stay ignored
+	 * across exec, where a shell can't even trap them again.  Give the
+	 * program the default for everything.
+	 */
+	(void) sigfillset(&sigs);
+	(void) sigdelset(&sigs, SIGKILL);
+	(void) sigdelset(&sigs, SIGSTOP);
+	(void) posix_spawnattr_setsigdefault(&attr, &sigs);
+	(void) sigemptyset(&sigs);
+	(void) posix_spawnattr_setsigmask(&attr, &sigs);
+	(void) posix_spawnattr_setflags(&attr,
+	    POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK);
+
+	if (infd == -1)
+		err = posix_spawn_file_actions_addopen(&fa, STDIN_FILENO,
+		    "/dev/null", O_RDONLY, 0);
+	else
+		err = posix_spawn_file_actions_adddup2(&fa, infd,
+		    STDIN_FILENO);
+	if (err == 0 && outfd == -1)
+		err = posix_spawn_file_actions_addopen(&fa, STDOUT_FILENO,
+		    "/dev/null", O_WRONLY, 0);
+	else if (err == 0)
+		err = posix_spawn_file_actions_adddup2(&fa, outfd,
+		    STDOUT_FILENO);
+	if (err == 0)
+		err = posix_spawn_file_actions_adddup2(&fa, STDOUT_FILENO,
+		    STDERR_FILENO);
 
-		if (i == -1 && errno == ENOENT) {
-			rctlblk_set_privilege(blk, RCPRIV_BASIC);
-			rctlblk_set_value(blk, r->jr_value);
-
-			if (setrctl(rname, NULL, blk, RCTL_INSERT) == -1)
-				(void) printf("[ setrctl(%s, %llu) "
-						"failed: %s ]\n",
-						rname,
-						(u_longlong_t)r->jr_name,
-						strerror(errno));
-			continue;
-		}
+	/*
+	 * This does not break const correctness, since posix_spawn() is only
+	 * missing the appropriate 'const' qualifier for historical reasons.
+	 */
+	if (err == 0)
+		err = posix_spawn(&pid, path, &fa, &attr, (char *const *)argv,
+		    envp ? (char *const *)envp : env);
 
-		if (i == -1) {
-			(void) printf("[ getrctl(%s) failed: %s ]\n",
-					rname, strerror(errno));
-			continue;
-		}
+	(void) posix_spawnattr_destroy(&attr);
+	(void) posix_spawn_file_actions_destroy(&fa);
 
-		bcopy(blk, blk2, rctlblk_size());
-		rctlblk_set_value(blk2, r->jr_value);
-		if (setrctl(rname, blk, blk2, RCTL_REPLACE) == -1) {
-			(void) printf("[ setrctl(%s, %llu) failed: %s ]\n",
-					rname, (u_longlong_t)r->jr_name,
-					strerror(errno));
-			continue;
-		}
+	if (err != 0) {
+		errno = err;
+		return (-1);
 	}
+
+	return (pid);
 }
 
 /*
- * Turn an FMRI into a name suitable for a job log.
+ * Start JOBEXEC with an empty environment, and write 'envp' to its stdin, one
+ * NUL-terminated entry after another, then an empty entry to mark the end.
+ * JOBEXEC is root until it becomes the user, and the runtime linker honours
+ * LD_PRELOAD and the like for anything that isn't set-id, so the user's
+ * ~/.environment mustn't be its own environment; it installs 'envp' only for
+ * the job's command.
  */
-static char *
-log_name(fmri)
-	char const	*fmri;
+pid_t
+spawn_jobexec(argv, envp, outfd)
+	char const *const	*argv;
+	char const *const	*envp;
+	int			 outfd;
 {
+int		 pfd[2] = { -1, -1 }, err;
 char const	*p;
-char		*n, *m;
-
-	p = fmri;
-	/* Skip the job:/ */
-	p += 5;
-	/* Skip the username */
-	if ((p = index(p, '/')) == NULL) {
-		logm(LOG_ERR, "log_name: mal-formed FMRI");
-		return (NULL);
-	}
-
-	if ((n = strdup(p + 1)) == NULL) {
-		logm(LOG_ERR, "log_name: out of memory");
-		return (NULL);
-	}
-
-	for (m = n; *m; ++m)
-		if (!isalnum(*m) && !index("-_", *m))
-			*m = '_';
-
-	return (n);
-}
-
-static void
-start_job(job, cmd)
-	job_t		*job;
-	char const	*cmd;
-{
-char		 *envfile;
-char		**env;
-int		  i = 0;
-struct passwd	 *pwd;
-int		  devnullfd;
-struct project	  proj;
-char		  nssbuf[PROJECT_BUFSZ];
-int		  logfd;
-char		  tbuf[64];
-struct tm	 *tm;
-int		  lwfd;
-char		 *logfile;
-char		 *s, *p;
-
-	if (job->job_logfmt)
-		logfile = logfmt(job->job_logfmt, job);
-	else
-		logfile = logfmt(DEFAULT_LOGFMT, job);
+size_t		 left;
+ssize_t		 n;
+pid_t		 pid;
 
-	if (logfile == NULL) {
-		logm(LOG_ERR, "start_job: could not create log format");
-		_exit(1);
-	}
-
-	if ((pwd = getpwnam(job->job_username)) == NULL) {
-		logm(LOG_ERR, "start_job: user %s doesn't exist",
-				job->job_username);
-		_exit(1);
-	}
+	if (envp && pipe(pfd) == -1)
+		return (-1);
 
 	/*
-	 * Ideally, all of this output would go to the logfile, but we can't
-	 * open the logfile as root.
+	 * JOBEXEC closes everything but its stdio, but nothing else we start
+	 * should have the write end either.
 	 */
-	if (getdefaultproj(pwd->pw_name, &proj,
-				nssbuf, sizeof (nssbuf)) == NULL) {
-		logm(LOG_ERR, "start_job: getdefaultproj: %s", strerror(errno));
-		_exit(1);
-	}
-
-	if (setproject(proj.pj_name, pwd->pw_name, TASK_NORMAL) != 0) {
-		logm(LOG_ERR, "start_job: setproject: %s", strerror(errno));
-		_exit(1);
-	}
-
-	if (job->job_project) {
-		if (inproj(pwd->pw_name, job->job_project,
-				nssbuf, sizeof (nssbuf))) {
-			/*
-			 * Don't error out here... it might be some kind of
-			 * transient issue.
-			 */
-			if (setproject(job->job_project,
-					pwd->pw_name, TASK_NORMAL) != 0)
-				logm(LOG_ERR, "start_job: setproject: %s",
-						strerror(errno));
-		} else {
-			logm(LOG_ERR, "Warning: user \"%s\" is not "
-					"a member of project \"%s\"",
-					pwd->pw_name, job->job_project);
-		}
-	}
-
-	if (initgroups(pwd->pw_name, pwd->pw_gid) == -1) {
-		logm(LOG_ERR, "start_job: initgroups: %s", strerror(errno));
-		_exit(1);
-	}
-
-	if (setgid(pwd->pw_gid) == -1) {
-		logm(LOG_ERR, "start_job: setgid: %s", strerror(errno));
-		_exit(1);
+	if (envp && fd_set_cloexec(pfd[1], 1) == -1) {
+		err = errno;
+		(void) close(pfd[0]);
+		(void) close(pfd[1]);
+		errno = err;
+		return (-1);
 	}
 
-	if (setuid(pwd->pw_uid) == -1) {
-		logm(LOG_ERR, "start_job: setuid: %s", strerror(errno));
-		_exit(1);
-	}
+	pid = spawn_program(JOBEXEC, argv, NULL, pfd[0], outfd);
+	err = errno;
+	if (envp == NULL)
+		return (pid);
 
-	if ((devnullfd = open("/dev/null", O_RDONLY)) == -1) {
-		logm(LOG_ERR, "start_job: /dev/null: %s", strerror(errno));
-		_exit(1);
+	(void) close(pfd[0]);
+	if (pid == -1) {
+		(void) close(pfd[1]);
+		errno = err;
+		return (-1);
 	}
 
 	/*
-	 * This is like mkdir -p.
+	 * If this fails, JOBEXEC doesn't see the end marker, and doesn't start
+	 * the job.
 	 */
-	s = p = logfile + 1;
-	if (*logfile == '/') {
-		if (chdir("/") == -1) {
-			logm(LOG_ERR, "chdir(/): %s", strerror(errno));
-			_exit(1);
-		}
-	} else {
-		if (chdir(pwd->pw_name) == -1) {
-			logm(LOG_ERR, "chdir(%s): %s",
-					pwd->pw_name, strerror(errno));
-			_exit(1);
-		}
-	}
-
-	while ((s = index(p, '/')) != NULL) {
-		*s = 0;
-		if (mkdir(p, 0700) == -1 && errno != EEXIST) {
-			logm(LOG_ERR, "mkdir(%s): %s", p, strerror(errno));
-			_exit(1);
-		}
-
-		if (chdir(p) == -1) {
-			logm(LOG_ERR, "chdir(%s): %s", p, strerror(errno));
-			_exit(1);
+	for (; ; ++envp) {
+		p = *envp ? *envp : "";
+		for (left = strlen(p) + 1; left; p += n, left -= n) {
+			if ((n = write(pfd[1], p, left)) == -1) {
+				if (errno == EINTR) {
+					n = 0;
+					continue;
+				}
+				logm(LOG_ERR, "spawn_jobexec: cannot write "
+				    "environment: %s", strerror(errno));
+				goto done;
+			}
 		}
 
-		*s++ = '/';
-		p = s;
+		if (*envp == NULL)
+			break;
 	}
 
-	/*LINTED*/
-	if ((logfd = open(logfile, O_RDWR | O_CREAT | O_APPEND, 0600)) == -1) {
-		logm(LOG_ERR, "fork_execute: %s: %s", logfile, strerror(errno));
-		_exit(1);
-	}
+done:
+	(void) close(pfd[1]);
+	return (pid);
+}
 
-	if (dup2(devnullfd, STDIN_FILENO) == -1 ||
-	    dup2(logfd, STDOUT_FILENO) == -1 ||
-	    dup2(logfd, STDERR_FILENO) == -1) {
-		_exit(1);
-	}
+/*
+ * Build the JOBEXEC command line to run 'cmd' as the job's user.  The work of
+ * becoming the user and setting up the job's environment is done by JOBEXEC.
+ * If there's a launch plan, JOBEXEC is given its results, and doesn't have to
+ * look anything up.
+ */
+char **
+jobexec_argv(job, plan, cmd)
+	job_t			*job;
+	launch_plan_t const	*plan;
+	char const		*cmd;
+{
+char const	**argv;
+char		**ret = NULL, *p;
+char		 *rctls = NULL, *creds = NULL;
+int		  i, n = 0;
+size_t		  sz;
 
-	(void) close(logfd);
-	(void) close(devnullfd);
+	assert(cmd);
 
-	if (chdir(pwd->pw_dir) == -1) {
-		(void) printf("[ chdir(%s): %s ]\n",
-				pwd->pw_dir, strerror(errno));
-		(void) printf("[ Job start aborted. ]\n");
-		_exit(1);
+	if ((argv = calloc(24 + job->job_nrctls * 2, sizeof (*argv))) == NULL ||
+	    (job->job_nrctls && (rctls = calloc(job->job_nrctls,
+	    RCTL_ARG_SIZE)) == NULL) ||
+	    (plan && (creds = calloc(plan->lp_ngroups + 1, 12)) == NULL)) {
+		logm(LOG_ERR, "jobexec_argv: out of memory");
+		goto err;
 	}
 
-	if ((env = calloc(5, sizeof (char **))) == NULL) {
-		(void) printf("[ Out of memory. ]\n");
-		(void) printf("[ Job start aborted. ]\n");
-		_exit(1);
+	argv[n++] = "jobexec";
+	argv[n++] = "-u";
+	argv[n++] = job->job_username;
+
+	if (plan) {
+		(void) sprintf(creds, "%ld", (long)plan->lp_uid);
+		for (i = 0; i < plan->lp_ngroups; ++i)
+			(void) sprintf(creds + strlen(creds), ",%ld",
+			    (long)plan->lp_groups[i]);
+		argv[n++] = "-c";
+		argv[n++] = creds;
+		argv[n++] = "-d";
+		argv[n++] = plan->lp_home;
+		argv[n++] = "-j";
+		argv[n++] = plan->lp_project;
+		argv[n++] = "-e";
+		if (plan->lp_readenv)
+			argv[n++] = "-E";
+	} else if (job->job_project) {
+		argv[n++] = "-p";
+		argv[n++] = job->job_project;
 	}
 
-	set_rctls(job);
-
-	(void) asprintf(&env[i++], "HOME=%s", pwd->pw_dir);
-	(void) asprintf(&env[i++], "LOGNAME=%s", pwd->pw_name);
-	(void) asprintf(&env[i++], "USER=%s", pwd->pw_name);
-	(void) asprintf(&env[i++], "SHELL=%s", pwd->pw_shell);
+	/*
+	 * rctls are given by their full names.
+	 */
+	for (i = 0; i < job->job_nrctls; ++i) {
+	char	*r = rctls + i * RCTL_ARG_SIZE;
+		(void) snprintf(r, RCTL_ARG_SIZE, "%s.%s=%llu",
+		    strcmp(job->job_rctls[i].jr_name, "max-cpu-time") ?
+		    "process" : "task", job->job_rctls[i].jr_name,
+		    (u_longlong_t)job->job_rctls[i].jr_value);
+		argv[n++] = "-r";
+		argv[n++] = r;
+	}
 
-	env[i] = NULL;
+	argv[n++] = "--";
+	argv[n++] = cmd;
 
-	(void) asprintf(&envfile, "%s/.environment", pwd->pw_dir);
-	(void) load_environment(&env, i, envfile);
+	/*
+	 * Copy the arguments into a single block, so the caller doesn't need
+	 * to know what was allocated.
+	 */
+	sz = (n + 1) * sizeof (*ret);
+	for (i = 0; i < n; ++i)
+		sz += strlen(argv[i]) + 1;
 
-	if ((lwfd = fork_logwriter(logfile, job->job_logsize,
-	    job->job_logkeep)) == -1) {
-		(void) printf("[ Cannot start logwriter: %s. ]\n",
-				strerror(errno));
-		(void) printf("[ Job start aborted. ]\n");
-		_exit(1);
+	if ((ret = malloc(sz)) == NULL) {
+		logm(LOG_ERR, "jobexec_argv: out of memory");
+		goto err;
 	}
 
-	if (dup2(lwfd, STDOUT_FILENO) == -1 ||
-	    dup2(lwfd, STDERR_FILENO) == -1) {
-		_exit(1);
+	p = (char *)(ret + n + 1);
+	for (i = 0; i < n; ++i) {
+		ret[i] = p;
+		(void) strcpy(p, argv[i]);
+		p += strlen(p) + 1;
 	}
+	ret[n] = NULL;
 
-	(void) close(lwfd);
-	tm = localtime(&current_time);
-	(void) strftime(tbuf, sizeof (tbuf), "%Y-%m-%d %H:%M:%S", tm);
-
-	(void) printf("[ %s: Executing command \"%s\" ]\n",
-			tbuf, cmd);
-	(void) fflush(stdout);
-
-	(void) execle("/usr/xpg4/bin/sh", "sh", "-c", cmd, NULL, env);
-
-	(void) printf("[ Failed: %s ]\n", strerror(errno));
-	(void) fflush(stdout);
-
-	_exit(1);
+err:
+	free(argv);
+	free(rctls);
+	free(creds);
+	return (ret);
 }
 
 /*
- * Execute a program as a specific user.
+ * Execute a program as a specific user, with its output collected by the
+ * daemon.
  */
 pid_t
 fork_execute(job, cmd)
 	job_t		*job;
 	char const	*cmd;
 {
-pid_t	pid;
-	assert(cmd);
-
-	switch (pid = fork()) {
-	case -1:
-		logm(LOG_ERR, "fork failed: %s", strerror(errno));
-		goto err;
-
-	case 0:
-		/* Doesn't return */
-		start_job(job, cmd);
+launch_plan_t const	 *plan = plan_get(job);
+char			**argv, *file;
+joblog_t		 *jl = NULL;
+uid_t			  uid;
+gid_t			  gid;
+pid_t			  pid;
+int			  wfd = -1, err;
+
+	if ((argv = jobexec_argv(job, plan, cmd)) == NULL)
+		return (-1);
 
-	default:
-		break;
+	if ((file = joblog_file(job, plan, &uid, &gid)) != NULL) {
+		jl = joblog_new(file, uid, gid, job->job_logsize,
+		    job->job_logkeep, job->job_logstamp, &wfd);
+		err = errno;
+		free(file);
+		if (jl == NULL) {
+			logm(LOG_ERR, "fork_execute: cannot create log "
+			    "collector: %s", strerror(err));
+			free(argv);
+			errno = err;
+			return (-1);
+		}
 	}
 
-	return (pid);
-
-err:
-	return (-1);
-}
+	if ((pid = spawn_jobexec((char const *const *)argv,
+	    plan ? (char const *const *)plan->lp_env : NULL, wfd)) == -1)
+		logm(LOG_ERR, "fork_execute: cannot start %s: %s", JOBEXEC,
+		    strerror(errno));
 
-static int
-fork_logwriter(file, maxsize, keep)
-	char const	*file;
-	size_t		 maxsize;
-	int		 keep;
-{
-char	maxs[32], keeps[16];
-int	fds[2];
+	err = errno;
+	if (wfd != -1)
+		(void) close(wfd);
 
-	(void) snprintf(maxs, sizeof (maxs), "%lu", (unsigned long) maxsize);
-	(void) snprintf(keeps, sizeof (keeps), "%d", keep);
+	if (jl && (pid == -1 || joblog_register(jl) == -1))
+		joblog_free(jl);
 
-	if (pipe(fds) == -1)
-		return (-1);
-
-	switch (fork()) {
-	case -1:
-		(void) close(fds[1]);
-		return (-1);
-
-	case 0:
-		(void) close(fds[1]);
-		(void) dup2(fds[0], STDIN_FILENO);
-		(void) close(fds[0]);
-
-		(void) execl(LOGWRITER, "logwriter", file, maxs, keeps, NULL);
-		_exit(1);
-
-	default:
-		(void) close(fds[0]);
-		return (fds[1]);
-	}
+	free(argv);
+	errno = err;
+	return (pid);
 }
 
 int
-send_mail(recip, msg)
-	char const *recip, *msg;
+send_mail(cmd, recip, file)
+	char const *cmd, *recip, *file;
 {
 char const *args[] = {
-	"/usr/lib/sendmail",
+	"sendmail",
 	"-oi",
 	"-bm",
 	"--",
 	NULL,
 	NULL
 };
-int	fds[2];
+int	fd;
 
 	args[4] = recip;
 
-	if (pipe(fds) == -1) {
-		logm(LOG_ERR, "send_mail: pipe: %s", strerror(errno));
+	/*LINTED*/
+	if ((fd = open(file, O_RDONLY | O_NOFOLLOW)) == -1) {
+		logm(LOG_ERR, "send_mail: %s: %s", file, strerror(errno));
 		return (-1);
 	}
 
-	switch (fork()) {
-	case 0:
-		if (dup2(fds[0], 0) == -1) {
-			logm(LOG_ERR, "send_mail: dup2: %s", strerror(errno));
-			_exit(1);
-		}
-
-		(void) close(fds[0]);
-		(void) close(fds[1]);
-
-		/*
-		 * This does not break const correctness, since execv() is only
-		 * missing the appropriate 'const' qualifier for historical
-		 * reasons.
-		 */
-		(void) execv("/usr/lib/sendmail", (char **)args);
-		logm(LOG_ERR, "send_mail: execv: %s", strerror(errno));
-		_exit(1);
-		/*FALLTHROUGH*/
-
-	case -1:
-		logm(LOG_ERR, "send_mail: fork: %s", strerror(errno));
+	/*
+	 * The mailer reads the message straight from the file, so we never
+	 * wait for it to take the message.
+	 */
+	if (spawn_program(cmd, args, NULL, fd, -1) == -1) {
+		logm(LOG_ERR, "send_mail: cannot start %s: %s", cmd,
+		    strerror(errno));
+		(void) close(fd);
 		return (-1);
-
-	default:
-		(void) close(fds[0]);
-		(void) write(fds[1], msg, strlen(msg));
-		(void) close(fds[1]);
 	}
 
+	(void) close(fd);
+	(void) unlink(file);
+
 	/* We're ignoring SIGCHLD, so no need to wait */
 	return (0);
 }
-
-static char *
-logfmt(fmt, job)
-	char const	*fmt;
-	job_t		*job;
-{
-static char	 fl[1024];
-char const	*p = fmt;
-char		*f = fl;
-size_t		 nleft = sizeof (fl);
-struct passwd	*pwd;
-char		 dbuf[128], tbuf[128];
-struct tm	*tm;
-char		*fmri = log_name(job->job_fmri);
-
-	tm = gmtime(&current_time);
-	(void) strftime(tbuf, sizeof (tbuf), "%Y-%m-%d_%H:%M:%S", tm);
-	(void) strftime(dbuf, sizeof (dbuf), "%Y-%m-%d", tm);
-	if ((pwd = getpwnam(job->job_username)) == NULL)
-		return (NULL);
-
-	bzero(fl, sizeof (fl));
-
-	while (*p) {
-		if (*p != '%') {
-			if (nleft)
-				*f++ = *p;
-			nleft--;
-			p++;
-			continue;
-		}
-
-		p++;
-		switch (*p) {
-		case '%':
-			if (nleft)
-				*f++ = '%';
-			nleft--;
-			break;
-
-		case 'h':
-			(void) strlcat(fl, pwd->pw_dir, sizeof (fl));
-			f = fl + strlen(fl);
-			nleft = sizeof (fl) - strlen(fl);
-			break;
-
-		case 'f':
-			(void) strlcat(fl, fmri, sizeof (fl));
-			f = fl + strlen(fl);
-			nleft = sizeof (fl) - strlen(fl);
-			break;
-
-		case 't':
-			(void) strlcat(fl, tbuf, sizeof (fl));
-			f = fl + strlen(fl);
-			nleft = sizeof (fl) - strlen(fl);
-			break;
-
-		case 'd':
-			(void) strlcat(fl, dbuf, sizeof (fl));
-			f = fl + strlen(fl);
-			nleft = sizeof (fl) - strlen(fl);
-			break;
-		}
-
-		p++;
-	}
-
-	return (fl);
-}
@@ -9,8 +9,41 @@
 #include	<sys/types.h>
 
 #include	"state.h"
+#include	"plan.h"
 
+/*
+ * Start a program with posix_spawn(), with stdin from 'infd', stdout and
+ * stderr to 'outfd' (either of which is /dev/null if it's -1), and the
+ * environment 'envp' (or an empty one if it's NULL).
+ */
+pid_t spawn_program(char const *path, char const *const *argv,
+	char const *const *envp, int infd, int outfd);
+
+/*
+ * Start JOBEXEC with stdout and stderr to 'outfd', passing it the job's
+ * environment 'envp' (if not NULL) through a pipe rather than as its own
+ * environment, which is always empty.
+ */
+pid_t spawn_jobexec(char const *const *argv, char const *const *envp,
+	int outfd);
+
+/*
+ * Return the JOBEXEC arguments to run 'cmd' for the job, in a single block to
+ * be freed with free(), or NULL on failure.  'plan' may be NULL.  If it isn't,
+ * JOBEXEC must be given the plan's environment by spawn_jobexec().
+ */
+char **jobexec_argv(job_t *, launch_plan_t const *, char const *cmd);
+
+/*
+ * These start the program directly from the calling process.  The daemon
+ * itself normally uses the launcher (see launcher.h) instead.
+ */
 pid_t fork_execute(job_t *, char const *cmd);
-int send_mail(char const *recip, char const *msg);
+
+/*
+ * Run the mailer 'cmd' to send the message in 'file' to 'recip'.  The file is
+ * removed once the mailer has it.
+ */
+int send_mail(char const *cmd, char const *recip, char const *file);
 
 #endif	/* !EXECUTE_H */
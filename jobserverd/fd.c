@@ -40,6 +40,7 @@ typedef struct fde {
 	fde_rl_callback	 fde_rl_callback;
 	fde_nvl_callback fde_nvl_callback;
 	uint32_t	 fde_nvlength;
+	int		 fde_plain;	/* not XTI; use read() and write() */
 	buffer_t	 fde_wbuf;
 	buffer_t	 fde_rbuf;
 	void		*fde_udata;
@@ -49,6 +50,8 @@ static fde_t *fd_table;
 static int nfds;
 
 static int fd_drain(int fd);
+static ssize_t fd_recv(fde_t *, char *, size_t);
+static ssize_t fd_send(fde_t *, char const *, size_t);
 
 int
 fd_init(prt)
@@ -248,7 +251,6 @@ size_t	 bytesleft; /* space left in fde_rbuf */
 ssize_t	 i;
 int	 save_errno, save_terrno;
 char	 rbuf[1024];
-int	 flags = 0;
 
 	assert(fd < nfds);
 	assert(type == FDE_READ);
@@ -262,7 +264,7 @@ int	 flags = 0;
 	 * gives other fds a chance to be processed even if one fd is sending
 	 * an excessive amount of data.
 	 */
-	while ((i = t_rcv(fd, rbuf, bytesleft, &flags)) > 0) {
+	while ((i = fd_recv(e, rbuf, bytesleft)) > 0) {
 		if (buf_append(&e->fde_rbuf, rbuf, i) == -1) {
 			logm(LOG_ERR, "fd=%d "
 			    "fd_readline_callback: buf_append failed",
@@ -388,7 +390,7 @@ fd_nvl_callback(fd, type, udata)
 fde_t	*e;
 char	 rbuf[1024];
 size_t	 bytesleft; /* space left in fde_rbuf */
-int	 i, flags;
+int	 i;
 int	 save_errno, save_terrno;
 	assert(fd < nfds);
 	assert(type == FDE_READ);
@@ -402,7 +404,7 @@ int	 save_errno, save_terrno;
 	 * gives other fds a chance to be processed even if one fd is sending
 	 * an excessive amount of data.
 	 */
-	while ((i = t_rcv(fd, rbuf, bytesleft, &flags)) > 0) {
+	while ((i = fd_recv(e, rbuf, bytesleft)) > 0) {
 		if (buf_append(&e->fde_rbuf, rbuf, i) == -1) {
 			logm(LOG_ERR, "fd=%d "
 			    "fd_readline_callback: buf_append failed",
@@ -505,6 +507,53 @@ int	flags;
 	return (fcntl(fd, F_SETFL, flags));
 }
 
+int
+fd_set_plain(fd)
+	int	fd;
+{
+	assert(fd >= 0 && fd < nfds);
+	fd_table[fd].fde_plain = 1;
+	return (0);
+}
+
+/*
+ * Managed i/o is done with t_rcv() and t_snd(), since most of our fds are XTI
+ * endpoints.  For plain fds, use read() and write() instead, and report
+ * errors the way XTI would so the callers only have to check one thing.
+ */
+static ssize_t
+fd_recv(e, buf, sz)
+	fde_t	*e;
+	char	*buf;
+	size_t	 sz;
+{
+ssize_t	n;
+int	flags;
+
+	if (!e->fde_plain)
+		return (t_rcv(e->fde_fd, buf, sz, &flags));
+
+	if ((n = read(e->fde_fd, buf, sz)) == -1)
+		t_errno = (errno == EAGAIN) ? TNODATA : TSYSERR;
+	return (n);
+}
+
+static ssize_t
+fd_send(e, buf, sz)
+	fde_t		*e;
+	char const	*buf;
+	size_t		 sz;
+{
+ssize_t	n;
+
+	if (!e->fde_plain)
+		return (t_snd(e->fde_fd, (char *)buf, sz, 0));
+
+	if ((n = write(e->fde_fd, buf, sz)) == -1)
+		t_errno = TSYSERR;
+	return (n);
+}
+
 int
 fd_set_cloexec(fd, ce)
 	int	fd, ce;
@@ -607,8 +656,8 @@ fde_t	*e;
 	e = &fd_table[fd];
 	for (;;) {
 	ssize_t	n;
-		if ((n = t_snd(e->fde_fd, e->fde_wbuf.b_data,
-		    e->fde_wbuf.b_size, 0)) == -1) {
+		if ((n = fd_send(e, e->fde_wbuf.b_data,
+		    e->fde_wbuf.b_size)) == -1) {
 			if (t_errno == TSYSERR && errno == EINTR)
 				continue;
 			return (-1);
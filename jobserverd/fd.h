@@ -71,6 +71,12 @@ int fd_set_nonblocking(int, int);
  */
 int fd_set_cloexec(int, int);
 
+/*
+ * Mark an fd which is not an XTI endpoint, such as a pipe or a socketpair(),
+ * so managed i/o uses read() and write() on it.  Call after fd_open().
+ */
+int fd_set_plain(int);
+
 /*
  * Managed i/o.  This provides a higher level interface than basic read/write
  * notifications.
@@ -0,0 +1,382 @@
+/*
+ * Copyright 2010 River Tarnell.  All rights reserved.
+ * Use is subject to license terms.
+ */
+
+#include	<stdlib.h>
+#include	<string.h>
+#include	<strings.h>
+#include	<errno.h>
+#include	<assert.h>
+
+#include	"jobserver.h"
+#include	"fmriidx.h"
+#include	"jerrno.h"
+#include	"queue.h"
+
+#define	FMRI_PREFIX	"job:/"
+#define	FMRI_PREFIX_LEN	(sizeof (FMRI_PREFIX) - 1)
+
+#define	IDX_MIN_BUCKETS	64
+
+/*
+ * Exact match table.  Jobs are chained through job_fmri_hash.
+ */
+static LIST_HEAD(job_bucket, job) *exact;
+static size_t	nexact_buckets;
+static size_t	nexact;
+
+/*
+ * The reverse-component trie.  Rather than giving each node its own child
+ * table, all edges live in a single hash table keyed on (parent, name).  The
+ * per-node child list is only used to walk down to the single job below a
+ * node when the node's count is 1.
+ */
+typedef struct fmri_node {
+	struct fmri_node	*fn_parent;
+	char			*fn_name;
+	size_t			 fn_namelen;
+	job_t			*fn_job;	/* job whose FMRI ends here */
+	int			 fn_njobs;	/* jobs at or below this node */
+	LIST_HEAD(fmri_children, fmri_node) fn_children;
+	LIST_ENTRY(fmri_node)	 fn_sibling;
+	LIST_ENTRY(fmri_node)	 fn_hash;
+} fmri_node_t;
+
+static fmri_node_t	 root;
+static LIST_HEAD(node_bucket, fmri_node) *edges;
+static size_t		 nedge_buckets;
+static size_t		 nedges;
+
+static int		 exact_grow(void);
+static int		 edges_grow(void);
+static uint32_t		 edge_hash(fmri_node_t *, char const *, size_t);
+static fmri_node_t	*edge_find(fmri_node_t *, char const *, size_t);
+static fmri_node_t	*edge_add(fmri_node_t *, char const *, size_t);
+static void		 node_release(fmri_node_t *);
+static char const	*prev_component(char const *, char const *, size_t *);
+
+static uint32_t
+edge_hash(parent, name, len)
+	fmri_node_t	*parent;
+	char const	*name;
+	size_t		 len;
+{
+	return (memhash(name, len, memhash(&parent, sizeof (parent), 0)));
+}
+
+static int
+exact_grow()
+{
+struct job_bucket	*nb;
+size_t			 nsz, i;
+job_t			*job;
+
+	nsz = nexact_buckets ? nexact_buckets * 2 : IDX_MIN_BUCKETS;
+	if ((nb = calloc(nsz, sizeof (*nb))) == NULL) {
+		logm(LOG_ERR, "fmriidx: out of memory");
+		return (-1);
+	}
+
+	for (i = 0; i < nexact_buckets; ++i) {
+		while ((job = LIST_FIRST(&exact[i])) != NULL) {
+			LIST_REMOVE(job, job_fmri_hash);
+			LIST_INSERT_HEAD(&nb[strhash(job->job_fmri, 0) &
+			    (nsz - 1)], job, job_fmri_hash);
+		}
+	}
+
+	free(exact);
+	exact = nb;
+	nexact_buckets = nsz;
+	return (0);
+}
+
+static int
+edges_grow()
+{
+struct node_bucket	*nb;
+size_t			 nsz, i;
+fmri_node_t		*n;
+
+	nsz = nedge_buckets ? nedge_buckets * 2 : IDX_MIN_BUCKETS;
+	if ((nb = calloc(nsz, sizeof (*nb))) == NULL) {
+		logm(LOG_ERR, "fmriidx: out of memory");
+		return (-1);
+	}
+
+	for (i = 0; i < nedge_buckets; ++i) {
+		while ((n = LIST_FIRST(&edges[i])) != NULL) {
+			LIST_REMOVE(n, fn_hash);
+			LIST_INSERT_HEAD(&nb[edge_hash(n->fn_parent, n->fn_name,
+			    n->fn_namelen) & (nsz - 1)], n, fn_hash);
+		}
+	}
+
+	free(edges);
+	edges = nb;
+	nedge_buckets = nsz;
+	return (0);
+}
+
+static fmri_node_t *
+edge_find(parent, name, len)
+	fmri_node_t	*parent;
+	char const	*name;
+	size_t		 len;
+{
+fmri_node_t	*n;
+	if (nedge_buckets == 0)
+		return (NULL);
+
+	LIST_FOREACH(n, &edges[edge_hash(parent, name, len) &
+	    (nedge_buckets - 1)], fn_hash) {
+		if (n->fn_parent == parent && n->fn_namelen == len &&
+		    bcmp(n->fn_name, name, len) == 0)
+			return (n);
+	}
+
+	return (NULL);
+}
+
+static fmri_node_t *
+edge_add(parent, name, len)
+	fmri_node_t	*parent;
+	char const	*name;
+	size_t		 len;
+{
+fmri_node_t	*n;
+
+	if ((n = edge_find(parent, name, len)) != NULL)
+		return (n);
+
+	if (nedges >= nedge_buckets * 2 && edges_grow() == -1)
+		return (NULL);
+
+	if ((n = calloc(1, sizeof (*n))) == NULL ||
+	    (n->fn_name = malloc(len)) == NULL) {
+		logm(LOG_ERR, "fmriidx: out of memory");
+		free(n);
+		return (NULL);
+	}
+
+	bcopy(name, n->fn_name, len);
+	n->fn_namelen = len;
+	n->fn_parent = parent;
+	LIST_INIT(&n->fn_children);
+	LIST_INSERT_HEAD(&parent->fn_children, n, fn_sibling);
+	LIST_INSERT_HEAD(&edges[edge_hash(parent, name, len) &
+	    (nedge_buckets - 1)], n, fn_hash);
+	nedges++;
+	return (n);
+}
+
+/*
+ * Drop one job from the count of n and all its parents, freeing any node
+ * which no longer has any jobs below it.
+ */
+static void
+node_release(n)
+	fmri_node_t	*n;
+{
+fmri_node_t	*parent;
+
+	while (n != &root) {
+		parent = n->fn_parent;
+
+		if (--n->fn_njobs == 0) {
+			assert(LIST_EMPTY(&n->fn_children));
+			assert(n->fn_job == NULL);
+			LIST_REMOVE(n, fn_sibling);
+			LIST_REMOVE(n, fn_hash);
+			free(n->fn_name);
+			free(n);
+			nedges--;
+		}
+
+		n = parent;
+	}
+
+	root.fn_njobs--;
+}
+
+/*
+ * Return the last component of the string [start, end), and store its length
+ * in *len.  Returns NULL if there are no more components.  The caller should
+ * continue with end set to the '/' before the returned component, or to
+ * start if there isn't one.
+ */
+static char const *
+prev_component(start, end, len)
+	char const	*start, *end;
+	size_t		*len;
+{
+char const	*p;
+
+	if (end == start)
+		return (NULL);
+
+	for (p = end; p > start && p[-1] != '/'; --p)
+		;
+
+	/*LINTED*/
+	*len = end - p;
+	return (p);
+}
+
+int
+fmriidx_insert(job)
+	job_t	*job;
+{
+char const	*start, *p, *end;
+size_t		 len;
+fmri_node_t	*n = &root, *c;
+
+	assert(job->job_fmri);
+	assert(strncmp(job->job_fmri, FMRI_PREFIX, FMRI_PREFIX_LEN) == 0);
+	assert(fmriidx_find_exact(job->job_fmri) == NULL);
+
+	if (nexact >= nexact_buckets * 2 && exact_grow() == -1)
+		return (-1);
+
+	if (root.fn_parent == NULL) {
+		LIST_INIT(&root.fn_children);
+		root.fn_parent = &root;
+	}
+
+	/*
+	 * Build the trie path first, so that a failure doesn't leave the job
+	 * in the exact table but not the trie.  Counts are only updated once
+	 * the whole path exists.
+	 */
+	start = job->job_fmri + FMRI_PREFIX_LEN;
+	end = start + strlen(start);
+	while ((p = prev_component(start, end, &len)) != NULL) {
+		if ((c = edge_add(n, p, len)) == NULL) {
+			/* Free any nodes we created that have no jobs. */
+			while (n != &root && n->fn_njobs == 0 &&
+			    LIST_EMPTY(&n->fn_children)) {
+				c = n->fn_parent;
+				LIST_REMOVE(n, fn_sibling);
+				LIST_REMOVE(n, fn_hash);
+				free(n->fn_name);
+				free(n);
+				nedges--;
+				n = c;
+			}
+			return (-1);
+		}
+
+		n = c;
+		end = (p > start) ? p - 1 : start;
+	}
+
+	assert(n->fn_job == NULL);
+	n->fn_job = job;
+	for (c = n; c != &root; c = c->fn_parent)
+		c->fn_njobs++;
+	root.fn_njobs++;
+
+	LIST_INSERT_HEAD(&exact[strhash(job->job_fmri, 0) &
+	    (nexact_buckets - 1)], job, job_fmri_hash);
+	nexact++;
+	return (0);
+}
+
+void
+fmriidx_remove(job)
+	job_t	*job;
+{
+char const	*start, *p, *end;
+size_t		 len;
+fmri_node_t	*n = &root;
+
+	if (fmriidx_find_exact(job->job_fmri) != job)
+		return;
+
+	start = job->job_fmri + FMRI_PREFIX_LEN;
+	end = start + strlen(start);
+	while ((p = prev_component(start, end, &len)) != NULL) {
+		n = edge_find(n, p, len);
+		assert(n);
+		end = (p > start) ? p - 1 : start;
+	}
+
+	assert(n->fn_job == job);
+	n->fn_job = NULL;
+	node_release(n);
+
+	LIST_REMOVE(job, job_fmri_hash);
+	nexact--;
+}
+
+job_t *
+fmriidx_find_exact(fmri)
+	char const	*fmri;
+{
+job_t	*job;
+	if (nexact_buckets == 0)
+		return (NULL);
+
+	LIST_FOREACH(job, &exact[strhash(fmri, 0) & (nexact_buckets - 1)],
+	    job_fmri_hash) {
+		if (strcmp(job->job_fmri, fmri) == 0)
+			return (job);
+	}
+
+	return (NULL);
+}
+
+job_t *
+fmriidx_find(spec)
+	char const	*spec;
+{
+job_t		*job;
+char const	*p, *end;
+size_t		 len;
+fmri_node_t	*n = &root;
+
+	if ((job = fmriidx_find_exact(spec)) != NULL)
+		return (job);
+
+	/*
+	 * If the spec starts with job:/ and wasn't an exact match, then it
+	 * can't exist.  An empty component (e.g. "foo//bar" or "/bar") can
+	 * never match either.
+	 */
+	if (*spec == '\0' || *spec == '/' ||
+	    strncmp(spec, FMRI_PREFIX, FMRI_PREFIX_LEN) == 0)
+		goto notfound;
+
+	/*
+	 * Walk the trie from the last component of the spec.
+	 */
+	end = spec + strlen(spec);
+	while ((p = prev_component(spec, end, &len)) != NULL) {
+		if (len == 0)
+			goto notfound;
+		if ((n = edge_find(n, p, len)) == NULL)
+			goto notfound;
+		end = (p > spec) ? p - 1 : spec;
+	}
+
+	if (n->fn_njobs > 1) {
+		errno = JEAMBIGUOUS_FMRI;
+		return (NULL);
+	}
+
+	/*
+	 * Exactly one job lives below this node.  Since empty nodes are always
+	 * freed, every node on the way down has exactly one child.
+	 */
+	while (n->fn_job == NULL) {
+		n = LIST_FIRST(&n->fn_children);
+		assert(n && n->fn_njobs == 1);
+	}
+
+	return (n->fn_job);
+
+notfound:
+	errno = JEJOB_NOT_FOUND;
+	return (NULL);
+}
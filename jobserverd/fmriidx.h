@@ -0,0 +1,40 @@
+/*
+ * Copyright 2010 River Tarnell.  All rights reserved.
+ * Use is subject to license terms.
+ */
+
+/*
+ * An index of job FMRIs, used to implement find_job_fmri().
+ *
+ * Full FMRIs are kept in a hash table for exact matches.  Partial FMRIs are
+ * resolved using a trie built from the FMRI components in reverse order, so
+ * for the job "job:/jsmith/foo/myjob", the specifications "myjob",
+ * "foo/myjob" and "jsmith/foo/myjob" are all paths from the root of the trie.
+ * Each node records how many jobs live at or below it, which lets us detect
+ * ambiguous specifications without visiting any jobs.
+ */
+
+#ifndef	FMRIIDX_H
+#define	FMRIIDX_H
+
+#include	"state.h"
+
+/*
+ * Add a job to the index, under its current FMRI.  The job's FMRI must not
+ * change while it's in the index; remove it first.
+ */
+int	 fmriidx_insert(job_t *);
+void	 fmriidx_remove(job_t *);
+
+/*
+ * Find a job by full FMRI only.  Returns NULL if there is no such job.
+ */
+job_t	*fmriidx_find_exact(char const *);
+
+/*
+ * Find a job by full or partial FMRI.  On failure, returns NULL and sets
+ * errno to JEJOB_NOT_FOUND or JEAMBIGUOUS_FMRI.
+ */
+job_t	*fmriidx_find(char const *);
+
+#endif	/* !FMRIIDX_H */
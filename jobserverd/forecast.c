@@ -0,0 +1,326 @@
+/*
+ * Copyright 2010 River Tarnell.  All rights reserved.
+ * Use is subject to license terms.
+ */
+
+#include	<stdlib.h>
+#include	<string.h>
+#include	<strings.h>
+#include	<errno.h>
+#include	<assert.h>
+
+#include	"jobserver.h"
+#include	"forecast.h"
+#include	"schedtab.h"
+#include	"sched.h"
+#include	"state.h"
+#include	"event.h"
+#include	"tz.h"
+
+/*
+ * How many fire times to work out before going back to the event loop.
+ */
+#define	FORECAST_SLICE	20000
+
+/*
+ * A copy of what we need to know about one job.  The job itself may be
+ * changed or deleted while the forecast is running.
+ */
+typedef struct fc_job {
+	cron_t		 fj_sched;
+	tz_t const	*fj_tz;
+	char		*fj_fmri;
+} fc_job_t;
+
+typedef struct fc_fire {
+	time_t		 ff_time;
+	uint32_t	 ff_job;
+} fc_fire_t;
+
+struct forecast {
+	ev_id_t		  fc_ev;
+	time_t		  fc_start;
+	time_t		  fc_end;
+	fc_job_t	 *fc_jobs;
+	uint32_t	  fc_njobs;
+
+	/* Where the next slice carries on from. */
+	uint32_t	  fc_next;
+	time_t		  fc_after;
+	int		  fc_fired;
+
+	/*
+	 * The earliest fc_limit fires seen so far, as a heap with the latest
+	 * of them at the top; a new fire only has to be compared against the
+	 * top to know whether it's kept.
+	 */
+	fc_fire_t	 *fc_heap;
+	uint_t		  fc_nheap;
+	uint_t		  fc_limit;
+
+	uint64_t	  fc_total;
+	uint32_t	  fc_nfiring;
+	uint32_t	 *fc_hist;
+	uint_t		  fc_nminutes;
+
+	forecast_callback fc_callback;
+	void		 *fc_udata;
+};
+
+static void	fc_run(ev_id_t, void *);
+static void	fc_add(forecast_t *, uint32_t, time_t);
+static void	fc_finish(forecast_t *);
+static void	fc_free(forecast_t *);
+static int	fire_cmp(fc_fire_t const *, fc_fire_t const *);
+static int	fire_qcmp(void const *, void const *);
+
+forecast_t *
+forecast_start(start, window, limit, user, viewer, callback, udata)
+	time_t			 start, window;
+	uint_t			 limit;
+	char const		*user, *viewer;
+	forecast_callback	 callback;
+	void			*udata;
+{
+forecast_t	*fc;
+job_t		**jobs = NULL;
+size_t		 n, i;
+fc_job_t	*fj;
+
+	assert(window > 0 && window <= FORECAST_MAX_WINDOW);
+	assert(limit <= FORECAST_MAX_LIMIT);
+
+	if ((fc = calloc(1, sizeof (*fc))) == NULL)
+		goto nomem;
+
+	fc->fc_ev = -1;
+	fc->fc_start = start;
+	fc->fc_end = start + window;
+	fc->fc_after = start - 1;
+	fc->fc_limit = limit;
+	fc->fc_nminutes = (window + 59) / 60;
+	fc->fc_callback = callback;
+	fc->fc_udata = udata;
+
+	n = schedtab_size();
+	if ((jobs = calloc(n ? n : 1, sizeof (*jobs))) == NULL ||
+	    (fc->fc_jobs = calloc(n ? n : 1, sizeof (*fc->fc_jobs))) == NULL ||
+	    (fc->fc_heap = calloc(limit ? limit : 1,
+	    sizeof (*fc->fc_heap))) == NULL ||
+	    (fc->fc_hist = calloc(fc->fc_nminutes,
+	    sizeof (*fc->fc_hist))) == NULL)
+		goto nomem;
+
+	n = schedtab_scheduled(jobs, n);
+	for (i = 0; i < n; ++i) {
+		if (user && strcmp(jobs[i]->job_username, user))
+			continue;
+		if (viewer && !job_access(jobs[i], viewer, JOB_VIEW))
+			continue;
+
+		fj = &fc->fc_jobs[fc->fc_njobs];
+		fj->fj_sched = jobs[i]->job_schedule;
+		fj->fj_tz = job_get_tz(jobs[i]);
+		if ((fj->fj_fmri = strdup(jobs[i]->job_fmri)) == NULL)
+			goto nomem;
+		fc->fc_njobs++;
+	}
+
+	free(jobs);
+	jobs = NULL;
+
+	if ((fc->fc_ev = ev_add_once(0, fc_run, fc)) == -1) {
+		logm(LOG_ERR, "forecast_start: cannot add event");
+		fc_free(fc);
+		errno = EAGAIN;
+		return (NULL);
+	}
+
+	return (fc);
+
+nomem:
+	logm(LOG_ERR, "forecast_start: out of memory");
+	free(jobs);
+	if (fc)
+		fc_free(fc);
+	errno = ENOMEM;
+	return (NULL);
+}
+
+void
+forecast_cancel(fc)
+	forecast_t	*fc;
+{
+	if (fc->fc_ev != -1)
+		(void) ev_cancel(fc->fc_ev);
+	fc_free(fc);
+}
+
+static void
+fc_free(fc)
+	forecast_t	*fc;
+{
+uint32_t	i;
+
+	if (fc->fc_jobs)
+		for (i = 0; i < fc->fc_njobs; ++i)
+			free(fc->fc_jobs[i].fj_fmri);
+	free(fc->fc_jobs);
+	free(fc->fc_heap);
+	free(fc->fc_hist);
+	free(fc);
+}
+
+/*ARGSUSED*/
+static void
+fc_run(evid, udata)
+	ev_id_t	 evid;
+	void	*udata;
+{
+forecast_t	*fc = udata;
+fc_job_t	*fj;
+int		 budget = FORECAST_SLICE;
+time_t		 t;
+
+	fc->fc_ev = -1;
+
+	for (; fc->fc_next < fc->fc_njobs; fc->fc_next++) {
+		fj = &fc->fc_jobs[fc->fc_next];
+
+		for (;;) {
+			if (budget-- == 0) {
+				if ((fc->fc_ev = ev_add_once(0, fc_run, fc))
+				    != -1)
+					return;
+
+				/*
+				 * Carry on here rather than lose the
+				 * forecast.
+				 */
+				logm(LOG_WARNING, "fc_run: cannot add event");
+				budget = -1;
+			}
+
+			t = sched_nextrun_after(&fj->fj_sched, fj->fj_tz,
+			    fc->fc_after);
+			if (t == -1 || t >= fc->fc_end)
+				break;
+
+			fc_add(fc, fc->fc_next, t);
+			fc->fc_after = t;
+		}
+
+		fc->fc_after = fc->fc_start - 1;
+		fc->fc_fired = 0;
+	}
+
+	fc_finish(fc);
+}
+
+static int
+fire_cmp(a, b)
+	fc_fire_t const	*a, *b;
+{
+	if (a->ff_time != b->ff_time)
+		return (a->ff_time < b->ff_time ? -1 : 1);
+	if (a->ff_job != b->ff_job)
+		return (a->ff_job < b->ff_job ? -1 : 1);
+	return (0);
+}
+
+static int
+fire_qcmp(a, b)
+	void const	*a, *b;
+{
+	return (fire_cmp(a, b));
+}
+
+static void
+fc_add(fc, job, t)
+	forecast_t	*fc;
+	uint32_t	 job;
+	time_t		 t;
+{
+fc_fire_t	 f, tmp;
+fc_fire_t	*h = fc->fc_heap;
+uint_t		 i, c;
+
+	fc->fc_total++;
+	fc->fc_hist[(t - fc->fc_start) / 60]++;
+	if (!fc->fc_fired) {
+		fc->fc_fired = 1;
+		fc->fc_nfiring++;
+	}
+
+	f.ff_time = t;
+	f.ff_job = job;
+
+	if (fc->fc_nheap < fc->fc_limit) {
+		/* Sift the new fire up from the bottom. */
+		h[i = fc->fc_nheap++] = f;
+		while (i > 0 && fire_cmp(&h[(i - 1) / 2], &h[i]) < 0) {
+			tmp = h[i];
+			h[i] = h[(i - 1) / 2];
+			h[(i - 1) / 2] = tmp;
+			i = (i - 1) / 2;
+		}
+		return;
+	}
+
+	if (fc->fc_limit == 0 || fire_cmp(&f, &h[0]) >= 0)
+		return;
+
+	/* Replace the latest fire, and sift it down. */
+	h[i = 0] = f;
+	for (;;) {
+		c = 2 * i + 1;
+		if (c >= fc->fc_nheap)
+			break;
+		if (c + 1 < fc->fc_nheap && fire_cmp(&h[c + 1], &h[c]) > 0)
+			c++;
+		if (fire_cmp(&h[c], &h[i]) <= 0)
+			break;
+		tmp = h[i];
+		h[i] = h[c];
+		h[c] = tmp;
+		i = c;
+	}
+}
+
+static void
+fc_finish(fc)
+	forecast_t	*fc;
+{
+forecast_result_t	 res;
+uint_t			 i;
+
+	qsort(fc->fc_heap, fc->fc_nheap, sizeof (*fc->fc_heap), fire_qcmp);
+
+	bzero(&res, sizeof (res));
+	res.fr_start = fc->fc_start;
+	res.fr_window = fc->fc_end - fc->fc_start;
+	res.fr_total = fc->fc_total;
+	res.fr_njobs = fc->fc_nfiring;
+	res.fr_nminutes = fc->fc_nminutes;
+	res.fr_histogram = fc->fc_hist;
+	res.fr_nfires = fc->fc_nheap;
+
+	if ((res.fr_times = calloc(fc->fc_nheap + 1,
+	    sizeof (*res.fr_times))) == NULL ||
+	    (res.fr_fmris = calloc(fc->fc_nheap + 1,
+	    sizeof (*res.fr_fmris))) == NULL) {
+		logm(LOG_ERR, "fc_finish: out of memory");
+		res.fr_nfires = 0;
+	}
+
+	for (i = 0; i < res.fr_nfires; ++i) {
+		res.fr_times[i] = fc->fc_heap[i].ff_time;
+		res.fr_fmris[i] = fc->fc_jobs[fc->fc_heap[i].ff_job].fj_fmri;
+	}
+
+	fc->fc_callback(&res, fc->fc_udata);
+
+	free(res.fr_times);
+	free(res.fr_fmris);
+	fc_free(fc);
+}
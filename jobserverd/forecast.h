@@ -0,0 +1,67 @@
+/*
+ * Copyright 2010 River Tarnell.  All rights reserved.
+ * Use is subject to license terms.
+ */
+
+/*
+ * Schedule forecasts: every time a scheduled job would start during a window,
+ * across many jobs at once.
+ *
+ * The schedules of the interesting jobs are copied when the forecast starts,
+ * so it describes the schedule table as it was at that moment.  The fire times
+ * are then worked out a slice at a time from the event loop, so a forecast
+ * over a large number of jobs doesn't hold up anything else the daemon is
+ * doing.  When it's finished, the caller's callback is called with the result.
+ */
+
+#ifndef	FORECAST_H
+#define	FORECAST_H
+
+#include	<sys/types.h>
+#include	<inttypes.h>
+
+#define	FORECAST_DEFAULT_WINDOW	(60 * 60)
+#define	FORECAST_MAX_WINDOW	(7 * 24 * 60 * 60)
+#define	FORECAST_DEFAULT_LIMIT	1000
+#define	FORECAST_MAX_LIMIT	10000
+
+typedef struct forecast forecast_t;
+
+typedef struct forecast_result {
+	time_t		  fr_start;
+	time_t		  fr_window;
+	uint64_t	  fr_total;	/* fires in the window */
+	uint32_t	  fr_njobs;	/* jobs which fire at least once */
+	/* The first fr_nfires fires, in time order. */
+	uint_t		  fr_nfires;
+	uint64_t	 *fr_times;
+	char		**fr_fmris;
+	/* The number of fires starting in each minute of the window. */
+	uint_t		  fr_nminutes;
+	uint32_t	 *fr_histogram;
+} forecast_result_t;
+
+/*
+ * Called when the forecast is complete.  The result, and the forecast, are
+ * freed when the callback returns.
+ */
+typedef void (*forecast_callback)(forecast_result_t const *, void *);
+
+/*
+ * Start a forecast of the enabled, scheduled jobs which fire in the 'window'
+ * seconds from 'start', and keep the first 'limit' fires.  If user is not
+ * NULL, only that user's jobs are included.  If viewer is not NULL, only jobs
+ * that user can view are included.
+ *
+ * Returns NULL and sets errno on failure.
+ */
+forecast_t	*forecast_start(time_t start, time_t window, uint_t limit,
+			char const *user, char const *viewer,
+			forecast_callback, void *);
+
+/*
+ * Abandon a forecast which hasn't finished yet.  The callback is not called.
+ */
+void		 forecast_cancel(forecast_t *);
+
+#endif	/* !FORECAST_H */
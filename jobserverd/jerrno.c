@@ -21,6 +21,11 @@ static char const *jerrlist[] = {
 	"Job is not in maintenance state",
 	"Job is not scheduled",
 	"Job is not running",
+	"FMRI matches more than one job",
+	"Unknown time zone",
+	"Dependency would create a cycle",
+	"Other jobs depend on this job",
+	"Job is already running",
 };
 #define nerrs (sizeof(jerrlist) / sizeof(*jerrlist))
 
@@ -31,7 +36,7 @@ jstrerror(err)
 	if (err >= 0)
 		return strerror(err);
 
-	if (-err >= nerrs)
+	if (-err > nerrs)
 		return "Unknown error";
 
 	return jerrlist[-err - 1];
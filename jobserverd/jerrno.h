@@ -21,6 +21,11 @@ const char *jstrerror(int);
 #define JENOT_IN_MAINTENANCE		-10
 #define JENOT_SCHEDULED			-11
 #define JENOT_RUNNING			-12
-#define JELAST_ERROR			-13
+#define JEAMBIGUOUS_FMRI		-13
+#define JEINVALID_TZ			-14
+#define JEDEP_CYCLE			-15
+#define JEHAS_DEPENDENTS		-16
+#define JEALREADY_RUNNING		-17
+#define JELAST_ERROR			-18
 
 #endif	/* !JERRNO_H */
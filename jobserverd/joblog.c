@@ -0,0 +1,651 @@
+/*
+ * Copyright 2010 River Tarnell.  All rights reserved.
+ * Use is subject to license terms.
+ */
+
+#include	<sys/types.h>
+#include	<sys/stat.h>
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<strings.h>
+#include	<unistd.h>
+#include	<fcntl.h>
+#include	<errno.h>
+#include	<ctype.h>
+#include	<time.h>
+#include	<sys/time.h>
+#include	<pwd.h>
+#include	<grp.h>
+#include	<limits.h>
+
+#include	"joblog.h"
+#include	"jobserver.h"
+#include	"fd.h"
+#include	"logcomp.h"
+
+/*
+ * The most we read from a pipe before writing it out.  A pipe rarely holds
+ * this much, so each write is usually everything the program has said since
+ * the last one.
+ */
+#define	JOBLOG_BUFSZ	(64 * 1024)
+
+/*
+ * With logstamp, each line is prefixed with the wall clock time (UTC) and the
+ * time since the program started, as "[<wall> +<seconds>] ".  The time is
+ * when we read the line, which is as close as we can get.
+ */
+#define	JOBLOG_STAMPSZ	64
+
+struct joblog {
+	int		 jl_fd;		/* read side of the pipe */
+	int		 jl_logfd;	/* -1 until the log is opened */
+	char		*jl_file;
+	uid_t		 jl_uid;
+	gid_t		 jl_gid;
+	uint64_t	 jl_maxsize;
+	int		 jl_keep;
+	uint64_t	 jl_size;	/* the log's size, as far as we know */
+	int		 jl_warned;	/* already complained about the log */
+	time_t		 jl_rotated;	/* when we last tried to rotate it */
+	int		 jl_stamp;	/* timestamp lines and keep an index */
+	int		 jl_idxfd;	/* the index, or -1 */
+	time_t		 jl_bucket;	/* last bucket in the index */
+	int		 jl_bol;	/* next byte starts a line */
+	hrtime_t	 jl_start;	/* when the program started */
+};
+
+static gid_t	*our_groups;
+static int	 our_ngroups = -1;
+
+static int	 joblog_open(joblog_t *);
+static void	 joblog_close(joblog_t *);
+static void	 joblog_stamp(joblog_t *, char const *, size_t);
+static void	 joblog_write(joblog_t *, char const *, size_t);
+static void	 joblog_rotate(joblog_t *);
+static void	 joblog_shift(joblog_t *);
+static void	 joblog_callback(int, fde_evt_type_t, void *);
+
+char *
+joblog_file(job, plan, uid, gid)
+	job_t			*job;
+	launch_plan_t const	*plan;
+	uid_t			*uid;
+	gid_t			*gid;
+{
+struct passwd	*pwd;
+char const	*home, *p;
+char		*fl, *name, *m;
+char		 dbuf[128], tbuf[128];
+struct tm	*tm;
+size_t		 len;
+
+	if (plan) {
+		home = plan->lp_home;
+		*uid = plan->lp_uid;
+		*gid = plan->lp_groups[0];
+	} else if ((pwd = getpwnam(job->job_username)) != NULL) {
+		home = pwd->pw_dir;
+		*uid = pwd->pw_uid;
+		*gid = pwd->pw_gid;
+	} else {
+		logm(LOG_WARNING, "job %ld: no log: user %s doesn't exist",
+		    (long)job->job_id, job->job_username);
+		return (NULL);
+	}
+
+	/*
+	 * The FMRI without the job:/user/, made safe for a file name.
+	 */
+	if ((p = index(job->job_fmri + 5, '/')) == NULL) {
+		logm(LOG_WARNING, "job %ld: no log: mal-formed FMRI",
+		    (long)job->job_id);
+		return (NULL);
+	}
+
+	if ((name = strdup(p + 1)) == NULL) {
+		logm(LOG_ERR, "joblog_file: out of memory");
+		return (NULL);
+	}
+
+	for (m = name; *m; ++m)
+		if (!isalnum(*m) && !index("-_", *m))
+			*m = '_';
+
+	if ((fl = calloc(1, PATH_MAX)) == NULL) {
+		logm(LOG_ERR, "joblog_file: out of memory");
+		free(name);
+		return (NULL);
+	}
+
+	tm = gmtime(&current_time);
+	(void) strftime(tbuf, sizeof (tbuf), "%Y-%m-%d_%H:%M:%S", tm);
+	(void) strftime(dbuf, sizeof (dbuf), "%Y-%m-%d", tm);
+
+	p = job->job_logfmt ? job->job_logfmt : DEFAULT_LOGFMT;
+
+	/*
+	 * A relative log is in the user's home directory.
+	 */
+	if (*p != '/')
+		(void) snprintf(fl, PATH_MAX, "%s/", home);
+
+	for (; *p; ++p) {
+		len = strlen(fl);
+
+		if (*p != '%') {
+			if (len < PATH_MAX - 1)
+				fl[len] = *p;
+			continue;
+		}
+
+		switch (*++p) {
+		case '%':
+			(void) strlcat(fl, "%", PATH_MAX);
+			break;
+
+		case 'h':
+			(void) strlcat(fl, home, PATH_MAX);
+			break;
+
+		case 'f':
+			(void) strlcat(fl, name, PATH_MAX);
+			break;
+
+		case 't':
+			(void) strlcat(fl, tbuf, PATH_MAX);
+			break;
+
+		case 'd':
+			(void) strlcat(fl, dbuf, PATH_MAX);
+			break;
+
+		case '\0':
+			--p;
+			break;
+		}
+	}
+
+	free(name);
+
+	/*
+	 * Remember it, so clients can find the log.  This is only a hint, so
+	 * it doesn't matter if we can't.
+	 */
+	free(job->job_logfile);
+	job->job_logfile = strdup(fl);
+	return (fl);
+}
+
+joblog_t *
+joblog_new(file, uid, gid, maxsize, keep, stamp, wfd)
+	char const	*file;
+	uid_t		 uid;
+	gid_t		 gid;
+	uint64_t	 maxsize;
+	int		 keep, stamp;
+	int		*wfd;
+{
+joblog_t	*jl;
+int		 fds[2];
+
+	if ((jl = calloc(1, sizeof (*jl))) == NULL)
+		return (NULL);
+
+	if ((jl->jl_file = strdup(file)) == NULL) {
+		free(jl);
+		errno = ENOMEM;
+		return (NULL);
+	}
+
+	if (pipe(fds) == -1) {
+		free(jl->jl_file);
+		free(jl);
+		return (NULL);
+	}
+
+	/*
+	 * Only the program should have the write side, or the collector
+	 * would never see the end of its output.
+	 */
+	(void) fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+	(void) fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+	(void) fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL, 0) | O_NONBLOCK);
+
+	jl->jl_fd = fds[0];
+	jl->jl_logfd = -1;
+	jl->jl_uid = uid;
+	jl->jl_gid = gid;
+	jl->jl_maxsize = maxsize;
+	jl->jl_keep = keep;
+	jl->jl_stamp = stamp;
+	jl->jl_idxfd = -1;
+	jl->jl_bol = 1;
+	jl->jl_start = gethrtime();
+
+	*wfd = fds[1];
+	return (jl);
+}
+
+int
+joblog_fd(jl)
+	joblog_t	*jl;
+{
+	return (jl->jl_fd);
+}
+
+void
+joblog_free(jl)
+	joblog_t	*jl;
+{
+	if (jl->jl_fd != -1)
+		(void) close(jl->jl_fd);
+	joblog_close(jl);
+	free(jl->jl_file);
+	free(jl);
+}
+
+/*
+ * Read at most one buffer each time, so a program with a lot to say doesn't
+ * hold up the others; if there's more, the pipe is still readable and we'll
+ * be back.
+ */
+int
+joblog_read(jl)
+	joblog_t	*jl;
+{
+static char	buf[JOBLOG_BUFSZ];
+size_t		len = 0;
+ssize_t		n;
+int		eof = 0;
+
+	while (len < sizeof (buf)) {
+		if ((n = read(jl->jl_fd, buf + len, sizeof (buf) - len)) > 0) {
+			len += n;
+			continue;
+		}
+
+		if (n == -1 && errno == EINTR)
+			continue;
+
+		if (n == 0 || errno != EAGAIN)
+			eof = 1;
+		break;
+	}
+
+	if (len && jl->jl_stamp)
+		joblog_stamp(jl, buf, len);
+	else if (len)
+		joblog_write(jl, buf, len);
+
+	return (eof ? -1 : 0);
+}
+
+/*
+ * Copy 'buf' to the log with a timestamp at the start of each line.  A line
+ * which arrives in pieces is only stamped once.
+ */
+static void
+joblog_stamp(jl, buf, len)
+	joblog_t	*jl;
+	char const	*buf;
+	size_t		 len;
+{
+static char	 out[JOBLOG_BUFSZ + JOBLOG_STAMPSZ];
+char		 stamp[JOBLOG_STAMPSZ], tbuf[32];
+char const	*nl;
+size_t		 o = 0, slen, n;
+struct timeval	 tv;
+hrtime_t	 since = gethrtime() - jl->jl_start;
+time_t		 t;
+
+	(void) gettimeofday(&tv, NULL);
+	t = tv.tv_sec;
+	(void) strftime(tbuf, sizeof (tbuf), "%Y-%m-%dT%H:%M:%S", gmtime(&t));
+	(void) snprintf(stamp, sizeof (stamp), "[%s.%03dZ +%lld.%06d] ",
+	    tbuf, (int)(tv.tv_usec / 1000), (long long)(since / NANOSEC),
+	    (int)(since % NANOSEC / 1000));
+	slen = strlen(stamp);
+
+	while (len) {
+		if (jl->jl_bol) {
+			if (o + slen > sizeof (out)) {
+				joblog_write(jl, out, o);
+				o = 0;
+			}
+			bcopy(stamp, out + o, slen);
+			o += slen;
+			jl->jl_bol = 0;
+		}
+
+		nl = memchr(buf, '\n', len);
+		n = nl ? nl - buf + 1 : len;
+		n = min(n, sizeof (out) - o);
+
+		bcopy(buf, out + o, n);
+		o += n;
+		jl->jl_bol = (out[o - 1] == '\n');
+		buf += n;
+		len -= n;
+
+		if (o == sizeof (out)) {
+			joblog_write(jl, out, o);
+			o = 0;
+		}
+	}
+
+	if (o)
+		joblog_write(jl, out, o);
+}
+
+/*
+ * Output that can't be written is thrown away, and the log is opened again
+ * for the next lot.
+ */
+static void
+joblog_write(jl, buf, len)
+	joblog_t	*jl;
+	char const	*buf;
+	size_t		 len;
+{
+ssize_t	n;
+time_t	t;
+char	rec[JOBLOG_IDX_RECSZ + 1];
+
+	if (jl->jl_logfd == -1 && joblog_open(jl) == -1)
+		return;
+
+	/*
+	 * Note where each new bucket starts in the index.  Other writers can
+	 * append to the log too, so an offset might be a little early, but
+	 * never late.
+	 */
+	t = time(NULL);
+	t -= t % JOBLOG_IDX_BUCKET;
+	if (jl->jl_idxfd != -1 && t != jl->jl_bucket) {
+		jl->jl_bucket = t;
+		(void) snprintf(rec, sizeof (rec), JOBLOG_IDX_FMT,
+		    (long)jl->jl_bucket, (u_longlong_t)jl->jl_size);
+		(void) write(jl->jl_idxfd, rec, JOBLOG_IDX_RECSZ);
+	}
+
+	for (; len; buf += n, len -= n) {
+		if ((n = write(jl->jl_logfd, buf, len)) == -1) {
+			if (errno == EINTR) {
+				n = 0;
+				continue;
+			}
+
+			if (!jl->jl_warned)
+				logm(LOG_WARNING, "%s: %s", jl->jl_file,
+				    strerror(errno));
+			jl->jl_warned = 1;
+			joblog_close(jl);
+			return;
+		}
+
+		jl->jl_size += n;
+	}
+
+	if (jl->jl_maxsize && jl->jl_size >= jl->jl_maxsize)
+		joblog_rotate(jl);
+}
+
+/*
+ * Open the log, creating it and its directories if needed.
+ */
+static int
+joblog_open(jl)
+	joblog_t	*jl;
+{
+struct stat	 st;
+char		*s, *idx;
+int		 err = 0;
+
+	if (joblog_become(jl->jl_uid, jl->jl_gid) == -1) {
+		err = errno;
+		goto err;
+	}
+
+	/*
+	 * This is like mkdir -p, but it's only done when the log can't be
+	 * opened; the directory almost always exists.
+	 */
+	/*LINTED*/
+	if ((jl->jl_logfd = open(jl->jl_file, O_WRONLY | O_APPEND | O_CREAT,
+	    0600)) == -1 && errno == ENOENT) {
+		for (s = jl->jl_file + 1; (s = index(s, '/')) != NULL; ++s) {
+			*s = '\0';
+			if (mkdir(jl->jl_file, 0700) == -1 && errno != EEXIST) {
+				err = errno;
+				*s = '/';
+				break;
+			}
+			*s = '/';
+		}
+
+		/*LINTED*/
+		if (!err && (jl->jl_logfd = open(jl->jl_file,
+		    O_WRONLY | O_APPEND | O_CREAT, 0600)) == -1)
+			err = errno;
+	} else if (jl->jl_logfd == -1)
+		err = errno;
+
+	if (!err) {
+		jl->jl_size = fstat(jl->jl_logfd, &st) == 0 ? st.st_size : 0;
+
+		/*
+		 * A new log needs a new index.
+		 */
+		if (jl->jl_stamp && (idx = malloc(strlen(jl->jl_file) +
+		    sizeof (JOBLOG_IDX_SUFFIX))) != NULL) {
+			(void) sprintf(idx, "%s" JOBLOG_IDX_SUFFIX,
+			    jl->jl_file);
+			/*LINTED*/
+			jl->jl_idxfd = open(idx, O_WRONLY | O_APPEND | O_CREAT |
+			    (jl->jl_size ? 0 : O_TRUNC), 0600);
+			free(idx);
+		}
+	}
+
+	joblog_unbecome();
+
+	if (err)
+		goto err;
+
+	(void) fcntl(jl->jl_logfd, F_SETFD, FD_CLOEXEC);
+	if (jl->jl_idxfd != -1)
+		(void) fcntl(jl->jl_idxfd, F_SETFD, FD_CLOEXEC);
+	jl->jl_bucket = 0;
+	jl->jl_warned = 0;
+	return (0);
+
+err:
+	if (!jl->jl_warned)
+		logm(LOG_WARNING, "%s: %s", jl->jl_file, strerror(err));
+	jl->jl_warned = 1;
+	return (-1);
+}
+
+static void
+joblog_close(jl)
+	joblog_t	*jl;
+{
+	if (jl->jl_logfd != -1)
+		(void) close(jl->jl_logfd);
+	if (jl->jl_idxfd != -1)
+		(void) close(jl->jl_idxfd);
+	jl->jl_logfd = jl->jl_idxfd = -1;
+}
+
+/*
+ * Move the log to .0 for the compressor, which keeps as many compressed
+ * segments as fit in logsize * logkeep bytes.  If the compressor hasn't dealt
+ * with the last .0 yet, the log carries on growing, and we try again a second
+ * later.  The log is opened again when there's something to write to it.
+ */
+static void
+joblog_rotate(jl)
+	joblog_t	*jl;
+{
+size_t	 fs = strlen(jl->jl_file) + 32;
+char	*fname;
+time_t	 now = time(NULL);
+int	 rotated = 0;
+
+	if (!logcomp_running()) {
+		joblog_shift(jl);
+		return;
+	}
+
+	if (jl->jl_rotated == now)
+		return;
+	jl->jl_rotated = now;
+
+	if ((fname = malloc(fs)) == NULL)
+		return;
+	(void) snprintf(fname, fs, "%s.0", jl->jl_file);
+
+	if (joblog_become(jl->jl_uid, jl->jl_gid) == -1) {
+		logm(LOG_WARNING, "%s: cannot rotate: %s", jl->jl_file,
+		    strerror(errno));
+		free(fname);
+		return;
+	}
+
+	if (access(fname, F_OK) == -1 && errno == ENOENT &&
+	    rename(jl->jl_file, fname) == 0)
+		rotated = 1;
+
+	joblog_unbecome();
+	free(fname);
+
+	if (rotated)
+		joblog_close(jl);
+
+	/*
+	 * If we couldn't rotate, ask again anyway, in case the compressor
+	 * missed the last request.
+	 */
+	(void) logcomp_request(jl->jl_file, jl->jl_uid, jl->jl_gid,
+	    jl->jl_maxsize * (jl->jl_keep > 0 ? jl->jl_keep : 1));
+}
+
+/*
+ * Without a compressor: move the log to .0, .0 to .1 and so on, losing the
+ * last of 'keep' old logs.
+ */
+static void
+joblog_shift(jl)
+	joblog_t	*jl;
+{
+size_t	 fs = strlen(jl->jl_file) + 32;
+char	*fname, *ofname;
+int	 i;
+
+	joblog_close(jl);
+
+	if ((fname = malloc(fs)) == NULL || (ofname = malloc(fs)) == NULL) {
+		free(fname);
+		return;
+	}
+
+	if (joblog_become(jl->jl_uid, jl->jl_gid) == -1) {
+		logm(LOG_WARNING, "%s: cannot rotate: %s", jl->jl_file,
+		    strerror(errno));
+		goto done;
+	}
+
+	for (i = jl->jl_keep - 1; i > 0; --i) {
+		(void) snprintf(fname, fs, "%s.%d", jl->jl_file, i);
+		(void) snprintf(ofname, fs, "%s.%d", jl->jl_file, i - 1);
+		(void) rename(ofname, fname);
+	}
+
+	(void) snprintf(fname, fs, "%s.0", jl->jl_file);
+	(void) rename(jl->jl_file, fname);
+
+	joblog_unbecome();
+
+done:
+	free(fname);
+	free(ofname);
+}
+
+/*
+ * Nothing else runs while we're the user, so this is safe even in the daemon.
+ * Our own supplementary groups are dropped as well, so they can't be used to
+ * write somewhere the user couldn't.
+ */
+int
+joblog_become(uid, gid)
+	uid_t	uid;
+	gid_t	gid;
+{
+long	ngmax;
+
+	if (our_ngroups == -1) {
+		if ((ngmax = sysconf(_SC_NGROUPS_MAX)) < 1)
+			ngmax = 1;
+		if ((our_groups = calloc(ngmax, sizeof (gid_t))) == NULL)
+			return (-1);
+		if ((our_ngroups = getgroups((int)ngmax, our_groups)) == -1) {
+			our_ngroups = 0;
+			return (-1);
+		}
+	}
+
+	if (setgroups(1, &gid) == -1 ||
+	    setegid(gid) == -1 ||
+	    seteuid(uid) == -1) {
+		joblog_unbecome();
+		return (-1);
+	}
+
+	return (0);
+}
+
+void
+joblog_unbecome()
+{
+int	err = errno;
+	(void) seteuid(getuid());
+	(void) setegid(getgid());
+	(void) setgroups(our_ngroups, our_groups);
+	errno = err;
+}
+
+int
+joblog_register(jl)
+	joblog_t	*jl;
+{
+	if (fd_open(jl->jl_fd) == -1)
+		return (-1);
+
+	if (register_fd(jl->jl_fd, FDE_READ, joblog_callback, jl) == -1) {
+		close_fd(jl->jl_fd);
+		jl->jl_fd = -1;
+		return (-1);
+	}
+
+	return (0);
+}
+
+/*ARGSUSED*/
+static void
+joblog_callback(fd, type, udata)
+	int		 fd;
+	fde_evt_type_t	 type;
+	void		*udata;
+{
+joblog_t	*jl = udata;
+
+	if (joblog_read(jl) == 0)
+		return;
+
+	close_fd(jl->jl_fd);
+	jl->jl_fd = -1;
+	joblog_free(jl);
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright 2010 River Tarnell.  All rights reserved.
+ * Use is subject to license terms.
+ */
+
+/*
+ * Job logs.  A program's stdout and stderr are a pipe, and a collector reads
+ * the pipe and appends what it reads to the job's log file, rotating the file
+ * when it reaches the job's logsize.  Collectors aren't processes: they all
+ * run in the launcher (or in the daemon, if there's no launcher), so a
+ * thousand running jobs cost a thousand pipes rather than a thousand
+ * logwriters.
+ *
+ * The log is in the user's home directory, so it's created, opened and
+ * rotated with the user's credentials, never as root.  Rotated logs are
+ * compressed by the log compressor (see logcomp.h).
+ *
+ * If the job has logstamp set, each line of the log is timestamped, and an
+ * index is kept in <log>.idx, so a reader can find the output since a given
+ * time without reading the whole log.  The index has a fixed-size text
+ * record for each JOBLOG_IDX_BUCKET seconds in which anything was written:
+ * the start of the bucket, and the log's size when the bucket began.  The
+ * index only covers the current log, and is started again when it's rotated.
+ */
+
+#ifndef	JOBLOG_H
+#define	JOBLOG_H
+
+#include	<sys/types.h>
+#include	<inttypes.h>
+
+#include	"state.h"
+#include	"plan.h"
+
+#define	JOBLOG_IDX_SUFFIX	".idx"
+#define	JOBLOG_IDX_BUCKET	60
+#define	JOBLOG_IDX_FMT		"%010ld %020llu\n"
+#define	JOBLOG_IDX_RECSZ	32
+
+typedef struct joblog joblog_t;
+
+/*
+ * Expand the job's logfmt, and find the user and group the log belongs to.
+ * 'plan' may be NULL.  The name is also kept as the job's job_logfile.
+ * Returns the file name, to be freed with free(), or NULL if there's no log.
+ */
+char		*joblog_file(job_t *, launch_plan_t const *, uid_t *, gid_t *);
+
+/*
+ * Create a collector for 'file'.  If 'stamp' is non-zero, lines are
+ * timestamped and the index is kept.  '*wfd' is set to the write side of its
+ * pipe; the caller gives it to the program as stdout and stderr, then closes
+ * it.  Returns NULL and sets errno on failure.
+ */
+joblog_t	*joblog_new(char const *file, uid_t, gid_t, uint64_t maxsize,
+			int keep, int stamp, int *wfd);
+
+/*
+ * The read side of the collector's pipe.
+ */
+int		 joblog_fd(joblog_t *);
+
+/*
+ * Copy what's waiting in the pipe to the log.  Returns 0, or -1 once the
+ * program has closed its end, when the collector should be freed.
+ */
+int		 joblog_read(joblog_t *);
+
+void		 joblog_free(joblog_t *);
+
+/*
+ * Run the collector from the daemon's event loop.  It frees itself when the
+ * program closes the pipe.
+ */
+int		 joblog_register(joblog_t *);
+
+/*
+ * Switch our effective credentials to the log's owner, and back.  Also used
+ * by the log compressor.
+ */
+int		 joblog_become(uid_t, gid_t);
+void		 joblog_unbecome(void);
+
+#endif	/* !JOBLOG_H */
@@ -8,6 +8,7 @@
 
 #include	<syslog.h>
 #include	<stdarg.h>
+#include	<inttypes.h>
 
 /*PRINTFLIKE2*/
 void logm(int sev, char const *msg, ...);
@@ -24,6 +25,13 @@ void *xrecalloc(void *ptr, size_t o, size_t n, size_t size);
 int vasprintf(char **s, char const *fmt, va_list ap);
 int asprintf(char **s, char const *fmt, ...);
 
+/*
+ * Hash a string or a block of memory, for use with hash tables.  The
+ * second argument is the initial value; pass 0 unless chaining hashes.
+ */
+uint32_t strhash(char const *, uint32_t);
+uint32_t memhash(void const *, size_t, uint32_t);
+
 #define	min(x, y) ((x) < (y) ? (x) : (y))
 
 #define	VERSION "E2.0-4_ALPHA"
@@ -32,7 +40,7 @@ int asprintf(char **s, char const *fmt, ...);
 #error prefix not defined
 #endif
 
-#define	LOGWRITER PREFIX "/lib/logwriter"
+#define	JOBEXEC PREFIX "/lib/jobexec"
 
 /*
  * What the time was at the top of the event loop.
@@ -0,0 +1,811 @@
+/*
+ * Copyright 2010 River Tarnell.  All rights reserved.
+ * Use is subject to license terms.
+ */
+
+#include	<sys/types.h>
+#include	<sys/socket.h>
+#include	<sys/ctfs.h>
+#include	<port.h>
+#include	<poll.h>
+#include	<libcontract.h>
+#include	<libnvpair.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<unistd.h>
+#include	<fcntl.h>
+#include	<errno.h>
+#include	<signal.h>
+#include	<stdio.h>
+#include	<netinet/in.h>
+
+#include	"launcher.h"
+#include	"jobserver.h"
+#include	"execute.h"
+#include	"joblog.h"
+#include	"logcomp.h"
+#include	"event.h"
+#include	"queue.h"
+#include	"fd.h"
+
+/*
+ * The largest request the launcher will accept.  Job environments are the
+ * only thing that gets anywhere near this.
+ */
+#define	LAUNCHER_MAX_REQUEST	(1024 * 1024)
+
+typedef struct launch {
+	launch_id_t	 la_id;
+	launch_callback	 la_callback;	/* NULL once cancelled */
+	void		*la_udata;
+	/*
+	 * For a launch done by the daemon itself, the result, waiting to be
+	 * delivered from the event loop.
+	 */
+	ev_id_t		 la_ev;
+	pid_t		 la_pid;
+	contract_t	*la_ct;
+	int		 la_errno;
+	LIST_ENTRY(launch) la_entries;
+} launch_t;
+
+static LIST_HEAD(launch_list, launch) launches;
+static launch_id_t next_id = 1;
+
+/* Our end of the launcher's socket, or -1 if there's no launcher. */
+static int lfd = -1;
+
+static int	 contract_is_regent(void);
+static launch_t	*launch_find(launch_id_t);
+static void	 launch_finish(launch_t *, pid_t, contract_t *, int);
+static int	 launch_direct(launch_t *, job_t *, char const *);
+static void	 launch_deliver(ev_id_t, void *);
+static void	 launcher_reply(int, nvlist_t *, void *);
+static void	 launcher_main(int);
+static int	 launcher_request(int, int, int, nvlist_t *, int *);
+static nvlist_t	*launcher_read(int);
+static int	 launcher_write(int, nvlist_t *);
+static int	 launcher_start(int, int, nvlist_t *, nvlist_t *, int *);
+static char const **launcher_strv(nvlist_t *, char const *);
+
+/*
+ * Contracts abandoned by the launcher are only inherited if our process
+ * contract is a regent.  Otherwise they would be orphaned, and since job
+ * contracts have CT_PR_NOORPHAN, the jobs would be killed.
+ */
+static int
+contract_is_regent()
+{
+char		 fname[128];
+int		 fd;
+ct_stathdl_t	 st;
+uint_t		 param = 0;
+
+	(void) snprintf(fname, sizeof (fname), "%s/process/%ld/status",
+	    CTFS_ROOT, (long)getctid());
+
+	if ((fd = open64(fname, O_RDONLY)) == -1) {
+		logm(LOG_ERR, "contract_is_regent: %s: %s",
+		    fname, strerror(errno));
+		return (0);
+	}
+
+	if (ct_status_read(fd, CTD_FIXED, &st) == -1) {
+		logm(LOG_ERR, "contract_is_regent: %s: %s",
+		    fname, strerror(errno));
+		(void) close(fd);
+		return (0);
+	}
+
+	(void) ct_pr_status_get_param(st, &param);
+	ct_status_free(st);
+	(void) close(fd);
+
+	return ((param & CT_PR_REGENT) != 0);
+}
+
+int
+launcher_init()
+{
+int	sv[2];
+pid_t	pid;
+
+	LIST_INIT(&launches);
+
+	if (!contract_is_regent()) {
+		logm(LOG_NOTICE, "process contract is not a regent; "
+		    "starting jobs without the launcher");
+		(void) logcomp_init();
+		return (0);
+	}
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1) {
+		logm(LOG_ERR, "launcher_init: socketpair: %s",
+		    strerror(errno));
+		return (-1);
+	}
+
+	switch (pid = fork()) {
+	case -1:
+		logm(LOG_ERR, "launcher_init: fork: %s", strerror(errno));
+		(void) close(sv[0]);
+		(void) close(sv[1]);
+		return (-1);
+
+	case 0:
+		(void) close(sv[0]);
+		launcher_main(sv[1]);
+		_exit(0);
+		/*NOTREACHED*/
+
+	default:
+		break;
+	}
+
+	(void) close(sv[1]);
+	lfd = sv[0];
+
+	if (fd_open(lfd) == -1 || fd_set_plain(lfd) == -1 ||
+	    fd_set_nonblocking(lfd, 1) == -1 ||
+	    fd_readnvlist(lfd, launcher_reply, NULL) == -1) {
+		logm(LOG_ERR, "launcher_init: cannot set up launcher fd: %s",
+		    strerror(errno));
+		(void) close(lfd);
+		lfd = -1;
+		return (-1);
+	}
+
+	logm(LOG_INFO, "launcher started, pid %ld", (long)pid);
+	return (0);
+}
+
+static launch_t *
+launch_find(id)
+	launch_id_t	id;
+{
+launch_t	*la;
+	LIST_FOREACH(la, &launches, la_entries)
+		if (la->la_id == id)
+			return (la);
+	return (NULL);
+}
+
+launch_id_t
+launch_job(job, cmd, callback, udata)
+	job_t		*job;
+	char const	*cmd;
+	launch_callback	 callback;
+	void		*udata;
+{
+launch_t		 *la;
+launch_plan_t const	 *plan;
+char			**argv = NULL, *file = NULL;
+nvlist_t		 *nvl = NULL;
+uint_t			  n, nenv;
+uid_t			  uid;
+gid_t			  gid;
+
+	if ((la = calloc(1, sizeof (*la))) == NULL) {
+		logm(LOG_ERR, "launch_job: out of memory");
+		errno = ENOMEM;
+		return (0);
+	}
+
+	la->la_id = next_id++;
+	if (next_id == 0)
+		next_id = 1;
+	la->la_callback = callback;
+	la->la_udata = udata;
+	la->la_ev = -1;
+
+	if (lfd == -1) {
+		if (launch_direct(la, job, cmd) == -1)
+			goto err;
+		LIST_INSERT_HEAD(&launches, la, la_entries);
+		return (la->la_id);
+	}
+
+	plan = plan_get(job);
+	if ((argv = jobexec_argv(job, plan, cmd)) == NULL) {
+		errno = ENOMEM;
+		goto err;
+	}
+	for (n = 0; argv[n]; ++n)
+		;
+
+	if (nvlist_alloc(&nvl, NV_UNIQUE_NAME, 0) ||
+	    nvlist_add_uint32(nvl, "id", la->la_id) ||
+	    nvlist_add_string(nvl, "request", "job") ||
+	    nvlist_add_string_array(nvl, "argv", argv, n)) {
+		logm(LOG_ERR, "launch_job: out of memory");
+		errno = ENOMEM;
+		goto err;
+	}
+
+	if (plan) {
+		for (nenv = 0; plan->lp_env[nenv]; ++nenv)
+			;
+		if (nvlist_add_string_array(nvl, "env", plan->lp_env, nenv)) {
+			logm(LOG_ERR, "launch_job: out of memory");
+			errno = ENOMEM;
+			goto err;
+		}
+	}
+
+	/*
+	 * The launcher collects the job's output.
+	 */
+	if ((file = joblog_file(job, plan, &uid, &gid)) != NULL &&
+	    (nvlist_add_string(nvl, "log", file) ||
+	    nvlist_add_int32(nvl, "loguid", (int32_t)uid) ||
+	    nvlist_add_int32(nvl, "loggid", (int32_t)gid) ||
+	    nvlist_add_uint64(nvl, "logsize", job->job_logsize) ||
+	    nvlist_add_int32(nvl, "logkeep", job->job_logkeep) ||
+	    nvlist_add_int32(nvl, "logstamp", job->job_logstamp))) {
+		logm(LOG_ERR, "launch_job: out of memory");
+		errno = ENOMEM;
+		goto err;
+	}
+
+	if (fd_write_nvlist(lfd, nvl, NV_ENCODE_NATIVE) == -1) {
+		logm(LOG_ERR, "launch_job: cannot send request: %s",
+		    strerror(errno));
+		goto err;
+	}
+
+	nvlist_free(nvl);
+	free(argv);
+	free(file);
+	LIST_INSERT_HEAD(&launches, la, la_entries);
+	return (la->la_id);
+
+err:
+	if (nvl)
+		nvlist_free(nvl);
+	free(argv);
+	free(file);
+	free(la);
+	return (0);
+}
+
+/*
+ * Start the job from the daemon, when there's no launcher.  The result is
+ * still delivered from the event loop, so callers see the same thing either
+ * way.
+ */
+static int
+launch_direct(la, job, cmd)
+	launch_t	*la;
+	job_t		*job;
+	char const	*cmd;
+{
+	if ((la->la_pid = fork_execute(job, cmd)) == -1)
+		la->la_errno = errno;
+	else if ((la->la_ct = contract_open_latest()) == NULL)
+		la->la_errno = errno ? errno : EINVAL;
+
+	if ((la->la_ev = ev_add_once(0, launch_deliver, la)) == -1) {
+		logm(LOG_ERR, "launch_direct: cannot add event");
+		if (la->la_ct) {
+			(void) sigsend(P_CTID, la->la_ct->ct_id, SIGKILL);
+			(void) ct_ctl_abandon(la->la_ct->ct_ctl);
+			contract_close(la->la_ct);
+		}
+		errno = EAGAIN;
+		return (-1);
+	}
+
+	return (0);
+}
+
+/*ARGSUSED*/
+static void
+launch_deliver(evid, udata)
+	ev_id_t	 evid;
+	void	*udata;
+{
+launch_t	*la = udata;
+	la->la_ev = -1;
+	launch_finish(la, la->la_pid, la->la_ct, la->la_errno);
+}
+
+/*
+ * Hand the result of a launch to its owner, or get rid of the processes if
+ * nobody wants them any more.
+ */
+static void
+launch_finish(la, pid, ct, err)
+	launch_t	*la;
+	pid_t		 pid;
+	contract_t	*ct;
+	int		 err;
+{
+	LIST_REMOVE(la, la_entries);
+
+	if (la->la_callback == NULL) {
+		if (ct) {
+			(void) sigsend(P_CTID, ct->ct_id, SIGKILL);
+			if (ct_ctl_abandon(ct->ct_ctl) == -1)
+				logm(LOG_WARNING, "launch_finish: "
+				    "ct_ctl_abandon failed: %s",
+				    strerror(errno));
+			contract_close(ct);
+		}
+		free(la);
+		return;
+	}
+
+	if (ct == NULL) {
+		pid = -1;
+		errno = err;
+	}
+
+	la->la_callback(la->la_id, pid, ct, la->la_udata);
+	free(la);
+}
+
+void
+launch_cancel(id)
+	launch_id_t	id;
+{
+launch_t	*la;
+	if ((la = launch_find(id)) != NULL)
+		la->la_callback = NULL;
+}
+
+int
+launch_mail(cmd, recip, file)
+	char const	*cmd, *recip, *file;
+{
+nvlist_t	*nvl = NULL;
+int		 ret = -1;
+
+	if (lfd == -1)
+		return (send_mail(cmd, recip, file));
+
+	if (nvlist_alloc(&nvl, NV_UNIQUE_NAME, 0) ||
+	    nvlist_add_uint32(nvl, "id", 0) ||
+	    nvlist_add_string(nvl, "request", "mail") ||
+	    nvlist_add_string(nvl, "command", cmd) ||
+	    nvlist_add_string(nvl, "recipient", recip) ||
+	    nvlist_add_string(nvl, "file", file)) {
+		logm(LOG_ERR, "launch_mail: out of memory");
+		goto err;
+	}
+
+	if ((ret = fd_write_nvlist(lfd, nvl, NV_ENCODE_NATIVE)) == -1)
+		logm(LOG_ERR, "launch_mail: cannot send request: %s",
+		    strerror(errno));
+
+err:
+	if (nvl)
+		nvlist_free(nvl);
+	return (ret);
+}
+
+/*
+ * A result from the launcher, or NULL if the launcher has gone away.
+ */
+/*ARGSUSED*/
+static void
+launcher_reply(fd, nvl, udata)
+	int		 fd;
+	nvlist_t	*nvl;
+	void		*udata;
+{
+launch_t	*la;
+uint32_t	 id;
+int32_t		 err = 0, pid = -1, ctid = -1;
+contract_t	*ct = NULL;
+
+	if (nvl == NULL) {
+		logm(LOG_ERR, "launcher exited; starting jobs "
+		    "without the launcher");
+		close_fd(lfd);
+		lfd = -1;
+
+		/*
+		 * Anything the launcher hadn't answered is lost.  Launches
+		 * started by the callbacks are done directly, so aren't
+		 * affected.
+		 */
+	again:
+		LIST_FOREACH(la, &launches, la_entries) {
+			if (la->la_ev == -1) {
+				launch_finish(la, -1, NULL, EPIPE);
+				goto again;
+			}
+		}
+		return;
+	}
+
+	if (nvlist_lookup_uint32(nvl, "id", &id) ||
+	    nvlist_lookup_int32(nvl, "error", &err)) {
+		logm(LOG_WARNING, "launcher_reply: malformed reply");
+		return;
+	}
+	(void) nvlist_lookup_int32(nvl, "pid", &pid);
+	(void) nvlist_lookup_int32(nvl, "ctid", &ctid);
+
+	if ((la = launch_find(id)) == NULL) {
+		logm(LOG_WARNING, "launcher_reply: unknown launch %lu",
+		    (ulong_t)id);
+		return;
+	}
+
+	if (err == 0 && (ct = contract_adopt(ctid)) == NULL) {
+		err = errno;
+		(void) sigsend(P_CTID, ctid, SIGKILL);
+	}
+
+	launch_finish(la, pid, ct, err);
+}
+
+/*
+ * Everything from here on runs in the launcher process.
+ */
+
+static void
+launcher_main(fd)
+	int	fd;
+{
+nvlist_t	*req;
+port_event_t	 ev;
+joblog_t	*jl;
+int		 tmpl, port, i, nlogs = 0;
+
+	/*
+	 * Keep nothing from the daemon but the socket.
+	 */
+	closelog();
+	for (i = 0; i < fd; ++i)
+		(void) close(i);
+	closefrom(fd + 1);
+	openlog("jobserverd", LOG_PID, LOG_DAEMON);
+
+	(void) signal(SIGPIPE, SIG_IGN);
+	(void) signal(SIGCHLD, SIG_IGN);
+	(void) signal(SIGINT, SIG_IGN);
+	(void) signal(SIGTERM, SIG_IGN);
+
+	if ((tmpl = contract_template()) == -1)
+		return;
+
+	/*
+	 * The daemon only starts listening to a job's contract after it's
+	 * adopted it, so the events it needs must be kept until then.
+	 */
+	if (ct_tmpl_set_critical(tmpl, CT_PR_EV_EMPTY | CT_PR_EV_EXIT |
+	    CT_PR_EV_CORE | CT_PR_EV_SIGNAL | CT_PR_EV_HWERR) == -1) {
+		logm(LOG_ERR, "launcher: ct_tmpl_set_critical: %s",
+		    strerror(errno));
+		return;
+	}
+
+	/*
+	 * The compressor is ours, since we rotate the logs.
+	 */
+	(void) logcomp_init();
+
+	if ((port = port_create()) == -1 ||
+	    port_associate(port, PORT_SOURCE_FD, fd, POLLIN, NULL) == -1) {
+		logm(LOG_ERR, "launcher: cannot create event port: %s",
+		    strerror(errno));
+		return;
+	}
+
+	/*
+	 * Requests come from the daemon's socket, and output from the jobs'
+	 * pipes.  Once the daemon has gone, we stay until the jobs we started
+	 * have closed their output, so none of it is lost.
+	 */
+	while (fd != -1 || nlogs > 0) {
+		if (port_get(port, &ev, NULL) == -1) {
+			if (errno == EINTR)
+				continue;
+			logm(LOG_ERR, "launcher: port_get: %s",
+			    strerror(errno));
+			return;
+		}
+
+		if ((jl = ev.portev_user) != NULL) {
+			if (joblog_read(jl) == 0 &&
+			    port_associate(port, PORT_SOURCE_FD,
+			    joblog_fd(jl), POLLIN, jl) == 0)
+				continue;
+
+			joblog_free(jl);
+			nlogs--;
+			continue;
+		}
+
+		if ((req = launcher_read(fd)) == NULL) {
+			(void) close(fd);
+			fd = -1;
+			continue;
+		}
+
+		/*
+		 * If the daemon can't be answered, nothing more can be
+		 * started, but the jobs already running still need their
+		 * output read.
+		 */
+		if (launcher_request(fd, port, tmpl, req, &nlogs) == -1) {
+			nvlist_free(req);
+			(void) close(fd);
+			fd = -1;
+			continue;
+		}
+
+		nvlist_free(req);
+		if (port_associate(port, PORT_SOURCE_FD, fd, POLLIN,
+		    NULL) == -1) {
+			logm(LOG_ERR, "launcher: port_associate: %s",
+			    strerror(errno));
+			return;
+		}
+	}
+}
+
+/*
+ * Handle one request from the daemon.  If a job was started with a log
+ * collector, '*nlogs' is incremented.  Returns -1 if the daemon couldn't be
+ * answered, otherwise 0.
+ */
+static int
+launcher_request(fd, port, tmpl, req, nlogs)
+	int		 fd, port, tmpl;
+	nvlist_t	*req;
+	int		*nlogs;
+{
+nvlist_t	*rep = NULL;
+char		*type, *cmd, *recip, *file, **argv;
+uint_t		 n;
+uint32_t	 id;
+
+	if (nvlist_lookup_uint32(req, "id", &id) ||
+	    nvlist_lookup_string(req, "request", &type)) {
+		logm(LOG_WARNING, "launcher: malformed request");
+		return (0);
+	}
+
+	if (strcmp(type, "mail") == 0) {
+		if (nvlist_lookup_string(req, "command", &cmd) == 0 &&
+		    nvlist_lookup_string(req, "recipient", &recip) == 0 &&
+		    nvlist_lookup_string(req, "file", &file) == 0)
+			(void) send_mail(cmd, recip, file);
+		return (0);
+	}
+
+	if (strcmp(type, "job") != 0 ||
+	    nvlist_lookup_string_array(req, "argv", &argv, &n) ||
+	    n == 0) {
+		logm(LOG_WARNING, "launcher: malformed request");
+		return (0);
+	}
+
+	if (nvlist_alloc(&rep, NV_UNIQUE_NAME, 0) ||
+	    nvlist_add_uint32(rep, "id", id) ||
+	    launcher_start(port, tmpl, req, rep, nlogs) == -1 ||
+	    launcher_write(fd, rep) == -1) {
+		logm(LOG_ERR, "launcher: cannot reply to daemon: %s",
+		    strerror(errno));
+		nvlist_free(rep);
+		return (-1);
+	}
+
+	nvlist_free(rep);
+	return (0);
+}
+
+/*
+ * Start one job, and put the result in 'rep'.  If the job's output is being
+ * collected, '*nlogs' is incremented.  Returns -1 if the reply couldn't be
+ * made.
+ */
+static int
+launcher_start(port, tmpl, req, rep, nlogs)
+	int		 port, tmpl;
+	nvlist_t	*req, *rep;
+	int		*nlogs;
+{
+char const	**argv = NULL, **env = NULL;
+char		 *file;
+pid_t		  pid = -1;
+contract_t	 *ct = NULL;
+joblog_t	 *jl = NULL;
+int32_t		  uid, gid, keep, stamp = 0;
+uint64_t	  size;
+int		  err = 0, wfd = -1;
+
+	(void) nvlist_lookup_int32(req, "logstamp", &stamp);
+
+	if (nvlist_lookup_string(req, "log", &file) == 0 &&
+	    nvlist_lookup_int32(req, "loguid", &uid) == 0 &&
+	    nvlist_lookup_int32(req, "loggid", &gid) == 0 &&
+	    nvlist_lookup_uint64(req, "logsize", &size) == 0 &&
+	    nvlist_lookup_int32(req, "logkeep", &keep) == 0 &&
+	    (jl = joblog_new(file, (uid_t)uid, (gid_t)gid, size, keep,
+	    stamp, &wfd)) == NULL) {
+		err = errno;
+		logm(LOG_ERR, "launcher: cannot create log collector: %s",
+		    strerror(errno));
+	} else if ((argv = launcher_strv(req, "argv")) == NULL ||
+	    (nvlist_exists(req, "env") &&
+	    (env = launcher_strv(req, "env")) == NULL)) {
+		logm(LOG_ERR, "launcher: out of memory");
+		err = ENOMEM;
+	} else if (ct_tmpl_activate(tmpl) == -1) {
+		err = errno;
+		logm(LOG_ERR, "launcher: cannot activate template: %s",
+		    strerror(errno));
+	} else {
+		if ((pid = spawn_jobexec(argv, env, wfd)) == -1) {
+			err = errno;
+			logm(LOG_ERR, "launcher: cannot start %s: %s",
+			    JOBEXEC, strerror(errno));
+		}
+		(void) ct_tmpl_clear(tmpl);
+	}
+
+	/*
+	 * Give the contract up, so the daemon can adopt it.
+	 */
+	if (err == 0) {
+		if ((ct = contract_open_latest()) == NULL) {
+			err = errno ? errno : EINVAL;
+			(void) kill(pid, SIGKILL);
+		} else if (ct_ctl_abandon(ct->ct_ctl) == -1) {
+			err = errno;
+			logm(LOG_ERR, "launcher: ct_ctl_abandon: %s",
+			    strerror(errno));
+			(void) sigsend(P_CTID, ct->ct_id, SIGKILL);
+		}
+	}
+
+	free(argv);
+	free(env);
+
+	/*
+	 * The program has its own copy of the pipe now.
+	 */
+	if (wfd != -1)
+		(void) close(wfd);
+
+	if (jl && (err || port_associate(port, PORT_SOURCE_FD, joblog_fd(jl),
+	    POLLIN, jl) == -1)) {
+		if (!err)
+			logm(LOG_ERR, "launcher: port_associate: %s",
+			    strerror(errno));
+		joblog_free(jl);
+		jl = NULL;
+	}
+
+	if (jl)
+		(*nlogs)++;
+
+	if (nvlist_add_int32(rep, "error", err) ||
+	    (err == 0 && (nvlist_add_int32(rep, "pid", pid) ||
+	    nvlist_add_int32(rep, "ctid", ct->ct_id)))) {
+		contract_close(ct);
+		return (-1);
+	}
+
+	contract_close(ct);
+	return (0);
+}
+
+/*
+ * nvlist string arrays aren't terminated, but exec wants them to be.
+ * Returns a NULL-terminated copy of the array (but not the strings).
+ */
+static char const **
+launcher_strv(nvl, name)
+	nvlist_t	*nvl;
+	char const	*name;
+{
+char		**strs;
+char const	**v;
+uint_t		  i, n;
+
+	if (nvlist_lookup_string_array(nvl, name, &strs, &n))
+		n = 0;
+
+	if ((v = calloc(n + 1, sizeof (*v))) == NULL)
+		return (NULL);
+
+	for (i = 0; i < n; ++i)
+		v[i] = strs[i];
+	return (v);
+}
+
+/*
+ * Requests and replies are framed the same way as fd_write_nvlist(): a 32-bit
+ * length in network order, then the packed nvlist.  The launcher has nothing
+ * else to do, so it uses blocking i/o.
+ */
+static nvlist_t *
+launcher_read(fd)
+	int	fd;
+{
+uint32_t	 len;
+char		*buf, *p;
+size_t		 left;
+ssize_t		 n;
+nvlist_t	*nvl = NULL;
+
+	for (p = (char *)&len, left = sizeof (len); left; p += n, left -= n)
+		if ((n = read(fd, p, left)) <= 0) {
+			if (n == -1 && errno == EINTR) {
+				n = 0;
+				continue;
+			}
+			return (NULL);
+		}
+
+	if ((len = ntohl(len)) > LAUNCHER_MAX_REQUEST) {
+		logm(LOG_ERR, "launcher: request too large (%lu bytes)",
+		    (ulong_t)len);
+		return (NULL);
+	}
+
+	if ((buf = malloc(len)) == NULL) {
+		logm(LOG_ERR, "launcher: out of memory");
+		return (NULL);
+	}
+
+	for (p = buf, left = len; left; p += n, left -= n)
+		if ((n = read(fd, p, left)) <= 0) {
+			if (n == -1 && errno == EINTR) {
+				n = 0;
+				continue;
+			}
+			free(buf);
+			return (NULL);
+		}
+
+	if (nvlist_unpack(buf, len, &nvl, 0))
+		logm(LOG_ERR, "launcher: nvlist_unpack failed");
+	free(buf);
+	return (nvl);
+}
+
+static int
+launcher_write(fd, nvl)
+	int		 fd;
+	nvlist_t	*nvl;
+{
+char		*buf = NULL, *p;
+size_t		 size, left;
+ssize_t		 n;
+uint32_t	 len;
+int		 ret = 0;
+
+	if (nvlist_pack(nvl, &buf, &size, NV_ENCODE_NATIVE, 0))
+		return (-1);
+
+	len = htonl(size);
+	for (p = (char *)&len, left = sizeof (len); left; p += n, left -= n)
+		if ((n = write(fd, p, left)) == -1) {
+			if (errno == EINTR) {
+				n = 0;
+				continue;
+			}
+			ret = -1;
+			goto done;
+		}
+
+	for (p = buf, left = size; left; p += n, left -= n)
+		if ((n = write(fd, p, left)) == -1) {
+			if (errno == EINTR) {
+				n = 0;
+				continue;
+			}
+			ret = -1;
+			goto done;
+		}
+
+done:
+	free(buf);
+	return (ret);
+}
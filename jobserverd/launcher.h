@@ -0,0 +1,69 @@
+/*
+ * Copyright 2010 River Tarnell.  All rights reserved.
+ * Use is subject to license terms.
+ */
+
+/*
+ * The launcher: a small helper process which starts jobs, stop methods and
+ * mail for the daemon, so the event loop never waits for a new process.
+ *
+ * The launcher is forked from main() before the state database is loaded, so
+ * it's small and stays that way.  The daemon sends it requests over a
+ * socketpair, and the results come back whenever they're ready; any number of
+ * launches can be outstanding at once.
+ *
+ * The launcher also collects the output of the jobs it starts (see joblog.h),
+ * and carries on doing so if the daemon exits, until the jobs have finished.
+ *
+ * The launcher starts each job in a new process contract and abandons it.
+ * Because the launcher is a member of the daemon's own process contract, and
+ * that contract is a regent, the job's contract is inherited by it, and the
+ * daemon adopts the contract when the result arrives.  If the daemon's
+ * contract isn't a regent, or the launcher dies, programs are started from
+ * the daemon itself instead.
+ */
+
+#ifndef	LAUNCHER_H
+#define	LAUNCHER_H
+
+#include	<sys/types.h>
+#include	<inttypes.h>
+
+#include	"state.h"
+#include	"ct.h"
+
+typedef uint32_t launch_id_t;
+
+/*
+ * Called when a launch has finished.  On success, 'ct' is the new processes'
+ * contract, adopted and open, and now belongs to the callback.  On failure,
+ * 'ct' is NULL and errno is set.
+ */
+typedef void (*launch_callback)(launch_id_t, pid_t, contract_t *, void *);
+
+/*
+ * Start the launcher.  Should only be called once, from main().
+ */
+int		launcher_init(void);
+
+/*
+ * Run 'cmd' for the job, the same way fork_execute() does.  Returns 0 and
+ * sets errno if the launch couldn't be started; otherwise, the callback is
+ * always called later, from the event loop.
+ */
+launch_id_t	launch_job(job_t *, char const *cmd, launch_callback, void *);
+
+/*
+ * Forget about a launch which hasn't finished.  The callback is not called,
+ * and if the processes were started, they're killed.
+ */
+void		launch_cancel(launch_id_t);
+
+/*
+ * Send the mail message in 'file' to 'recip' with the mailer 'cmd', as
+ * send_mail() does.  There's no result; failures are logged.
+ */
+int		launch_mail(char const *cmd, char const *recip,
+			char const *file);
+
+#endif	/* !LAUNCHER_H */
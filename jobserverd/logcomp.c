@@ -0,0 +1,312 @@
+/*
+ * Copyright 2010 River Tarnell.  All rights reserved.
+ * Use is subject to license terms.
+ */
+
+#include	<sys/types.h>
+#include	<sys/stat.h>
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<unistd.h>
+#include	<fcntl.h>
+#include	<errno.h>
+#include	<signal.h>
+#include	<limits.h>
+#include	<zlib.h>
+
+#include	"logcomp.h"
+#include	"joblog.h"
+#include	"jobserver.h"
+
+/*
+ * A request is written in a single write() of at most PIPE_BUF bytes, so it
+ * arrives whole or not at all.
+ */
+typedef struct logcomp_req {
+	uid_t		lr_uid;
+	gid_t		lr_gid;
+	uint64_t	lr_budget;
+	uint32_t	lr_len;		/* of the file name which follows */
+} logcomp_req_t;
+
+#define	LOGCOMP_MAX_NAME	(PIPE_BUF - sizeof (logcomp_req_t))
+
+/*
+ * Don't look for more old segments than this.
+ */
+#define	LOGCOMP_MAX_SEGS	10000
+
+/* Our end of the compressor's pipe, or -1. */
+static int cfd = -1;
+
+static void	logcomp_main(int);
+static int	logcomp_read(int, void *, size_t);
+static void	logcomp_file(logcomp_req_t const *, char const *);
+static int	logcomp_gzip(int, char const *);
+static void	logcomp_expire(char const *, uint64_t);
+
+int
+logcomp_init()
+{
+int	fds[2];
+
+	if (pipe(fds) == -1) {
+		logm(LOG_ERR, "logcomp_init: pipe: %s", strerror(errno));
+		return (-1);
+	}
+
+	switch (fork()) {
+	case -1:
+		logm(LOG_ERR, "logcomp_init: fork: %s", strerror(errno));
+		(void) close(fds[0]);
+		(void) close(fds[1]);
+		return (-1);
+
+	case 0:
+		(void) close(fds[1]);
+		logcomp_main(fds[0]);
+		_exit(0);
+		/*NOTREACHED*/
+
+	default:
+		(void) close(fds[0]);
+		cfd = fds[1];
+		(void) fcntl(cfd, F_SETFD, FD_CLOEXEC);
+		(void) fcntl(cfd, F_SETFL, fcntl(cfd, F_GETFL, 0) | O_NONBLOCK);
+		return (0);
+	}
+}
+
+int
+logcomp_running()
+{
+	return (cfd != -1);
+}
+
+int
+logcomp_request(file, uid, gid, budget)
+	char const	*file;
+	uid_t		 uid;
+	gid_t		 gid;
+	uint64_t	 budget;
+{
+char		 buf[PIPE_BUF];
+logcomp_req_t	 req;
+size_t		 len = strlen(file);
+
+	if (cfd == -1) {
+		errno = EPIPE;
+		return (-1);
+	}
+
+	if (len > LOGCOMP_MAX_NAME) {
+		errno = ENAMETOOLONG;
+		return (-1);
+	}
+
+	bzero(&req, sizeof (req));
+	req.lr_uid = uid;
+	req.lr_gid = gid;
+	req.lr_budget = budget;
+	req.lr_len = len;
+	bcopy(&req, buf, sizeof (req));
+	bcopy(file, buf + sizeof (req), len);
+
+	if (write(cfd, buf, sizeof (req) + len) == -1) {
+		if (errno == EPIPE) {
+			logm(LOG_ERR, "log compressor exited; rotated logs "
+			    "will not be compressed");
+			(void) close(cfd);
+			cfd = -1;
+		}
+		return (-1);
+	}
+
+	return (0);
+}
+
+/*
+ * Everything from here on runs in the compressor process.
+ */
+
+static void
+logcomp_main(fd)
+	int	fd;
+{
+logcomp_req_t	 req;
+char		 file[PIPE_BUF + 1];
+int		 i;
+
+	closelog();
+	for (i = 0; i < fd; ++i)
+		(void) close(i);
+	closefrom(fd + 1);
+	openlog("jobserverd", LOG_PID, LOG_DAEMON);
+
+	(void) signal(SIGPIPE, SIG_IGN);
+	(void) signal(SIGCHLD, SIG_IGN);
+	(void) signal(SIGINT, SIG_IGN);
+	(void) signal(SIGTERM, SIG_IGN);
+
+	/*
+	 * Compression is never urgent.
+	 */
+	(void) nice(19);
+
+	while (logcomp_read(fd, &req, sizeof (req)) == 0) {
+		if (req.lr_len > LOGCOMP_MAX_NAME ||
+		    logcomp_read(fd, file, req.lr_len) == -1)
+			break;
+		file[req.lr_len] = '\0';
+
+		logcomp_file(&req, file);
+	}
+}
+
+static int
+logcomp_read(fd, buf, len)
+	int	 fd;
+	void	*buf;
+	size_t	 len;
+{
+char	*p = buf;
+ssize_t	 n;
+
+	for (; len; p += n, len -= n)
+		if ((n = read(fd, p, len)) <= 0) {
+			if (n == -1 && errno == EINTR) {
+				n = 0;
+				continue;
+			}
+			return (-1);
+		}
+
+	return (0);
+}
+
+/*
+ * Compress <file>.0 to <file>.0.gz, after moving the older segments up.  If
+ * <file>.0 isn't there, this is a repeated request for a segment we've
+ * already done, and only the expiry is needed.
+ */
+static void
+logcomp_file(req, file)
+	logcomp_req_t const	*req;
+	char const		*file;
+{
+char	seg[PATH_MAX], tmp[PATH_MAX], from[PATH_MAX], to[PATH_MAX];
+int	in, i, n;
+
+	if (joblog_become(req->lr_uid, req->lr_gid) == -1) {
+		logm(LOG_WARNING, "%s: cannot compress: %s", file,
+		    strerror(errno));
+		return;
+	}
+
+	(void) snprintf(seg, sizeof (seg), "%s.0", file);
+	(void) snprintf(tmp, sizeof (tmp), "%s.0.gz.tmp", file);
+
+	/*LINTED*/
+	if ((in = open(seg, O_RDONLY | O_NOFOLLOW)) != -1) {
+		if (logcomp_gzip(in, tmp) == 0) {
+			for (n = 0; n < LOGCOMP_MAX_SEGS; ++n) {
+				(void) snprintf(from, sizeof (from), "%s.%d.gz",
+				    file, n);
+				if (access(from, F_OK) == -1)
+					break;
+			}
+
+			for (i = n; i > 0; --i) {
+				(void) snprintf(from, sizeof (from), "%s.%d.gz",
+				    file, i - 1);
+				(void) snprintf(to, sizeof (to), "%s.%d.gz",
+				    file, i);
+				(void) rename(from, to);
+			}
+
+			(void) snprintf(to, sizeof (to), "%s.0.gz", file);
+			if (rename(tmp, to) == 0)
+				(void) unlink(seg);
+			else
+				(void) unlink(tmp);
+		} else
+			(void) unlink(tmp);
+
+		(void) close(in);
+	}
+
+	logcomp_expire(file, req->lr_budget);
+	joblog_unbecome();
+}
+
+static int
+logcomp_gzip(in, tmp)
+	int		 in;
+	char const	*tmp;
+{
+static char	 buf[64 * 1024];
+gzFile		 gz;
+ssize_t		 n;
+int		 out, ret = 0;
+
+	/*LINTED*/
+	if ((out = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW,
+	    0600)) == -1) {
+		logm(LOG_WARNING, "%s: %s", tmp, strerror(errno));
+		return (-1);
+	}
+
+	if ((gz = gzdopen(out, "wb")) == NULL) {
+		logm(LOG_WARNING, "%s: gzdopen failed", tmp);
+		(void) close(out);
+		return (-1);
+	}
+
+	while ((n = read(in, buf, sizeof (buf))) != 0) {
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			ret = -1;
+			break;
+		}
+
+		if (gzwrite(gz, buf, (unsigned)n) != n) {
+			ret = -1;
+			break;
+		}
+	}
+
+	if (gzclose(gz) != Z_OK)
+		ret = -1;
+
+	if (ret == -1)
+		logm(LOG_WARNING, "%s: compression failed", tmp);
+	return (ret);
+}
+
+/*
+ * Remove the oldest segments until the rest fit in the budget.  The newest
+ * is always kept, however big it is.
+ */
+static void
+logcomp_expire(file, budget)
+	char const	*file;
+	uint64_t	 budget;
+{
+char		name[PATH_MAX];
+struct stat	st;
+uint64_t	total = 0;
+int		i;
+
+	for (i = 0; i < LOGCOMP_MAX_SEGS; ++i) {
+		(void) snprintf(name, sizeof (name), "%s.%d.gz", file, i);
+		if (lstat(name, &st) == -1)
+			break;
+
+		total += st.st_size;
+		if (i > 0 && total > budget)
+			(void) unlink(name);
+	}
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright 2010 River Tarnell.  All rights reserved.
+ * Use is subject to license terms.
+ */
+
+/*
+ * The log compressor: a low-priority process which gzips rotated job logs.
+ *
+ * When a log is rotated, it's renamed to <log>.0 and the compressor is asked
+ * to deal with it.  The compressor moves the older <log>.N.gz files up by
+ * one, compresses <log>.0 to <log>.0.gz, and then removes the oldest files
+ * until the rest fit in the job's log budget (logsize * logkeep compressed
+ * bytes).  Like the collectors, it works with the log owner's credentials.
+ *
+ * Requests are written without blocking, so a busy compressor never holds up
+ * a collector; if it's still working on a log's last segment when the log is
+ * due to be rotated again, the log just grows until the compressor catches
+ * up.
+ */
+
+#ifndef	LOGCOMP_H
+#define	LOGCOMP_H
+
+#include	<sys/types.h>
+#include	<inttypes.h>
+
+/*
+ * Start the compressor.  Called once, by whichever process runs the
+ * collectors.  Returns -1 if it couldn't be started; logs are then rotated
+ * without compression.
+ */
+int	logcomp_init(void);
+
+/*
+ * Non-zero if there's a compressor to send requests to.
+ */
+int	logcomp_running(void);
+
+/*
+ * Ask the compressor to compress <file>.0 and expire old segments of <file>.
+ * Returns -1 if the request couldn't be sent (for example, because the
+ * compressor is busy and its pipe is full).
+ */
+int	logcomp_request(char const *file, uid_t, gid_t, uint64_t budget);
+
+#endif	/* !LOGCOMP_H */
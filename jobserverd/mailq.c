@@ -0,0 +1,456 @@
+/*
+ * Copyright 2010 River Tarnell.  All rights reserved.
+ * Use is subject to license terms.
+ */
+
+#include	<sys/types.h>
+#include	<sys/stat.h>
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<strings.h>
+#include	<unistd.h>
+#include	<fcntl.h>
+#include	<errno.h>
+#include	<ctype.h>
+#include	<dirent.h>
+#include	<limits.h>
+#include	<time.h>
+#include	<deflt.h>
+
+#include	"mailq.h"
+#include	"jobserver.h"
+#include	"launcher.h"
+#include	"event.h"
+#include	"queue.h"
+
+#define	MAILQ_DEFAULTS		DEFLT "/jobserver"
+#define	MAILQ_DEFAULT_WINDOW	60
+#define	MAILQ_DEFAULT_COMMAND	"/usr/lib/sendmail"
+
+/*
+ * Each notification in a spool file is a line "<length> <time> <subject>",
+ * followed by <length> bytes of text.
+ */
+typedef struct mailq_ent {
+	time_t		 me_time;
+	char const	*me_subject;
+	char const	*me_body;
+	size_t		 me_len;
+} mailq_ent_t;
+
+/*
+ * A recipient whose digest window is open.
+ */
+typedef struct mailq_rcpt {
+	char		*mr_name;
+	ev_id_t		 mr_timer;
+	LIST_ENTRY(mailq_rcpt) mr_entries;
+} mailq_rcpt_t;
+
+static LIST_HEAD(mailq_rcpt_list, mailq_rcpt) rcpts;
+
+static int	 mail_window = MAILQ_DEFAULT_WINDOW;
+static char const *mail_command;
+static uint_t	 mail_seq;
+
+static void	mailq_load_config(void);
+static int	mailq_valid(char const *);
+static int	mailq_schedule(char const *);
+static void	mailq_timer(ev_id_t, void *);
+static int	mailq_flush(char const *);
+static int	mailq_parse(char *, size_t, mailq_ent_t **);
+static int	mailq_compose(FILE *, char const *, mailq_ent_t const *, int);
+
+int
+mailq_init()
+{
+DIR		*dir;
+struct dirent	*de;
+char		 file[PATH_MAX], recip[PATH_MAX], *p;
+
+	mailq_load_config();
+
+	if (mkdir(MAILQ_SPOOL, 0700) == -1 && errno != EEXIST) {
+		logm(LOG_ERR, "mailq_init: %s: %s", MAILQ_SPOOL,
+		    strerror(errno));
+		return (-1);
+	}
+
+	if ((dir = opendir(MAILQ_SPOOL)) == NULL) {
+		logm(LOG_ERR, "mailq_init: %s: %s", MAILQ_SPOOL,
+		    strerror(errno));
+		return (-1);
+	}
+
+	while ((de = readdir(dir)) != NULL) {
+		if (strcmp(de->d_name, ".") == 0 ||
+		    strcmp(de->d_name, "..") == 0)
+			continue;
+
+		if (de->d_name[0] != '.') {
+			(void) mailq_schedule(de->d_name);
+			continue;
+		}
+
+		/*
+		 * A digest, ".<recipient>.<time>.<seq>", which was written but
+		 * never handed to the mailer.
+		 */
+		(void) strlcpy(recip, de->d_name + 1, sizeof (recip));
+		if ((p = strrchr(recip, '.')) != NULL)
+			*p = '\0';
+		if ((p = strrchr(recip, '.')) == NULL || !mailq_valid(recip))
+			continue;
+		*p = '\0';
+
+		(void) snprintf(file, sizeof (file), "%s/%s", MAILQ_SPOOL,
+		    de->d_name);
+		(void) launch_mail(mail_command, recip, file);
+	}
+
+	(void) closedir(dir);
+	return (0);
+}
+
+/*
+ * Read the mail settings from /etc/default/jobserver.
+ */
+static void
+mailq_load_config()
+{
+char	*s;
+int	 n;
+
+	if (defopen(MAILQ_DEFAULTS) == 0) {
+		if ((s = defread("MAIL_DIGEST_WINDOW=")) != NULL) {
+			if ((n = atoi(s)) >= 0 && isdigit(*s))
+				mail_window = n;
+			else
+				logm(LOG_WARNING, "%s: invalid "
+				    "MAIL_DIGEST_WINDOW \"%s\"",
+				    MAILQ_DEFAULTS, s);
+		}
+
+		if ((s = defread("MAIL_COMMAND=")) != NULL) {
+			if (*s == '/')
+				mail_command = strdup(s);
+			else
+				logm(LOG_WARNING, "%s: invalid MAIL_COMMAND "
+				    "\"%s\" (must be an absolute path)",
+				    MAILQ_DEFAULTS, s);
+		}
+
+		(void) defopen(NULL);
+	}
+
+	if (mail_command == NULL)
+		mail_command = MAILQ_DEFAULT_COMMAND;
+}
+
+/*
+ * Recipients are user names, which are used as file names in the spool.
+ */
+static int
+mailq_valid(recip)
+	char const	*recip;
+{
+	return (*recip && *recip != '.' && index(recip, '/') == NULL);
+}
+
+int
+mailq_add(recip, subject, body)
+	char const	*recip, *subject, *body;
+{
+char	 file[PATH_MAX], *subj, *rec, *p;
+int	 fd, len;
+
+	if (!mailq_valid(recip)) {
+		logm(LOG_WARNING, "mailq_add: invalid recipient \"%s\"",
+		    recip);
+		errno = EINVAL;
+		return (-1);
+	}
+
+	/*
+	 * The subject is on the record's first line.
+	 */
+	if ((subj = strdup(subject)) == NULL) {
+		logm(LOG_ERR, "mailq_add: out of memory");
+		return (-1);
+	}
+
+	for (p = subj; *p; ++p)
+		if (*p == '\n')
+			*p = ' ';
+
+	len = asprintf(&rec, "%lu %ld %s\n%s", (unsigned long)strlen(body),
+	    (long)current_time, subj, body);
+	free(subj);
+	if (len == -1) {
+		logm(LOG_ERR, "mailq_add: out of memory");
+		return (-1);
+	}
+
+	/*
+	 * The record is appended in one write, so a crash never leaves half
+	 * of it in the file unless the disk is full.
+	 */
+	(void) snprintf(file, sizeof (file), "%s/%s", MAILQ_SPOOL, recip);
+	/*LINTED*/
+	if ((fd = open(file, O_WRONLY | O_APPEND | O_CREAT | O_NOFOLLOW,
+	    0600)) == -1) {
+		logm(LOG_ERR, "mailq_add: %s: %s", file, strerror(errno));
+		free(rec);
+		return (-1);
+	}
+
+	if (write(fd, rec, len) != len) {
+		logm(LOG_ERR, "mailq_add: %s: %s", file, strerror(errno));
+		(void) close(fd);
+		free(rec);
+		return (-1);
+	}
+
+	(void) close(fd);
+	free(rec);
+	return (mailq_schedule(recip));
+}
+
+/*
+ * Open the digest window for 'recip', if it isn't already open.
+ */
+static int
+mailq_schedule(recip)
+	char const	*recip;
+{
+mailq_rcpt_t	*mr;
+
+	LIST_FOREACH(mr, &rcpts, mr_entries)
+		if (strcmp(mr->mr_name, recip) == 0)
+			return (0);
+
+	if ((mr = calloc(1, sizeof (*mr))) == NULL ||
+	    (mr->mr_name = strdup(recip)) == NULL) {
+		logm(LOG_ERR, "mailq_schedule: out of memory");
+		free(mr);
+		return (-1);
+	}
+
+	if ((mr->mr_timer = ev_add_once(mail_window, mailq_timer,
+	    mr)) == -1) {
+		logm(LOG_ERR, "mailq_schedule: cannot add timer: %s",
+		    strerror(errno));
+		free(mr->mr_name);
+		free(mr);
+		return (-1);
+	}
+
+	LIST_INSERT_HEAD(&rcpts, mr, mr_entries);
+	return (0);
+}
+
+/*ARGSUSED*/
+static void
+mailq_timer(evid, udata)
+	ev_id_t	 evid;
+	void	*udata;
+{
+mailq_rcpt_t	*mr = udata;
+
+	LIST_REMOVE(mr, mr_entries);
+	(void) mailq_flush(mr->mr_name);
+	free(mr->mr_name);
+	free(mr);
+}
+
+/*
+ * Turn the recipient's spool file into a digest, and send it.  If the digest
+ * can't be written, the spool file is left alone, and is tried again next
+ * time the daemon starts.
+ */
+static int
+mailq_flush(recip)
+	char const	*recip;
+{
+char		 file[PATH_MAX], out[PATH_MAX];
+char		*buf = NULL;
+struct stat	 st;
+mailq_ent_t	*ents = NULL;
+ssize_t		 n;
+size_t		 got = 0;
+int		 fd, ofd = -1, nents;
+FILE		*fl = NULL;
+
+	(void) snprintf(file, sizeof (file), "%s/%s", MAILQ_SPOOL, recip);
+	/*LINTED*/
+	if ((fd = open(file, O_RDONLY | O_NOFOLLOW)) == -1) {
+		logm(LOG_ERR, "mailq_flush: %s: %s", file, strerror(errno));
+		return (-1);
+	}
+
+	if (fstat(fd, &st) == -1 ||
+	    (buf = malloc(st.st_size + 1)) == NULL) {
+		logm(LOG_ERR, "mailq_flush: %s: %s", file, strerror(errno));
+		goto err;
+	}
+
+	while (got < st.st_size) {
+		if ((n = read(fd, buf + got, st.st_size - got)) <= 0) {
+			if (n == -1 && errno == EINTR)
+				continue;
+			logm(LOG_ERR, "mailq_flush: %s: %s", file,
+			    n == 0 ? "short read" : strerror(errno));
+			goto err;
+		}
+		got += n;
+	}
+	buf[got] = '\0';
+
+	if ((nents = mailq_parse(buf, got, &ents)) == -1) {
+		logm(LOG_ERR, "mailq_flush: out of memory");
+		goto err;
+	}
+
+	(void) close(fd);
+	fd = -1;
+
+	if (nents == 0) {
+		(void) unlink(file);
+		free(buf);
+		return (0);
+	}
+
+	(void) snprintf(out, sizeof (out), "%s/.%s.%ld.%u", MAILQ_SPOOL,
+	    recip, (long)current_time, mail_seq++);
+	/*LINTED*/
+	if ((ofd = open(out, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW,
+	    0600)) == -1 || (fl = fdopen(ofd, "w")) == NULL) {
+		logm(LOG_ERR, "mailq_flush: %s: %s", out, strerror(errno));
+		goto err;
+	}
+
+	if (mailq_compose(fl, recip, ents, nents) == -1) {
+		logm(LOG_ERR, "mailq_flush: %s: %s", out, strerror(errno));
+		(void) fclose(fl);
+		(void) unlink(out);
+		fl = NULL;
+		ofd = -1;
+		goto err;
+	}
+
+	if (fclose(fl) == EOF) {
+		logm(LOG_ERR, "mailq_flush: %s: %s", out, strerror(errno));
+		(void) unlink(out);
+		fl = NULL;
+		ofd = -1;
+		goto err;
+	}
+
+	(void) unlink(file);
+	free(ents);
+	free(buf);
+
+	return (launch_mail(mail_command, recip, out));
+
+err:
+	if (fl)
+		(void) fclose(fl);
+	else if (ofd != -1)
+		(void) close(ofd);
+	if (fd != -1)
+		(void) close(fd);
+	free(ents);
+	free(buf);
+	return (-1);
+}
+
+/*
+ * Split a spool file into its notifications.  A record cut short (by a crash
+ * while it was being written) ends the file.  The strings point into 'buf',
+ * which is modified.
+ */
+static int
+mailq_parse(buf, len, entsp)
+	char		 *buf;
+	size_t		  len;
+	mailq_ent_t	**entsp;
+{
+mailq_ent_t	*ents = NULL, *e;
+char		*p = buf, *end = buf + len, *nl, *s;
+unsigned long	 blen;
+int		 n = 0;
+
+	while (p < end && (nl = memchr(p, '\n', end - p)) != NULL) {
+		*nl = '\0';
+		blen = strtoul(p, &s, 10);
+		if (*s != ' ' || blen > (size_t)(end - (nl + 1)))
+			break;
+
+		if ((e = xrecalloc(ents, n, n + 1, sizeof (*ents))) == NULL) {
+			free(ents);
+			return (-1);
+		}
+		ents = e;
+		e = &ents[n++];
+
+		e->me_time = (time_t)strtol(s + 1, &s, 10);
+		e->me_subject = (*s == ' ') ? s + 1 : s;
+		e->me_body = nl + 1;
+		e->me_len = blen;
+		p = nl + 1 + blen;
+	}
+
+	*entsp = ents;
+	return (n);
+}
+
+/*
+ * Write the digest.  A single notification goes out as it is; several get a
+ * summary, one line each, followed by their full text.
+ */
+static int
+mailq_compose(fl, recip, ents, n)
+	FILE			*fl;
+	char const		*recip;
+	mailq_ent_t const	*ents;
+	int			 n;
+{
+char	hostname[64], timestr[128];
+int	i;
+
+	if (gethostname(hostname, sizeof (hostname)) == -1)
+		(void) strlcpy(hostname, "unknown", sizeof (hostname));
+	else
+		hostname[sizeof (hostname) - 1] = 0;
+
+	(void) strftime(timestr, sizeof (timestr),
+	    "%a, %d %b %Y %H:%M:%S %z", gmtime(&current_time));
+	(void) fprintf(fl, "To: %s\nDate: %s\n", recip, timestr);
+
+	if (n == 1)
+		(void) fprintf(fl, "Subject: %s\n\n", ents[0].me_subject);
+	else {
+		(void) fprintf(fl, "Subject: %d notifications about your jobs "
+		    "on %s\n\n", n, hostname);
+		(void) fprintf(fl, "There were %d notifications about your "
+		    "jobs on the host \"%s\":\n\n", n, hostname);
+
+		for (i = 0; i < n; ++i) {
+			(void) strftime(timestr, sizeof (timestr),
+			    "%Y-%m-%d %H:%M:%S", localtime(&ents[i].me_time));
+			(void) fprintf(fl, "  %s  %s\n", timestr,
+			    ents[i].me_subject);
+		}
+	}
+
+	for (i = 0; i < n; ++i) {
+		if (n > 1)
+			(void) fprintf(fl, "\n-- %s\n\n", ents[i].me_subject);
+		(void) fwrite(ents[i].me_body, 1, ents[i].me_len, fl);
+	}
+
+	(void) fprintf(fl, "\nRegards,\n\tThe job server.\n");
+	return (ferror(fl) ? -1 : 0);
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright 2010 River Tarnell.  All rights reserved.
+ * Use is subject to license terms.
+ */
+
+/*
+ * The mail queue.  Notifications about jobs aren't mailed as they happen;
+ * they're appended to a spool file for their recipient in MAILQ_SPOOL.  The
+ * first notification for a recipient starts the digest window, and when the
+ * window ends, everything in the recipient's spool file is sent as a single
+ * message, so a thousand jobs failing at once is one mail per user rather than
+ * a thousand.  The message is written to a file and handed to the launcher,
+ * which starts the mailer with the file as its input.
+ *
+ * The window and the mailer are set in /etc/default/jobserver:
+ *
+ *	MAIL_DIGEST_WINDOW=n	seconds to collect notifications for (60)
+ *	MAIL_COMMAND=path	the mailer (/usr/lib/sendmail)
+ *
+ * The mailer is run as "<path> -oi -bm -- <recipient>", with the message on
+ * stdin, so any program which reads its input and exits will do in place of
+ * sendmail.
+ *
+ * Anything left in the spool when the daemon stops is sent when it starts
+ * again.
+ */
+
+#ifndef	MAILQ_H
+#define	MAILQ_H
+
+#define	MAILQ_SPOOL	"/var/jobserver/mail"
+
+/*
+ * Read the configuration and send whatever was left in the spool.  Must be
+ * called after launcher_init().
+ */
+int	mailq_init(void);
+
+/*
+ * Queue a notification.  'body' is the text of the notification, without any
+ * headers; 'subject' is used if it's the only one in the digest.
+ */
+int	mailq_add(char const *recip, char const *subject, char const *body);
+
+#endif	/* !MAILQ_H */
@@ -34,6 +34,8 @@
 #include	"event.h"
 #include	"state.h"
 #include	"sched.h"
+#include	"launcher.h"
+#include	"mailq.h"
 
 time_t current_time;
 int shutting_down;
@@ -120,11 +122,25 @@ struct rlimit	nofile;
 		return (1);
 	}
 
+	/*
+	 * Start the launcher before loading any state, so it's as small as
+	 * possible.
+	 */
+	if (launcher_init() == -1) {
+		logm(LOG_ERR, "cannot start launcher");
+		return (1);
+	}
+
 	if (statedb_init() == -1) {
 		logm(LOG_ERR, "cannot initialise database");
 		return (1);
 	}
 
+	if (mailq_init() == -1) {
+		logm(LOG_ERR, "cannot initialise mail queue");
+		return (1);
+	}
+
 	if (sched_init(port) == -1) {
 		logm(LOG_ERR, "cannot initialise scheduler");
 		return (1);
@@ -232,6 +248,47 @@ va_list	ap2;
 	return (ret);
 }
 
+/*
+ * FNV-1a.  This is not a particularly good hash, but it's fast and good
+ * enough for the string keys (FMRIs, usernames) we use it for.
+ */
+#define	FNV_OFFSET	2166136261U
+#define	FNV_PRIME	16777619U
+
+uint32_t
+strhash(s, h)
+	char const	*s;
+	uint32_t	 h;
+{
+	if (h == 0)
+		h = FNV_OFFSET;
+
+	while (*s) {
+		h ^= (uchar_t)*s++;
+		h *= FNV_PRIME;
+	}
+
+	return (h);
+}
+
+uint32_t
+memhash(p, sz, h)
+	void const	*p;
+	size_t		 sz;
+	uint32_t	 h;
+{
+uchar_t const	*s = p;
+	if (h == 0)
+		h = FNV_OFFSET;
+
+	while (sz--) {
+		h ^= *s++;
+		h *= FNV_PRIME;
+	}
+
+	return (h);
+}
+
 int
 asprintf(char **buf, char const *fmt, ...)
 {
@@ -0,0 +1,324 @@
+/*
+ * Copyright 2010 River Tarnell.  All rights reserved.
+ * Use is subject to license terms.
+ */
+
+#include	<sys/types.h>
+#include	<sys/stat.h>
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<strings.h>
+#include	<unistd.h>
+#include	<fcntl.h>
+#include	<errno.h>
+#include	<pwd.h>
+#include	<grp.h>
+#include	<deflt.h>
+#include	<project.h>
+#include	<limits.h>
+
+#include	"plan.h"
+#include	"jobserver.h"
+
+/*
+ * Files which, when they change, make every plan out of date.
+ */
+static char const *const plan_files[] = {
+	"/etc/passwd",
+	"/etc/group",
+	"/etc/project",
+	"/etc/user_attr",
+	DEFLT "/login",
+};
+#define	NPLAN_FILES	(sizeof (plan_files) / sizeof (*plan_files))
+
+static timestruc_t	plan_mtimes[NPLAN_FILES];
+static time_t		plan_checked;
+static uint_t		plan_gen;
+
+static void		 plan_check_files(void);
+static int		 plan_current(launch_plan_t const *);
+static launch_plan_t	*plan_build(job_t *);
+static int		 plan_env_add(launch_plan_t *, int *, char const *,
+				char const *);
+static int		 plan_read_env(launch_plan_t *, int *, uid_t);
+static void		 plan_free(launch_plan_t *);
+
+/*
+ * Look at the system files at most once a second; a plan built in the same
+ * second as a change will be rebuilt after the next check.
+ */
+static void
+plan_check_files()
+{
+struct stat	st;
+size_t		i;
+
+	if (plan_checked == current_time)
+		return;
+	plan_checked = current_time;
+
+	for (i = 0; i < NPLAN_FILES; ++i) {
+		if (stat(plan_files[i], &st) == -1)
+			bzero(&st, sizeof (st));
+
+		if (st.st_mtim.tv_sec != plan_mtimes[i].tv_sec ||
+		    st.st_mtim.tv_nsec != plan_mtimes[i].tv_nsec) {
+			plan_mtimes[i] = st.st_mtim;
+			plan_gen++;
+		}
+	}
+}
+
+static int
+plan_current(lp)
+	launch_plan_t const	*lp;
+{
+char		path[PATH_MAX];
+struct stat	st;
+
+	if (lp->lp_gen != plan_gen || current_time < lp->lp_built ||
+	    current_time - lp->lp_built >= PLAN_MAX_AGE)
+		return (0);
+
+	if (lp->lp_readenv)
+		return (1);
+
+	(void) snprintf(path, sizeof (path), "%s/.environment", lp->lp_home);
+	if (lstat(path, &st) == -1)
+		return (errno == ENOENT && !lp->lp_envfile);
+
+	return (lp->lp_envfile && st.st_ino == lp->lp_envino &&
+	    st.st_size == lp->lp_envsize &&
+	    st.st_mtim.tv_sec == lp->lp_envmtime.tv_sec &&
+	    st.st_mtim.tv_nsec == lp->lp_envmtime.tv_nsec);
+}
+
+launch_plan_t const *
+plan_get(job)
+	job_t	*job;
+{
+	plan_check_files();
+
+	if (job->job_plan) {
+		if (plan_current(job->job_plan))
+			return (job->job_plan);
+		plan_invalidate(job);
+	}
+
+	job->job_plan = plan_build(job);
+	return (job->job_plan);
+}
+
+void
+plan_invalidate(job)
+	job_t	*job;
+{
+	plan_free(job->job_plan);
+	job->job_plan = NULL;
+}
+
+static void
+plan_free(lp)
+	launch_plan_t	*lp;
+{
+char	**p;
+
+	if (!lp)
+		return;
+
+	if (lp->lp_env)
+		for (p = lp->lp_env; *p; ++p)
+			free(*p);
+	free(lp->lp_env);
+	free(lp->lp_groups);
+	free(lp->lp_home);
+	free(lp->lp_project);
+	free(lp);
+}
+
+static launch_plan_t *
+plan_build(job)
+	job_t	*job;
+{
+launch_plan_t	*lp;
+struct passwd	*pwd;
+struct project	 proj;
+char		 nssbuf[PROJECT_BUFSZ];
+char		*path;
+long		 ngmax;
+int		 n, nenv = 0;
+
+	if ((lp = calloc(1, sizeof (*lp))) == NULL)
+		goto nomem;
+
+	lp->lp_built = current_time;
+	lp->lp_gen = plan_gen;
+
+	if ((pwd = getpwnam(job->job_username)) == NULL) {
+		logm(LOG_WARNING, "job %ld: cannot build launch plan: "
+		    "user %s doesn't exist",
+		    (long)job->job_id, job->job_username);
+		goto err;
+	}
+
+	lp->lp_uid = pwd->pw_uid;
+
+	/*
+	 * The same list initgroups() would set.
+	 */
+	if ((ngmax = sysconf(_SC_NGROUPS_MAX)) < 1)
+		ngmax = 1;
+	if ((lp->lp_groups = calloc(ngmax, sizeof (gid_t))) == NULL)
+		goto nomem;
+	lp->lp_groups[0] = pwd->pw_gid;
+	if ((n = _getgroupsbymember(pwd->pw_name, lp->lp_groups,
+	    (int)ngmax, 1)) < 1)
+		n = 1;
+	lp->lp_ngroups = n;
+
+	if ((lp->lp_home = strdup(pwd->pw_dir)) == NULL)
+		goto nomem;
+
+	/*
+	 * The job's own project if the user is still a member of it, or else
+	 * the user's default project.
+	 */
+	if (job->job_project) {
+		if (inproj(pwd->pw_name, job->job_project, nssbuf,
+		    sizeof (nssbuf))) {
+			if ((lp->lp_project = strdup(job->job_project)) == NULL)
+				goto nomem;
+		} else
+			logm(LOG_WARNING, "job %ld: user \"%s\" is not "
+			    "a member of project \"%s\"", (long)job->job_id,
+			    pwd->pw_name, job->job_project);
+	}
+
+	if (lp->lp_project == NULL) {
+		if (getdefaultproj(pwd->pw_name, &proj, nssbuf,
+		    sizeof (nssbuf)) == NULL) {
+			logm(LOG_WARNING, "job %ld: cannot build launch plan: "
+			    "getdefaultproj: %s", (long)job->job_id,
+			    strerror(errno));
+			goto err;
+		}
+
+		if ((lp->lp_project = strdup(proj.pj_name)) == NULL)
+			goto nomem;
+	}
+
+	/*
+	 * The standard environment, then the user's own.
+	 */
+	if (defopen(DEFLT "/login") == -1 || (path = defread("PATH=")) == NULL)
+		path = "/usr/bin:";
+
+	if (plan_env_add(lp, &nenv, "PATH", path) == -1 ||
+	    plan_env_add(lp, &nenv, "HOME", pwd->pw_dir) == -1 ||
+	    plan_env_add(lp, &nenv, "LOGNAME", pwd->pw_name) == -1 ||
+	    plan_env_add(lp, &nenv, "USER", pwd->pw_name) == -1 ||
+	    plan_env_add(lp, &nenv, "SHELL", pwd->pw_shell) == -1) {
+		(void) defopen(NULL);
+		goto nomem;
+	}
+	(void) defopen(NULL);
+
+	if (plan_read_env(lp, &nenv, pwd->pw_uid) == -1)
+		goto nomem;
+
+	return (lp);
+
+nomem:
+	logm(LOG_ERR, "plan_build: out of memory");
+err:
+	plan_free(lp);
+	return (NULL);
+}
+
+/*
+ * Add name=value to the plan's environment.  If value is NULL, name is
+ * already a complete entry.
+ */
+static int
+plan_env_add(lp, n, name, value)
+	launch_plan_t	*lp;
+	int		*n;
+	char const	*name, *value;
+{
+char	**ne;
+
+	if ((ne = xrecalloc(lp->lp_env, *n, *n + 2, sizeof (char *))) == NULL)
+		return (-1);
+	lp->lp_env = ne;
+
+	if (value) {
+		if (asprintf(&ne[*n], "%s=%s", name, value) == -1) {
+			ne[*n] = NULL;
+			return (-1);
+		}
+	} else if ((ne[*n] = strdup(name)) == NULL)
+		return (-1);
+
+	(*n)++;
+	return (0);
+}
+
+/*
+ * Read ~/.environment into the plan.  We're root and the file belongs to
+ * the user, so only a regular file owned by the user is read; anything else
+ * (including a file we can't read, e.g. over NFS) is left for jobexec to read
+ * as the user, as it always did.  Returns -1 only if out of memory.
+ */
+static int
+plan_read_env(lp, n, uid)
+	launch_plan_t	*lp;
+	int		*n;
+	uid_t		 uid;
+{
+char		 path[PATH_MAX], line[4096], *k, *e;
+struct stat	 st;
+FILE		*inf;
+int		 fd;
+
+	(void) snprintf(path, sizeof (path), "%s/.environment", lp->lp_home);
+
+	if ((fd = open(path, O_RDONLY | O_NOFOLLOW | O_NONBLOCK)) == -1) {
+		if (errno != ENOENT)
+			lp->lp_readenv = 1;
+		return (0);
+	}
+
+	if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_uid != uid ||
+	    (inf = fdopen(fd, "r")) == NULL) {
+		(void) close(fd);
+		lp->lp_readenv = 1;
+		return (0);
+	}
+
+	lp->lp_envfile = 1;
+	lp->lp_envino = st.st_ino;
+	lp->lp_envsize = st.st_size;
+	lp->lp_envmtime = st.st_mtim;
+
+	while (fgets(line, sizeof (line), inf) != NULL) {
+		for (k = line; *k == ' '; ++k)
+			;
+
+		if ((e = index(k, '\n')) != NULL)
+			*e = '\0';
+
+		if (!*k || *k == '#')
+			continue;
+
+		if (plan_env_add(lp, n, k, NULL) == -1) {
+			(void) fclose(inf);
+			return (-1);
+		}
+	}
+
+	(void) fclose(inf);
+	return (0);
+}
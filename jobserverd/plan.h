@@ -0,0 +1,63 @@
+/*
+ * Copyright 2010 River Tarnell.  All rights reserved.
+ * Use is subject to license terms.
+ */
+
+/*
+ * Launch plans: what jobexec needs to start a job as its user (credentials,
+ * project, home directory and environment), looked up once and kept with the
+ * job.  Without a plan, every start asks the name service the same questions
+ * again, which for a job that runs every minute can cost more than the job.
+ *
+ * A plan is thrown away when the job's user, project or log settings change,
+ * when /etc/passwd, /etc/group, /etc/project or /etc/default/login change,
+ * and when the user's ~/.environment changes.  Since the name service might
+ * not be files, plans are also rebuilt after PLAN_MAX_AGE seconds.
+ */
+
+#ifndef	PLAN_H
+#define	PLAN_H
+
+#include	<sys/types.h>
+#include	<sys/stat.h>
+
+#include	"state.h"
+
+#define	PLAN_MAX_AGE	300
+
+typedef struct launch_plan {
+	uid_t		  lp_uid;
+	gid_t		 *lp_groups;	/* the primary group first */
+	int		  lp_ngroups;
+	char		 *lp_home;
+	char		 *lp_project;
+	char		**lp_env;	/* NULL-terminated */
+	/*
+	 * The daemon couldn't read ~/.environment safely, so jobexec reads it
+	 * itself once it's become the user.
+	 */
+	int		  lp_readenv;
+
+	/* What the plan was built from. */
+	time_t		  lp_built;
+	uint_t		  lp_gen;
+	int		  lp_envfile;	/* ~/.environment existed */
+	ino_t		  lp_envino;
+	off_t		  lp_envsize;
+	timestruc_t	  lp_envmtime;
+} launch_plan_t;
+
+/*
+ * Return the job's plan, building it if there isn't a current one.  Returns
+ * NULL if a plan can't be built; the job can still be started, and jobexec
+ * will look everything up itself.
+ */
+launch_plan_t const	*plan_get(job_t *);
+
+/*
+ * Throw away the job's plan.  Called by state.c when anything the plan
+ * depends on changes, and when the job is freed.
+ */
+void			 plan_invalidate(job_t *);
+
+#endif	/* !PLAN_H */
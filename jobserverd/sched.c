@@ -27,23 +27,103 @@
 #include	"sched.h"
 #include	"jobserver.h"
 #include	"fd.h"
-#include	"execute.h"
+#include	"launcher.h"
+#include	"mailq.h"
 #include	"jerrno.h"
+#include	"schedtab.h"
 
 static LIST_HEAD(sjob_list, sjob) sjobs;
 
+/*
+ * sjobs hashed by job id.
+ */
+#define	SJOB_MIN_BUCKETS	64
+static struct sjob_list	*sjob_buckets;
+static size_t		 nsjob_buckets;
+static size_t		 nsjobs;
+
+#define	SJOB_BUCKET(id)	(&sjob_buckets[(uint32_t)(id) & (nsjob_buckets - 1)])
+
+/*
+ * Extra instances of jobs with the parallel overlap policy.  These aren't in
+ * the hash or the scheduling table, so they're counted here.
+ */
+static struct sjob_list	 instances;
+static int		 ninstances;
+static int		 ninstrunning, ninststopping;
+
+/*
+ * Jobs waiting for a run slot, in the order they were queued.  Each user's
+ * queued jobs are also on the user's own queue, and the users with anything
+ * queued are on runq_users, so sched_admit() only has to look at the first
+ * job of each user.
+ */
+static TAILQ_HEAD(sjob_queue, sjob) runq = TAILQ_HEAD_INITIALIZER(runq);
+static TAILQ_HEAD(job_user_queue, job_user) runq_users =
+	TAILQ_HEAD_INITIALIZER(runq_users);
+static uint64_t	 runq_seq;
+
+static void cron_simple_expr(cron_t const *, cron_expr_t *);
 static sjob_t *sjob_find(job_id_t id);
+static sjob_t *sjob_get(job_t *);
 static void free_sjob(sjob_t *);
+static void sjob_launch_failed(sjob_t *, job_t *);
+static void sched_run_abandoned(sjob_t *, job_t *);
+static void sjob_set_state(sjob_t *, job_t *, sjob_state_t);
+static void sjob_enqueue(sjob_t *, job_t *);
+static void sjob_dequeue(sjob_t *, job_t *);
+static int sched_can_run(job_t *, int, int);
+static double sched_user_priority(job_user_t const *);
+static int sched_exec(job_t *, sjob_t *);
+static int sched_exec_instance(job_t *, time_t);
+static int sched_live(job_user_t const *);
+static void sjob_stop(sjob_t *, job_t *);
+static void sjob_stop_arm(sjob_t *);
+static void sjob_stop_deadline(sjob_t *, time_t);
+static void sched_launched(launch_id_t, pid_t, contract_t *, void *);
+static void sched_stop_launched(launch_id_t, pid_t, contract_t *, void *);
+static void sched_overlap(sjob_t *, job_t *, time_t);
+static void sjob_record_run(sjob_t *, job_t *, sjob_outcome_t);
+static int hist_bucket(time_t);
+static void sched_restart_later(sjob_t *, job_t *);
+static void sjob_cancel_restart(sjob_t *);
+static void sjob_restart(ev_id_t, void *);
 
 static void sched_handle_exit(sjob_t *);
 static void sched_handle_fail(sjob_t *);
 static void sched_handle_crash(sjob_t *);
 
 static int do_start_job(job_t *, void *);
+static void pace_load_config(void);
+static void pace_tick(ev_id_t, void *);
+static void sched_pace(job_t *);
+static int sched_catchup(sjob_t *, job_t *);
+static void sched_dep_done(job_t *, sjob_outcome_t);
+static int sjob_dep_record(sjob_t *, job_id_t, sjob_outcome_t);
 
 static int ctfd;
 static int adopting = 0;
 
+/* When everything must have stopped by, during shutdown. */
+static time_t stop_deadline;
+
+/*
+ * Paced starts.  Jobs started after the daemon starts, and catch-up runs of
+ * scheduled jobs, are not all forked at once; pace_tick() starts pace_rate of
+ * them every pace_interval seconds.  Job ids are stored, not pointers, since
+ * a job may be deleted before its turn comes.
+ */
+#define	SCHED_DEFAULTS		DEFLT "/jobserver"
+#define	PACE_DEFAULT_RATE	10
+#define	PACE_DEFAULT_INTERVAL	1
+
+static job_id_t	*pace_queue;
+static size_t	 npace, pace_size, pace_next;
+static int	 pace_rate = PACE_DEFAULT_RATE;
+static int	 pace_interval = PACE_DEFAULT_INTERVAL;
+static ev_id_t	 pace_timer = -1;
+static time_t	 boot_began;		/* non-zero until boot starts are done */
+
 void sched_fd_callback(int, fde_evt_type_t, void *);
 
 /*ARGSUSED*/
@@ -51,44 +131,11 @@ int
 sched_init(prt)
 	int prt;
 {
-uint_t		 inform;
 struct utmpx	*ut;
 time_t		 newboot, oldboot;
 
-	if ((ctfd = open64(CTFS_ROOT "/process/template", O_RDWR)) == -1) {
-		logm(LOG_ERR, "sched_init: cannot open process template: %s",
-				strerror(errno));
-		return (-1);
-	}
-
-	if (fd_set_cloexec(ctfd, 1) == -1) {
-		logm(LOG_ERR, "sched_init: "
-			"cannot set cloexec on process template fd: %s",
-			strerror(errno));
-		return (-1);
-	}
-
-	if (ct_tmpl_get_informative(ctfd, &inform) == -1) {
-		logm(LOG_ERR, "sched_init: ct_tmpl_get_informative: %s",
-				strerror(errno));
-		return (-1);
-	}
-
-	inform |= (CT_PR_EV_EMPTY | CT_PR_EV_EXIT | CT_PR_EV_CORE |
-			CT_PR_EV_SIGNAL | CT_PR_EV_HWERR);
-	if (ct_tmpl_set_informative(ctfd, inform) == -1) {
-		logm(LOG_ERR, "sched_init: ct_tmpl_set_informative: %s",
-				strerror(errno));
-		return (-1);
-	}
-
-#if 1	/* Remove this when contract adoption is working  */
-	if (ct_pr_tmpl_set_param(ctfd, CT_PR_NOORPHAN) == -1) {
-		logm(LOG_ERR, "sched_init: cannot set CT_PR_NOORPHAN: %s",
-			strerror(errno));
+	if ((ctfd = contract_template()) == -1)
 		return (-1);
-	}
-#endif
 
 	if (ct_tmpl_activate(ctfd) == -1) {
 		logm(LOG_ERR, "sched_init: cannot activate template: %s",
@@ -119,54 +166,684 @@ time_t		 newboot, oldboot;
 		adopting = 1;
 
 	/*
-	 * Start all enabled jobs.
+	 * Schedule all enabled scheduled jobs, and queue all other enabled jobs
+	 * to be started from the event loop.
 	 */
+	pace_load_config();
+	boot_began = current_time;
 	if (job_enumerate(do_start_job, NULL) == -1)
 		logm(LOG_ERR, "sched_init: job_enumerate failed");
 
+	if (npace > 0)
+		logm(LOG_INFO, "boot: %lu jobs to start, %d every %d seconds",
+		    (unsigned long)npace, pace_rate, pace_interval);
+	else
+		boot_began = 0;
+
 	return (0);
 }
 
-sjob_t *
+/*
+ * Read the start rate from /etc/default/jobserver:
+ *
+ *	BOOT_START_RATE=n	start at most n jobs per interval
+ *	BOOT_START_INTERVAL=n	length of the interval, in seconds
+ */
+static void
+pace_load_config()
+{
+char	*s;
+int	 n;
+
+	if (defopen(SCHED_DEFAULTS) != 0)
+		return;
+
+	if ((s = defread("BOOT_START_RATE=")) != NULL) {
+		if ((n = atoi(s)) > 0)
+			pace_rate = n;
+		else
+			logm(LOG_WARNING, "%s: invalid BOOT_START_RATE \"%s\"",
+			    SCHED_DEFAULTS, s);
+	}
+
+	if ((s = defread("BOOT_START_INTERVAL=")) != NULL) {
+		if ((n = atoi(s)) > 0)
+			pace_interval = n;
+		else
+			logm(LOG_WARNING, "%s: invalid BOOT_START_INTERVAL "
+			    "\"%s\"", SCHED_DEFAULTS, s);
+	}
+
+	(void) defopen(NULL);
+}
+
+/*
+ * Add a job to the paced start queue.
+ */
+static void
+sched_pace(job)
+	job_t	*job;
+{
+job_id_t	*nq;
+size_t		 nsz;
+
+	if (npace == pace_size) {
+		nsz = pace_size ? pace_size * 2 : 64;
+		if ((nq = xrecalloc(pace_queue, pace_size, nsz,
+		    sizeof (*pace_queue))) == NULL) {
+			logm(LOG_ERR, "sched_pace: job %ld: out of memory",
+			    (long)job->job_id);
+			return;
+		}
+		pace_queue = nq;
+		pace_size = nsz;
+	}
+	pace_queue[npace++] = job->job_id;
+
+	if (pace_timer == -1 &&
+	    (pace_timer = ev_add(pace_interval, pace_tick, NULL)) == -1)
+		logm(LOG_ERR, "sched_pace: cannot add timer: %s",
+		    strerror(errno));
+}
+
+/*ARGSUSED*/
+static void
+pace_tick(evid, udata)
+	ev_id_t	 evid;
+	void	*udata;
+{
+job_t	*job;
+sjob_t	*sjob;
+int	 n = 0;
+
+	while (!shutting_down && pace_next < npace && n < pace_rate) {
+		/*
+		 * The job may have been deleted, disabled or started by hand
+		 * since it was queued.
+		 */
+		if ((job = find_job(pace_queue[pace_next++])) == NULL)
+			continue;
+		if ((job->job_flags & (JOB_ENABLED | JOB_MAINTENANCE)) !=
+		    JOB_ENABLED || sched_get_state(job) != SJOB_STOPPED) {
+			if ((sjob = sjob_find(job->job_id)) != NULL)
+				sched_run_abandoned(sjob, job);
+			continue;
+		}
+
+		if (sched_start(job) == -1)
+			logm(LOG_ERR, "pace_tick: job %ld: sched_start failed",
+			    (long)job->job_id);
+		n++;
+	}
+
+	if (!shutting_down && pace_next < npace)
+		return;
+
+	if (!shutting_down && boot_began)
+		logm(LOG_INFO, "boot: all jobs started in %ld seconds",
+		    (long)(current_time - boot_began));
+	boot_began = 0;
+
+	(void) ev_cancel(pace_timer);
+	pace_timer = -1;
+	free(pace_queue);
+	pace_queue = NULL;
+	npace = pace_size = pace_next = 0;
+}
+
+int
+sched_pace_pending()
+{
+	/*LINTED*/
+	return (npace - pace_next);
+}
+
+/*
+ * Return the sjob for a job id, or NULL if the scheduler has never done
+ * anything with the job.
+ */
+static sjob_t *
 sjob_find(id)
 	job_id_t	id;
 {
 sjob_t	*sj;
-	LIST_FOREACH(sj, &sjobs, sjob_entries) {
+	if (nsjob_buckets == 0)
+		return (NULL);
+
+	LIST_FOREACH(sj, SJOB_BUCKET(id), sjob_hash) {
 		if (sj->sjob_id == id)
 			return (sj);
 	}
 
+	return (NULL);
+}
+
+/*
+ * Return the sjob for a job, creating it if it doesn't exist yet.
+ */
+static sjob_t *
+sjob_get(job)
+	job_t	*job;
+{
+sjob_t	*sj;
+	if ((sj = sjob_find(job->job_id)) != NULL)
+		return (sj);
+
+	if (nsjobs >= nsjob_buckets) {
+	struct sjob_list	*nb, *ob = sjob_buckets;
+	size_t			 i, osz = nsjob_buckets;
+
+		nsjob_buckets = osz ? osz * 2 : SJOB_MIN_BUCKETS;
+		if ((nb = calloc(nsjob_buckets, sizeof (*nb))) == NULL) {
+			logm(LOG_ERR, "sjob_get: out of memory");
+			nsjob_buckets = osz;
+			return (NULL);
+		}
+
+		sjob_buckets = nb;
+		for (i = 0; i < osz; ++i) {
+			while ((sj = LIST_FIRST(&ob[i])) != NULL) {
+				LIST_REMOVE(sj, sjob_hash);
+				LIST_INSERT_HEAD(SJOB_BUCKET(sj->sjob_id), sj,
+				    sjob_hash);
+			}
+		}
+		free(ob);
+	}
+
 	if ((sj = calloc(1, sizeof(*sj))) == NULL) {
-		logm(LOG_ERR, "sjob_find: out of memory");
+		logm(LOG_ERR, "sjob_get: out of memory");
 		return (NULL);
 	}
 
-	sj->sjob_id = id;
+	sj->sjob_id = job->job_id;
 	sj->sjob_timer = -1;
+	sj->sjob_stop_timer = -1;
 	sj->sjob_state = SJOB_STOPPED;
 	LIST_INSERT_HEAD(&sjobs, sj, sjob_entries);
+	LIST_INSERT_HEAD(SJOB_BUCKET(sj->sjob_id), sj, sjob_hash);
+	nsjobs++;
 	return (sj);
 }
 
+/*
+ * Change the state of an sjob.  All state changes should go through here so
+ * that the per-user running counts and the scheduling table stay correct.
+ * Like the scheduling table, the per-user job counts are of jobs, not
+ * instances; instances have their own per-user counts.
+ */
+static void
+sjob_set_state(sjob, job, state)
+	sjob_t		*sjob;
+	job_t		*job;
+	sjob_state_t	 state;
+{
+	assert(job->job_id == sjob->sjob_id);
+
+	if (!sjob->sjob_instance) {
+		job_user_sched_state(job,
+		    (state == SJOB_RUNNING) -
+		    (sjob->sjob_state == SJOB_RUNNING),
+		    (state == SJOB_STOPPING) -
+		    (sjob->sjob_state == SJOB_STOPPING),
+		    (state == SJOB_QUEUED) -
+		    (sjob->sjob_state == SJOB_QUEUED));
+		schedtab_set_state(job, state);
+	} else {
+	int	drunning, dstopping;
+		drunning = (state == SJOB_RUNNING) -
+		    (sjob->sjob_state == SJOB_RUNNING);
+		dstopping = (state == SJOB_STOPPING) -
+		    (sjob->sjob_state == SJOB_STOPPING);
+		ninstrunning += drunning;
+		ninststopping += dstopping;
+		job_user_instance_state(job, drunning, dstopping);
+	}
+
+	sjob->sjob_state = state;
+}
+
+/*
+ * Put a job on the run queue, and on its owner's.
+ */
+static void
+sjob_enqueue(sjob, job)
+	sjob_t	*sjob;
+	job_t	*job;
+{
+job_user_t	*ju = job->job_user;
+
+	assert(ju != NULL);
+	sjob->sjob_queued = current_time;
+	sjob->sjob_qseq = runq_seq++;
+	TAILQ_INSERT_TAIL(&runq, sjob, sjob_queue);
+
+	if (TAILQ_EMPTY(&ju->ju_runq)) {
+		TAILQ_INIT(&ju->ju_runq);
+		TAILQ_INSERT_TAIL(&runq_users, ju, ju_runq_entries);
+	}
+	TAILQ_INSERT_TAIL(&ju->ju_runq, sjob, sjob_uqueue);
+
+	sjob_set_state(sjob, job, SJOB_QUEUED);
+}
+
+/*
+ * Take a job off the run queue without starting it.
+ */
+static void
+sjob_dequeue(sjob, job)
+	sjob_t	*sjob;
+	job_t	*job;
+{
+job_user_t	*ju = job->job_user;
+
+	assert(sjob->sjob_state == SJOB_QUEUED);
+	TAILQ_REMOVE(&runq, sjob, sjob_queue);
+	TAILQ_REMOVE(&ju->ju_runq, sjob, sjob_uqueue);
+	if (TAILQ_EMPTY(&ju->ju_runq))
+		TAILQ_REMOVE(&runq_users, ju, ju_runq_entries);
+	sjob->sjob_queued = 0;
+	sjob->sjob_due = 0;
+	sjob_set_state(sjob, job, SJOB_STOPPED);
+}
+
 int
 sched_jobs_running()
 {
-int	 n = 0;
+	return (sched_live(NULL));
+}
+
+int
+sched_count(states, user)
+	uint32_t	 states;
+	char const	*user;
+{
+job_user_t const	*ju = NULL;
+int			 n = schedtab_count(states, user);
+
+	if (user != NULL && (ju = find_job_user(user)) == NULL)
+		return (n);
+
+	if (states & SCHEDTAB_STATE(SJOB_RUNNING))
+		n += ju ? ju->ju_ninstrunning : ninstrunning;
+	if (states & SCHEDTAB_STATE(SJOB_STOPPING))
+		n += ju ? ju->ju_ninststopping : ninststopping;
+	return (n);
+}
+
+/*
+ * The number of running or stopping jobs, counting each parallel instance,
+ * either in total or, if 'ju' isn't NULL, for one user.
+ */
+static int
+sched_live(ju)
+	job_user_t const	*ju;
+{
+	if (ju == NULL)
+		return (schedtab_count(SCHEDTAB_LIVE, NULL) + ninstances);
+
+	return (ju->ju_nrunning + ju->ju_nstopping + ju->ju_ninstrunning +
+	    ju->ju_ninststopping);
+}
+
+int
+sched_instances(job)
+	job_t	*job;
+{
 sjob_t	*sj;
-	LIST_FOREACH(sj, &sjobs, sjob_entries) {
-		if (sj->sjob_state == SJOB_RUNNING ||
-		    sj->sjob_state == SJOB_STOPPING)
+int	 n = 0;
+
+	if (ninstances == 0)
+		return (0);
+
+	LIST_FOREACH(sj, &instances, sjob_entries)
+		if (sj->sjob_id == job->job_id)
 			n++;
+	return (n);
+}
+
+int
+sched_skipped_runs(job)
+	job_t	*job;
+{
+sjob_t	*sjob;
+	if ((sjob = sjob_find(job->job_id)) == NULL)
+		return (0);
+	return (sjob->sjob_skipped);
+}
+
+/*
+ * Return 1 if starting the job now would stay within the global limit 'gmax'
+ * and the per-user limit 'umax'.  A limit of 0 or less means no limit.
+ * Stopping jobs still hold their slot until their contract is empty.
+ */
+static int
+sched_can_run(job, gmax, umax)
+	job_t	*job;
+	int	 gmax, umax;
+{
+	if (gmax > 0 && sched_live(NULL) >= gmax)
+		return (0);
+	if (umax > 0 && job->job_user != NULL &&
+	    sched_live(job->job_user) >= umax)
+		return (0);
+	return (1);
+}
+
+/*
+ * A user's fair-share priority; lower runs first.  This is the user's recent
+ * usage plus SCHED_FS_RUN_CHARGE for each job they have running, divided by
+ * their share.  Counting running jobs means that when many jobs are queued at
+ * once, starts alternate between users instead of all going to whichever
+ * user has the least history.
+ */
+static double
+sched_user_priority(ju)
+	job_user_t const	*ju;
+{
+	return ((job_user_usage(ju) + SCHED_FS_RUN_CHARGE *
+	    sched_live(ju)) / ju->ju_share);
+}
+
+void
+sched_admit()
+{
+job_user_t	*ju, *bestju;
+sjob_t		*best;
+job_t		*job;
+double		 pri, bestpri;
+int		 gmax, umax;
+
+	if (shutting_down || TAILQ_EMPTY(&runq_users))
+		return;
+
+	gmax = quota_get_running();
+	umax = quota_get_running_per_user();
+
+	/*
+	 * Each pass starts the first queued job of the user with the lowest
+	 * fair-share priority; between users with the same priority, the job
+	 * queued first wins.  A user at their own limit doesn't hold up other
+	 * users' jobs.  Within a user, jobs start in the order they were
+	 * queued.
+	 */
+	while (gmax <= 0 || sched_live(NULL) < gmax) {
+		bestju = NULL;
+		bestpri = 0;
+
+		TAILQ_FOREACH(ju, &runq_users, ju_runq_entries) {
+			if (umax > 0 && sched_live(ju) >= umax)
+				continue;
+
+			pri = sched_user_priority(ju);
+			if (bestju == NULL || pri < bestpri ||
+			    (pri == bestpri &&
+			    TAILQ_FIRST(&ju->ju_runq)->sjob_qseq <
+			    TAILQ_FIRST(&bestju->ju_runq)->sjob_qseq)) {
+				bestju = ju;
+				bestpri = pri;
+			}
+		}
+
+		if (bestju == NULL)
+			break;
+
+		best = TAILQ_FIRST(&bestju->ju_runq);
+		if ((job = find_job(best->sjob_id)) == NULL)
+			abort();
+
+		logm(LOG_INFO, "job %ld: starting after %ld seconds in queue",
+		    (long)job->job_id,
+		    (long)(current_time - best->sjob_queued));
+		sjob_dequeue(best, job);
+		if (sched_exec(job, best) == -1)
+			logm(LOG_WARNING, "sched_admit: job %ld: start failed",
+			    (long)job->job_id);
 	}
+}
 
-	return (n);
+int
+sched_queue_position(job, since)
+	job_t	*job;
+	time_t	*since;
+{
+sjob_t	*sj;
+int	 pos = 0;
+
+	TAILQ_FOREACH(sj, &runq, sjob_queue) {
+		pos++;
+		if (sj->sjob_id == job->job_id) {
+			*since = sj->sjob_queued;
+			return (pos);
+		}
+	}
+
+	return (0);
+}
+
+/*
+ * Record the outcome of dependency 'id' with a dependent job.
+ */
+static int
+sjob_dep_record(sjob, id, outcome)
+	sjob_t		*sjob;
+	job_id_t	 id;
+	sjob_outcome_t	 outcome;
+{
+sjob_dep_t	*nd;
+int		 i;
+
+	for (i = 0; i < sjob->sjob_ndepdone; ++i) {
+		if (sjob->sjob_depdone[i].sd_job == id) {
+			sjob->sjob_depdone[i].sd_outcome = outcome;
+			return (0);
+		}
+	}
+
+	if ((nd = xrecalloc(sjob->sjob_depdone, sjob->sjob_ndepdone,
+	    sjob->sjob_ndepdone + 1, sizeof (*nd))) == NULL) {
+		logm(LOG_ERR, "sjob_dep_record: out of memory");
+		return (-1);
+	}
+
+	nd[sjob->sjob_ndepdone].sd_job = id;
+	nd[sjob->sjob_ndepdone].sd_outcome = outcome;
+	sjob->sjob_depdone = nd;
+	sjob->sjob_ndepdone++;
+	return (0);
+}
+
+sjob_outcome_t
+sched_dep_outcome(job, id)
+	job_t		*job;
+	job_id_t	 id;
+{
+sjob_t	*sjob;
+int	 i;
+
+	if ((sjob = sjob_find(job->job_id)) == NULL)
+		return (SJOB_OUTCOME_NONE);
+
+	for (i = 0; i < sjob->sjob_ndepdone; ++i)
+		if (sjob->sjob_depdone[i].sd_job == id)
+			return (sjob->sjob_depdone[i].sd_outcome);
+
+	return (SJOB_OUTCOME_NONE);
+}
+
+/*
+ * Return the histogram bucket for a number of seconds.
+ */
+static int
+hist_bucket(secs)
+	time_t	secs;
+{
+int	b = 0;
+	while (secs > 0 && b < SJOB_HIST_BUCKETS - 1) {
+		secs >>= 1;
+		b++;
+	}
+	return (b);
+}
+
+/*
+ * Add a finished run to the job's statistics.  An instance's runs are
+ * counted with the job's own sjob.
+ */
+static void
+sjob_record_run(sjob, job, outcome)
+	sjob_t		*sjob;
+	job_t		*job;
+	sjob_outcome_t	 outcome;
+{
+sjob_t		*owner = sjob;
+sjob_stats_t	*st;
+sjob_run_t	*r;
+time_t		 dur = current_time - sjob->sjob_start_time;
+
+	if (sjob->sjob_instance && (owner = sjob_find(job->job_id)) == NULL)
+		return;
+	st = &owner->sjob_stats;
+
+	if (dur < 0)
+		dur = 0;
+
+	r = &st->st_recent[st->st_nrecent++ % SJOB_NRECENT];
+	r->sr_start = sjob->sjob_start_time;
+	/*LINTED*/
+	r->sr_duration = dur;
+	/*LINTED*/
+	r->sr_skew = sjob->sjob_skew;
+	r->sr_status = sjob->sjob_status;
+	if (outcome == SJOB_OUTCOME_SUCCESS)
+		r->sr_result = SJOB_RESULT_EXIT;
+	else if (sjob->sjob_crashed)
+		r->sr_result = SJOB_RESULT_CRASH;
+	else
+		r->sr_result = SJOB_RESULT_FAIL;
+
+	st->st_runs++;
+	st->st_results[r->sr_result]++;
+	st->st_total_duration += dur;
+	if (r->sr_duration > st->st_max_duration)
+		st->st_max_duration = r->sr_duration;
+	st->st_duration[hist_bucket(dur)]++;
+	if (sjob->sjob_skew >= 0)
+		st->st_skew[hist_bucket(sjob->sjob_skew)]++;
+}
+
+sjob_stats_t const *
+sched_get_stats(job)
+	job_t	*job;
+{
+sjob_t	*sjob;
+	if ((sjob = sjob_find(job->job_id)) == NULL ||
+	    sjob->sjob_stats.st_runs == 0)
+		return (NULL);
+	return (&sjob->sjob_stats);
+}
+
+sjob_outcome_t
+sched_last_outcome(job)
+	job_t	*job;
+{
+sjob_t	*sjob;
+	if ((sjob = sjob_find(job->job_id)) == NULL)
+		return (SJOB_OUTCOME_NONE);
+	return (sjob->sjob_outcome);
+}
+
+/*
+ * A job finished a run, or skipped one.  Pass the outcome to each enabled job
+ * which depends on it, and start those whose dependencies have now all
+ * finished.  The dependency graph has no cycles (see job_set_deps()), so
+ * passing on a skipped run always terminates.
+ */
+static void
+sched_dep_done(job, outcome)
+	job_t		*job;
+	sjob_outcome_t	 outcome;
+{
+job_t		*dj;
+sjob_t		*dsj;
+sjob_outcome_t	 o;
+int		 i, j, met;
+
+	for (i = 0; i < job->job_nrdeps; ++i) {
+		if ((dj = find_job(job->job_rdeps[i])) == NULL)
+			continue;
+		if ((dj->job_flags & (JOB_ENABLED | JOB_MAINTENANCE)) !=
+		    JOB_ENABLED)
+			continue;
+
+		if ((dsj = sjob_get(dj)) == NULL ||
+		    sjob_dep_record(dsj, job->job_id, outcome) == -1)
+			continue;
+
+		for (j = 0, met = 1; j < dj->job_ndeps; ++j) {
+			o = sched_dep_outcome(dj, dj->job_deps[j].jd_job);
+			if (o == SJOB_OUTCOME_NONE)
+				break;
+
+			switch (dj->job_deps[j].jd_cond) {
+			case DEP_SUCCESS:
+				met &= (o == SJOB_OUTCOME_SUCCESS);
+				break;
+			case DEP_FAILURE:
+				met &= (o == SJOB_OUTCOME_FAILURE);
+				break;
+			default:
+				break;
+			}
+		}
+
+		/*
+		 * Still waiting for another dependency.
+		 */
+		if (j < dj->job_ndeps)
+			continue;
+
+		dsj->sjob_ndepdone = 0;
+
+		if (!met) {
+			logm(LOG_INFO, "job %ld: dependencies not met, "
+			    "skipping run", (long)dj->job_id);
+			dsj->sjob_outcome = SJOB_OUTCOME_SKIPPED;
+			sched_dep_done(dj, SJOB_OUTCOME_SKIPPED);
+			continue;
+		}
+
+		if (dsj->sjob_state != SJOB_STOPPED) {
+			logm(LOG_INFO, "job %ld: dependencies done, but the "
+			    "job is already running", (long)dj->job_id);
+			continue;
+		}
+
+		logm(LOG_INFO, "job %ld: dependencies done, starting",
+		    (long)dj->job_id);
+		if (sched_start(dj) == -1)
+			logm(LOG_WARNING, "job %ld: start failed",
+			    (long)dj->job_id);
+	}
 }
 
 void
 sched_stop_all()
 {
 sjob_t	*sj;
+job_t	*ijob;
+time_t	 deadline;
+int	 timeout;
+
+	if ((timeout = config_get_shutdown_timeout()) <= 0)
+		timeout = SCHED_SHUTDOWN_TIMEOUT;
+	stop_deadline = deadline = current_time + timeout;
+
+	LIST_FOREACH(sj, &instances, sjob_entries)
+		if (sj->sjob_state == SJOB_RUNNING &&
+		    (ijob = find_job(sj->sjob_id)) != NULL)
+			sjob_stop(sj, ijob);
+
 	LIST_FOREACH(sj, &sjobs, sjob_entries) {
 	job_t	*job;
 		if (sj->sjob_state == SJOB_RUNNING) {
@@ -192,17 +869,34 @@ sjob_t	*sj;
 #endif
 		}
 	}
+
+	/*
+	 * Every job is now stopping, either from above or because it was
+	 * already being stopped.  Bring forward any signals due after the
+	 * deadline.
+	 */
+	LIST_FOREACH(sj, &instances, sjob_entries)
+		if (sj->sjob_state == SJOB_STOPPING)
+			sjob_stop_deadline(sj, deadline);
+	LIST_FOREACH(sj, &sjobs, sjob_entries)
+		if (sj->sjob_state == SJOB_STOPPING)
+			sjob_stop_deadline(sj, deadline);
+
+	logm(LOG_INFO, "waiting up to %d seconds for %d job(s) to stop",
+	    timeout, sched_jobs_running());
 }
 
+/*
+ * A job counts as running while any parallel instance of it is.
+ */
 sjob_state_t
 sched_get_state(job)
 	job_t	*job;
 {
-sjob_t	*sjob;
-	if ((sjob = sjob_find(job->job_id)) == NULL)
-		return (SJOB_UNKNOWN);
-
-	return (sjob->sjob_state);
+sjob_state_t	state = schedtab_get_state(job);
+	if (state == SJOB_STOPPED && sched_instances(job) > 0)
+		return (SJOB_RUNNING);
+	return (state);
 }
 
 /*ARGSUSED*/
@@ -211,122 +905,425 @@ sched_stop_timer_callback(evid, udata)
 	ev_id_t	 evid;
 	void	*udata;
 {
-sjob_t	*sjob = udata;
+sjob_t		*sjob = udata;
+stop_step_t	*st = &sjob->sjob_stop_chain[sjob->sjob_stop_next++];
+char		 sig[SIG2STR_MAX];
 
-	/*
-	 * We called the stop method of a process, but after the timeout
-	 * period the process still hadn't exited.
-	 */
-	logm(LOG_INFO, "contract %ld: stop timeout expired, sending SIGKILL",
-			(long)sjob->sjob_contract);
+	sjob->sjob_stop_timer = -1;
+
+	if (sig2str(st->ss_signo, sig) == -1)
+		(void) snprintf(sig, sizeof (sig), "%d", st->ss_signo);
+	logm(LOG_INFO, "job %ld: still running %d seconds after stop, "
+	    "sending SIG%s", (long)sjob->sjob_id, st->ss_delay, sig);
 
-	if (sigsend(P_CTID, sjob->sjob_contract->ct_id, SIGKILL) == -1)
+	if (sigsend(P_CTID, sjob->sjob_contract->ct_id, st->ss_signo) == -1)
 		logm(LOG_ERR, "sched_stop: could not signal processes: %s",
 				strerror(errno));
 
-	sjob->sjob_timer = -1;
+	sjob_stop_arm(sjob);
+}
+
+/*
+ * Start the timer for the next signal in the sjob's stop chain, if there is
+ * one.
+ */
+static void
+sjob_stop_arm(sjob)
+	sjob_t	*sjob;
+{
+time_t	when;
+
+	if (sjob->sjob_stop_timer != -1) {
+		(void) ev_cancel(sjob->sjob_stop_timer);
+		sjob->sjob_stop_timer = -1;
+	}
+
+	if (sjob->sjob_stop_next >= sjob->sjob_stop_nsteps)
+		return;
+
+	when = sjob->sjob_stop_began +
+	    sjob->sjob_stop_chain[sjob->sjob_stop_next].ss_delay - current_time;
+	if ((sjob->sjob_stop_timer = ev_add_once(when > 0 ? when : 0,
+	    sched_stop_timer_callback, sjob)) == -1)
+		logm(LOG_ERR, "job %ld: cannot add stop timer",
+		    (long)sjob->sjob_id);
+}
+
+/*
+ * Make sure a stopping sjob is killed no later than 'deadline'.
+ */
+static void
+sjob_stop_deadline(sjob, deadline)
+	sjob_t	*sjob;
+	time_t	 deadline;
+{
+int	i, at;
+
+	at = deadline - sjob->sjob_stop_began;
+	for (i = sjob->sjob_stop_next; i < sjob->sjob_stop_nsteps; ++i)
+		if (sjob->sjob_stop_chain[i].ss_delay >= at)
+			break;
+
+	if (i == sjob->sjob_stop_nsteps)
+		return;
+
+	sjob->sjob_stop_chain[i].ss_signo = SIGKILL;
+	sjob->sjob_stop_chain[i].ss_delay = at;
+	sjob->sjob_stop_nsteps = i + 1;
+	if (i == sjob->sjob_stop_next)
+		sjob_stop_arm(sjob);
 }
 
 int
 sched_stop(job)
 	job_t	*job;
 {
-sjob_t		*sjob = NULL;
+sjob_t		*sjob = NULL, *inst;
+int		 n = 0;
 
-	if ((sjob = sjob_find(job->job_id)) == NULL)
-		goto err;
+	/*
+	 * A queued job has no processes yet; stopping it just means it no
+	 * longer waits for a slot.
+	 */
+	if ((sjob = sjob_find(job->job_id)) != NULL &&
+	    sjob->sjob_state == SJOB_QUEUED) {
+		sjob_dequeue(sjob, job);
+		return (0);
+	}
 
-	if (sjob->sjob_state != SJOB_RUNNING) {
+	LIST_FOREACH(inst, &instances, sjob_entries) {
+		if (inst->sjob_id == job->job_id &&
+		    inst->sjob_state == SJOB_RUNNING) {
+			sjob_stop(inst, job);
+			n++;
+		}
+	}
+
+	if (sjob == NULL || sjob->sjob_state != SJOB_RUNNING) {
+		if (n)
+			return (0);
 		errno = JENOT_RUNNING;
 		goto err;
 	}
 
+	sjob_stop(sjob, job);
+	return (0);
+
+err:
+	return (-1);
+}
+
+/*
+ * Stop one running instance of a job, following the job's stop policy.
+ */
+static void
+sjob_stop(sjob, job)
+	sjob_t	*sjob;
+	job_t	*job;
+{
+stop_policy_t const	*sp = &job->job_stop;
+int			 signo, timeout, i, n = 0;
+
+	/*
+	 * If the job is still being started, it's stopped as soon as its
+	 * processes exist; see sched_launched().
+	 */
+	if (sjob->sjob_launch) {
+		sjob_set_state(sjob, job, SJOB_STOPPING);
+		return;
+	}
+
+	signo = sp->sp_nsteps ? sp->sp_steps[0].ss_signo : SIGTERM;
+
 	/*
-	 * If there's no stop method defined, just send SIGTERM to the
-	 * process contract.  Otherwise, execute the user's stop method.
+	 * If there's no stop method defined, just send the first signal to
+	 * the process contract.  Otherwise, execute the user's stop method.
 	 */
 	if (*job->job_stop_method) {
-		if (fork_execute(job, job->job_stop_method) == -1) {
+		if ((sjob->sjob_stop_launch = launch_job(job,
+		    job->job_stop_method, sched_stop_launched, sjob)) == 0) {
 			logm(LOG_ERR, "sched_stop: could not start "
-				"stop method: %s; sending SIGTERM",
+				"stop method: %s; sending signal",
 				strerror(errno));
 			if (sigsend(P_CTID, sjob->sjob_contract->ct_id,
-					SIGTERM) == -1)
+					signo) == -1)
 				logm(LOG_ERR, "sched_stop: could not "
 					"signal processes: %s",
 					strerror(errno));
 		}
-
-		if ((sjob->sjob_stop_contract = contract_open_latest()) == NULL)
-			logm(LOG_ERR, "sched_stop: "
-				"cannot open latest contract: %s",
-				strerror(errno));
 	} else {
-		if (sigsend(P_CTID, sjob->sjob_contract->ct_id, SIGTERM) == -1)
+		if (sigsend(P_CTID, sjob->sjob_contract->ct_id, signo) == -1)
 			logm(LOG_ERR, "sched_stop: "
 				"could not signal processes: %s",
 				strerror(errno));
 	}
 
-	sjob->sjob_state = SJOB_STOPPING;
+	sjob_set_state(sjob, job, SJOB_STOPPING);
+
+	/*
+	 * Send the rest of the signals at their times, then kill whatever is
+	 * left at the timeout.
+	 */
+	timeout = sp->sp_timeout ? sp->sp_timeout : SCHED_STOP_TIMEOUT;
+	for (i = 1; i < sp->sp_nsteps && sp->sp_steps[i].ss_delay < timeout;
+	    ++i) {
+		sjob->sjob_stop_chain[n++] = sp->sp_steps[i];
+		if (sp->sp_steps[i].ss_signo == SIGKILL)
+			break;
+	}
+	if (n == 0 || sjob->sjob_stop_chain[n - 1].ss_signo != SIGKILL) {
+		sjob->sjob_stop_chain[n].ss_signo = SIGKILL;
+		sjob->sjob_stop_chain[n++].ss_delay = timeout;
+	}
+
+	sjob->sjob_stop_began = current_time;
+	sjob->sjob_stop_nsteps = n;
+	sjob->sjob_stop_next = 0;
+	sjob_stop_arm(sjob);
+}
+
+int
+sched_start(job)
+	job_t	*job;
+{
+sjob_t		*sjob = NULL;
+
+	if ((sjob = sjob_get(job)) == NULL)
+		goto err;
+
+	if (sjob->sjob_state == SJOB_QUEUED)
+		return (0);
+
+	if (sjob->sjob_state != SJOB_STOPPED) {
+		errno = JEALREADY_RUNNING;
+		goto err;
+	}
+
+	if (!sched_can_run(job, quota_get_running(),
+	    quota_get_running_per_user())) {
+		logm(LOG_INFO, "job %ld: run limit reached, queueing",
+		    (long)job->job_id);
+		sjob_enqueue(sjob, job);
+		return (0);
+	}
+
+	return (sched_exec(job, sjob));
+
+err:
+	return (-1);
+}
+
+/*
+ * Actually start a job, without checking the run limits.
+ */
+static int
+sched_exec(job, sjob)
+	job_t	*job;
+	sjob_t	*sjob;
+{
+	sjob->sjob_fatal = 0;
+	sjob->sjob_outcome = SJOB_OUTCOME_NONE;
+	sjob->sjob_status = -1;
+	sjob->sjob_crashed = 0;
+	sjob->sjob_start_time = current_time;
+	if (sjob->sjob_due) {
+		sjob->sjob_skew = current_time - sjob->sjob_due;
+		sjob->sjob_due = 0;
+	} else
+		sjob->sjob_skew = -1;
 
 	/*
-	 * Wait 30 seconds for the job to stop, then kill it.
+	 * Start the job.  The job counts as running from now on, but it has
+	 * no contract until the launcher says it's started.
 	 */
-	sjob->sjob_timer = ev_add_once(30, sched_stop_timer_callback, sjob);
+	if ((sjob->sjob_launch = launch_job(job, job->job_start_method,
+	    sched_launched, sjob)) == 0)
+		goto err;
 
+	sjob_set_state(sjob, job, SJOB_RUNNING);
 	return (0);
 
 err:
+	sjob_launch_failed(sjob, job);
 	return (-1);
 }
 
-int
-sched_start(job)
+/*
+ * A job couldn't be started.  An extra instance is simply forgotten, but the
+ * job's own sjob is kept, stopped, so its next-run timer, statistics, restart
+ * backoff and dependency state aren't lost, and a scheduled job's next run is
+ * scheduled.
+ */
+static void
+sjob_launch_failed(sjob, job)
+	sjob_t	*sjob;
 	job_t	*job;
 {
-sjob_t		*sjob = NULL;
-
-	if (!(job->job_flags & JOB_SCHEDULED)) {
-		errno = JENOT_SCHEDULED;
-		goto err;
-	}
+	if (sjob->sjob_contract) {
+		if (sjob->sjob_contract->ct_events != -1)
+			unregister_fd(sjob->sjob_contract->ct_events,
+			    FDE_BOTH);
+		contract_close(sjob->sjob_contract);
+		sjob->sjob_contract = NULL;
+	}
+
+	if (sjob->sjob_state != SJOB_STOPPED)
+		sjob_set_state(sjob, job, SJOB_STOPPED);
+
+	if (sjob->sjob_instance)
+		free_sjob(sjob);
+	else
+		sched_run_abandoned(sjob, job);
+}
+
+/*
+ * A run of a scheduled job won't reach the contract empty handler, which is
+ * what normally schedules the next run: its start failed, or the paced start
+ * queue skipped it.  Catch-up runs have no timer armed while they wait, so
+ * without this the job would never run again.  An absolute job's only run is
+ * used up, so it's unscheduled instead, unless it's running and the handler
+ * will do that.
+ */
+static void
+sched_run_abandoned(sjob, job)
+	sjob_t	*sjob;
+	job_t	*job;
+{
+	if ((job->job_flags & (JOB_ENABLED | JOB_SCHEDULED | JOB_MAINTENANCE))
+	    != (JOB_ENABLED | JOB_SCHEDULED) || sjob->sjob_nextrun != 0)
+		return;
+
+	if (job->job_schedule.cron_type != CRON_ABSOLUTE) {
+		sched_job_scheduled(job);
+		return;
+	}
+
+	if (sjob->sjob_state == SJOB_STOPPED && job_unschedule(job) == -1)
+		logm(LOG_ERR, "job %ld: cannot unschedule: %s",
+		    (long)job->job_id, strerror(errno));
+}
+
+/*
+ * Called by the launcher when a job's processes have been started.
+ */
+/*ARGSUSED*/
+static void
+sched_launched(id, pid, ct, udata)
+	launch_id_t	 id;
+	pid_t		 pid;
+	contract_t	*ct;
+	void		*udata;
+{
+sjob_t	*sjob = udata;
+job_t	*job;
+
+	sjob->sjob_launch = 0;
+
+	if ((job = find_job(sjob->sjob_id)) == NULL)
+		abort();
+
+	if (ct == NULL) {
+		logm(LOG_ERR, "job %ld: cannot start: %s",
+		    (long)sjob->sjob_id, strerror(errno));
+		goto err;
+	}
+
+	sjob->sjob_pid = pid;
+	sjob->sjob_contract = ct;
+
+	if (fd_open(ct->ct_events) == -1)
+		goto err;
+
+	if (register_fd(ct->ct_events, FDE_READ,
+			sched_fd_callback, sjob) == -1) {
+		logm(LOG_ERR, "sched_start: register_fd(%d): %s",
+				ct->ct_events, strerror(errno));
+		goto err;
+	}
+
+	if (!sjob->sjob_instance && job_set_ctid(job, ct->ct_id) == -1)
+		logm(LOG_WARNING, "sched_start: job_update failed");
+
+	/*
+	 * Someone stopped the job while it was starting.
+	 */
+	if (sjob->sjob_state == SJOB_STOPPING) {
+		sjob_stop(sjob, job);
+		if (shutting_down)
+			sjob_stop_deadline(sjob, stop_deadline);
+	}
+	return;
+
+err:
+	if (sjob->sjob_contract) {
+		(void) sigsend(P_CTID, sjob->sjob_contract->ct_id, SIGKILL);
+		(void) ct_ctl_abandon(sjob->sjob_contract->ct_ctl);
+	}
+	sjob_launch_failed(sjob, job);
+	if (!shutting_down)
+		sched_admit();
+}
+
+/*
+ * Called by the launcher when a job's stop method has been started.
+ */
+/*ARGSUSED*/
+static void
+sched_stop_launched(id, pid, ct, udata)
+	launch_id_t	 id;
+	pid_t		 pid;
+	contract_t	*ct;
+	void		*udata;
+{
+sjob_t		*sjob = udata;
+job_t		*job;
+int		 signo;
 
-	if ((sjob = sjob_find(job->job_id)) == NULL)
-		goto err;
+	sjob->sjob_stop_launch = 0;
 
-	sjob->sjob_fatal = 0;
-	sjob->sjob_start_time = current_time;
+	if (ct) {
+		sjob->sjob_stop_contract = ct;
+		return;
+	}
 
-	/*
-	 * Start the job.
-	 */
-	if ((sjob->sjob_pid = fork_execute(job, job->job_start_method)) == -1)
-		goto err;
+	if ((job = find_job(sjob->sjob_id)) == NULL)
+		abort();
+	signo = job->job_stop.sp_nsteps ?
+	    job->job_stop.sp_steps[0].ss_signo : SIGTERM;
 
-	if ((sjob->sjob_contract = contract_open_latest()) == NULL)
-		goto err;
+	logm(LOG_ERR, "sched_stop: could not start stop method: %s; "
+	    "sending signal", strerror(errno));
+	if (sigsend(P_CTID, sjob->sjob_contract->ct_id, signo) == -1)
+		logm(LOG_ERR, "sched_stop: could not signal processes: %s",
+		    strerror(errno));
+}
 
-	if (fd_open(sjob->sjob_contract->ct_events) == -1)
-		goto err;
+/*
+ * Start an extra instance of a job which is already running, for the run due
+ * at 'due'.
+ */
+static int
+sched_exec_instance(job, due)
+	job_t	*job;
+	time_t	 due;
+{
+sjob_t	*sj;
 
-	if (register_fd(sjob->sjob_contract->ct_events, FDE_READ,
-			sched_fd_callback, NULL) == -1) {
-		logm(LOG_ERR, "sched_start: register_fd(%d): %s",
-				sjob->sjob_contract->ct_events,
-				strerror(errno));
-		goto err;
+	if ((sj = calloc(1, sizeof (*sj))) == NULL) {
+		logm(LOG_ERR, "sched_exec_instance: out of memory");
+		return (-1);
 	}
 
-	if (job_set_ctid(job, sjob->sjob_contract->ct_id) == -1)
-		logm(LOG_WARNING, "sched_start: job_update failed");
-
-	sjob->sjob_state = SJOB_RUNNING;
-	return (0);
+	sj->sjob_id = job->job_id;
+	sj->sjob_timer = -1;
+	sj->sjob_stop_timer = -1;
+	sj->sjob_state = SJOB_STOPPED;
+	sj->sjob_instance = 1;
+	sj->sjob_due = due;
+	LIST_INSERT_HEAD(&instances, sj, sjob_entries);
+	ninstances++;
 
-err:
-	free_sjob(sjob);
-	return (-1);
+	return (sched_exec(job, sj));
 }
 
 void
@@ -336,30 +1333,165 @@ free_sjob(sjob)
 	if (!sjob)
 		return;
 
+	if (sjob->sjob_launch)
+		launch_cancel(sjob->sjob_launch);
+	if (sjob->sjob_stop_launch)
+		launch_cancel(sjob->sjob_stop_launch);
 	if (sjob->sjob_contract && sjob->sjob_contract->ct_events != -1)
 		unregister_fd(sjob->sjob_contract->ct_events, FDE_BOTH);
-	if (sjob->sjob_contract && sjob->sjob_stop_contract->ct_events != -1)
+	if (sjob->sjob_stop_contract &&
+	    sjob->sjob_stop_contract->ct_events != -1)
 		unregister_fd(sjob->sjob_stop_contract->ct_events, FDE_BOTH);
 	contract_close(sjob->sjob_contract);
 	contract_close(sjob->sjob_stop_contract);
 	if (sjob->sjob_timer != -1)
 		ev_cancel(sjob->sjob_timer);
+	if (sjob->sjob_stop_timer != -1)
+		ev_cancel(sjob->sjob_stop_timer);
+	free(sjob->sjob_depdone);
 
 	LIST_REMOVE(sjob, sjob_entries);
+	if (sjob->sjob_instance)
+		ninstances--;
+	else {
+		LIST_REMOVE(sjob, sjob_hash);
+		nsjobs--;
+	}
+	free(sjob);
 }
 
-void
-sched_job_enabled(job)
+/*
+ * An enabled job stopped and its restart policy is enabled; restart it after
+ * the appropriate delay, or put it into maintenance if it has used up its
+ * attempts.
+ */
+static void
+sched_restart_later(sjob, job)
+	sjob_t	*sjob;
+	job_t	*job;
+{
+restart_policy_t const	*rs = &job->job_restart;
+time_t			 delay, maxdelay;
+int			 backoff, reset, i;
+
+	backoff = rs->rs_backoff ? rs->rs_backoff : SCHED_RESTART_BACKOFF;
+	maxdelay = rs->rs_max_delay ? rs->rs_max_delay :
+	    SCHED_RESTART_MAX_DELAY;
+	reset = rs->rs_reset ? rs->rs_reset : SCHED_MIN_RUNTIME;
+
+	if (current_time - sjob->sjob_start_time >= reset)
+		sjob->sjob_restarts = 0;
+
+	if (rs->rs_attempts && sjob->sjob_restarts >= rs->rs_attempts) {
+		sjob->sjob_restarts = 0;
+		if (job_set_maintenance(job, "Restarting too quickly") == -1)
+			logm(LOG_WARNING, "job %ld: could not set "
+			    "maintenance mode", (long)job->job_id);
+		return;
+	}
+
+	delay = rs->rs_delay;
+	for (i = 0; backoff > 1 && i < sjob->sjob_restarts &&
+	    delay < maxdelay; ++i)
+		delay *= backoff;
+	if (delay > maxdelay)
+		delay = maxdelay;
+
+	sjob->sjob_restarts++;
+	logm(LOG_INFO, "job %ld: restart %d in %ld seconds",
+	    (long)job->job_id, sjob->sjob_restarts, (long)delay);
+
+	if ((sjob->sjob_timer = ev_add_once(delay, sjob_restart, sjob)) == -1) {
+		logm(LOG_ERR, "job %ld: cannot add restart timer: %s",
+		    (long)job->job_id, strerror(errno));
+		return;
+	}
+	sjob->sjob_restart_at = current_time + delay;
+}
+
+static void
+sjob_cancel_restart(sjob)
+	sjob_t	*sjob;
+{
+	if (sjob->sjob_restart_at == 0)
+		return;
+
+	if (ev_cancel(sjob->sjob_timer) == -1)
+		logm(LOG_WARNING, "job %ld: cannot cancel restart timer",
+		    (long)sjob->sjob_id);
+	sjob->sjob_timer = -1;
+	sjob->sjob_restart_at = 0;
+}
+
+/*ARGSUSED*/
+static void
+sjob_restart(evid, udata)
+	ev_id_t	 evid;
+	void	*udata;
+{
+sjob_t	*sjob = udata;
+job_t	*job;
+
+	sjob->sjob_timer = -1;
+	sjob->sjob_restart_at = 0;
+
+	if ((job = find_job(sjob->sjob_id)) == NULL)
+		return;
+
+	if ((job->job_flags & (JOB_ENABLED | JOB_MAINTENANCE |
+	    JOB_SCHEDULED)) != JOB_ENABLED || sjob->sjob_state != SJOB_STOPPED)
+		return;
+
+	if (sched_start(job) == -1)
+		logm(LOG_WARNING, "job %ld: restart failed",
+		    (long)job->job_id);
+}
+
+time_t
+sched_restart_pending(job)
 	job_t	*job;
 {
 sjob_t	*sjob;
+
 	if ((sjob = sjob_find(job->job_id)) == NULL)
-		return;
+		return (0);
+	return (sjob->sjob_restart_at);
+}
 
+void
+sched_job_enabled(job)
+	job_t	*job;
+{
+sjob_t	*sjob;
 	if (job->job_flags & JOB_SCHEDULED) {
+		/*
+		 * Runs missed while the job was disabled, in maintenance or
+		 * not scheduled aren't caught up.
+		 */
+		if ((sjob = sjob_find(job->job_id)) != NULL)
+			sjob->sjob_catchup = 0;
+		if (job_set_lastrun(job, current_time) == -1)
+			logm(LOG_WARNING, "job %ld: cannot record last run",
+			    (long)job->job_id);
 		sched_job_scheduled(job);
 	} else {
-		if (sjob->sjob_state != SJOB_STOPPED)
+		if ((sjob = sjob_find(job->job_id)) != NULL &&
+		    sjob->sjob_state != SJOB_STOPPED)
+			return;
+
+		/*
+		 * Enabling the job by hand (e.g. after "job clear") starts
+		 * it now, and starts the backoff over.
+		 */
+		if (sjob) {
+			sjob_cancel_restart(sjob);
+			sjob->sjob_restarts = 0;
+		}
+
+		/*
+		 * A job with dependencies waits for them to run.
+		 */
+		if (job->job_ndeps)
 			return;
 
 		if (sched_start(job) == -1)
@@ -373,14 +1505,26 @@ sched_job_disabled(job)
 	job_t	*job;
 {
 sjob_t	*sjob;
-	if ((sjob = sjob_find(job->job_id)) == NULL)
-		return;
+	/*
+	 * Forget any dependencies which finished while the job was enabled.
+	 */
+	if ((sjob = sjob_find(job->job_id)) != NULL) {
+		sjob->sjob_ndepdone = 0;
+		sjob->sjob_overlap_pending = 0;
+		sjob->sjob_due = 0;
+	}
 
 	if ((job->job_flags & JOB_ENABLED) &&
 		(job->job_flags & JOB_SCHEDULED)) {
 		sched_job_unscheduled(job);
 	} else {
-		if (sjob->sjob_state != SJOB_RUNNING)
+		if ((sjob = sjob_find(job->job_id)) != NULL)
+			sjob_cancel_restart(sjob);
+
+		if ((sjob == NULL ||
+		    (sjob->sjob_state != SJOB_RUNNING &&
+		    sjob->sjob_state != SJOB_QUEUED)) &&
+		    sched_instances(job) == 0)
 			return;
 
 		if (sched_stop(job) == -1)
@@ -395,9 +1539,13 @@ sched_job_deleted(job)
 	job_t	*job;
 {
 sjob_t	*sjob;
-	if ((sjob = sjob_find(job->job_id)) == NULL)
-		abort();
-
+	/*
+	 * The job may never have been started, in which case there's
+	 * nothing to do.
+	 */
+	if ((sjob = sjob_find(job->job_id)) != NULL &&
+	    sjob->sjob_state == SJOB_QUEUED)
+		sjob_dequeue(sjob, job);
 	free_sjob(sjob);
 }
 
@@ -413,14 +1561,10 @@ sjob_t		*sjob = NULL;
 pid_t		 pid;
 int		 sig, status = 0;
 job_t		*job = NULL;
+sjob_outcome_t	 outcome;
 int		 i;
 
-	LIST_FOREACH(sjob, &sjobs, sjob_entries) {
-		if (sjob->sjob_contract &&
-		    sjob->sjob_contract->ct_events == fd)
-			break;
-	}
-
+	sjob = udata;
 	assert(type == FDE_READ);
 	assert(sjob);
 	assert(fd == sjob->sjob_contract->ct_events);
@@ -441,6 +1585,10 @@ int		 i;
 		 * no need to be delicate here as the stop method is transient
 		 * anyway.
 		 */
+		if (sjob->sjob_stop_launch) {
+			launch_cancel(sjob->sjob_stop_launch);
+			sjob->sjob_stop_launch = 0;
+		}
 		if (sjob->sjob_stop_contract) {
 			(void) sigsend(P_CTID,
 				sjob->sjob_stop_contract->ct_id, SIGKILL);
@@ -462,41 +1610,92 @@ int		 i;
 		if ((job = find_job(sjob->sjob_id)) == NULL)
 			abort();
 
-		if (job_set_ctid(job, -1) == -1)
+		if (!sjob->sjob_instance && job_set_ctid(job, -1) == -1)
 			logm(LOG_WARNING, "job %ld: "
 				"cannot set ctid",
 				(long)sjob->sjob_id);
 
 		sjob->sjob_contract = NULL;
 
-		if (sjob->sjob_timer != -1 && ev_cancel(sjob->sjob_timer) == -1)
+		if (sjob->sjob_stop_timer != -1 &&
+		    ev_cancel(sjob->sjob_stop_timer) == -1)
 			logm(LOG_WARNING, "job %ld: cannot cancel "
 				"stop timeout: %s",
 				(long)sjob->sjob_id, strerror(errno));
+		sjob->sjob_stop_timer = -1;
+
+		sjob_set_state(sjob, job, SJOB_STOPPED);
+		job_user_charge(job, current_time - sjob->sjob_start_time);
+
+		/*
+		 * If no process exit was seen for the job's own process, we
+		 * can't say it succeeded.
+		 */
+		if (sjob->sjob_outcome == SJOB_OUTCOME_NONE)
+			sjob->sjob_outcome = SJOB_OUTCOME_FAILURE;
+		outcome = sjob->sjob_outcome;
+		sjob_record_run(sjob, job, outcome);
 
-		sjob->sjob_state = SJOB_STOPPED;
+		/*
+		 * An extra instance just goes away; the job's own sjob
+		 * decides what happens next.
+		 */
+		if (sjob->sjob_instance) {
+			free_sjob(sjob);
+			if (!shutting_down) {
+				sched_admit();
+				sched_dep_done(job, outcome);
+			}
+			break;
+		}
 
 		if (shutting_down)
 			break;
 
 		/*
-		 * See if we should restart the job.
+		 * A slot is free, so start anything that was waiting for one
+		 * before deciding whether this job restarts; a restarting job
+		 * goes to the back of the queue like any other.
+		 */
+		sched_admit();
+
+		/*
+		 * See if we should restart the job.  A job with dependencies
+		 * and no schedule runs again when its dependencies next
+		 * finish.
 		 */
 		if (!(job->job_flags & JOB_MAINTENANCE)) {
 			if (job->job_flags & JOB_SCHEDULED) {
 				if (job->job_schedule.cron_type
-				    != CRON_ABSOLUTE)
+				    != CRON_ABSOLUTE) {
 					sched_job_scheduled(job);
-				else {
+
+					/*
+					 * A run was due while this one was
+					 * still going (OVERLAP_QUEUE or
+					 * OVERLAP_KILL).
+					 */
+					if (sjob->sjob_overlap_pending) {
+						sjob->sjob_overlap_pending = 0;
+						if (sched_start(job) == -1)
+							logm(LOG_WARNING,
+							    "job %ld: start "
+							    "failed", (long)
+							    job->job_id);
+					}
+				} else {
 					if (job_unschedule(job) == -1)
 						logm(LOG_ERR, "job %ld: cannot "
 							"unschedule: %s",
 							(long)job->job_id,
 							strerror(errno));
 				}
-			} else if (job->job_flags & JOB_ENABLED) {
-				if (sjob->sjob_start_time + SCHED_MIN_RUNTIME
-				    > current_time) {
+			} else if ((job->job_flags & JOB_ENABLED) &&
+			    job->job_ndeps == 0) {
+				if (job->job_restart.rs_delay > 0)
+					sched_restart_later(sjob, job);
+				else if (sjob->sjob_start_time +
+				    SCHED_MIN_RUNTIME > current_time) {
 					if (job_set_maintenance(job,
 						"Restarting too quickly") == -1)
 						logm(LOG_WARNING, "job %ld: "
@@ -512,6 +1711,7 @@ int		 i;
 			}
 		}
 
+		sched_dep_done(job, outcome);
 		break;
 
 	case CT_PR_EV_CORE:
@@ -538,6 +1738,9 @@ int		 i;
 			status = 0;
 		}
 
+		if (pid == sjob->sjob_pid)
+			sjob->sjob_status = status;
+
 		if (WIFEXITED(status) && pid == sjob->sjob_pid) {
 			/*
 			 * Normal exit - status 0 means 'exit', anything else
@@ -610,14 +1813,17 @@ sched_handle_exit(sjob)
 job_t		*job;
 char		 msg[4096];
 char		 hostname[64];
-char		 timestr[128];
+char		 subject[256];
 
 	if (sjob->sjob_fatal)
 		return;
 	sjob->sjob_fatal = 1;
+	sjob->sjob_outcome = SJOB_OUTCOME_SUCCESS;
 
-	if (sjob->sjob_state == SJOB_STOPPING)
+	if (sjob->sjob_state == SJOB_STOPPING) {
+		sjob->sjob_outcome = SJOB_OUTCOME_FAILURE;
 		return;
+	}
 
 	if (gethostname(hostname, sizeof (hostname)) == -1)
 		(void) strlcpy(hostname, "unknown", sizeof (hostname));
@@ -628,24 +1834,22 @@ char		 timestr[128];
 		abort();
 
 	if (job->job_exit_action & ST_EXIT_MAIL) {
-		(void) strftime(timestr, sizeof (timestr),
-			"%a, %d %b %Y %H:%M:%S %z", gmtime(&current_time));
+		(void) snprintf(subject, sizeof (subject), "\"%s\" exited",
+			job->job_fmri);
 		(void) snprintf(msg, sizeof (msg),
-			"To: %s\n"
-			"Subject: \"%s\" exited\n"
-			"Date: %s"
-			"\n"
 			"Your job \"%s\" on the host \"%s\" has "
 			"exited successfully.\n",
-			job->job_username,
-			job->job_fmri,
-			timestr,
 			job->job_fmri,
 			hostname);
 	}
 
+	/*
+	 * With a restart delay, a quick exit is dealt with by the backoff
+	 * policy when the job stops (see sched_restart_later()).
+	 */
 	if ((job->job_flags & JOB_ENABLED) &&
-	    !(job->job_flags & JOB_SCHEDULED) &&
+	    !(job->job_flags & JOB_SCHEDULED) && job->job_ndeps == 0 &&
+	    job->job_restart.rs_delay == 0 &&
 	    sjob->sjob_start_time + SCHED_MIN_RUNTIME > current_time) {
 		if (job_set_maintenance(job, "Restarting too quickly") == -1)
 			logm(LOG_WARNING, "job %ld: could not set maintenance",
@@ -667,10 +1871,8 @@ char		 timestr[128];
 	}
 
 	if (job->job_exit_action & ST_EXIT_MAIL) {
-		(void) strlcat(msg, "\nRegards,\n"
-			"\tThe job server.\n", sizeof (msg));
-		if (send_mail(job->job_username, msg) == -1)
-			logm(LOG_ERR, "sched_handle_fail: "
+		if (mailq_add(job->job_username, subject, msg) == -1)
+			logm(LOG_ERR, "sched_handle_exit: "
 				"cannot send mail: %s", strerror(errno));
 	}
 }
@@ -682,11 +1884,12 @@ sched_handle_fail(sjob)
 job_t		*job;
 char		 msg[4096];
 char		 hostname[64];
-char		 timestr[128];
+char		 subject[256];
 
 	if (sjob->sjob_fatal)
 		return;
 	sjob->sjob_fatal = 1;
+	sjob->sjob_outcome = SJOB_OUTCOME_FAILURE;
 
 	if (sjob->sjob_state == SJOB_STOPPING)
 		return;
@@ -700,17 +1903,10 @@ char		 timestr[128];
 		abort();
 
 	if (job->job_fail_action & ST_EXIT_MAIL) {
-		(void) strftime(timestr, sizeof (timestr),
-			"%a, %d %b %Y %H:%M:%S %z", gmtime(&current_time));
+		(void) snprintf(subject, sizeof (subject), "\"%s\" failed",
+			job->job_fmri);
 		(void) snprintf(msg, sizeof (msg),
-			"To: %s\n"
-			"Subject: \"%s\" failed\n"
-			"Date: %s"
-			"\n"
 			"Your job \"%s\" on the host \"%s\" has failed.\n",
-			job->job_username,
-			job->job_fmri,
-			timestr,
 			job->job_fmri,
 			hostname);
 	}
@@ -726,9 +1922,7 @@ char		 timestr[128];
 	}
 
 	if (job->job_fail_action & ST_EXIT_MAIL) {
-		(void) strlcat(msg, "\nRegards,\n\tThe job server.\n",
-			sizeof (msg));
-		if (send_mail(job->job_username, msg) == -1)
+		if (mailq_add(job->job_username, subject, msg) == -1)
 			logm(LOG_ERR, "sched_handle_fail: "
 				"cannot send mail: %s", strerror(errno));
 	}
@@ -742,11 +1936,13 @@ sched_handle_crash(sjob)
 job_t		*job;
 char		 msg[4096];
 char		 hostname[64];
-char		 timestr[128];
+char		 subject[256];
 
 	if (sjob->sjob_fatal)
 		return;
 	sjob->sjob_fatal = 1;
+	sjob->sjob_outcome = SJOB_OUTCOME_FAILURE;
+	sjob->sjob_crashed = 1;
 
 	if (sjob->sjob_state == SJOB_STOPPING)
 		return;
@@ -760,17 +1956,10 @@ char		 timestr[128];
 		abort();
 
 	if (job->job_crash_action & ST_EXIT_MAIL) {
-		(void) strftime(timestr, sizeof (timestr),
-			"%a, %d %b %Y %H:%M:%S %z", gmtime(&current_time));
+		(void) snprintf(subject, sizeof (subject), "\"%s\" crashed",
+			job->job_fmri);
 		(void) snprintf(msg, sizeof (msg),
-			"To: %s\n"
-			"Subject: \"%s\" crashed\n"
-			"Date: %s"
-			"\n"
 			"Your job \"%s\" on the host \"%s\" has crashed.\n",
-			job->job_username,
-			job->job_fmri,
-			timestr,
 			job->job_fmri,
 			hostname);
 	}
@@ -789,74 +1978,173 @@ char		 timestr[128];
 	}
 
 	if (job->job_crash_action & ST_EXIT_MAIL) {
-		(void) strlcat(msg, "\nRegards,\n"
-			"\tThe job server.\n", sizeof (msg));
-		if (send_mail(job->job_username, msg) == -1)
+		if (mailq_add(job->job_username, subject, msg) == -1)
 			logm(LOG_ERR, "sched_handle_crash: "
 				"cannot send mail: %s", strerror(errno));
 	}
 }
 
+/*
+ * The fixed schedule types are just particular cron expressions, so they
+ * share its next-run code.
+ */
+static void
+cron_simple_expr(sched, ce)
+	cron_t const	*sched;
+	cron_expr_t	*ce;
+{
+int	a1 = sched->cron_arg1, a2 = sched->cron_arg2;
+
+	ce->ce_minutes = (1ULL << 60) - 1;
+	ce->ce_hours = (1U << 24) - 1;
+	ce->ce_mdays = ~1U;
+	ce->ce_months = (1U << 12) - 1;
+	ce->ce_wdays = (1U << 7) - 1;
+	ce->ce_flags = CE_MDAY_ANY | CE_WDAY_ANY;
+
+	switch (sched->cron_type) {
+	case CRON_EVERY_HOUR:
+		ce->ce_minutes = 1ULL << a1;
+		break;
+
+	case CRON_EVERY_DAY:
+		ce->ce_minutes = 1ULL << (a1 % 60);
+		ce->ce_hours = 1U << (a1 / 60 % 24);
+		break;
+
+	case CRON_EVERY_WEEK:
+		ce->ce_minutes = 1ULL << (a2 % 60);
+		ce->ce_hours = 1U << (a2 / 60 % 24);
+		ce->ce_wdays = 1U << a1;
+		ce->ce_flags = CE_MDAY_ANY;
+		break;
+
+	default:
+		/* CRON_EVERY_MINUTE: every field is already '*'. */
+		break;
+	}
+}
+
 time_t
-sched_nextrun(sched)
-	cron_t	*sched;
+sched_nextrun(sched, tz)
+	cron_t		*sched;
+	tz_t const	*tz;
 {
-struct tm	*tm = gmtime(&current_time);
-int		 hr, min, wday;
-int		 a1, a2;
+	/*
+	 * An "at" job which is due but hasn't run yet still runs at its
+	 * (past) time.
+	 */
+	if (sched->cron_type == CRON_ABSOLUTE)
+		return (sched->cron_arg1);
+	return (sched_nextrun_after(sched, tz, current_time));
+}
 
-	a1 = sched->cron_arg1;
-	a2 = sched->cron_arg2;
+time_t
+sched_nextrun_after(sched, tz, after)
+	cron_t		*sched;
+	tz_t const	*tz;
+	time_t		 after;
+{
+cron_expr_t	ce;
 
 	switch (sched->cron_type) {
 	case CRON_ABSOLUTE:
-		return (a1);
+		return (sched->cron_arg1 > after ? sched->cron_arg1 : -1);
 
-	case CRON_EVERY_MINUTE:
-		tm->tm_sec = 0;
-		tm->tm_min++;
-		return (mktime(tm));
+	case CRON_EXPR:
+		return (cron_expr_next(&sched->cron_expr, tz, after));
 
+	case CRON_EVERY_MINUTE:
 	case CRON_EVERY_HOUR:
-		if (a1 <= tm->tm_min)
-			tm->tm_hour++;
-		tm->tm_min = a1;
-		return (mktime(tm));
-
 	case CRON_EVERY_DAY:
-		min = a1 % 60;
-		hr = a1 / 60;
-
-		if ((hr < tm->tm_hour) ||
-			(hr == tm->tm_hour && min <= tm->tm_min))
-			tm->tm_mday++;
-		tm->tm_hour = hr;
-		tm->tm_min = min;
-		return (mktime(tm));
-
 	case CRON_EVERY_WEEK:
-		wday = a1;
-		min = a2 % 60;
-		hr = a2 / 60;
-
-		if (wday < tm->tm_wday ||
-		    (wday == tm->tm_wday && hr < tm->tm_hour) ||
-		    (wday == tm->tm_wday && hr == tm->tm_hour &&
-			min <= tm->tm_min)) {
-			tm->tm_mday += ((wday + 7) - tm->tm_wday);
-		} else {
-			tm->tm_mday += (wday - tm->tm_wday);
-		}
-
-		tm->tm_hour = hr;
-		tm->tm_min = min;
-		return (mktime(tm));
+		cron_simple_expr(sched, &ce);
+		return (cron_expr_next(&ce, tz, after));
 
 	default:
 		return (-1);
 	}
 }
 
+/*
+ * Check whether runs of a scheduled job were missed: that is, whether it
+ * was due between its last run and SCHED_CATCHUP_GRACE seconds ago.  If so,
+ * apply the job's catch-up policy.  Catch-up runs go through the paced start
+ * queue, and when one finishes, sched_job_scheduled() queues the next.
+ * Returns 1 if the caller should not schedule the job's next run.
+ *
+ * An absolute job's one run is missed if its time is more than
+ * SCHED_CATCHUP_GRACE seconds ago, whenever the job last ran.  It's either
+ * run now or unscheduled, never left to its timer, which would fire at once
+ * and find it late again.
+ */
+static int
+sched_catchup(sjob, job)
+	sjob_t	*sjob;
+	job_t	*job;
+{
+cron_t		*sched = &job->job_schedule;
+tz_t const	*tz = job_get_tz(job);
+time_t		 cutoff = current_time - SCHED_CATCHUP_GRACE, t;
+catchup_t	 policy = job->job_catchup;
+int		 lim, nmissed = 0;
+
+	if (sched->cron_type == CRON_ABSOLUTE) {
+		if (sched->cron_arg1 > cutoff)
+			return (0);
+		nmissed = 1;
+	} else {
+		/*
+		 * A job that has never run has nothing to catch up on.
+		 */
+		if (job->job_lastrun == 0 || job->job_lastrun >= cutoff)
+			return (0);
+
+		if (policy == CATCHUP_ALL)
+			lim = job->job_catchup_max ? job->job_catchup_max :
+			    SCHED_CATCHUP_MAX;
+		else
+			lim = 1;
+
+		for (t = job->job_lastrun; nmissed < lim; nmissed++)
+			if ((t = sched_nextrun_after(sched, tz, t)) == -1 ||
+			    t > cutoff)
+				break;
+
+		if (nmissed == 0)
+			return (0);
+	}
+
+	if (policy == CATCHUP_DEFAULT)
+		policy = (sched->cron_type == CRON_ABSOLUTE) ? CATCHUP_ONCE :
+		    CATCHUP_SKIP;
+
+	/*
+	 * The missed runs are now dealt with, one way or another.
+	 */
+	if (job_set_lastrun(job, current_time) == -1)
+		logm(LOG_WARNING, "job %ld: cannot record last run",
+		    (long)job->job_id);
+
+	if (policy == CATCHUP_SKIP) {
+		logm(LOG_INFO, "job %ld: skipping missed runs",
+		    (long)job->job_id);
+		if (sched->cron_type != CRON_ABSOLUTE)
+			return (0);
+
+		if (job_unschedule(job) == -1)
+			logm(LOG_ERR, "job %ld: cannot unschedule: %s",
+			    (long)job->job_id, strerror(errno));
+		return (1);
+	}
+
+	logm(LOG_INFO, "job %ld: catching up %d missed run(s)",
+	    (long)job->job_id, nmissed);
+	sjob->sjob_catchup = nmissed - 1;
+	sched_pace(job);
+	return (1);
+}
+
 /*ARGSUSED*/
 static void
 sjob_run_scheduled(evid, udata)
@@ -865,31 +2153,144 @@ sjob_run_scheduled(evid, udata)
 {
 sjob_t	*sjob = udata;
 job_t	*job;
+time_t	 due = sjob->sjob_nextrun;
 
 	if ((job = find_job(sjob->sjob_id)) == NULL)
 		return;
 
+	sjob->sjob_timer = -1;
 	sjob->sjob_nextrun = 0;
 
+	/*
+	 * If the timer fired late, the system was probably suspended or the
+	 * clock jumped, and this run counts as missed.
+	 */
+	if (current_time - due > SCHED_CATCHUP_GRACE) {
+		if (!sched_catchup(sjob, job))
+			sched_job_scheduled(job);
+		return;
+	}
+
+	if (job_set_lastrun(job, current_time) == -1)
+		logm(LOG_WARNING, "job %ld: cannot record last run",
+		    (long)job->job_id);
+
+	/*
+	 * Arm the timer for the following run now rather than when this run
+	 * ends, so that a run which outlasts the interval meets the overlap
+	 * policy instead of quietly pushing the schedule back.
+	 */
+	if (job->job_schedule.cron_type != CRON_ABSOLUTE)
+		sched_job_scheduled(job);
+
+	if (sjob->sjob_state != SJOB_STOPPED) {
+		sched_overlap(sjob, job, due);
+		return;
+	}
+
+	sjob->sjob_due = due;
 	if (sched_start(job) == -1)
 		logm(LOG_WARNING, "sched_run_scheduled: sched_start failed");
 }
 
+/*
+ * A scheduled job is due, but its last run hasn't finished; apply the job's
+ * overlap policy.
+ */
+static void
+sched_overlap(sjob, job, due)
+	sjob_t	*sjob;
+	job_t	*job;
+	time_t	 due;
+{
+	/*
+	 * A run that's still waiting for a slot covers this one too.
+	 */
+	if (sjob->sjob_state == SJOB_QUEUED)
+		goto skip;
+
+	switch (job->job_overlap) {
+	case OVERLAP_QUEUE:
+		if (sjob->sjob_overlap_pending)
+			goto skip;
+		logm(LOG_INFO, "job %ld: still running, will run again when "
+		    "it finishes", (long)job->job_id);
+		sjob->sjob_overlap_pending = 1;
+		sjob->sjob_due = due;
+		return;
+
+	case OVERLAP_KILL:
+		logm(LOG_INFO, "job %ld: still running, stopping it",
+		    (long)job->job_id);
+		sjob->sjob_overlap_pending = 1;
+		sjob->sjob_due = due;
+		if (sjob->sjob_state == SJOB_RUNNING && sched_stop(job) == -1)
+			logm(LOG_WARNING, "job %ld: cannot stop: %s",
+			    (long)job->job_id, jstrerror(errno));
+		return;
+
+	case OVERLAP_PARALLEL:
+		if (!sched_can_run(job, quota_get_running(),
+		    quota_get_running_per_user())) {
+			logm(LOG_INFO, "job %ld: run limit reached",
+			    (long)job->job_id);
+			goto skip;
+		}
+
+		logm(LOG_INFO, "job %ld: still running, starting another "
+		    "instance", (long)job->job_id);
+		if (sched_exec_instance(job, due) == -1)
+			logm(LOG_WARNING, "job %ld: cannot start instance",
+			    (long)job->job_id);
+		return;
+
+	default:
+		break;
+	}
+
+skip:
+	sjob->sjob_skipped++;
+	logm(LOG_INFO, "job %ld: previous run still going, skipping this run",
+	    (long)job->job_id);
+}
+
 void
 sched_job_scheduled(job)
 	job_t	*job;
 {
 sjob_t	*sjob;
+time_t	 delay;
 
 	if (!(job->job_flags & JOB_ENABLED))
 		return;
 
-	if ((sjob = sjob_find(job->job_id)) == NULL)
+	if ((sjob = sjob_get(job)) == NULL)
+		return;
+
+	/*
+	 * A run is already pending; don't add a second timer.
+	 */
+	if (sjob->sjob_nextrun != 0)
+		return;
+
+	if (sjob->sjob_catchup > 0) {
+		sjob->sjob_catchup--;
+		sched_pace(job);
 		return;
+	}
+
+	if ((sjob->sjob_nextrun = sched_nextrun(&job->job_schedule,
+	    job_get_tz(job))) == -1) {
+		logm(LOG_ERR, "sched_job_scheduled: job %ld will never run",
+		    (long)job->job_id);
+		sjob->sjob_nextrun = 0;
+		return;
+	}
 
-	sjob->sjob_nextrun = sched_nextrun(&job->job_schedule);
+	if ((delay = sjob->sjob_nextrun - current_time) < 0)
+		delay = 0;
 
-	if ((sjob->sjob_timer = ev_add_once(sjob->sjob_nextrun - current_time,
+	if ((sjob->sjob_timer = ev_add_once(delay,
 					sjob_run_scheduled, sjob)) == -1) {
 		logm(LOG_ERR, "sched_job_schedule: ev_add_once failed: %s",
 				strerror(errno));
@@ -905,10 +2306,26 @@ sjob_t	*sjob;
 	if ((sjob = sjob_find(job->job_id)) == NULL)
 		return;
 
+	/*
+	 * If the job was unscheduled (rather than just being rescheduled),
+	 * a run that's waiting for a slot shouldn't happen either.
+	 */
+	if (!(job->job_flags & JOB_ENABLED)) {
+		if (sjob->sjob_state == SJOB_QUEUED)
+			sjob_dequeue(sjob, job);
+		sjob->sjob_catchup = 0;
+		sjob->sjob_overlap_pending = 0;
+		sjob->sjob_due = 0;
+	}
+
+	if (sjob->sjob_nextrun == 0)
+		return;
+
 	sjob->sjob_nextrun = 0;
 	if (ev_cancel(sjob->sjob_timer) == -1)
 		logm(LOG_WARNING, "sched_job_unscheduled: "
 			"warning: ev_cancel failed");
+	sjob->sjob_timer = -1;
 }
 
 /*ARGSUSED*/
@@ -930,7 +2347,7 @@ sjob_t	*sjob = NULL;
 	int	 ctfd;
 	char	 statfile[128], ctevents[128], ctlfile[128];
 
-		if ((sjob = sjob_find(job->job_id)) == NULL)
+		if ((sjob = sjob_get(job)) == NULL)
 			goto err;
 
 		sjob->sjob_fatal = 0;
@@ -989,7 +2406,7 @@ sjob_t	*sjob = NULL;
 		}
 
 		if (register_fd(sjob->sjob_eventfd, FDE_READ,
-				sched_fd_callback, NULL) == -1) {
+				sched_fd_callback, sjob) == -1) {
 			logm(LOG_ERR, "do_start_job: register_fd(%d): %s",
 				sjob->sjob_eventfd, strerror(errno));
 			goto err;
@@ -1008,12 +2425,13 @@ err:
 
 	if (job->job_flags & JOB_ENABLED) {
 		if (job->job_flags & JOB_SCHEDULED) {
-			sched_job_scheduled(job);
-		} else {
-			if (sched_start(job) == -1)
-				logm(LOG_ERR, "do_start_job: job %ld: "
-						"sched_start failed",
-						(long)job->job_id);
+		sjob_t	*sj;
+			if ((sj = sjob_get(job)) == NULL)
+				return (0);
+			if (!sched_catchup(sj, job))
+				sched_job_scheduled(job);
+		} else if (job->job_ndeps == 0) {
+			sched_pace(job);
 		}
 		return (0);
 	}
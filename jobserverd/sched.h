@@ -16,6 +16,7 @@
 #include	"state.h"
 #include	"event.h"
 #include	"ct.h"
+#include	"launcher.h"
 #include	"queue.h"
 
 /*
@@ -25,32 +26,165 @@
  */
 #define	SCHED_MIN_RUNTIME	(60*5)
 
+/*
+ * Defaults for a job's restart policy (restart_policy_t), when the policy is
+ * enabled but a field is 0.  A job which runs for SCHED_MIN_RUNTIME is
+ * considered healthy by default.
+ */
+#define	SCHED_RESTART_BACKOFF	2
+#define	SCHED_RESTART_MAX_DELAY	(60*60)
+
+/*
+ * For fair-share ordering of the run queue, each running job counts as this
+ * many seconds of usage.
+ */
+#define	SCHED_FS_RUN_CHARGE	60
+
+/*
+ * A scheduled run is missed (and subject to the job's catch-up policy) if it
+ * didn't start within SCHED_CATCHUP_GRACE seconds of its time.  With the ALL
+ * policy, at most job_catchup_max missed runs are made up, or
+ * SCHED_CATCHUP_MAX if that's 0.
+ */
+#define	SCHED_CATCHUP_GRACE	60
+#define	SCHED_CATCHUP_MAX	10
+
+/*
+ * A job which is still running SCHED_STOP_TIMEOUT seconds after it was asked
+ * to stop is killed, unless its stop policy says otherwise.  When the
+ * jobserver shuts down, every job is stopped at once, and anything still
+ * running after the shutdown timeout (by default SCHED_SHUTDOWN_TIMEOUT) is
+ * killed whatever its policy.
+ */
+#define	SCHED_STOP_TIMEOUT	30
+#define	SCHED_SHUTDOWN_TIMEOUT	60
+
 int sched_init(int port);
 
 typedef enum {
 	SJOB_UNKNOWN = 0,
 	SJOB_RUNNING,
 	SJOB_STOPPING,
-	SJOB_STOPPED
+	SJOB_STOPPED,
+	SJOB_QUEUED		/* waiting for a free run slot */
 } sjob_state_t;
 
+#define	SJOB_NSTATES	(SJOB_QUEUED + 1)
+
+/*
+ * How a job's last run ended, for its dependents.  A run which is stopped
+ * by hand counts as a failure.
+ */
+typedef enum {
+	SJOB_OUTCOME_NONE = 0,	/* hasn't finished a run yet */
+	SJOB_OUTCOME_SUCCESS,
+	SJOB_OUTCOME_FAILURE,
+	SJOB_OUTCOME_SKIPPED	/* its own dependencies weren't met */
+} sjob_outcome_t;
+
+/*
+ * The outcome of a dependency's run, held by the dependent job until all its
+ * dependencies have finished.
+ */
+typedef struct {
+	job_id_t	 sd_job;
+	sjob_outcome_t	 sd_outcome;
+} sjob_dep_t;
+
+/*
+ * Run statistics, kept for each job since the daemon started.  Durations and
+ * start skews (how long after its scheduled time a run started, including
+ * time spent on the run queue) are counted in log2 buckets: bucket 0 is under
+ * a second, bucket n (n > 0) is [2^(n-1), 2^n) seconds, and the last bucket
+ * holds everything longer.  Skew is only recorded for runs started by the
+ * job's schedule.  The last SJOB_NRECENT runs are kept in a ring.
+ */
+#define	SJOB_HIST_BUCKETS	16
+#define	SJOB_NRECENT		8
+
+#define	SJOB_RESULT_EXIT	0	/* exited 0 */
+#define	SJOB_RESULT_FAIL	1	/* non-0 exit, fatal signal or stopped */
+#define	SJOB_RESULT_CRASH	2	/* a process crashed */
+
+typedef struct {
+	time_t		 sr_start;
+	uint32_t	 sr_duration;
+	int32_t		 sr_skew;		/* -1 if not a scheduled run */
+	int32_t		 sr_status;		/* wait status, -1 if unknown */
+	uint8_t		 sr_result;		/* SJOB_RESULT_* */
+} sjob_run_t;
+
+typedef struct {
+	uint32_t	 st_runs;
+	uint32_t	 st_results[3];		/* by SJOB_RESULT_* */
+	uint64_t	 st_total_duration;
+	uint32_t	 st_max_duration;
+	uint32_t	 st_duration[SJOB_HIST_BUCKETS];
+	uint32_t	 st_skew[SJOB_HIST_BUCKETS];
+	uint32_t	 st_nrecent;		/* runs ever added to the ring */
+	sjob_run_t	 st_recent[SJOB_NRECENT];
+} sjob_stats_t;
+
 typedef struct sjob {
 	job_id_t	 sjob_id;		/* job this sjob represents */
 	sjob_state_t	 sjob_state;
 	contract_t	*sjob_contract;
 	contract_t	*sjob_stop_contract;
-	ev_id_t		 sjob_timer;
+	launch_id_t	 sjob_launch;		/* start not finished yet */
+	launch_id_t	 sjob_stop_launch;	/* same, for the stop method */
+	ev_id_t		 sjob_timer;		/* schedule or restart timer */
+	/*
+	 * While stopping, the signals to send after the first one (the last
+	 * is always SIGKILL), and the next of them to send.
+	 */
+	ev_id_t		 sjob_stop_timer;
+	time_t		 sjob_stop_began;
+	stop_step_t	 sjob_stop_chain[JOB_MAX_STOP_STEPS + 1];
+	int		 sjob_stop_nsteps;
+	int		 sjob_stop_next;
 	pid_t		 sjob_pid;
 	int		 sjob_fatal;		/* job received a fatal event */
 	time_t		 sjob_nextrun;
 	time_t		 sjob_start_time;
+	time_t		 sjob_queued;		/* when it entered the run queue */
+	uint64_t	 sjob_qseq;		/* order in the run queue */
+	time_t		 sjob_restart_at;	/* pending delayed restart */
+	int		 sjob_restarts;		/* consecutive restarts */
+	int		 sjob_catchup;		/* catch-up runs still to do */
+	sjob_outcome_t	 sjob_outcome;		/* of the last run */
+	sjob_dep_t	*sjob_depdone;		/* dependencies finished */
+	int		 sjob_ndepdone;
+	int		 sjob_instance;		/* an extra parallel instance */
+	int		 sjob_overlap_pending;	/* run again when this run ends */
+	int		 sjob_skipped;		/* runs skipped by overlap */
+	time_t		 sjob_due;		/* scheduled time of next start */
+	time_t		 sjob_skew;		/* of this run; -1 if unscheduled */
+	int		 sjob_status;		/* wait status of sjob_pid */
+	int		 sjob_crashed;
+	sjob_stats_t	 sjob_stats;
 	char const	*sjob_lasterr;
 	LIST_ENTRY(sjob) sjob_entries;
+	LIST_ENTRY(sjob) sjob_hash;
+	TAILQ_ENTRY(sjob) sjob_queue;
+	TAILQ_ENTRY(sjob) sjob_uqueue;		/* owner's run queue */
 } sjob_t;
 
+/*
+ * Start a job.  If starting it now would exceed the global or per-user limit
+ * on running jobs, the job is put on the run queue instead, and started when
+ * a running job exits.  Queued jobs are started in fair-share order across
+ * users (see sched_admit()), and in FIFO order within a user.
+ */
+
 int sched_start(job_t *);
 int sched_stop(job_t *);
 sjob_state_t sched_get_state(job_t *);
+
+/*
+ * Stop every running job, for shutdown.  Jobs are stopped according to their
+ * stop policies, except that anything still running after the shutdown
+ * timeout is killed.
+ */
 void sched_stop_all(void);
 
 /*
@@ -64,13 +198,81 @@ void sched_job_scheduled(job_t *);
 void sched_job_unscheduled(job_t *);
 
 /*
- * Get the next runtime of a scheduled job.
+ * Get the next runtime of a schedule, in the given time zone.  Returns -1 if
+ * the schedule will never run again.
+ */
+time_t sched_nextrun(cron_t *, tz_t const *);
+
+/*
+ * Get the first run time of a schedule after 'after'.  Returns -1 if there
+ * isn't one.
  */
-time_t sched_nextrun(cron_t *);
+time_t sched_nextrun_after(cron_t *, tz_t const *, time_t after);
 
 /*
  * Return the number of running jobs.
  */
 int sched_jobs_running(void);
 
+/*
+ * Like schedtab_count(), but each parallel instance of a job is counted as
+ * well as the job itself.
+ */
+int sched_count(uint32_t states, char const *user);
+
+/*
+ * Return the number of jobs waiting in the paced start queue, either because
+ * the daemon just started or to catch up on missed runs.
+ */
+int sched_pace_pending(void);
+
+/*
+ * Start queued jobs for as long as the run limits allow.  Call this after
+ * the limits are raised.
+ */
+void sched_admit(void);
+
+/*
+ * If the job is waiting to be restarted under its restart policy, return the
+ * time it will be restarted, otherwise 0.
+ */
+time_t sched_restart_pending(job_t *);
+
+/*
+ * A job with dependencies is started when the last of them finishes a run, if
+ * their outcomes satisfy its conditions; otherwise that run is skipped, which
+ * its own dependents see as SJOB_OUTCOME_SKIPPED.  Every job made ready by a
+ * run is started at once, subject to the run limits.  An enabled job with
+ * dependencies and no schedule only runs when its dependencies are done.
+ *
+ * sched_last_outcome() returns the outcome of the job's last run, and
+ * sched_dep_outcome() the outcome of dependency 'dep' towards the job's next
+ * run, or SJOB_OUTCOME_NONE if the dependency hasn't finished yet.
+ */
+sjob_outcome_t sched_last_outcome(job_t *);
+sjob_outcome_t sched_dep_outcome(job_t *, job_id_t dep);
+
+/*
+ * When a scheduled job is due while it is still running, its overlap policy
+ * (see state.h) decides what happens.  OVERLAP_PARALLEL runs each extra
+ * instance under its own sjob, which isn't in the sjob table; the job counts
+ * as running while any instance is.  sched_skipped_runs() returns the number
+ * of runs skipped because of overlap since the daemon started, and
+ * sched_instances() the number of extra instances running.
+ */
+int sched_skipped_runs(job_t *);
+int sched_instances(job_t *);
+
+/*
+ * Return a job's run statistics, or NULL if it hasn't run since the daemon
+ * started.  Runs of parallel instances are included.
+ */
+sjob_stats_t const *sched_get_stats(job_t *);
+
+/*
+ * If the job is on the run queue, return its 1-based position and store the
+ * time it was queued in *since.  Otherwise return 0.
+ */
+int sched_queue_position(job_t *, time_t *since);
+
 #endif	/* !SCHED_H */
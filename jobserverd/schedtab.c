@@ -0,0 +1,183 @@
+/*
+ * Copyright 2010 River Tarnell.  All rights reserved.
+ * Use is subject to license terms.
+ */
+
+#include	<stdlib.h>
+#include	<strings.h>
+#include	<assert.h>
+#include	<inttypes.h>
+
+#include	"jobserver.h"
+#include	"schedtab.h"
+
+#define	TAB_MIN_SIZE	64
+
+/*
+ * One entry per job; job_tabslot is the job's index.  Entries are kept dense
+ * by moving the last entry into the hole when a job is removed.
+ *
+ * The scan loops below are written without branches in the loop body so the
+ * compiler can vectorise them.  Counts by state are kept as jobs change state
+ * (and per user in job_user_t), so counting never needs a scan.
+ */
+static size_t		  tab_n;
+static size_t		  tab_size;
+static job_t		**tab_job;
+static uint32_t		 *tab_flags;
+static uint8_t		 *tab_state;
+
+/* Number of jobs in each state. */
+static int		  tab_nstate[SJOB_NSTATES];
+
+static int	tab_grow(void);
+static int	tab_slot(job_t *);
+
+static int
+tab_grow()
+{
+size_t	nsz = tab_size ? tab_size * 2 : TAB_MIN_SIZE;
+void	*p;
+
+	/*
+	 * If one of these fails, the arrays we already grew are just bigger
+	 * than they need to be, which is harmless.
+	 */
+#define	GROW(a)								\
+	if ((p = realloc(a, nsz * sizeof (*a))) == NULL)		\
+		goto err;						\
+	a = p;
+
+	GROW(tab_job);
+	GROW(tab_flags);
+	GROW(tab_state);
+#undef	GROW
+
+	tab_size = nsz;
+	return (0);
+
+err:
+	logm(LOG_ERR, "schedtab: out of memory");
+	return (-1);
+}
+
+static int
+tab_slot(job)
+	job_t	*job;
+{
+	assert(job->job_tabslot >= 0 && job->job_tabslot < tab_n);
+	assert(tab_job[job->job_tabslot] == job);
+	return (job->job_tabslot);
+}
+
+int
+schedtab_insert(job)
+	job_t	*job;
+{
+size_t	i;
+
+	if (tab_n == tab_size && tab_grow() == -1)
+		return (-1);
+
+	i = tab_n++;
+	tab_job[i] = job;
+	tab_flags[i] = job->job_flags;
+	tab_state[i] = SJOB_STOPPED;
+	tab_nstate[SJOB_STOPPED]++;
+	/*LINTED*/
+	job->job_tabslot = i;
+	return (0);
+}
+
+void
+schedtab_remove(job)
+	job_t	*job;
+{
+int	i = tab_slot(job);
+size_t	last = --tab_n;
+
+	tab_nstate[tab_state[i]]--;
+	if (i != last) {
+		tab_job[i] = tab_job[last];
+		tab_flags[i] = tab_flags[last];
+		tab_state[i] = tab_state[last];
+		tab_job[i]->job_tabslot = i;
+	}
+
+	job->job_tabslot = -1;
+}
+
+void
+schedtab_set_flags(job)
+	job_t	*job;
+{
+	tab_flags[tab_slot(job)] = job->job_flags;
+}
+
+void
+schedtab_set_state(job, state)
+	job_t		*job;
+	sjob_state_t	 state;
+{
+int	i = tab_slot(job);
+	tab_nstate[tab_state[i]]--;
+	tab_nstate[state]++;
+	tab_state[i] = state;
+}
+
+sjob_state_t
+schedtab_get_state(job)
+	job_t	*job;
+{
+	return ((sjob_state_t)tab_state[tab_slot(job)]);
+}
+
+int
+schedtab_count(states, user)
+	uint32_t	 states;
+	char const	*user;
+{
+int		 n[SJOB_NSTATES], i, ret = 0;
+job_user_t const *ju;
+
+	if (user == NULL) {
+		bcopy(tab_nstate, n, sizeof (n));
+	} else {
+		if ((ju = find_job_user(user)) == NULL)
+			return (0);
+
+		n[SJOB_UNKNOWN] = 0;
+		n[SJOB_RUNNING] = ju->ju_nrunning;
+		n[SJOB_STOPPING] = ju->ju_nstopping;
+		n[SJOB_QUEUED] = ju->ju_nqueued;
+		n[SJOB_STOPPED] = ju->ju_njobs - ju->ju_nrunning -
+		    ju->ju_nstopping - ju->ju_nqueued;
+	}
+
+	for (i = 0; i < SJOB_NSTATES; ++i)
+		if (states & SCHEDTAB_STATE(i))
+			ret += n[i];
+	return (ret);
+}
+
+size_t
+schedtab_scheduled(jobs, max)
+	job_t	**jobs;
+	size_t	  max;
+{
+size_t		i, n = 0;
+uint32_t const	want = JOB_ENABLED | JOB_SCHEDULED;
+
+	for (i = 0; i < tab_n && n < max; ++i) {
+		jobs[n] = tab_job[i];
+		n += ((tab_flags[i] & (want | JOB_MAINTENANCE)) == want);
+	}
+
+	return (n);
+}
+
+size_t
+schedtab_size()
+{
+	return (tab_n);
+}
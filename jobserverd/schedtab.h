@@ -0,0 +1,53 @@
+/*
+ * Copyright 2010 River Tarnell.  All rights reserved.
+ * Use is subject to license terms.
+ */
+
+/*
+ * The scheduling table holds a copy of the scheduler-relevant fields of every
+ * job, stored as one array per field rather than one structure per job.
+ * Questions about many jobs at once ("how many jobs are running?", "which
+ * jobs are scheduled?") are answered by scanning these arrays, instead of
+ * following list pointers to job_t's and sjob_t's all over the heap.
+ *
+ * The table is kept up to date by state.c (flags) and sched.c (run state);
+ * nothing else should modify it.
+ */
+
+#ifndef	SCHEDTAB_H
+#define	SCHEDTAB_H
+
+#include	"state.h"
+#include	"sched.h"
+
+/* Add or remove a job.  A new job starts out SJOB_STOPPED. */
+int	 schedtab_insert(job_t *);
+void	 schedtab_remove(job_t *);
+
+/* Update the table after the job's flags or scheduler state changed. */
+void	 schedtab_set_flags(job_t *);
+void	 schedtab_set_state(job_t *, sjob_state_t);
+
+sjob_state_t	schedtab_get_state(job_t *);
+
+/*
+ * Count jobs whose state is in 'states', a mask of SCHEDTAB_STATE() bits.
+ * If user is not NULL, only count that user's jobs.  This is O(1); the counts
+ * are maintained as jobs change state.
+ */
+#define	SCHEDTAB_STATE(st)	(1U << (st))
+#define	SCHEDTAB_LIVE		(SCHEDTAB_STATE(SJOB_RUNNING) | \
+				    SCHEDTAB_STATE(SJOB_STOPPING))
+int	 schedtab_count(uint32_t states, char const *user);
+
+/*
+ * Find up to 'max' enabled, scheduled jobs which aren't in maintenance,
+ * whatever their run state, and store them in 'jobs'.  Returns the number of
+ * jobs found.
+ */
+size_t	 schedtab_scheduled(job_t **jobs, size_t max);
+
+/* The number of jobs in the table. */
+size_t	 schedtab_size(void);
+
+#endif	/* !SCHEDTAB_H */
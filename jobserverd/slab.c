@@ -0,0 +1,177 @@
+/*
+ * Copyright 2010 River Tarnell.  All rights reserved.
+ * Use is subject to license terms.
+ */
+
+#include	<stdlib.h>
+#include	<strings.h>
+#include	<assert.h>
+
+#include	"jobserver.h"
+#include	"slab.h"
+#include	"queue.h"
+
+/*
+ * Chunks are roughly this size, but always hold at least SLAB_MIN_OBJS
+ * objects.
+ */
+#define	SLAB_CHUNK_SIZE	16384
+#define	SLAB_MIN_OBJS	8
+
+/*
+ * Each object is preceded by a pointer to its chunk, padded so the object is
+ * suitably aligned for any type.  While the object is free, the same space
+ * holds the next free object in the chunk.
+ */
+typedef union slab_align {
+	double		 sa_d;
+	long long	 sa_ll;
+	void		*sa_p;
+} slab_align_t;
+
+#define	SLAB_ROUND(n)	(((n) + sizeof (slab_align_t) - 1) & \
+			    ~(sizeof (slab_align_t) - 1))
+
+struct slab_chunk;
+
+typedef union slab_hdr {
+	struct slab_chunk	*sh_chunk;	/* allocated */
+	union slab_hdr		*sh_next;	/* free */
+	slab_align_t		 sh_align;
+} slab_hdr_t;
+
+typedef struct slab_chunk {
+	LIST_ENTRY(slab_chunk)	 sc_entries;
+	slab_hdr_t		*sc_free;
+	size_t			 sc_nfree;
+	slab_align_t		 sc_data[1];
+} slab_chunk_t;
+
+struct slab {
+	char const		*sl_name;
+	size_t			 sl_objsize;	/* including header */
+	size_t			 sl_nobjs;	/* per chunk */
+	size_t			 sl_nempty;	/* completely free chunks */
+	LIST_HEAD(slab_chunks, slab_chunk) sl_partial;
+};
+
+static slab_chunk_t	*slab_grow(slab_t *);
+
+slab_t *
+slab_create(name, size)
+	char const	*name;
+	size_t		 size;
+{
+slab_t	*sl;
+
+	if ((sl = calloc(1, sizeof (*sl))) == NULL) {
+		logm(LOG_ERR, "slab_create: %s: out of memory", name);
+		return (NULL);
+	}
+
+	sl->sl_name = name;
+	sl->sl_objsize = sizeof (slab_hdr_t) + SLAB_ROUND(size);
+	sl->sl_nobjs = (SLAB_CHUNK_SIZE - sizeof (slab_chunk_t)) /
+	    sl->sl_objsize;
+	if (sl->sl_nobjs < SLAB_MIN_OBJS)
+		sl->sl_nobjs = SLAB_MIN_OBJS;
+	LIST_INIT(&sl->sl_partial);
+	return (sl);
+}
+
+static slab_chunk_t *
+slab_grow(sl)
+	slab_t	*sl;
+{
+slab_chunk_t	*sc;
+char		*p;
+size_t		 i;
+
+	if ((sc = malloc(sizeof (*sc) + sl->sl_objsize * sl->sl_nobjs)) ==
+	    NULL) {
+		logm(LOG_ERR, "slab_alloc: %s: out of memory", sl->sl_name);
+		return (NULL);
+	}
+
+	sc->sc_free = NULL;
+	sc->sc_nfree = sl->sl_nobjs;
+
+	/*
+	 * Build the free list backwards, so objects are handed out in address
+	 * order.
+	 */
+	p = (char *)sc->sc_data + sl->sl_objsize * sl->sl_nobjs;
+	for (i = 0; i < sl->sl_nobjs; ++i) {
+	slab_hdr_t	*h;
+		p -= sl->sl_objsize;
+		/*LINTED*/
+		h = (slab_hdr_t *)p;
+		h->sh_next = sc->sc_free;
+		sc->sc_free = h;
+	}
+
+	LIST_INSERT_HEAD(&sl->sl_partial, sc, sc_entries);
+	sl->sl_nempty++;
+	return (sc);
+}
+
+void *
+slab_alloc(sl)
+	slab_t	*sl;
+{
+slab_chunk_t	*sc;
+slab_hdr_t	*h;
+
+	if ((sc = LIST_FIRST(&sl->sl_partial)) == NULL &&
+	    (sc = slab_grow(sl)) == NULL)
+		return (NULL);
+
+	if (sc->sc_nfree == sl->sl_nobjs)
+		sl->sl_nempty--;
+
+	h = sc->sc_free;
+	sc->sc_free = h->sh_next;
+	if (--sc->sc_nfree == 0)
+		LIST_REMOVE(sc, sc_entries);
+
+	h->sh_chunk = sc;
+	bzero(h + 1, sl->sl_objsize - sizeof (*h));
+	return (h + 1);
+}
+
+void
+slab_free(sl, obj)
+	slab_t	*sl;
+	void	*obj;
+{
+slab_hdr_t	*h;
+slab_chunk_t	*sc;
+
+	if (obj == NULL)
+		return;
+
+	h = (slab_hdr_t *)obj - 1;
+	sc = h->sh_chunk;
+	assert(sc->sc_nfree < sl->sl_nobjs);
+
+	if (sc->sc_nfree == 0)
+		LIST_INSERT_HEAD(&sl->sl_partial, sc, sc_entries);
+
+	h->sh_next = sc->sc_free;
+	sc->sc_free = h;
+
+	if (++sc->sc_nfree < sl->sl_nobjs)
+		return;
+
+	/*
+	 * The chunk is now empty.  Keep one empty chunk around so that
+	 * alternating alloc and free doesn't keep calling malloc().
+	 */
+	if (sl->sl_nempty == 0) {
+		sl->sl_nempty++;
+		return;
+	}
+
+	LIST_REMOVE(sc, sc_entries);
+	free(sc);
+}
@@ -0,0 +1,37 @@
+/*
+ * Copyright 2010 River Tarnell.  All rights reserved.
+ * Use is subject to license terms.
+ */
+
+/*
+ * A simple allocator for many objects of the same size.  Objects are carved
+ * out of larger chunks, which avoids a separate malloc() per object and keeps
+ * objects of one type close together in memory.  A chunk is returned to the
+ * system once every object in it has been freed, as long as another chunk has
+ * free space.
+ */
+
+#ifndef	SLAB_H
+#define	SLAB_H
+
+#include	<sys/types.h>
+
+typedef struct slab slab_t;
+
+/*
+ * Create a new slab for objects of the given size.  'name' is used in log
+ * messages and is not copied.
+ */
+slab_t	*slab_create(char const *name, size_t size);
+
+/*
+ * Allocate a zeroed object.  Returns NULL if memory is exhausted.
+ */
+void	*slab_alloc(slab_t *);
+
+/*
+ * Free an object returned by slab_alloc().  It is not an error to pass NULL.
+ */
+void	 slab_free(slab_t *, void *);
+
+#endif	/* !SLAB_H */
@@ -16,12 +16,19 @@
 #include	<pwd.h>
 #include	<ctype.h>
 #include	<inttypes.h>
+#include	<math.h>
+#include	<signal.h>
 
 #include	"jobserver.h"
 #include	"state.h"
 #include	"sched.h"
 #include	"kvdb.h"
 #include	"jerrno.h"
+#include	"fmriidx.h"
+#include	"slab.h"
+#include	"strpool.h"
+#include	"schedtab.h"
+#include	"plan.h"
 
 #define	DB_PATH "/var/jobserver"
 
@@ -31,10 +38,44 @@ static int db = -1;
 static int table_jobs = -1;
 static int table_config = -1;
 
+/* All job_t's are allocated from here. */
+static slab_t *job_slab;
+
 static int unserialise_job(job_t **, nvlist_t *nvl);
 
 static LIST_HEAD(job_list, job) jobs;
 
+/*
+ * Jobs hashed by id, for find_job().
+ */
+#define	JOB_MIN_BUCKETS	64
+static struct job_list	*job_buckets;
+static size_t		 njob_buckets;
+static size_t		 njobs_hashed;
+
+#define	JOB_BUCKET(id)	\
+	(&job_buckets[(uint32_t)(id) & (njob_buckets - 1)])
+
+/*
+ * Per-user job lists, hashed by username.
+ */
+#define	USER_MIN_BUCKETS	16
+static LIST_HEAD(user_bucket, job_user) *users;
+static size_t	nuser_buckets;
+static size_t	nusers;
+
+static int		 job_hash_insert(job_t *);
+static void		 job_hash_remove(job_t *);
+static job_user_t	*user_lookup(char const *);
+static int		 job_attach_user(job_t *);
+static void		 job_detach_user(job_t *);
+static void		 job_set_flags(job_t *, uint32_t);
+
+static int		 rdep_add(job_t *, job_id_t);
+static void		 rdep_remove(job_t *, job_id_t);
+static void		 deps_link(void);
+static int		 dep_reaches(job_t *, job_t *, uint_t);
+
 static int
 load_job_callback(key, nvl, udata)
 	char const	*key;
@@ -49,6 +90,38 @@ int	*nerrs = udata;
 		return (1);
 	}
 
+	if (job_hash_insert(job) == -1) {
+		free_job(job);
+		(*nerrs)++;
+		return (1);
+	}
+
+	if (fmriidx_insert(job) == -1) {
+		logm(LOG_ERR, "load_job_callback: cannot index %s",
+		    job->job_fmri);
+		job_hash_remove(job);
+		free_job(job);
+		(*nerrs)++;
+		return (1);
+	}
+
+	if (job_attach_user(job) == -1) {
+		fmriidx_remove(job);
+		job_hash_remove(job);
+		free_job(job);
+		(*nerrs)++;
+		return (1);
+	}
+
+	if (schedtab_insert(job) == -1) {
+		job_detach_user(job);
+		fmriidx_remove(job);
+		job_hash_remove(job);
+		free_job(job);
+		(*nerrs)++;
+		return (1);
+	}
+
 	LIST_INSERT_HEAD(&jobs, job, job_entries);
 	return (0);
 }
@@ -77,6 +150,10 @@ int		nerrs = 0;
 		logm(LOG_NOTICE, "created directory %s", DB_PATH);
 	}
 
+	if (job_slab == NULL &&
+	    (job_slab = slab_create("job_t", sizeof (job_t))) == NULL)
+		return (-1);
+
 	if ((db = kvdb_open(DB_PATH, KVDB_CREATE)) == -1) {
 		logm(LOG_ERR, "statedb_init: %s: %s",
 		    DB_PATH, jstrerror(errno));
@@ -104,6 +181,7 @@ int		nerrs = 0;
 	if (nerrs)
 		goto err;
 
+	deps_link();
 	return (0);
 
 err:
@@ -223,6 +301,155 @@ quota_set_jobs_per_user(n)
 	return (0);
 }
 
+int
+quota_get_running()
+{
+int	*nrun, n;
+size_t	 sz;
+
+	if (kvtable_get(table_config, "quota_running",
+	    (char **)&nrun, &sz) == -1) {
+		if (errno == ENOENT)
+			return (0);
+		return (-1);
+	}
+
+	n = *nrun;
+	free(nrun);
+	return (n);
+}
+
+int
+quota_set_running(n)
+	int	n;
+{
+	if (kvtable_replace(table_config, "quota_running",
+	    (char *)&n, sizeof (n)) == -1) {
+		logm(LOG_ERR, "quota_set_running: db put failed: %s",
+		    strerror(errno));
+		return (-1);
+	}
+
+	return (0);
+}
+
+int
+quota_get_running_per_user()
+{
+int	*nrun, n;
+size_t	 sz;
+
+	if (kvtable_get(table_config, "quota_running_per_user",
+	    (char **)&nrun, &sz) == -1) {
+		if (errno == ENOENT)
+			return (0);
+		return (-1);
+	}
+
+	n = *nrun;
+	free(nrun);
+	return (n);
+}
+
+int
+quota_set_running_per_user(n)
+	int	n;
+{
+	if (kvtable_replace(table_config, "quota_running_per_user",
+	    (char *)&n, sizeof (n)) == -1) {
+		logm(LOG_ERR, "quota_set_running_per_user: db put failed: %s",
+		    strerror(errno));
+		return (-1);
+	}
+
+	return (0);
+}
+
+/*
+ * Shares are stored in the config table as "share:<user>".
+ */
+int
+quota_get_share(user)
+	char const	*user;
+{
+char	 key[128];
+int	*share, n;
+size_t	 sz;
+
+	(void) snprintf(key, sizeof (key), "share:%s", user);
+	if (kvtable_get(table_config, key, (char **)&share, &sz) == -1) {
+		if (errno == ENOENT)
+			return (1);
+		return (-1);
+	}
+
+	n = *share;
+	free(share);
+	return (n);
+}
+
+int
+quota_set_share(user, n)
+	char const	*user;
+	int		 n;
+{
+char		 key[128];
+job_user_t	*ju;
+
+	if (n <= 0) {
+		errno = EINVAL;
+		return (-1);
+	}
+
+	(void) snprintf(key, sizeof (key), "share:%s", user);
+	if (kvtable_replace(table_config, key, (char *)&n, sizeof (n)) == -1) {
+		logm(LOG_ERR, "quota_set_share: db put failed: %s",
+		    strerror(errno));
+		return (-1);
+	}
+
+	if ((ju = user_lookup(user)) != NULL)
+		ju->ju_share = n;
+	return (0);
+}
+
+int
+config_get_shutdown_timeout()
+{
+int	*v, n;
+size_t	 sz;
+
+	if (kvtable_get(table_config, "shutdown_timeout",
+	    (char **)&v, &sz) == -1) {
+		if (errno == ENOENT)
+			return (0);
+		return (-1);
+	}
+
+	n = *v;
+	free(v);
+	return (n);
+}
+
+int
+config_set_shutdown_timeout(n)
+	int	n;
+{
+	if (n < 0) {
+		errno = EINVAL;
+		return (-1);
+	}
+
+	if (kvtable_replace(table_config, "shutdown_timeout",
+	    (char *)&n, sizeof (n)) == -1) {
+		logm(LOG_ERR, "config_set_shutdown_timeout: db put failed: %s",
+		    strerror(errno));
+		return (-1);
+	}
+
+	return (0);
+}
+
 job_t *
 create_job(user, name)
 	char const	*user, *name;
@@ -240,15 +467,13 @@ char		*fmri = NULL;
 		goto err;
 	}
 
-	if ((job = find_job_fmri(fmri)) != NULL) {
+	if (fmriidx_find_exact(fmri) != NULL) {
 		errno = JEDUPLICATE_FMRI;
 		goto err;
 	}
 
-	if ((job = calloc(1, sizeof (*job))) == NULL) {
-		logm(LOG_ERR, "create_job: out of memory");
+	if ((job = slab_alloc(job_slab)) == NULL)
 		goto err;
-	}
 
 	if ((job->job_id = next_job_id()) == -1) {
 		logm(LOG_ERR, "create_job: cannot get job id");
@@ -258,12 +483,10 @@ char		*fmri = NULL;
 	job->job_fmri = fmri;
 	fmri = NULL;
 
-	if ((job->job_username = strdup(user)) == NULL ||
-	    (job->job_start_method = strdup("")) == NULL ||
-	    (job->job_stop_method = strdup("")) == NULL) {
-		logm(LOG_ERR, "create_job: out of memory");
+	if ((job->job_username = strpool_get(user)) == NULL ||
+	    (job->job_start_method = strpool_get("")) == NULL ||
+	    (job->job_stop_method = strpool_get("")) == NULL)
 		goto err;
-	}
 
 
 	job->job_fail_action = ST_EXIT_DISABLE | ST_EXIT_MAIL;
@@ -273,8 +496,34 @@ char		*fmri = NULL;
 	job->job_logsize = (1024 * 1024);
 	job->job_logkeep = 5;
 
-	if (job_update(job) == -1)
+	if (job_hash_insert(job) == -1)
+		goto err;
+
+	if (fmriidx_insert(job) == -1) {
+		job_hash_remove(job);
+		goto err;
+	}
+
+	if (job_attach_user(job) == -1) {
+		fmriidx_remove(job);
+		job_hash_remove(job);
 		goto err;
+	}
+
+	if (schedtab_insert(job) == -1) {
+		job_detach_user(job);
+		fmriidx_remove(job);
+		job_hash_remove(job);
+		goto err;
+	}
+
+	if (job_update(job) == -1) {
+		schedtab_remove(job);
+		job_detach_user(job);
+		fmriidx_remove(job);
+		job_hash_remove(job);
+		goto err;
+	}
 
 	LIST_INSERT_HEAD(&jobs, job, job_entries);
 	return (job);
@@ -292,15 +541,14 @@ unserialise_job(job, nvl)
 {
 int32_t		 ct, ca1, ca2, ctid;
 char		*start = NULL, *stop = NULL, *proj = NULL,
-		*fmri = NULL, *username, *logfmt;
-uchar_t		*rctls;
-uint_t		 nrctls;
+		*fmri = NULL, *username, *logfmt, *tz;
+uchar_t		*rctls, *deps, *steps;
+uint_t		 nrctls, ndeps, nsteps;
 int32_t		 i;
+int64_t		 i64;
 
-	if ((*job = calloc(1, sizeof (job_t))) == NULL) {
-		logm(LOG_ERR, "unserialise_job: out of memory");
+	if ((*job = slab_alloc(job_slab)) == NULL)
 		goto err;
-	}
 
 	if (nvlist_lookup_int32(nvl, "id", &(*job)->job_id) ||
 		nvlist_lookup_string(nvl, "start", &start) ||
@@ -324,7 +572,7 @@ int32_t		 i;
 	if (nvlist_lookup_string(nvl, "username", &username) == 0 &&
 	    nvlist_lookup_string(nvl, "fmri", &fmri) == 0) {
 		if (((*job)->job_fmri = strdup(fmri)) == NULL ||
-		    ((*job)->job_username = strdup(username)) == NULL) {
+		    ((*job)->job_username = strpool_get(username)) == NULL) {
 			logm(LOG_ERR, "unserialise_job: out of memory");
 			goto err;
 		}
@@ -341,6 +589,37 @@ int32_t		 i;
 		(*job)->job_logkeep = i;
 	else
 		(*job)->job_logkeep = 5;
+	if (nvlist_lookup_int32(nvl, "logstamp", &i) == 0)
+		(*job)->job_logstamp = i;
+
+	if (nvlist_lookup_int64(nvl, "lastrun", &i64) == 0)
+		(*job)->job_lastrun = (time_t)i64;
+	if (nvlist_lookup_int32(nvl, "catchup", &i) == 0)
+		(*job)->job_catchup = (catchup_t)i;
+	if (nvlist_lookup_int32(nvl, "catchup_max", &i) == 0)
+		(*job)->job_catchup_max = i;
+	if (nvlist_lookup_int32(nvl, "overlap", &i) == 0)
+		(*job)->job_overlap = (overlap_t)i;
+
+	if (nvlist_lookup_int32(nvl, "restart_delay", &i) == 0)
+		(*job)->job_restart.rs_delay = i;
+	if (nvlist_lookup_int32(nvl, "restart_backoff", &i) == 0)
+		(*job)->job_restart.rs_backoff = i;
+	if (nvlist_lookup_int32(nvl, "restart_max_delay", &i) == 0)
+		(*job)->job_restart.rs_max_delay = i;
+	if (nvlist_lookup_int32(nvl, "restart_reset", &i) == 0)
+		(*job)->job_restart.rs_reset = i;
+	if (nvlist_lookup_int32(nvl, "restart_attempts", &i) == 0)
+		(*job)->job_restart.rs_attempts = i;
+
+	if (nvlist_lookup_int32(nvl, "stop_timeout", &i) == 0)
+		(*job)->job_stop.sp_timeout = i;
+	if (nvlist_lookup_byte_array(nvl, "stop_steps", &steps,
+	    &nsteps) == 0 && nsteps <= sizeof ((*job)->job_stop.sp_steps)) {
+		/*LINTED*/
+		(*job)->job_stop.sp_nsteps = nsteps / sizeof (stop_step_t);
+		bcopy(steps, (*job)->job_stop.sp_steps, nsteps);
+	}
 
 	if (nvlist_lookup_int32(nvl, "logsize", &i) == 0)
 		(*job)->job_logsize = i;
@@ -361,30 +640,62 @@ int32_t		 i;
 		(*job)->job_nrctls = 0;
 	}
 
-	if (nvlist_lookup_string(nvl, "project", &proj) == 0) {
-		if (((*job)->job_project = strdup(proj)) == NULL) {
-			logm(LOG_ERR, "job_update: out of memory");
+	if (nvlist_lookup_byte_array(nvl, "deps", &deps, &ndeps) == 0 &&
+	    ndeps >= sizeof (job_dep_t)) {
+		/*LINTED*/
+		(*job)->job_ndeps = ndeps / sizeof (job_dep_t);
+		if (((*job)->job_deps = calloc((*job)->job_ndeps,
+				sizeof (job_dep_t))) == NULL) {
+			logm(LOG_ERR, "unserialise_job: out of memory");
 			goto err;
 		}
+
+		bcopy(deps, (*job)->job_deps,
+		    sizeof (job_dep_t) * (*job)->job_ndeps);
+	}
+
+	if (nvlist_lookup_string(nvl, "project", &proj) == 0) {
+		if (((*job)->job_project = strpool_get(proj)) == NULL)
+			goto err;
+	}
+
+	if (nvlist_lookup_string(nvl, "tz", &tz) == 0) {
+		if (((*job)->job_tz = strpool_get(tz)) == NULL)
+			goto err;
 	}
 
 	if (nvlist_lookup_string(nvl, "logfmt", &logfmt) == 0) {
-		if (((*job)->job_logfmt = strdup(logfmt)) == NULL) {
-			logm(LOG_ERR, "job_update: out of memory");
+		if (((*job)->job_logfmt = strpool_get(logfmt)) == NULL)
 			goto err;
-		}
 	}
 
 	(*job)->job_schedule.cron_type = ct;
 	(*job)->job_schedule.cron_arg1 = ca1;
 	(*job)->job_schedule.cron_arg2 = ca2;
 
-	if (((*job)->job_start_method = strdup(start)) == NULL ||
-	    ((*job)->job_stop_method = strdup(stop)) == NULL) {
-		logm(LOG_ERR, "unserialise_job: out of memory");
-		goto err;
+	if (ct == CRON_EXPR) {
+	char	*spec;
+		if (nvlist_lookup_string(nvl, "cron_spec", &spec)) {
+			logm(LOG_ERR, "unserialise_job: no cron_spec");
+			goto err;
+		}
+
+		if (cron_expr_compile(spec,
+		    &(*job)->job_schedule.cron_expr) == -1) {
+			logm(LOG_ERR, "unserialise_job: invalid cron_spec "
+			    "\"%s\"", spec);
+			goto err;
+		}
+
+		if (((*job)->job_schedule.cron_spec = strpool_get(spec))
+		    == NULL)
+			goto err;
 	}
 
+	if (((*job)->job_start_method = strpool_get(start)) == NULL ||
+	    ((*job)->job_stop_method = strpool_get(stop)) == NULL)
+		goto err;
+
 	return (0);
 
 err:
@@ -398,9 +709,11 @@ find_job(id)
 {
 job_t	*job = NULL;
 
-	LIST_FOREACH(job, &jobs, job_entries) {
-		if (job->job_id == id)
-			return (job);
+	if (njob_buckets > 0) {
+		LIST_FOREACH(job, JOB_BUCKET(id), job_hash) {
+			if (job->job_id == id)
+				return (job);
+		}
 	}
 
 	errno = JEJOB_NOT_FOUND;
@@ -408,66 +721,57 @@ job_t	*job = NULL;
 
 }
 
-job_t *
-find_job_fmri(fmri)
-	char const	*fmri;
+/*
+ * Add a job to the id hash.  The table is doubled when it's full; if that
+ * fails, the job goes in the existing table, which only makes the chains
+ * longer.
+ */
+static int
+job_hash_insert(job)
+	job_t	*job;
 {
-job_t		*job;
-char const	*p, *q;
-	LIST_FOREACH(job, &jobs, job_entries) {
-		/*
-		 * Check for an exact match.
-		 */
-		if (strcmp(fmri, job->job_fmri) == 0)
-			return (job);
-
-		/*
-		 * Sanity: if the job starts with job:/ and wasn't an exact
-		 * match, then it can't exist.
-		 */
-		if (strncmp(fmri, "job:/", 5) == 0)
-			continue;
-
-		/*
-		 * If the spec is longer than the FMRI, it can't possibly match.
-		 * Subtract 4 because the partial FMRI can't match the "job:".
-		 */
-		if (strlen(fmri) > strlen(job->job_fmri) - 4)
-			continue;
-
-		/*
-		 * Start at the end of the string, and match backwards.  Every
-		 * time we see a / in one string, it must match a / in the
-		 * other.
-		 */
-		p = fmri + strlen(fmri) - 1;
-		q = job->job_fmri + strlen(job->job_fmri) - 1;
-		for (; p >= fmri && q >= job->job_fmri; --p, --q) {
-			if (*p != *q)
-				goto next;
-
-			if (*p == '/' && *q != '/')
-				goto next;
-
-			if (*q == '/' && *p != '/')
-				goto next;
+struct job_list	*nb, *ob = job_buckets;
+size_t		 i, osz = njob_buckets;
+job_t		*j;
+
+	if (njobs_hashed >= njob_buckets) {
+		njob_buckets = osz ? osz * 2 : JOB_MIN_BUCKETS;
+		if ((nb = calloc(njob_buckets, sizeof (*nb))) == NULL) {
+			logm(LOG_ERR, "job_hash_insert: out of memory");
+			njob_buckets = osz;
+			if (osz == 0)
+				return (-1);
+		} else {
+			job_buckets = nb;
+			for (i = 0; i < osz; ++i) {
+				while ((j = LIST_FIRST(&ob[i])) != NULL) {
+					LIST_REMOVE(j, job_hash);
+					LIST_INSERT_HEAD(JOB_BUCKET(j->job_id),
+					    j, job_hash);
+				}
+			}
+			free(ob);
 		}
+	}
 
-		/*
-		 * Ensure the last part matched is a full name, which means
-		 * there must be a / before it.
-		 */
-		if (*q != '/')
-			continue;
-
-		/* Match! */
-		return (job);
+	LIST_INSERT_HEAD(JOB_BUCKET(job->job_id), job, job_hash);
+	njobs_hashed++;
+	return (0);
+}
 
-next:		;
-	}
+static void
+job_hash_remove(job)
+	job_t	*job;
+{
+	LIST_REMOVE(job, job_hash);
+	njobs_hashed--;
+}
 
-	errno = JEJOB_NOT_FOUND;
-	return (NULL);
+job_t *
+find_job_fmri(fmri)
+	char const	*fmri;
+{
+	return (fmriidx_find(fmri));
 }
 
 int
@@ -475,6 +779,8 @@ delete_job(job)
 	job_t	*job;
 {
 char	id[64];
+int	i;
+job_t	*dep;
 	(void) snprintf(id, sizeof (id), "%ld", (long)job->job_id);
 
 	if (sched_get_state(job) != SJOB_STOPPED) {
@@ -482,13 +788,26 @@ char	id[64];
 		goto err;
 	}
 
+	if (job->job_nrdeps) {
+		errno = JEHAS_DEPENDENTS;
+		goto err;
+	}
+
 	if (kvtable_delete(table_jobs, id) == -1) {
 		logm(LOG_ERR, "delete_job: db del failed: %s",
 		    strerror(errno));
 		goto err;
 	}
 
+	for (i = 0; i < job->job_ndeps; ++i)
+		if ((dep = find_job(job->job_deps[i].jd_job)) != NULL)
+			rdep_remove(dep, job->job_id);
+
 	sched_job_deleted(job);
+	schedtab_remove(job);
+	fmriidx_remove(job);
+	job_detach_user(job);
+	job_hash_remove(job);
 	LIST_REMOVE(job, job_entries);
 	return (0);
 
@@ -502,7 +821,7 @@ job_enable(job)
 {
 int	 ret;
 
-	job->job_flags |= JOB_ENABLED;
+	job_set_flags(job, job->job_flags | JOB_ENABLED);
 	ret = job_update(job);
 
 	if (!(job->job_flags & JOB_MAINTENANCE))
@@ -517,7 +836,7 @@ job_disable(job)
 {
 int	 ret;
 
-	job->job_flags &= ~JOB_ENABLED;
+	job_set_flags(job, job->job_flags & ~JOB_ENABLED);
 	ret = job_update(job);
 
 	sched_job_disabled(job);
@@ -581,13 +900,13 @@ job_set_start_method(job, method)
 	job_t		*job;
 	char const	*method;
 {
-char	*news;
-int	 ret;
+char const	*news;
+int		 ret;
 
-	if ((news = strdup(method)) == NULL)
+	if ((news = strpool_get(method)) == NULL)
 		return (-1);
 
-	free(job->job_start_method);
+	strpool_release(job->job_start_method);
 	job->job_start_method = news;
 
 	ret = job_update(job);
@@ -599,13 +918,13 @@ job_set_stop_method(job, method)
 	job_t		*job;
 	char const	*method;
 {
-char	*news;
-int	 ret;
+char const	*news;
+int		 ret;
 
-	if ((news = strdup(method)) == NULL)
+	if ((news = strpool_get(method)) == NULL)
 		return (-1);
 
-	free(job->job_stop_method);
+	strpool_release(job->job_stop_method);
 	job->job_stop_method = news;
 
 	ret = job_update(job);
@@ -617,7 +936,7 @@ job_set_fmri(job, fmri)
 	job_t		*job;
 	char const	*fmri;
 {
-char	*news;
+char	*news, *olds;
 int	 ret;
 
 	if (!valid_fmri(fmri)) {
@@ -625,7 +944,7 @@ int	 ret;
 		return (-1);
 	}
 
-	if (find_job_fmri(fmri) != NULL) {
+	if (fmriidx_find_exact(fmri) != NULL) {
 		errno = JEDUPLICATE_FMRI;
 		return (-1);
 	}
@@ -633,9 +952,28 @@ int	 ret;
 	if ((news = strdup(fmri)) == NULL)
 		return (-1);
 
-	free(job->job_fmri);
+	fmriidx_remove(job);
+	olds = job->job_fmri;
 	job->job_fmri = news;
 
+	/*
+	 * If the new FMRI can't be indexed, put the old one back, so the job
+	 * is never left without an entry in the index.
+	 */
+	if (fmriidx_insert(job) == -1) {
+		ret = errno;
+		logm(LOG_ERR, "job_set_fmri: cannot index %s", news);
+		job->job_fmri = olds;
+		free(news);
+		if (fmriidx_insert(job) == -1)
+			logm(LOG_ERR, "job_set_fmri: cannot index %s", olds);
+		errno = ret;
+		return (-1);
+	}
+
+	free(olds);
+	plan_invalidate(job);
+
 	ret = job_update(job);
 	return (ret);
 }
@@ -677,6 +1015,31 @@ char		 id[64];
 			(int32_t)job->job_contract) != 0 ||
 		nvlist_add_int32(nvl, "logkeep",
 			(int32_t)job->job_logkeep) != 0 ||
+		nvlist_add_int32(nvl, "logstamp",
+			(int32_t)job->job_logstamp) != 0 ||
+		nvlist_add_int64(nvl, "lastrun",
+			(int64_t)job->job_lastrun) != 0 ||
+		nvlist_add_int32(nvl, "catchup",
+			(int32_t)job->job_catchup) != 0 ||
+		nvlist_add_int32(nvl, "catchup_max",
+			(int32_t)job->job_catchup_max) != 0 ||
+		nvlist_add_int32(nvl, "overlap",
+			(int32_t)job->job_overlap) != 0 ||
+		nvlist_add_int32(nvl, "restart_delay",
+			(int32_t)job->job_restart.rs_delay) != 0 ||
+		nvlist_add_int32(nvl, "restart_backoff",
+			(int32_t)job->job_restart.rs_backoff) != 0 ||
+		nvlist_add_int32(nvl, "restart_max_delay",
+			(int32_t)job->job_restart.rs_max_delay) != 0 ||
+		nvlist_add_int32(nvl, "restart_reset",
+			(int32_t)job->job_restart.rs_reset) != 0 ||
+		nvlist_add_int32(nvl, "restart_attempts",
+			(int32_t)job->job_restart.rs_attempts) != 0 ||
+		nvlist_add_int32(nvl, "stop_timeout",
+			(int32_t)job->job_stop.sp_timeout) != 0 ||
+		nvlist_add_byte_array(nvl, "stop_steps",
+			(uchar_t *)job->job_stop.sp_steps,
+			job->job_stop.sp_nsteps * sizeof (stop_step_t)) != 0 ||
 		nvlist_add_int32(nvl, "logsize",
 			(int32_t)job->job_logsize) != 0 ||
 		nvlist_add_int32(nvl, "cron_type",
@@ -700,6 +1063,15 @@ char		 id[64];
 		goto err;
 	}
 
+	if (job->job_ndeps && nvlist_add_byte_array(nvl, "deps",
+		(uchar_t *)job->job_deps,
+		sizeof (job_dep_t) * job->job_ndeps) != 0) {
+
+		logm(LOG_ERR, "job_update: cannot serialise: %s",
+			strerror(errno));
+		goto err;
+	}
+
 	if (job->job_project) {
 		if (nvlist_add_string(nvl, "project", job->job_project) != 0) {
 			logm(LOG_ERR, "job_update: " "cannot serialise: %s",
@@ -708,6 +1080,23 @@ char		 id[64];
 		}
 	}
 
+	if (job->job_tz) {
+		if (nvlist_add_string(nvl, "tz", job->job_tz) != 0) {
+			logm(LOG_ERR, "job_update: " "cannot serialise: %s",
+				strerror(errno));
+			goto err;
+		}
+	}
+
+	if (job->job_schedule.cron_spec) {
+		if (nvlist_add_string(nvl, "cron_spec",
+		    job->job_schedule.cron_spec) != 0) {
+			logm(LOG_ERR, "job_update: " "cannot serialise: %s",
+				strerror(errno));
+			goto err;
+		}
+	}
+
 	if (job->job_logfmt) {
 		if (nvlist_add_string(nvl, "logfmt", job->job_logfmt) != 0) {
 			logm(LOG_ERR, "job_update: " "cannot serialise: %s",
@@ -739,36 +1128,52 @@ free_job(job)
 	if (!job)
 		return;
 
+	plan_invalidate(job);
 	free(job->job_rctls);
-	free(job->job_start_method);
-	free(job->job_stop_method);
-	free(job->job_project);
-	free(job->job_logfmt);
+	free(job->job_deps);
+	free(job->job_rdeps);
 	free(job->job_fmri);
-	free(job->job_username);
-	free(job);
+	free(job->job_logfile);
+	strpool_release(job->job_start_method);
+	strpool_release(job->job_stop_method);
+	strpool_release(job->job_project);
+	strpool_release(job->job_logfmt);
+	strpool_release(job->job_username);
+	strpool_release(job->job_schedule.cron_spec);
+	strpool_release(job->job_tz);
+	slab_free(job_slab, job);
 }
 
 int
 job_enumerate(cb, udata)
 	job_enumerate_callback	 cb;
 	void			*udata;
-{
-	return (job_enumerate_user(NULL, cb, udata));
-}
-
-int
-job_enumerate_user(username, cb, udata)
-	char const *		 username;
-	job_enumerate_callback	 cb;
-	void			*udata;
 {
 job_t	*job;
 
 	LIST_FOREACH(job, &jobs, job_entries) {
-		if (username && strcmp(job->job_username, username))
-			continue;
-
+		if (cb(job, udata))
+			break;
+	}
+	return (0);
+}
+
+int
+job_enumerate_user(username, cb, udata)
+	char const *		 username;
+	job_enumerate_callback	 cb;
+	void			*udata;
+{
+job_t		*job;
+job_user_t	*ju;
+
+	if (username == NULL)
+		return (job_enumerate(cb, udata));
+
+	if ((ju = user_lookup(username)) == NULL)
+		return (0);
+
+	LIST_FOREACH(job, &ju->ju_jobs, job_user_entries) {
 		if (cb(job, udata))
 			break;
 	}
@@ -784,7 +1189,7 @@ job_unschedule(job)
 		return (-1);
 	}
 
-	job->job_flags &= ~(JOB_SCHEDULED | JOB_ENABLED);
+	job_set_flags(job, job->job_flags & ~(JOB_SCHEDULED | JOB_ENABLED));
 
 	/*
 	 * When unschedling a shceduled job with exit=restart,
@@ -806,7 +1211,7 @@ job_set_maintenance(job, reason)
 	job_t		*job;
 	char const	*reason;
 {
-	job->job_flags |= JOB_MAINTENANCE;
+	job_set_flags(job, job->job_flags | JOB_MAINTENANCE);
 	if (job_update(job) == -1)
 		logm(LOG_ERR, "job_set_maintenance: "
 			"warning: job_update failed");
@@ -823,7 +1228,7 @@ job_clear_maintenance(job)
 		return (-1);
 	}
 
-	job->job_flags &= ~JOB_MAINTENANCE;
+	job_set_flags(job, job->job_flags & ~JOB_MAINTENANCE);
 	if (job_update(job) == -1)
 		logm(LOG_ERR, "job_clear_maintenance: "
 			"warning: job_update failed");
@@ -933,22 +1338,42 @@ char	 s[64];
 		tm.tm_hour = h;
 		tm.tm_min = mi;
 		cron.cron_type = CRON_ABSOLUTE;
-		cron.cron_arg1 = mktime(&tm);
+		cron.cron_arg1 = tz_mktime(job_get_tz(job), &tm);
 
 		if (cron.cron_arg1 < current_time) {
 			errno = JEINVALID_SCHEDULE;
 			goto err;
 		}
+	} else if (strncmp(sched, "cron ", 5) == 0 ||
+	    cron_expr_compile(sched, &cron.cron_expr) == 0) {
+		if (strncmp(sched, "cron ", 5) == 0) {
+			sched += 5;
+			if (cron_expr_compile(sched, &cron.cron_expr) == -1)
+				goto err;
+		}
+
+		if (cron_expr_next(&cron.cron_expr, job_get_tz(job),
+		    current_time) == -1) {
+			errno = JEINVALID_SCHEDULE;
+			goto err;
+		}
+
+		cron.cron_type = CRON_EXPR;
+		if ((cron.cron_spec = strpool_get(sched)) == NULL)
+			goto err;
 	} else if (sscanf(sched, "at %d:%d", &h, &mi) == 2) {
-	struct tm	*tm = gmtime(&current_time);
-		tm->tm_hour = h;
-		tm->tm_min = mi;
+	struct tm	tm;
+	tz_t const	*tz = job_get_tz(job);
+		tz_localtime(tz, current_time, &tm);
+		tm.tm_hour = h;
+		tm.tm_min = mi;
+		tm.tm_sec = 0;
 		cron.cron_type = CRON_ABSOLUTE;
-		cron.cron_arg1 = mktime(tm);
+		cron.cron_arg1 = tz_mktime(tz, &tm);
 
 		if (cron.cron_arg1 < current_time) {
-			tm->tm_mday++;
-			cron.cron_arg1 = mktime(tm);
+			tm.tm_mday++;
+			cron.cron_arg1 = tz_mktime(tz, &tm);
 		}
 
 		if (cron.cron_arg1 < current_time) {
@@ -960,8 +1385,9 @@ char	 s[64];
 		goto err;
 	}
 
+	strpool_release(job->job_schedule.cron_spec);
 	job->job_schedule = cron;
-	job->job_flags |= (JOB_SCHEDULED | JOB_ENABLED);
+	job_set_flags(job, job->job_flags | JOB_SCHEDULED | JOB_ENABLED);
 
 	/*
 	 * When scheduling a job with exit=disable, automatically change it to
@@ -981,7 +1407,6 @@ char	 s[64];
 	if (job_update(job) == -1)
 		logm(LOG_ERR, "job_schedule: warning: job_update failed");
 
-	sched_job_scheduled(job);
 	sched_job_enabled(job);
 
 	return (0);
@@ -991,31 +1416,34 @@ err:
 }
 
 char *
-cron_to_string(cron)
-	cron_t	*cron;
+cron_to_string(job)
+	job_t	*job;
 {
 static char	 buf[128];
-struct tm	*tm;
-time_t		 t;
+struct tm	 tm;
 int		 hr, min;
 int		 a1, a2;
+cron_t		*cron = &job->job_schedule;
 
 	a1 = cron->cron_arg1;
 	a2 = cron->cron_arg2;
 
 	switch (cron->cron_type) {
 	case CRON_ABSOLUTE:
-		t = a1;
-		tm = gmtime(&t);
+		tz_localtime(job_get_tz(job), a1, &tm);
 		(void) strcpy(buf, "at ");
 		(void) strftime(buf + 3, sizeof (buf) - 3,
-			"%Y-%m-%d %H:%M", tm);
+			"%Y-%m-%d %H:%M", &tm);
 		return (buf);
 
 	case CRON_EVERY_MINUTE:
 		(void) strcpy(buf, "every minute");
 		return (buf);
 
+	case CRON_EXPR:
+		(void) snprintf(buf, sizeof (buf), "cron %s", cron->cron_spec);
+		return (buf);
+
 	case CRON_EVERY_HOUR:
 		(void) snprintf(buf, sizeof (buf), "every hour at %02d", a1);
 		return (buf);
@@ -1052,13 +1480,14 @@ int		 a1, a2;
 }
 
 char *
-cron_to_string_interval(cron)
-	cron_t	*cron;
+cron_to_string_interval(job)
+	job_t	*job;
 {
-time_t		when = sched_nextrun(cron) - current_time;
+time_t		when;
 static char	buf[128];
 size_t		i = 0;
 
+	when = sched_nextrun(&job->job_schedule, job_get_tz(job)) - current_time;
 	if (when <= 0)
 		return ("a very short time");
 
@@ -1364,33 +1793,79 @@ job_set_logfmt(job, logfmt)
 	job_t		*job;
 	char const	*logfmt;
 {
-char	*np = NULL;
+char const	*np = NULL;
 
 	assert(job);
 
 	if (logfmt && *logfmt) {
-		if ((np = strdup(logfmt)) == NULL) {
-			logm(LOG_ERR, "job_set_logfmt: out of memory");
-			goto err;
-		}
-
-		free(job->job_logfmt);
-		job->job_logfmt = np;
-	} else {
-		free(job->job_logfmt);
-		job->job_logfmt = NULL;
+		if ((np = strpool_get(logfmt)) == NULL)
+			return (-1);
 	}
 
+	strpool_release(job->job_logfmt);
+	job->job_logfmt = np;
+	plan_invalidate(job);
+
 	if (job_update(job) == -1) {
 		logm(LOG_ERR, "job_set_logfmt: job_updated failed");
-		goto err;
+		return (-1);
 	}
 
 	return (0);
+}
 
-err:
-	free(np);
-	return (-1);
+tz_t const *
+job_get_tz(job)
+	job_t	*job;
+{
+tz_t const	*tz;
+
+	if (job->job_tz == NULL)
+		return (tz_default());
+
+	if ((tz = tz_get(job->job_tz)) == NULL) {
+		logm(LOG_WARNING, "job_get_tz: %s: unknown time zone \"%s\", "
+		    "using default", job->job_fmri, job->job_tz);
+		return (tz_default());
+	}
+
+	return (tz);
+}
+
+int
+job_set_tz(job, name)
+	job_t		*job;
+	char const	*name;
+{
+char const	*np = NULL;
+
+	assert(job);
+
+	if (name && *name) {
+		if (tz_get(name) == NULL)
+			return (-1);
+		if ((np = strpool_get(name)) == NULL)
+			return (-1);
+	}
+
+	strpool_release(job->job_tz);
+	job->job_tz = np;
+
+	if (job_update(job) == -1) {
+		logm(LOG_ERR, "job_set_tz: job_updated failed");
+		return (-1);
+	}
+
+	/*
+	 * The next run time depends on the zone, so recompute it.
+	 */
+	if ((job->job_flags & (JOB_SCHEDULED | JOB_ENABLED)) ==
+	    (JOB_SCHEDULED | JOB_ENABLED)) {
+		sched_job_unscheduled(job);
+		sched_job_scheduled(job);
+	}
+
+	return (0);
 }
 
 int
@@ -1414,6 +1889,309 @@ job_set_logkeep(job, logkeep)
 	return (0);
 }
 
+int
+job_set_logstamp(job, logstamp)
+	job_t	*job;
+	int	 logstamp;
+{
+	assert(job);
+
+	job->job_logstamp = logstamp ? 1 : 0;
+	if (job_update(job) == -1) {
+		logm(LOG_ERR, "job_set_logstamp: job_update failed");
+		return (-1);
+	}
+
+	return (0);
+}
+
+int
+job_set_restart_policy(job, rs)
+	job_t			*job;
+	restart_policy_t const	*rs;
+{
+	assert(job);
+
+	if (rs->rs_delay < 0 || rs->rs_backoff < 0 || rs->rs_max_delay < 0 ||
+	    rs->rs_reset < 0 || rs->rs_attempts < 0) {
+		errno = EINVAL;
+		return (-1);
+	}
+
+	job->job_restart = *rs;
+	if (job_update(job) == -1) {
+		logm(LOG_ERR, "job_set_restart_policy: job_update failed");
+		return (-1);
+	}
+
+	return (0);
+}
+
+int
+job_set_stop_policy(job, sp)
+	job_t			*job;
+	stop_policy_t const	*sp;
+{
+int	i;
+
+	assert(job);
+
+	if (sp->sp_timeout < 0 || sp->sp_nsteps < 0 ||
+	    sp->sp_nsteps > JOB_MAX_STOP_STEPS ||
+	    (sp->sp_nsteps && sp->sp_steps[0].ss_delay != 0)) {
+		errno = EINVAL;
+		return (-1);
+	}
+
+	for (i = 0; i < sp->sp_nsteps; ++i) {
+		if (sp->sp_steps[i].ss_signo <= 0 ||
+		    sp->sp_steps[i].ss_signo >= NSIG ||
+		    (i > 0 && sp->sp_steps[i].ss_delay <=
+		    sp->sp_steps[i - 1].ss_delay)) {
+			errno = EINVAL;
+			return (-1);
+		}
+	}
+
+	job->job_stop = *sp;
+	if (job_update(job) == -1) {
+		logm(LOG_ERR, "job_set_stop_policy: job_update failed");
+		return (-1);
+	}
+
+	return (0);
+}
+
+int
+job_set_lastrun(job, when)
+	job_t	*job;
+	time_t	 when;
+{
+	job->job_lastrun = when;
+	if (job_update(job) == -1) {
+		logm(LOG_ERR, "job_set_lastrun: job_update failed");
+		return (-1);
+	}
+
+	return (0);
+}
+
+int
+job_set_catchup(job, policy, max)
+	job_t		*job;
+	catchup_t	 policy;
+	int		 max;
+{
+	assert(job);
+
+	if (policy < CATCHUP_DEFAULT || policy > CATCHUP_ALL || max < 0) {
+		errno = EINVAL;
+		return (-1);
+	}
+
+	job->job_catchup = policy;
+	job->job_catchup_max = max;
+	if (job_update(job) == -1) {
+		logm(LOG_ERR, "job_set_catchup: job_update failed");
+		return (-1);
+	}
+
+	return (0);
+}
+
+int
+job_set_overlap(job, overlap)
+	job_t		*job;
+	overlap_t	 overlap;
+{
+	assert(job);
+
+	if (overlap < OVERLAP_SKIP || overlap > OVERLAP_PARALLEL) {
+		errno = EINVAL;
+		return (-1);
+	}
+
+	job->job_overlap = overlap;
+	if (job_update(job) == -1) {
+		logm(LOG_ERR, "job_set_overlap: job_update failed");
+		return (-1);
+	}
+
+	return (0);
+}
+
+/*
+ * Record that job 'id' depends on 'job'.
+ */
+static int
+rdep_add(job, id)
+	job_t		*job;
+	job_id_t	 id;
+{
+job_id_t	*nr;
+
+	if ((nr = xrecalloc(job->job_rdeps, job->job_nrdeps,
+	    job->job_nrdeps + 1, sizeof (job_id_t))) == NULL) {
+		logm(LOG_ERR, "rdep_add: out of memory");
+		return (-1);
+	}
+
+	nr[job->job_nrdeps++] = id;
+	job->job_rdeps = nr;
+	return (0);
+}
+
+static void
+rdep_remove(job, id)
+	job_t		*job;
+	job_id_t	 id;
+{
+int	i;
+	for (i = 0; i < job->job_nrdeps; ++i) {
+		if (job->job_rdeps[i] != id)
+			continue;
+
+		job->job_rdeps[i] = job->job_rdeps[--job->job_nrdeps];
+		return;
+	}
+}
+
+/*
+ * Build each job's list of dependents once all jobs are loaded.  A dependency
+ * on a job which no longer exists is dropped.
+ */
+static void
+deps_link()
+{
+job_t	*job, *dep;
+int	 i;
+
+	LIST_FOREACH(job, &jobs, job_entries) {
+		for (i = 0; i < job->job_ndeps; ) {
+			if ((dep = find_job(job->job_deps[i].jd_job)) != NULL &&
+			    rdep_add(dep, job->job_id) == 0) {
+				i++;
+				continue;
+			}
+
+			logm(LOG_WARNING, "job %ld: dropping dependency on "
+			    "job %ld", (long)job->job_id,
+			    (long)job->job_deps[i].jd_job);
+			job->job_deps[i] = job->job_deps[--job->job_ndeps];
+		}
+	}
+}
+
+/*
+ * Return 1 if 'target' can be reached from 'from' by following dependencies.
+ * Jobs already visited in this search are marked with 'gen'.
+ */
+static int
+dep_reaches(from, target, gen)
+	job_t	*from, *target;
+	uint_t	 gen;
+{
+job_t	*dep;
+int	 i;
+
+	if (from == target)
+		return (1);
+	if (from->job_depgen == gen)
+		return (0);
+	from->job_depgen = gen;
+
+	for (i = 0; i < from->job_ndeps; ++i)
+		if ((dep = find_job(from->job_deps[i].jd_job)) != NULL &&
+		    dep_reaches(dep, target, gen))
+			return (1);
+
+	return (0);
+}
+
+int
+job_set_deps(job, deps, ndeps)
+	job_t			*job;
+	job_dep_t const		*deps;
+	int			 ndeps;
+{
+static uint_t	 gen;
+job_dep_t	*nd = NULL;
+job_t		*dep;
+int		 i, j;
+
+	assert(job);
+
+	for (i = 0; i < ndeps; ++i) {
+		if (deps[i].jd_cond < DEP_SUCCESS ||
+		    deps[i].jd_cond > DEP_ALWAYS) {
+			errno = EINVAL;
+			return (-1);
+		}
+
+		for (j = 0; j < i; ++j)
+			if (deps[j].jd_job == deps[i].jd_job) {
+				errno = EINVAL;
+				return (-1);
+			}
+
+		if ((dep = find_job(deps[i].jd_job)) == NULL)
+			return (-1);
+
+		/*
+		 * The new edge job -> dep makes a cycle if job is already
+		 * reachable from dep.
+		 */
+		if (dep_reaches(dep, job, ++gen)) {
+			errno = JEDEP_CYCLE;
+			return (-1);
+		}
+	}
+
+	if (ndeps && (nd = calloc(ndeps, sizeof (*nd))) == NULL) {
+		logm(LOG_ERR, "job_set_deps: out of memory");
+		return (-1);
+	}
+	if (ndeps)
+		bcopy(deps, nd, sizeof (*nd) * ndeps);
+
+	for (i = 0; i < job->job_ndeps; ++i)
+		if ((dep = find_job(job->job_deps[i].jd_job)) != NULL)
+			rdep_remove(dep, job->job_id);
+
+	for (i = 0; i < ndeps; ++i)
+		if (rdep_add(find_job(nd[i].jd_job), job->job_id) == -1) {
+			while (i-- > 0)
+				rdep_remove(find_job(nd[i].jd_job),
+				    job->job_id);
+			for (i = 0; i < job->job_ndeps; ++i)
+				if ((dep = find_job(job->job_deps[i].jd_job))
+				    != NULL)
+					(void) rdep_add(dep, job->job_id);
+			free(nd);
+			return (-1);
+		}
+
+	free(job->job_deps);
+	job->job_deps = nd;
+	job->job_ndeps = ndeps;
+
+	/*
+	 * As with scheduling, a job which runs after other jobs should wait
+	 * for its next turn when it exits, rather than being disabled.
+	 */
+	if (ndeps && (job->job_exit_action & ST_EXIT_DISABLE)) {
+		job->job_exit_action = (job->job_exit_action
+		    & ~(ST_EXIT_DISABLE | ST_EXIT_MAIL)) | ST_EXIT_RESTART;
+	}
+
+	if (job_update(job) == -1) {
+		logm(LOG_ERR, "job_set_deps: job_update failed");
+		return (-1);
+	}
+
+	return (0);
+}
+
 int
 job_set_logsize(job, logsize)
 	job_t	*job;
@@ -1440,7 +2218,7 @@ job_set_project(job, proj)
 	job_t		*job;
 	char const	*proj;
 {
-char	*np = NULL;
+char const	*np = NULL;
 
 	assert(job);
 
@@ -1452,51 +2230,229 @@ char	*np = NULL;
 		 */
 		if (!inproj(job->job_username, proj, nssbuf, sizeof (nssbuf))) {
 			errno = JEUSER_NOT_IN_PROJECT;
-			goto err;
-		}
-
-		if ((np = strdup(proj)) == NULL) {
-			logm(LOG_ERR, "job_set_project: out of memory");
-			goto err;
+			return (-1);
 		}
 
-		free(job->job_project);
-		job->job_project = np;
-	} else {
-		free(job->job_project);
-		job->job_project = NULL;
+		if ((np = strpool_get(proj)) == NULL)
+			return (-1);
 	}
 
+	strpool_release(job->job_project);
+	job->job_project = np;
+	plan_invalidate(job);
+
 	if (job_update(job) == -1) {
 		logm(LOG_ERR, "job_set_project: job_update failed");
-		goto err;
+		return (-1);
 	}
 
 	return (0);
+}
 
-err:
-	free(np);
-	return (-1);
+int
+njobs_for_user(username)
+	char const	*username;
+{
+job_user_t	*ju;
+	if ((ju = user_lookup(username)) == NULL)
+		return (0);
+	return (ju->ju_njobs);
+}
+
+job_user_t const *
+find_job_user(username)
+	char const	*username;
+{
+	return (user_lookup(username));
 }
 
-/*ARGSUSED*/
+static job_user_t *
+user_lookup(username)
+	char const	*username;
+{
+job_user_t	*ju;
+	if (nuser_buckets == 0)
+		return (NULL);
+
+	LIST_FOREACH(ju, &users[strhash(username, 0) & (nuser_buckets - 1)],
+	    ju_hash) {
+		if (strcmp(ju->ju_name, username) == 0)
+			return (ju);
+	}
+
+	return (NULL);
+}
+
+/*
+ * Add a job to its owner's job list, creating the job_user_t if this is the
+ * user's first job.
+ */
 static int
-_njobs_for_user_callback(job, udata)
+job_attach_user(job)
 	job_t	*job;
-	void	*udata;
 {
-	(*(int *)udata)++;
+job_user_t	*ju;
+
+	assert(job->job_user == NULL);
+
+	if ((ju = user_lookup(job->job_username)) == NULL) {
+		if (nusers >= nuser_buckets) {
+		struct user_bucket	*nb;
+		size_t			 nsz, i;
+		job_user_t		*u;
+
+			nsz = nuser_buckets ? nuser_buckets * 2
+			    : USER_MIN_BUCKETS;
+			if ((nb = calloc(nsz, sizeof (*nb))) == NULL) {
+				logm(LOG_ERR, "job_attach_user: out of memory");
+				return (-1);
+			}
+
+			for (i = 0; i < nuser_buckets; ++i) {
+				while ((u = LIST_FIRST(&users[i])) != NULL) {
+					LIST_REMOVE(u, ju_hash);
+					LIST_INSERT_HEAD(&nb[strhash(u->ju_name,
+					    0) & (nsz - 1)], u, ju_hash);
+				}
+			}
+
+			free(users);
+			users = nb;
+			nuser_buckets = nsz;
+		}
+
+		if ((ju = calloc(1, sizeof (*ju))) == NULL) {
+			logm(LOG_ERR, "job_attach_user: out of memory");
+			return (-1);
+		}
+
+		ju->ju_name = strpool_hold(job->job_username);
+		if ((ju->ju_share = quota_get_share(ju->ju_name)) <= 0)
+			ju->ju_share = 1;
+		ju->ju_usage_time = current_time;
+
+		LIST_INIT(&ju->ju_jobs);
+		LIST_INSERT_HEAD(&users[strhash(ju->ju_name, 0) &
+		    (nuser_buckets - 1)], ju, ju_hash);
+		nusers++;
+	}
+
+	job->job_user = ju;
+	LIST_INSERT_HEAD(&ju->ju_jobs, job, job_user_entries);
+	ju->ju_njobs++;
+	if (job->job_flags & JOB_ENABLED)
+		ju->ju_nenabled++;
+	if (job->job_flags & JOB_SCHEDULED)
+		ju->ju_nscheduled++;
 	return (0);
 }
 
-int
-njobs_for_user(username)
-	char const	*username;
+static void
+job_detach_user(job)
+	job_t	*job;
 {
-int	n = 0;
-	if (job_enumerate_user(username, _njobs_for_user_callback, &n) == -1)
-		return (-1);
-	return (n);
+job_user_t	*ju;
+
+	if ((ju = job->job_user) == NULL)
+		return;
+
+	LIST_REMOVE(job, job_user_entries);
+	job->job_user = NULL;
+
+	ju->ju_njobs--;
+	if (job->job_flags & JOB_ENABLED)
+		ju->ju_nenabled--;
+	if (job->job_flags & JOB_SCHEDULED)
+		ju->ju_nscheduled--;
+
+	if (ju->ju_njobs == 0) {
+		assert(ju->ju_nrunning == 0);
+		assert(ju->ju_nqueued == 0);
+		assert(ju->ju_ninstrunning == 0);
+		assert(TAILQ_EMPTY(&ju->ju_runq));
+		LIST_REMOVE(ju, ju_hash);
+		nusers--;
+		strpool_release(ju->ju_name);
+		free(ju);
+	}
+}
+
+/*
+ * Change a job's flags, keeping the owner's counters and the scheduling table
+ * up to date.  All changes to job_flags should go through here.
+ */
+static void
+job_set_flags(job, flags)
+	job_t		*job;
+	uint32_t	 flags;
+{
+job_user_t	*ju = job->job_user;
+uint32_t	 changed = job->job_flags ^ flags;
+
+	if (ju) {
+		if (changed & JOB_ENABLED)
+			ju->ju_nenabled += (flags & JOB_ENABLED) ? 1 : -1;
+		if (changed & JOB_SCHEDULED)
+			ju->ju_nscheduled += (flags & JOB_SCHEDULED) ? 1 : -1;
+	}
+
+	job->job_flags = flags;
+	schedtab_set_flags(job);
+}
+
+void
+job_user_sched_state(job, drunning, dstopping, dqueued)
+	job_t	*job;
+	int	 drunning, dstopping, dqueued;
+{
+	if (job->job_user == NULL)
+		return;
+
+	job->job_user->ju_nrunning += drunning;
+	job->job_user->ju_nstopping += dstopping;
+	job->job_user->ju_nqueued += dqueued;
+	assert(job->job_user->ju_nrunning >= 0);
+	assert(job->job_user->ju_nstopping >= 0);
+	assert(job->job_user->ju_nqueued >= 0);
+}
+
+void
+job_user_instance_state(job, drunning, dstopping)
+	job_t	*job;
+	int	 drunning, dstopping;
+{
+	if (job->job_user == NULL)
+		return;
+
+	job->job_user->ju_ninstrunning += drunning;
+	job->job_user->ju_ninststopping += dstopping;
+	assert(job->job_user->ju_ninstrunning >= 0);
+	assert(job->job_user->ju_ninststopping >= 0);
+}
+
+void
+job_user_charge(job, secs)
+	job_t	*job;
+	time_t	 secs;
+{
+job_user_t	*ju = job->job_user;
+
+	if (ju == NULL || secs <= 0)
+		return;
+
+	ju->ju_usage = job_user_usage(ju) + secs;
+	ju->ju_usage_time = current_time;
+}
+
+double
+job_user_usage(ju)
+	job_user_t const	*ju;
+{
+	if (ju->ju_usage == 0 || current_time <= ju->ju_usage_time)
+		return (ju->ju_usage);
+
+	return (ju->ju_usage * pow(0.5,
+	    (double)(current_time - ju->ju_usage_time) / JOB_USAGE_HALFLIFE));
 }
 
 int
@@ -14,6 +14,7 @@
 #include	<rctl.h>
 
 #include	"queue.h"
+#include	"cron.h"
 
 typedef int32_t job_id_t;
 
@@ -35,7 +36,8 @@ typedef enum {
 	CRON_EVERY_MINUTE,
 	CRON_EVERY_HOUR,
 	CRON_EVERY_DAY,
-	CRON_EVERY_WEEK
+	CRON_EVERY_WEEK,
+	CRON_EXPR
 } cron_type_t;
 
 typedef struct {
@@ -49,13 +51,50 @@ typedef struct {
 	 * minutes since midnight.
 	 * For EVERY_WEEK, we store the day it should run at (0=Sunday), and
 	 * the hour+minute in the same way as EVERY_DAY.
+	 * For EXPR, we store the expression text (from the string pool) and
+	 * its compiled form.
 	 */
-	int32_t	cron_arg1;
-	int32_t	cron_arg2;
+	int32_t		 cron_arg1;
+	int32_t		 cron_arg2;
+	char const	*cron_spec;
+	cron_expr_t	 cron_expr;
 } cron_t;
 
-char *cron_to_string(cron_t *);
-char *cron_to_string_interval(cron_t *);
+
+/*
+ * What to do about runs of a scheduled job that were missed because the
+ * jobserver wasn't running, or the system was suspended.
+ */
+typedef enum {
+	CATCHUP_DEFAULT = 0,	/* ONCE for "at" jobs, otherwise SKIP */
+	CATCHUP_SKIP,		/* don't run them */
+	CATCHUP_ONCE,		/* run once for all of them */
+	CATCHUP_ALL		/* run once for each, up to job_catchup_max */
+} catchup_t;
+
+/*
+ * What to do when a scheduled job is due while its previous run is still
+ * going.
+ */
+typedef enum {
+	OVERLAP_SKIP = 0,	/* don't run this time */
+	OVERLAP_QUEUE,		/* run once more when the previous run ends */
+	OVERLAP_KILL,		/* stop the previous run, then run */
+	OVERLAP_PARALLEL	/* run another instance alongside it */
+} overlap_t;
+
+/*
+ * A dependency of one job on another.  A job with dependencies runs when every
+ * job it depends on has finished a run, if each run's outcome matches jd_cond.
+ */
+#define	DEP_SUCCESS	1	/* the other job exited 0 */
+#define	DEP_FAILURE	2	/* the other job failed or crashed */
+#define	DEP_ALWAYS	3	/* any outcome */
+
+typedef struct {
+	job_id_t	jd_job;
+	int32_t		jd_cond;
+} job_dep_t;
 
 typedef struct {
 	char		jr_name[32];
@@ -63,17 +102,61 @@ typedef struct {
 } job_rctl_t;
 
 /*
- * Do not modify the contents of this struct; use the functions below.
+ * How to restart an enabled job that stopped.  If rs_delay is 0, the job is
+ * restarted at once, or put into maintenance if it ran for less than
+ * SCHED_MIN_RUNTIME.  Otherwise the n'th consecutive restart waits
+ * rs_delay * rs_backoff^(n-1) seconds, up to rs_max_delay; a job that ran for
+ * at least rs_reset seconds starts again from n = 1; and after rs_attempts
+ * restarts the job is put into maintenance.  For the other fields, 0 means
+ * the default (see sched.h); rs_attempts of 0 means no limit.
+ */
+typedef struct {
+	int	rs_delay;
+	int	rs_backoff;
+	int	rs_max_delay;
+	int	rs_reset;
+	int	rs_attempts;
+} restart_policy_t;
+
+/*
+ * How to stop a running job.  The job's stop method is run, or if it doesn't
+ * have one, the first step's signal is sent (SIGTERM if there are no steps).
+ * Each later step sends its signal ss_delay seconds after the stop began, and
+ * any processes left after sp_timeout seconds are killed; steps due after
+ * that are never reached.  Step delays are increasing, and the first step's
+ * delay is 0.  An sp_timeout of 0 means SCHED_STOP_TIMEOUT.
+ */
+#define	JOB_MAX_STOP_STEPS	4
+
+typedef struct {
+	int	ss_signo;
+	int	ss_delay;
+} stop_step_t;
+
+typedef struct {
+	int		sp_timeout;
+	int		sp_nsteps;
+	stop_step_t	sp_steps[JOB_MAX_STOP_STEPS];
+} stop_policy_t;
+
+struct job_user;
+struct launch_plan;
+struct sjob;
+
+/*
+ * Do not modify the contents of this struct; use the functions below.  The
+ * username, methods, project and log format are shared with other jobs (see
+ * strpool.h).
  */
 typedef struct job {
 	/*
 	 * General information about a job.
 	 */
 	job_id_t	 job_id;
-	char		*job_username;
+	char const	*job_username;
 	char		*job_fmri;
-	char		*job_start_method;
-	char		*job_stop_method;
+	char const	*job_start_method;
+	char const	*job_stop_method;
 	uint32_t	 job_flags;
 	uint32_t	 job_exit_action;	/* action on successful exit */
 	uint32_t	 job_crash_action;	/* action on crash */
@@ -81,14 +164,59 @@ typedef struct job {
 	cron_t		 job_schedule;
 	job_rctl_t	*job_rctls;
 	int		 job_nrctls;
-	char		*job_project;
+	char const	*job_project;
 	ctid_t		 job_contract;
-	char		*job_logfmt;
+	char const	*job_logfmt;
 	int		 job_logsize;
 	int		 job_logkeep;
+	int		 job_logstamp;		/* timestamp the log */
+	char		*job_logfile;		/* log of the last start */
+	char const	*job_tz;		/* NULL for host default */
+	restart_policy_t job_restart;
+	stop_policy_t	 job_stop;
+	time_t		 job_lastrun;		/* last scheduled run */
+	catchup_t	 job_catchup;
+	int		 job_catchup_max;	/* 0 for the default */
+	overlap_t	 job_overlap;
+	job_dep_t	*job_deps;		/* jobs this job runs after */
+	int		 job_ndeps;
+	job_id_t	*job_rdeps;		/* jobs which depend on this one */
+	int		 job_nrdeps;
+	uint_t		 job_depgen;		/* private to state.c */
 	LIST_ENTRY(job)	 job_entries;
+	LIST_ENTRY(job)	 job_hash;		/* private to state.c */
+	LIST_ENTRY(job)	 job_fmri_hash;		/* private to fmriidx */
+	struct job_user	*job_user;
+	LIST_ENTRY(job)	 job_user_entries;
+	int		 job_tabslot;		/* private to schedtab */
+	struct launch_plan *job_plan;		/* private to plan.c */
 } job_t;
 
+/*
+ * Every user who owns at least one job has a job_user_t, which holds the
+ * user's jobs and some counters maintained as jobs are created, deleted and
+ * change state.  This means per-user queries don't have to look at every job
+ * in the system.
+ */
+typedef struct job_user {
+	char const		*ju_name;
+	int			 ju_njobs;
+	int			 ju_nenabled;
+	int			 ju_nscheduled;
+	int			 ju_nrunning;
+	int			 ju_nstopping;
+	int			 ju_nqueued;
+	int			 ju_ninstrunning;	/* parallel instances */
+	int			 ju_ninststopping;
+	int			 ju_share;	/* fair-share weight */
+	double			 ju_usage;	/* decayed run time, seconds */
+	time_t			 ju_usage_time;	/* when ju_usage was decayed */
+	LIST_HEAD(job_user_jobs, job) ju_jobs;
+	LIST_ENTRY(job_user)	 ju_hash;
+	TAILQ_HEAD(job_user_runq, sjob) ju_runq;	/* private to sched.c */
+	TAILQ_ENTRY(job_user)	 ju_runq_entries;	/* private to sched.c */
+} job_user_t;
+
 int	 statedb_init(void);
 void	 statedb_shutdown(void);
 
@@ -119,7 +247,8 @@ int	 job_set_fmri(job_t *, char const *);
  *   foo/myjob
  *   myjob
  *
- * If the specification matches more than one FMRI, an error is returned.
+ * If the specification matches more than one FMRI, NULL is returned and errno
+ * is set to JEAMBIGUOUS_FMRI.  This does not depend on the number of jobs.
  */
 job_t	*find_job_fmri(char const *);
 
@@ -181,17 +310,102 @@ int	 job_set_ctid(job_t *, ctid_t);
 /* Set the project for a job. */
 int	job_set_project(job_t *, char const *);
 
+/*
+ * Set the time zone used for a job's schedule.  NULL or "" means the host's
+ * default zone.
+ */
+int		 job_set_tz(job_t *, char const *);
+tz_t const	*job_get_tz(job_t *);
+
+/*
+ * Describe a job's schedule, and the time until it next runs.  The returned
+ * buffer is static.
+ */
+char	*cron_to_string(job_t *);
+char	*cron_to_string_interval(job_t *);
+
 /* Set the log format */
 int	job_set_logfmt(job_t *, char const *);
 int	job_set_logsize(job_t *, size_t);
 int	job_set_logkeep(job_t *, int);
+int	job_set_logstamp(job_t *, int);
+
+/* Set the job's restart policy. */
+int	job_set_restart_policy(job_t *, restart_policy_t const *);
+
+/* Set the job's stop policy. */
+int	job_set_stop_policy(job_t *, stop_policy_t const *);
+
+/*
+ * Record the time of a scheduled job's last run.  Runs due between this time
+ * and now which didn't happen are subject to the catch-up policy.
+ */
+int	job_set_lastrun(job_t *, time_t);
+int	job_set_catchup(job_t *, catchup_t, int max);
+
+/* Set the job's overlap policy. */
+int	job_set_overlap(job_t *, overlap_t);
+
+/*
+ * Replace a job's dependencies.  Fails with JEDEP_CYCLE if the job would then
+ * depend on itself, directly or through other jobs.  A job which other jobs
+ * depend on can't be deleted (JEHAS_DEPENDENTS).
+ */
+int	job_set_deps(job_t *, job_dep_t const *, int);
 
 /* Count the number of jobs created by a given user. */
 int	njobs_for_user(char const *);
 
-/* Fetch/change quotas. */
+/*
+ * Return the job_user_t for a user, or NULL if the user doesn't have any
+ * jobs.  The returned structure must not be modified.
+ */
+job_user_t const *find_job_user(char const *);
+
+/*
+ * Called by the scheduler when a job's run state changes, to maintain the
+ * per-user running, stopping and queued counts.  Each argument is -1, 0 or 1.
+ */
+void	job_user_sched_state(job_t *, int drunning, int dstopping,
+		int dqueued);
+
+/*
+ * The same, for the running and stopping counts of a job's parallel
+ * instances, which are kept apart from the job counts.
+ */
+void	job_user_instance_state(job_t *, int drunning, int dstopping);
+
+/*
+ * Each user's recent usage is the total run time of their jobs, decayed by
+ * half every JOB_USAGE_HALFLIFE seconds.  job_user_charge() is called by the
+ * scheduler when a job stops; job_user_usage() returns the current value.
+ */
+#define	JOB_USAGE_HALFLIFE	(60*60)
+void	job_user_charge(job_t *, time_t);
+double	job_user_usage(job_user_t const *);
+
+/*
+ * Fetch/change quotas.  For the running job limits, 0 means no limit.
+ */
 int	quota_get_jobs_per_user(void);
 int	quota_set_jobs_per_user(int);
+int	quota_get_running(void);
+int	quota_set_running(int);
+int	quota_get_running_per_user(void);
+int	quota_set_running_per_user(int);
+
+/*
+ * A user's fair-share weight, which is 1 unless set.  Returns -1 on error.
+ */
+int	quota_get_share(char const *);
+int	quota_set_share(char const *, int);
+
+/*
+ * How long to give jobs to stop when the jobserver shuts down, in seconds.
+ * 0 means SCHED_SHUTDOWN_TIMEOUT.  Returns -1 on error.
+ */
+int	config_get_shutdown_timeout(void);
+int	config_set_shutdown_timeout(int);
 
 /* Check if a particular user has access to a job. */
 #define	JOB_VIEW	0x1	/* View information about a job */
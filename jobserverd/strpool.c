@@ -0,0 +1,123 @@
+/*
+ * Copyright 2010 River Tarnell.  All rights reserved.
+ * Use is subject to license terms.
+ */
+
+#include	<stdlib.h>
+#include	<stddef.h>
+#include	<string.h>
+#include	<strings.h>
+#include	<assert.h>
+
+#include	"jobserver.h"
+#include	"strpool.h"
+#include	"queue.h"
+
+#define	POOL_MIN_BUCKETS	64
+
+typedef struct pool_str {
+	LIST_ENTRY(pool_str)	 ps_hash;
+	uint32_t		 ps_hashval;
+	uint32_t		 ps_refs;
+	char			 ps_str[1];
+} pool_str_t;
+
+#define	PS_FROM_STR(s)	((pool_str_t *)(void *)((char *)(s) - \
+			    offsetof(pool_str_t, ps_str)))
+
+static LIST_HEAD(pool_bucket, pool_str) *pool;
+static size_t	npool_buckets;
+static size_t	npool;
+
+static int	pool_grow(void);
+
+static int
+pool_grow()
+{
+struct pool_bucket	*nb;
+size_t			 nsz, i;
+pool_str_t		*ps;
+
+	nsz = npool_buckets ? npool_buckets * 2 : POOL_MIN_BUCKETS;
+	if ((nb = calloc(nsz, sizeof (*nb))) == NULL)
+		return (-1);
+
+	for (i = 0; i < npool_buckets; ++i) {
+		while ((ps = LIST_FIRST(&pool[i])) != NULL) {
+			LIST_REMOVE(ps, ps_hash);
+			LIST_INSERT_HEAD(&nb[ps->ps_hashval & (nsz - 1)], ps,
+			    ps_hash);
+		}
+	}
+
+	free(pool);
+	pool = nb;
+	npool_buckets = nsz;
+	return (0);
+}
+
+char const *
+strpool_get(s)
+	char const	*s;
+{
+uint32_t	 h;
+size_t		 len;
+pool_str_t	*ps;
+
+	h = strhash(s, 0);
+
+	if (npool_buckets) {
+		LIST_FOREACH(ps, &pool[h & (npool_buckets - 1)], ps_hash) {
+			if (ps->ps_hashval == h && strcmp(ps->ps_str, s) == 0) {
+				ps->ps_refs++;
+				return (ps->ps_str);
+			}
+		}
+	}
+
+	if (npool >= npool_buckets && pool_grow() == -1) {
+		logm(LOG_ERR, "strpool_get: out of memory");
+		return (NULL);
+	}
+
+	len = strlen(s);
+	if ((ps = malloc(offsetof(pool_str_t, ps_str) + len + 1)) == NULL) {
+		logm(LOG_ERR, "strpool_get: out of memory");
+		return (NULL);
+	}
+
+	bcopy(s, ps->ps_str, len + 1);
+	ps->ps_hashval = h;
+	ps->ps_refs = 1;
+	LIST_INSERT_HEAD(&pool[h & (npool_buckets - 1)], ps, ps_hash);
+	npool++;
+	return (ps->ps_str);
+}
+
+char const *
+strpool_hold(s)
+	char const	*s;
+{
+	assert(PS_FROM_STR(s)->ps_refs > 0);
+	PS_FROM_STR(s)->ps_refs++;
+	return (s);
+}
+
+void
+strpool_release(s)
+	char const	*s;
+{
+pool_str_t	*ps;
+
+	if (s == NULL)
+		return;
+
+	ps = PS_FROM_STR(s);
+	assert(ps->ps_refs > 0);
+	if (--ps->ps_refs > 0)
+		return;
+
+	LIST_REMOVE(ps, ps_hash);
+	npool--;
+	free(ps);
+}
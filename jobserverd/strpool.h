@@ -0,0 +1,34 @@
+/*
+ * Copyright 2010 River Tarnell.  All rights reserved.
+ * Use is subject to license terms.
+ */
+
+/*
+ * A pool of shared, reference-counted strings.  This is used for job
+ * properties which are usually the same for many jobs, such as the username
+ * and project, so each distinct value is only stored once.
+ *
+ * Strings returned from the pool must not be modified or passed to free().
+ */
+
+#ifndef	STRPOOL_H
+#define	STRPOOL_H
+
+/*
+ * Return the pooled copy of a string, adding it to the pool if needed, and
+ * take a reference to it.  Returns NULL if memory is exhausted.
+ */
+char const	*strpool_get(char const *);
+
+/*
+ * Take another reference to a string already returned by strpool_get().
+ */
+char const	*strpool_hold(char const *);
+
+/*
+ * Release a reference.  The string is freed when the last reference is
+ * released.  It is not an error to pass NULL.
+ */
+void		 strpool_release(char const *);
+
+#endif	/* !STRPOOL_H */
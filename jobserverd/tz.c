@@ -0,0 +1,715 @@
+/*
+ * Copyright 2010 River Tarnell.  All rights reserved.
+ * Use is subject to license terms.
+ */
+
+#include	<sys/stat.h>
+#include	<stdlib.h>
+#include	<stdio.h>
+#include	<limits.h>
+#include	<string.h>
+#include	<strings.h>
+#include	<unistd.h>
+#include	<fcntl.h>
+#include	<errno.h>
+#include	<deflt.h>
+#include	<inttypes.h>
+#include	<ctype.h>
+
+#include	"jobserver.h"
+#include	"tz.h"
+#include	"jerrno.h"
+#include	"queue.h"
+
+#define	TZ_INIT_FILE	"/etc/default/init"
+#define	TZ_MAX_FILE	(256 * 1024)
+#define	TZ_HDR_LEN	44
+
+/*
+ * Transitions in either direction are never further apart than this, so
+ * only transitions within this window of a local time can affect it.
+ */
+#define	TZ_WINDOW	(60 * 60 * 26)
+
+/* How many years of transitions to generate from a POSIX TZ rule. */
+#define	TZ_RULE_YEARS	100
+
+/*
+ * One half of a POSIX TZ rule, e.g. "M3.2.0/2".
+ */
+typedef struct tz_rule {
+	int	tr_type;	/* 'J', 'n' or 'M' */
+	int	tr_yday;	/* J and n */
+	int	tr_mon, tr_week, tr_wday;	/* M */
+	int32_t	tr_time;	/* seconds after local midnight */
+} tz_rule_t;
+
+struct tz {
+	char			*tz_name;
+	int32_t			 tz_off0;	/* offset before first transition */
+	int32_t			 tz_isdst0;
+	size_t			 tz_n;
+	size_t			 tz_size;
+	time_t			*tz_at;		/* transition times (UTC) */
+	int32_t			*tz_off;	/* offset from tz_at[i] */
+	uint8_t			*tz_isdst;
+	LIST_ENTRY(tz)		 tz_entries;
+};
+
+static LIST_HEAD(tz_list, tz) zones;
+static tz_t	*host_tz;
+static tz_t	 utc = {
+	"UTC",		/* tz_name */
+	0, 0,		/* tz_off0, tz_isdst0 */
+	0, 0,		/* tz_n, tz_size */
+	NULL, NULL, NULL, /* tz_at, tz_off, tz_isdst */
+	{ NULL, NULL }	/* tz_entries */
+};
+
+static tz_t	*tz_load(char const *);
+static int	 tz_parse(tz_t *, uchar_t const *, size_t);
+static size_t	 tz_parse_block(tz_t *, uchar_t const *, size_t, size_t);
+static void	 tz_apply_rule(tz_t *, char const *);
+static void	 tz_add(tz_t *, time_t, int32_t, int);
+static char const *rule_name(char const *);
+static char const *rule_time(char const *, int32_t *);
+static char const *rule_date(char const *, tz_rule_t *);
+static long	 rule_when(tz_rule_t const *, long);
+static size_t	 tz_find(tz_t const *, time_t);
+static int32_t	 tz_offset(tz_t const *, time_t);
+static int32_t	 get32(uchar_t const *);
+static long	 days_from_civil(long, int, int);
+static void	 civil_from_days(long, long *, int *, int *);
+
+static int32_t
+get32(p)
+	uchar_t const	*p;
+{
+	return ((int32_t)(((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+	    ((uint32_t)p[2] << 8) | (uint32_t)p[3]));
+}
+
+/*
+ * Days since 1970-01-01 for a proleptic Gregorian date; mon is 1-12.
+ */
+static long
+days_from_civil(y, m, d)
+	long	y;
+	int	m, d;
+{
+long	era, yoe, doy, doe;
+	y -= (m <= 2);
+	era = (y >= 0 ? y : y - 399) / 400;
+	yoe = y - era * 400;
+	doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+	doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return (era * 146097 + doe - 719468);
+}
+
+static void
+civil_from_days(z, y, m, d)
+	long	 z;
+	long	*y;
+	int	*m, *d;
+{
+long	era, doe, yoe, doy, mp;
+	z += 719468;
+	era = (z >= 0 ? z : z - 146096) / 146097;
+	doe = z - era * 146097;
+	yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	mp = (5 * doy + 2) / 153;
+	*d = (int)(doy - (153 * mp + 2) / 5 + 1);
+	*m = (int)(mp < 10 ? mp + 3 : mp - 9);
+	*y = yoe + era * 400 + (*m <= 2);
+}
+
+/*
+ * Parse a TZif header and the data block which follows it.  'tsize' is 4 for
+ * version 1 data and 8 for the 64-bit data in later versions.  Returns the
+ * length of header and data, or 0 on error.
+ */
+static size_t
+tz_parse_block(tz, buf, len, tsize)
+	tz_t		*tz;
+	uchar_t const	*buf;
+	size_t		 len, tsize;
+{
+uint32_t	 isutcnt, isstdcnt, leapcnt, timecnt, typecnt, charcnt;
+uchar_t const	*times, *idx, *types;
+size_t		 i, n, total;
+int64_t		 at;
+
+	if (len < TZ_HDR_LEN || bcmp(buf, "TZif", 4) != 0)
+		return (0);
+
+	isutcnt = get32(buf + 20);
+	isstdcnt = get32(buf + 24);
+	leapcnt = get32(buf + 28);
+	timecnt = get32(buf + 32);
+	typecnt = get32(buf + 36);
+	charcnt = get32(buf + 40);
+
+	if (typecnt == 0 || typecnt > 256 || timecnt > 65536 ||
+	    charcnt > 65536 || leapcnt > 65536 || isutcnt > 256 ||
+	    isstdcnt > 256)
+		return (0);
+
+	total = TZ_HDR_LEN + timecnt * (tsize + 1) + typecnt * 6 + charcnt +
+	    leapcnt * (tsize + 4) + isstdcnt + isutcnt;
+	if (len < total)
+		return (0);
+
+	times = buf + TZ_HDR_LEN;
+	idx = times + timecnt * tsize;
+	types = idx + timecnt;
+
+	free(tz->tz_at);
+	free(tz->tz_off);
+	free(tz->tz_isdst);
+	tz->tz_at = NULL;
+	tz->tz_off = NULL;
+	tz->tz_isdst = NULL;
+	tz->tz_n = 0;
+
+	/* Leave room for transitions generated from the footer rule. */
+	tz->tz_size = timecnt + TZ_RULE_YEARS * 2;
+	if ((tz->tz_at = calloc(tz->tz_size, sizeof (time_t))) == NULL ||
+	    (tz->tz_off = calloc(tz->tz_size, sizeof (int32_t))) == NULL ||
+	    (tz->tz_isdst = calloc(tz->tz_size, sizeof (uint8_t))) == NULL)
+		return (0);
+
+	/* Type 0 is used for times before the first transition. */
+	tz->tz_off0 = get32(types);
+	tz->tz_isdst0 = types[4];
+
+	for (i = n = 0; i < timecnt; ++i) {
+		if (idx[i] >= typecnt)
+			return (0);
+
+		if (tsize == 8)
+			at = ((int64_t)get32(times + i * 8) << 32) |
+			    (uint32_t)get32(times + i * 8 + 4);
+		else
+			at = get32(times + i * 4);
+
+		/* Skip transitions time_t can't represent. */
+		if ((time_t)at != at)
+			continue;
+
+		if (n > 0 && at <= tz->tz_at[n - 1])
+			return (0);
+
+		tz->tz_at[n] = (time_t)at;
+		tz->tz_off[n] = get32(types + idx[i] * 6);
+		tz->tz_isdst[n] = types[idx[i] * 6 + 4];
+		n++;
+	}
+
+	tz->tz_n = n;
+	return (total);
+}
+
+/*
+ * Parse a POSIX TZ name ("EST" or "<+03>") and return a pointer past it.
+ */
+static char const *
+rule_name(p)
+	char const	*p;
+{
+char const	*s = p;
+	if (*p == '<') {
+		while (*p && *p != '>')
+			p++;
+		return (*p == '>' ? p + 1 : NULL);
+	}
+
+	while (isalpha((unsigned char)*p))
+		p++;
+	return (p - s >= 3 ? p : NULL);
+}
+
+/*
+ * Parse [+-]hh[:mm[:ss]] into seconds.
+ */
+static char const *
+rule_time(p, secs)
+	char const	*p;
+	int32_t		*secs;
+{
+int	sign = 1, part, i;
+	if (*p == '+' || *p == '-')
+		sign = (*p++ == '-') ? -1 : 1;
+
+	*secs = 0;
+	for (i = 0; i < 3; ++i) {
+		if (!isdigit((unsigned char)*p))
+			return (NULL);
+		for (part = 0; isdigit((unsigned char)*p); ++p)
+			part = part * 10 + (*p - '0');
+		*secs += part * (i == 0 ? 3600 : i == 1 ? 60 : 1);
+		if (*p != ':')
+			break;
+		p++;
+	}
+
+	*secs *= sign;
+	return (p);
+}
+
+/*
+ * Parse a rule date (Jn, n or Mm.w.d) and an optional /time.
+ */
+static char const *
+rule_date(p, r)
+	char const	*p;
+	tz_rule_t	*r;
+{
+int	*v[3], i, n;
+
+	bzero(r, sizeof (*r));
+	if (*p == 'M') {
+		r->tr_type = 'M';
+		p++;
+		v[0] = &r->tr_mon;
+		v[1] = &r->tr_week;
+		v[2] = &r->tr_wday;
+		for (i = 0; i < 3; ++i) {
+			if (!isdigit((unsigned char)*p))
+				return (NULL);
+			for (n = 0; isdigit((unsigned char)*p); ++p)
+				n = n * 10 + (*p - '0');
+			*v[i] = n;
+			if (i < 2 && *p++ != '.')
+				return (NULL);
+		}
+		if (r->tr_mon < 1 || r->tr_mon > 12 || r->tr_week < 1 ||
+		    r->tr_week > 5 || r->tr_wday > 6)
+			return (NULL);
+	} else {
+		r->tr_type = 'n';
+		if (*p == 'J') {
+			r->tr_type = 'J';
+			p++;
+		}
+		if (!isdigit((unsigned char)*p))
+			return (NULL);
+		for (n = 0; isdigit((unsigned char)*p); ++p)
+			n = n * 10 + (*p - '0');
+		if (n > 365)
+			return (NULL);
+		r->tr_yday = n;
+	}
+
+	r->tr_time = 2 * 3600;
+	if (*p == '/' && (p = rule_time(p + 1, &r->tr_time)) == NULL)
+		return (NULL);
+	return (p);
+}
+
+/*
+ * Return the local time, as seconds since the epoch, at which a rule takes
+ * effect in the given year.
+ */
+static long
+rule_when(r, year)
+	tz_rule_t const	*r;
+	long		 year;
+{
+long	day;
+int	leap, wd1, mday, dim;
+static int const	mdays[] = {
+	31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31
+};
+
+	leap = (year % 4 == 0 && (year % 100 != 0 || year % 400 == 0));
+
+	switch (r->tr_type) {
+	case 'J':
+		day = days_from_civil(year, 1, 1) + r->tr_yday - 1;
+		if (leap && r->tr_yday >= 60)
+			day++;
+		break;
+
+	case 'M':
+		day = days_from_civil(year, r->tr_mon, 1);
+		wd1 = (int)(((day % 7) + 11) % 7);
+		mday = 1 + (r->tr_wday - wd1 + 7) % 7 + (r->tr_week - 1) * 7;
+		dim = mdays[r->tr_mon - 1] + (r->tr_mon == 2 && leap);
+		while (mday > dim)
+			mday -= 7;
+		day += mday - 1;
+		break;
+
+	default:
+		day = days_from_civil(year, 1, 1) + r->tr_yday;
+		break;
+	}
+
+	return (day * 86400L + r->tr_time);
+}
+
+static void
+tz_add(tz, at, off, isdst)
+	tz_t	*tz;
+	time_t	 at;
+	int32_t	 off;
+	int	 isdst;
+{
+	if (tz->tz_n == tz->tz_size ||
+	    (tz->tz_n > 0 && at <= tz->tz_at[tz->tz_n - 1]))
+		return;
+	tz->tz_at[tz->tz_n] = at;
+	tz->tz_off[tz->tz_n] = off;
+	tz->tz_isdst[tz->tz_n] = isdst;
+	tz->tz_n++;
+}
+
+/*
+ * Apply the POSIX TZ string from the end of a version 2+ file, which
+ * describes times after the last transition in the file.  We expand it into
+ * explicit transitions for the next TZ_RULE_YEARS years, so lookups never
+ * have to evaluate rules.
+ */
+static void
+tz_apply_rule(tz, spec)
+	tz_t		*tz;
+	char const	*spec;
+{
+char const	*p;
+int32_t		 stdoff, dstoff;
+tz_rule_t	 start, end;
+long		 year, lastyear;
+time_t		 t;
+int64_t		 s, e;
+struct tm	 tm;
+
+	if ((p = rule_name(spec)) == NULL || (p = rule_time(p, &stdoff)) == NULL)
+		return;
+	/* POSIX offsets are positive west of Greenwich. */
+	stdoff = -stdoff;
+
+	if (*p == '\0') {
+		/* No DST. */
+		if (tz->tz_n == 0)
+			tz->tz_off0 = stdoff;
+		return;
+	}
+
+	if ((p = rule_name(p)) == NULL)
+		return;
+	dstoff = stdoff + 3600;
+	if (*p != ',' && *p != '\0') {
+		if ((p = rule_time(p, &dstoff)) == NULL)
+			return;
+		dstoff = -dstoff;
+	}
+
+	if (*p++ != ',' || (p = rule_date(p, &start)) == NULL ||
+	    *p++ != ',' || (p = rule_date(p, &end)) == NULL || *p != '\0')
+		return;
+
+	t = tz->tz_n ? tz->tz_at[tz->tz_n - 1] : 0;
+	tz_localtime(tz, t, &tm);
+	lastyear = tm.tm_year + 1900L + TZ_RULE_YEARS;
+
+	for (year = tm.tm_year + 1900L; year < lastyear; ++year) {
+		/* Each change happens in the local time in effect before it. */
+		s = rule_when(&start, year) - stdoff;
+		e = rule_when(&end, year) - dstoff;
+
+		if ((time_t)s != s || (time_t)e != e)
+			break;
+
+		if (s < e) {
+			tz_add(tz, (time_t)s, dstoff, 1);
+			tz_add(tz, (time_t)e, stdoff, 0);
+		} else {
+			tz_add(tz, (time_t)e, stdoff, 0);
+			tz_add(tz, (time_t)s, dstoff, 1);
+		}
+	}
+}
+
+/*
+ * Parse a TZif file.  For version 2 and later files we use the 64-bit data
+ * and the rule at the end of the file; for version 1 files, times after the
+ * last transition keep its offset.
+ */
+static int
+tz_parse(tz, buf, len)
+	tz_t		*tz;
+	uchar_t const	*buf;
+	size_t		 len;
+{
+size_t		 n;
+uchar_t const	*p, *e;
+char		 rule[128];
+
+	if ((n = tz_parse_block(tz, buf, len, 4)) == 0)
+		return (-1);
+
+	if (buf[4] < '2')
+		return (0);
+
+	buf += n;
+	len -= n;
+	if ((n = tz_parse_block(tz, buf, len, 8)) == 0)
+		return (-1);
+
+	/* The rule is between two newlines after the data. */
+	p = buf + n;
+	e = buf + len;
+	if (p < e && *p == '\n') {
+		p++;
+		for (n = 0; p < e && *p != '\n' && n < sizeof (rule) - 1; ++n)
+			rule[n] = *p++;
+		rule[n] = '\0';
+		if (p < e && *p == '\n')
+			tz_apply_rule(tz, rule);
+	}
+
+	return (0);
+}
+
+static tz_t *
+tz_load(name)
+	char const	*name;
+{
+char		 path[PATH_MAX];
+int		 fd = -1;
+struct stat	 sb;
+uchar_t		*buf = NULL;
+ssize_t		 n;
+size_t		 len = 0;
+tz_t		*tz = NULL;
+
+	(void) snprintf(path, sizeof (path), "%s/%s", TZ_DIR, name);
+	if ((fd = open(path, O_RDONLY)) == -1)
+		goto err;
+
+	if (fstat(fd, &sb) == -1 || !S_ISREG(sb.st_mode) ||
+	    sb.st_size > TZ_MAX_FILE)
+		goto err;
+
+	if ((buf = malloc(sb.st_size)) == NULL)
+		goto err;
+
+	while (len < sb.st_size) {
+		if ((n = read(fd, buf + len, sb.st_size - len)) <= 0)
+			goto err;
+		len += n;
+	}
+
+	if ((tz = calloc(1, sizeof (*tz))) == NULL ||
+	    (tz->tz_name = strdup(name)) == NULL)
+		goto err;
+
+	if (tz_parse(tz, buf, len) == -1)
+		goto err;
+
+	(void) close(fd);
+	free(buf);
+	return (tz);
+
+err:
+	if (fd != -1)
+		(void) close(fd);
+	free(buf);
+	if (tz) {
+		free(tz->tz_name);
+		free(tz->tz_at);
+		free(tz->tz_off);
+		free(tz->tz_isdst);
+		free(tz);
+	}
+	return (NULL);
+}
+
+tz_t const *
+tz_get(name)
+	char const	*name;
+{
+tz_t		*tz;
+char const	*p;
+
+	if (strcmp(name, "UTC") == 0 || strcmp(name, "GMT") == 0)
+		return (&utc);
+
+	LIST_FOREACH(tz, &zones, tz_entries) {
+		if (strcmp(tz->tz_name, name) == 0)
+			return (tz);
+	}
+
+	/*
+	 * Zone names come from users, so don't let them wander outside the
+	 * zoneinfo directory.
+	 */
+	if (*name == '\0' || *name == '/' || strlen(name) > 128)
+		goto err;
+	for (p = name; (p = strstr(p, "..")) != NULL; p += 2) {
+		if ((p == name || p[-1] == '/') && (p[2] == '/' || p[2] == '\0'))
+			goto err;
+	}
+
+	if ((tz = tz_load(name)) == NULL)
+		goto err;
+
+	LIST_INSERT_HEAD(&zones, tz, tz_entries);
+	return (tz);
+
+err:
+	errno = JEINVALID_TZ;
+	return (NULL);
+}
+
+tz_t const *
+tz_default()
+{
+char const	*name = NULL;
+tz_t const	*tz;
+
+	if (host_tz)
+		return (host_tz);
+
+	if (defopen(TZ_INIT_FILE) == 0) {
+		if ((name = defread("TZ=")) != NULL) {
+			if (*name == ':')
+				name++;
+			if ((tz = tz_get(name)) == NULL)
+				logm(LOG_WARNING, "unknown time zone \"%s\" "
+				    "in %s; using UTC", name, TZ_INIT_FILE);
+			else
+				/*LINTED*/
+				host_tz = (tz_t *)tz;
+		}
+		(void) defopen(NULL);
+	}
+
+	if (host_tz == NULL)
+		host_tz = &utc;
+	return (host_tz);
+}
+
+char const *
+tz_name(tz)
+	tz_t const	*tz;
+{
+	return (tz->tz_name);
+}
+
+/*
+ * Return the number of transitions at or before t.
+ */
+static size_t
+tz_find(tz, t)
+	tz_t const	*tz;
+	time_t		 t;
+{
+size_t	lo = 0, hi = tz->tz_n, mid;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (tz->tz_at[mid] <= t)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return (lo);
+}
+
+static int32_t
+tz_offset(tz, t)
+	tz_t const	*tz;
+	time_t		 t;
+{
+size_t	i = tz_find(tz, t);
+	return (i ? tz->tz_off[i - 1] : tz->tz_off0);
+}
+
+void
+tz_localtime(tz, t, tm)
+	tz_t const	*tz;
+	time_t		 t;
+	struct tm	*tm;
+{
+size_t	i = tz_find(tz, t);
+long	local, days, secs, year;
+int	mon, mday;
+
+	local = t + (i ? tz->tz_off[i - 1] : tz->tz_off0);
+	days = local / 86400;
+	secs = local % 86400;
+	if (secs < 0) {
+		secs += 86400;
+		days--;
+	}
+
+	civil_from_days(days, &year, &mon, &mday);
+	bzero(tm, sizeof (*tm));
+	tm->tm_year = (int)(year - 1900);
+	tm->tm_mon = mon - 1;
+	tm->tm_mday = mday;
+	tm->tm_hour = (int)(secs / 3600);
+	tm->tm_min = (int)(secs / 60 % 60);
+	tm->tm_sec = (int)(secs % 60);
+	tm->tm_wday = (int)(((days % 7) + 11) % 7);	/* 1970-01-01 was Thu */
+	tm->tm_yday = (int)(days - days_from_civil(year, 1, 1));
+	tm->tm_isdst = i ? tz->tz_isdst[i - 1] : tz->tz_isdst0;
+}
+
+time_t
+tz_mktime(tz, tm)
+	tz_t const	*tz;
+	struct tm const	*tm;
+{
+long	year, mon, local;
+size_t	i, first, last;
+int32_t	off;
+time_t	best = -1, u;
+
+	/* Normalise the month, then let the day arithmetic do the rest. */
+	year = tm->tm_year + 1900L + tm->tm_mon / 12;
+	mon = tm->tm_mon % 12;
+	if (mon < 0) {
+		mon += 12;
+		year--;
+	}
+
+	local = days_from_civil(year, (int)mon + 1, 1) * 86400L +
+	    (tm->tm_mday - 1) * 86400L + tm->tm_hour * 3600L +
+	    tm->tm_min * 60L + tm->tm_sec;
+
+	if (tz->tz_n == 0)
+		return ((time_t)(local - tz->tz_off0));
+
+	/*
+	 * The candidate offsets are the ones in effect just before and after
+	 * each transition near this time.  A candidate is right if converting
+	 * back with it gives the same offset.
+	 */
+	first = tz_find(tz, local - TZ_WINDOW);
+	last = tz_find(tz, local + TZ_WINDOW);
+
+	for (i = first; i <= last; ++i) {
+		off = i ? tz->tz_off[i - 1] : tz->tz_off0;
+		u = local - off;
+		if (tz_offset(tz, u) == off && (best == -1 || u < best))
+			best = u;
+	}
+
+	if (best != -1)
+		return (best);
+
+	/*
+	 * The local time falls in a gap.  Return the transition which
+	 * created the gap.
+	 */
+	for (i = first; i < last; ++i) {
+		off = i ? tz->tz_off[i - 1] : tz->tz_off0;
+		if (tz->tz_at[i] + off <= local &&
+		    local < tz->tz_at[i] + tz->tz_off[i])
+			return (tz->tz_at[i]);
+	}
+
+	return ((time_t)(local - tz_offset(tz, local)));
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright 2010 River Tarnell.  All rights reserved.
+ * Use is subject to license terms.
+ */
+
+/*
+ * Time zone support for schedules.  A zone's transitions are read once from
+ * its zoneinfo file into a table, after which converting between UTC and
+ * local time is a binary search and some arithmetic, with no calls into
+ * libc's time zone code.
+ *
+ * Zones are cached for the life of the process and must not be freed.
+ */
+
+#ifndef	TZ_H
+#define	TZ_H
+
+#include	<sys/types.h>
+#include	<time.h>
+
+#define	TZ_DIR	"/usr/share/lib/zoneinfo"
+
+typedef struct tz tz_t;
+
+/*
+ * Return the named zone, loading it if needed.  Returns NULL and sets errno to
+ * JEINVALID_TZ if the zone doesn't exist or its file can't be parsed.
+ */
+tz_t const	*tz_get(char const *name);
+
+/*
+ * Return the host's zone, from TZ in /etc/default/init.  If that isn't set or
+ * can't be loaded, UTC is used.  Never returns NULL.
+ */
+tz_t const	*tz_default(void);
+
+char const	*tz_name(tz_t const *);
+
+/*
+ * Convert a UTC time to local time in the given zone.  Sets tm_year, tm_mon,
+ * tm_mday, tm_hour, tm_min, tm_sec, tm_wday, tm_yday and tm_isdst.
+ */
+void		 tz_localtime(tz_t const *, time_t, struct tm *);
+
+/*
+ * Convert a local time in the given zone to UTC.  Only tm_year, tm_mon,
+ * tm_mday, tm_hour, tm_min and tm_sec are used; out of range values (such as
+ * tm_mday = 32) are normalised.
+ *
+ * Local times which occur twice (when clocks go back) convert to the earlier
+ * of the two.  Local times which don't exist (when clocks go forward) convert
+ * to the moment of the transition, so a job scheduled in the skipped period
+ * runs as soon as the clocks change.
+ */
+time_t		 tz_mktime(tz_t const *, struct tm const *);
+
+#endif	/* !TZ_H */